@@ -0,0 +1,556 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For sysconf(_SC_NPROCESSORS_ONLN). */
+#endif
+#include <errno.h>
+#include <SSC/Operation.h>
+#include "ArchiveV1.h"
+#include "Durability.h"
+
+#ifdef THREECRYPT_ARCHIVE_V1_H
+
+#if   defined(SSC_OS_UNIXLIKE)
+ #include <pthread.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+ #define MKDIR_(Path) mkdir(Path, 0777)
+#elif defined(SSC_OS_WINDOWS)
+ #include <direct.h>
+ #define MKDIR_(Path) _mkdir(Path)
+#endif
+
+#define R_ SSC_RESTRICT
+
+#define MAC_BYTES_         THREECRYPT_ARCHIVE_V1_MAC_BYTES
+#define HEADER_BYTES_      THREECRYPT_ARCHIVE_V1_HEADER_BYTES
+#define ENTRY_BYTES_       THREECRYPT_ARCHIVE_V1_ENTRY_BYTES
+#define TRAILER_BYTES_     THREECRYPT_ARCHIVE_V1_TRAILER_BYTES
+#define KEYING_OFFSET_     THREECRYPT_ARCHIVE_V1_KEYING_OFFSET
+#define TWEAK_OFFSET_      (KEYING_OFFSET_ + THREECRYPT_KEYING_BYTES)
+#define HEADER_MAC_OFFSET_ (TWEAK_OFFSET_ + PPQ_THREEFISH512_TWEAK_BYTES)
+/* Offsets within an index entry. */
+#define ENTRY_SIZE_        8
+#define ENTRY_IV_          16
+#define ENTRY_TAG_         (ENTRY_IV_ + THREECRYPT_CTR_IV_BYTES)
+#define ENTRY_NAME_SIZE_   (ENTRY_TAG_ + MAC_BYTES_)
+/* Offsets within the trailer. */
+#define TRAILER_COUNT_     8
+#define TRAILER_IV_        16
+#define TRAILER_MAC_       (TRAILER_IV_ + THREECRYPT_CTR_IV_BYTES)
+#define MAX_THREADS_       64
+
+#define AUTH_FAILED_       "Error: Authentication failed. The file has been corrupted or truncated.\n"
+
+typedef struct {
+  const char*    path;  /* Only used when packing. */
+  const uint8_t* name;
+  uint64_t       offset;
+  uint64_t       size;
+  uint8_t        iv  [THREECRYPT_CTR_IV_BYTES];
+  uint8_t        tag [MAC_BYTES_];
+  uint16_t       name_size;
+} Member_;
+
+/* The decrypted, parsed index of an Archive_V1 file. */
+typedef struct {
+  uint8_t* plaintext;
+  Member_* members;
+  uint64_t size;
+  uint64_t count;
+} Index_;
+
+static uint16_t
+load16_(const uint8_t* p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void
+store16_(uint8_t* p, uint16_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+/* Derive the keys from @ctx->keying and the @header of an Archive_V1 file. */
+static void
+derive_keys_(Threecrypt_ArchiveV1* R_ ctx, const uint8_t* R_ header)
+{
+  keying_derive(
+   &ctx->keying,
+   header + KEYING_OFFSET_,
+   THREECRYPT_ARCHIVE_V1_ID,
+   THREECRYPT_ARCHIVE_V1_ID_NBYTES,
+   ctx->derived,
+   sizeof(ctx->derived));
+  memcpy(ctx->enc_key,  ctx->derived,                                PPQ_THREEFISH512_BLOCK_BYTES);
+  memcpy(ctx->auth_key, ctx->derived + PPQ_THREEFISH512_BLOCK_BYTES, PPQ_THREEFISH512_BLOCK_BYTES);
+  SSC_secureZero(ctx->derived, sizeof(ctx->derived));
+  memcpy(ctx->tweak, header + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+}
+
+/* MAC the @size bytes at @begin under the authentication key, storing the result in @out. */
+static void
+mac_(Threecrypt_ArchiveV1* R_ ctx, uint8_t* R_ out, const uint8_t* R_ begin, uint64_t size)
+{
+  PPQ_Skein512_mac(&ctx->keying.ubi512, out, begin, ctx->auth_key, MAC_BYTES_, size);
+}
+
+/* Packing. Every worker has its own copy of the keys, cipher and hash states,
+ * and claims the next member to encrypt until none are left. */
+typedef struct {
+  Threecrypt_ArchiveV1* ctx;
+  Member_*              members;
+  uint8_t*              out;
+  size_t                count;
+  size_t                next;
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_mutex_t       lock;
+#endif
+} Work_;
+
+static bool
+claim_(Work_* R_ work, size_t* R_ i)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_mutex_lock(&work->lock);
+#endif
+  *i = work->next;
+  if (work->next < work->count)
+    ++work->next;
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_mutex_unlock(&work->lock);
+#endif
+  return *i < work->count;
+}
+
+static void*
+pack_worker_(void* arg)
+{
+  Work_* const work = (Work_*)arg;
+  Threecrypt_Ctr ctr;
+  PPQ_UBI512     ubi512;
+  uint64_t       enc_key [PPQ_THREEFISH512_EXTERNAL_KEY_WORDS];
+  uint64_t       tweak   [PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS];
+  memcpy(enc_key, work->ctx->enc_key, sizeof(enc_key));
+  memcpy(tweak,   work->ctx->tweak,   sizeof(tweak));
+  size_t i;
+  while (claim_(work, &i)) {
+    Member_* const m = &work->members[i];
+    SSC_MemMap map = SSC_MEMMAP_NULL_LITERAL;
+    map.size = SSC_FilePath_getSizeOrDie(m->path);
+    map.file = SSC_FilePath_openOrDie(m->path, true);
+    SSC_assertMsg(map.size == m->size, "Error: The file %s changed size while it was being archived!\n", m->path);
+    uint8_t* const ciphertext = work->out + m->offset;
+    if (map.size) {
+      SSC_MemMap_mapOrDie(&map, true);
+      threecrypt_ctr_init(&ctr, enc_key, tweak, m->iv);
+      threecrypt_ctr_xor(&ctr, ciphertext, map.ptr, m->size, 0);
+      SSC_MemMap_unmapOrDie(&map);
+    }
+    SSC_File_closeOrDie(map.file);
+    PPQ_Skein512_mac(&ubi512, m->tag, ciphertext, work->ctx->auth_key, MAC_BYTES_, m->size);
+  }
+  SSC_secureZero(&ctr,     sizeof(ctr));
+  SSC_secureZero(&ubi512,  sizeof(ubi512));
+  SSC_secureZero(enc_key,  sizeof(enc_key));
+  return SSC_NULL;
+}
+
+static size_t
+thread_count_(size_t count)
+{
+  long n = THREECRYPT_ARCHIVE_V1_THREADS;
+#if defined(SSC_OS_UNIXLIKE) && defined(_SC_NPROCESSORS_ONLN)
+  if (n <= 0)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (n <= 0)
+    n = 1;
+  if (n > MAX_THREADS_)
+    n = MAX_THREADS_;
+  return ((size_t)n < count) ? (size_t)n : (count ? count : 1);
+}
+
+static void
+pack_members_(Work_* R_ work)
+{
+  const size_t n = thread_count_(work->count);
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_t threads [MAX_THREADS_];
+  size_t started = 0;
+  pthread_mutex_init(&work->lock, SSC_NULL);
+  /* The calling thread is a worker too. */
+  for (; (started + 1) < n; ++started) {
+    if (pthread_create(&threads[started], SSC_NULL, pack_worker_, work))
+      break; /* Carry on with fewer threads. */
+  }
+  pack_worker_(work);
+  for (size_t i = 0; i < started; ++i)
+    pthread_join(threads[i], SSC_NULL);
+  pthread_mutex_destroy(&work->lock);
+#else
+  (void)n;
+  pack_worker_(work);
+#endif
+}
+
+void
+archive_v1_pack(
+ Threecrypt_ArchiveV1* R_       ctx,
+ const Threecrypt_FileList* R_  list,
+ size_t                         root_size,
+ SSC_MemMap* R_                 output_map)
+{
+  const size_t count = list->count;
+  Member_* members = count ? (Member_*)SSC_mallocOrDie(count * sizeof(Member_)) : SSC_NULL;
+  /* Lay out the members back to back after the header, and size the index. */
+  uint64_t offset = HEADER_BYTES_;
+  uint64_t index_size = 0;
+  for (size_t i = 0; i < count; ++i) {
+    Member_* const m = &members[i];
+    const char* name = list->paths[i] + root_size;
+    while (*name == '/')
+      ++name;
+    const size_t name_size = strlen(name);
+    SSC_assertMsg(
+     name_size && (name_size <= THREECRYPT_ARCHIVE_V1_MAX_NAME_BYTES),
+     "Error: The name of %s is too long to archive!\n", list->paths[i]);
+    m->path = list->paths[i];
+    m->name = (const uint8_t*)name;
+    m->name_size = (uint16_t)name_size;
+    m->offset = offset;
+    m->size = (uint64_t)SSC_FilePath_getSizeOrDie(m->path);
+    PPQ_CSPRNG_get(&ctx->csprng, m->iv, THREECRYPT_CTR_IV_BYTES);
+    offset += m->size;
+    index_size += ENTRY_BYTES_ + name_size;
+  }
+  output_map->size = (size_t)(offset + index_size + TRAILER_BYTES_);
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  SSC_MemMap_mapOrDie(output_map, false);
+  uint8_t* const out = output_map->ptr;
+  memcpy(out, THREECRYPT_ARCHIVE_V1_ID, THREECRYPT_ARCHIVE_V1_ID_NBYTES);
+  keying_store(&ctx->keying, out + KEYING_OFFSET_, &ctx->csprng);
+  PPQ_CSPRNG_get(&ctx->csprng, out + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+  /* One key-derivation for the whole archive. */
+  derive_keys_(ctx, out);
+  mac_(ctx, out + HEADER_MAC_OFFSET_, out, HEADER_MAC_OFFSET_);
+  {
+    Work_ work;
+    work.ctx     = ctx;
+    work.members = members;
+    work.out     = out;
+    work.count   = count;
+    work.next    = 0;
+    pack_members_(&work);
+  }
+  /* Serialize the index, then encrypt it in place. */
+  uint8_t* const index   = out + offset;
+  uint8_t* const trailer = index + index_size;
+  uint8_t* entry = index;
+  for (size_t i = 0; i < count; ++i) {
+    const Member_* const m = &members[i];
+    threecrypt_store64(entry, m->offset);
+    threecrypt_store64(entry + ENTRY_SIZE_, m->size);
+    memcpy(entry + ENTRY_IV_,  m->iv,  THREECRYPT_CTR_IV_BYTES);
+    memcpy(entry + ENTRY_TAG_, m->tag, MAC_BYTES_);
+    store16_(entry + ENTRY_NAME_SIZE_, m->name_size);
+    memcpy(entry + ENTRY_BYTES_, m->name, m->name_size);
+    entry += ENTRY_BYTES_ + m->name_size;
+  }
+  threecrypt_store64(trailer, index_size);
+  threecrypt_store64(trailer + TRAILER_COUNT_, (uint64_t)count);
+  PPQ_CSPRNG_get(&ctx->csprng, trailer + TRAILER_IV_, THREECRYPT_CTR_IV_BYTES);
+  threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, trailer + TRAILER_IV_);
+  threecrypt_ctr_xor(&ctx->ctr, index, index, index_size, 0);
+  mac_(ctx, trailer + TRAILER_MAC_, index, (trailer + TRAILER_MAC_) - index);
+  if (members) {
+    SSC_secureZero(members, count * sizeof(Member_));
+    free(members);
+  }
+  durability_sync_map(output_map);
+  SSC_MemMap_unmapOrDie(output_map);
+  SSC_File_closeOrDie(output_map->file);
+}
+
+/* Authenticate the header and index of the @size byte Archive_V1 file at @file, then decrypt and
+ * parse its index into @index. Returns an error message, or SSC_NULL. */
+static const char*
+open_index_(Threecrypt_ArchiveV1* R_ ctx, const uint8_t* R_ file, size_t size, Index_* R_ index)
+{
+  *index = (Index_){SSC_NULL, SSC_NULL, 0, 0};
+  if (size < (HEADER_BYTES_ + TRAILER_BYTES_))
+    return "Error: The file is too small to be an Archive_V1 encrypted file.\n";
+  derive_keys_(ctx, file);
+  /* A wrong password or keyfile is caught here, without reading the index. */
+  mac_(ctx, ctx->mac, file, HEADER_MAC_OFFSET_);
+  if (!threecrypt_ct_equal(ctx->mac, file + HEADER_MAC_OFFSET_, MAC_BYTES_))
+    return "Error: Authentication failed. Wrong password or keyfile, or the header has been corrupted.\n";
+  const uint8_t* const trailer = file + size - TRAILER_BYTES_;
+  const uint64_t index_size = threecrypt_load64(trailer);
+  const uint64_t count      = threecrypt_load64(trailer + TRAILER_COUNT_);
+  if ((index_size > (size - HEADER_BYTES_ - TRAILER_BYTES_)) || (count > (index_size / ENTRY_BYTES_)))
+    return AUTH_FAILED_;
+  const uint8_t* const encrypted = trailer - index_size;
+  mac_(ctx, ctx->mac, encrypted, (trailer + TRAILER_MAC_) - encrypted);
+  if (!threecrypt_ct_equal(ctx->mac, trailer + TRAILER_MAC_, MAC_BYTES_))
+    return AUTH_FAILED_;
+  index->size  = index_size;
+  index->count = count;
+  if (index_size) {
+    index->plaintext = (uint8_t*)SSC_mallocOrDie((size_t)index_size);
+    threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, trailer + TRAILER_IV_);
+    threecrypt_ctr_xor(&ctx->ctr, index->plaintext, encrypted, index_size, 0);
+  }
+  if (count)
+    index->members = (Member_*)SSC_mallocOrDie((size_t)count * sizeof(Member_));
+  /* The index is authentic, but its entries must still lie within the member region. */
+  const uint64_t data_end = (uint64_t)(encrypted - file);
+  const uint8_t* entry = index->plaintext;
+  const uint8_t* const end = index->plaintext + index_size;
+  for (uint64_t i = 0; i < count; ++i) {
+    Member_* const m = &index->members[i];
+    if ((uint64_t)(end - entry) < ENTRY_BYTES_)
+      return "Error: The archive has an invalid index.\n";
+    m->path      = SSC_NULL;
+    m->offset    = threecrypt_load64(entry);
+    m->size      = threecrypt_load64(entry + ENTRY_SIZE_);
+    m->name_size = load16_(entry + ENTRY_NAME_SIZE_);
+    m->name      = entry + ENTRY_BYTES_;
+    memcpy(m->iv,  entry + ENTRY_IV_,  THREECRYPT_CTR_IV_BYTES);
+    memcpy(m->tag, entry + ENTRY_TAG_, MAC_BYTES_);
+    if (!m->name_size || ((uint64_t)(end - m->name) < m->name_size) ||
+        (m->offset < HEADER_BYTES_) || (m->offset > data_end) || (m->size > (data_end - m->offset)))
+      return "Error: The archive has an invalid index.\n";
+    entry = m->name + m->name_size;
+  }
+  if (entry != end)
+    return "Error: The archive has an invalid index.\n";
+  return SSC_NULL;
+}
+
+static void
+close_index_(Index_* R_ index)
+{
+  if (index->plaintext) {
+    SSC_secureZero(index->plaintext, (size_t)index->size);
+    free(index->plaintext);
+  }
+  if (index->members) {
+    SSC_secureZero(index->members, (size_t)index->count * sizeof(Member_));
+    free(index->members);
+  }
+  *index = (Index_){SSC_NULL, SSC_NULL, 0, 0};
+}
+
+static void
+close_input_(SSC_MemMap* R_ input_map)
+{
+  SSC_MemMap_unmapOrDie(input_map);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+/* Open the index of @input_map, or die after closing it. */
+static void
+open_index_or_die_(Threecrypt_ArchiveV1* R_ ctx, SSC_MemMap* R_ input_map, Index_* R_ index)
+{
+  const char* error = open_index_(ctx, input_map->ptr, input_map->size, index);
+  if (error) {
+    close_index_(index);
+    close_input_(input_map);
+    SSC_errx("%s", error);
+  }
+}
+
+static bool
+authenticate_member_(Threecrypt_ArchiveV1* R_ ctx, const uint8_t* R_ file, const Member_* R_ m)
+{
+  mac_(ctx, ctx->mac, file + m->offset, m->size);
+  return threecrypt_ct_equal(ctx->mac, m->tag, MAC_BYTES_);
+}
+
+/* Decrypt the authenticated member @m of @file into the new file @output_filename. */
+static void
+write_member_(Threecrypt_ArchiveV1* R_ ctx, const uint8_t* R_ file, const Member_* R_ m, const char* R_ output_filename)
+{
+  SSC_assertMsg(
+   !SSC_FilePath_exists(output_filename),
+   "Error: The output file %s already seems to exist.\n", output_filename);
+  SSC_MemMap map = SSC_MEMMAP_NULL_LITERAL;
+  map.file = SSC_FilePath_createOrDie(output_filename);
+  map.size = (size_t)m->size;
+  SSC_File_setSizeOrDie(map.file, map.size);
+  if (map.size) {
+    SSC_MemMap_mapOrDie(&map, false);
+    threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, m->iv);
+    threecrypt_ctr_xor(&ctx->ctr, map.ptr, file + m->offset, m->size, 0);
+    durability_sync_map(&map);
+    SSC_MemMap_unmapOrDie(&map);
+  }
+  SSC_File_closeOrDie(map.file);
+}
+
+void
+archive_v1_list(Threecrypt_ArchiveV1* R_ ctx, SSC_MemMap* R_ input_map)
+{
+  Index_ index;
+  open_index_or_die_(ctx, input_map, &index);
+  for (uint64_t i = 0; i < index.count; ++i) {
+    const Member_* const m = &index.members[i];
+    printf("%20" PRIu64 "  %.*s\n", m->size, (int)m->name_size, (const char*)m->name);
+  }
+  close_index_(&index);
+  close_input_(input_map);
+}
+
+void
+archive_v1_extract(
+ Threecrypt_ArchiveV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ const char* R_           member,
+ const char* R_           output_filename)
+{
+  Index_ index;
+  open_index_or_die_(ctx, input_map, &index);
+  const size_t member_size = strlen(member);
+  const Member_* found = SSC_NULL;
+  for (uint64_t i = 0; (i < index.count) && !found; ++i) {
+    const Member_* const m = &index.members[i];
+    if ((m->name_size == member_size) && !memcmp(m->name, member, member_size))
+      found = m;
+  }
+  if (!found || !authenticate_member_(ctx, input_map->ptr, found)) {
+    close_index_(&index);
+    close_input_(input_map);
+    if (!found)
+      SSC_errx("Error: The archive has no member named %s.\n", member);
+    SSC_errx("%s", AUTH_FAILED_);
+  }
+  write_member_(ctx, input_map->ptr, found, output_filename);
+  close_index_(&index);
+  close_input_(input_map);
+}
+
+/* Returns whether the @size byte member name @name stays beneath the directory it is extracted into. */
+static bool
+safe_name_(const uint8_t* R_ name, size_t size)
+{
+  size_t begin = 0;
+  for (size_t i = 0; i <= size; ++i) {
+    if ((i < size) && (name[i] != '/'))
+      continue;
+    const size_t n = i - begin;
+    if (!n || ((n == 1) && (name[begin] == '.')) || ((n == 2) && (name[begin] == '.') && (name[begin + 1] == '.')))
+      return false;
+    begin = i + 1;
+  }
+  return !memchr(name, '\0', size) && !memchr(name, '\\', size);
+}
+
+/* Order member names as paths, component by component, so that every name beneath a member's name
+ * sorts immediately after it. */
+static int
+compare_names_(const void* a, const void* b)
+{
+  const Member_* const x = *(const Member_* const*)a;
+  const Member_* const y = *(const Member_* const*)b;
+  const size_t size = (x->name_size < y->name_size) ? x->name_size : y->name_size;
+  for (size_t i = 0; i < size; ++i) {
+    const int cx = (x->name[i] == '/') ? 0 : (int)x->name[i];
+    const int cy = (y->name[i] == '/') ? 0 : (int)y->name[i];
+    if (cx != cy)
+      return cx - cy;
+  }
+  return (int)x->name_size - (int)y->name_size;
+}
+
+/* Returns whether two members of @index share a name, or one would be extracted as a file where
+ * another needs a directory. */
+static bool
+names_collide_(const Index_* R_ index)
+{
+  if (index->count < 2)
+    return false;
+  const size_t count = (size_t)index->count;
+  const Member_** sorted = (const Member_**)SSC_mallocOrDie(count * sizeof(Member_*));
+  for (size_t i = 0; i < count; ++i)
+    sorted[i] = &index->members[i];
+  qsort(sorted, count, sizeof(Member_*), compare_names_);
+  bool collide = false;
+  for (size_t i = 1; (i < count) && !collide; ++i) {
+    const Member_* const prev = sorted[i - 1];
+    const Member_* const m    = sorted[i];
+    collide = (m->name_size >= prev->name_size) && !memcmp(m->name, prev->name, prev->name_size) &&
+     ((m->name_size == prev->name_size) || (m->name[prev->name_size] == '/'));
+  }
+  free(sorted);
+  return collide;
+}
+
+void
+archive_v1_extract_all(
+ Threecrypt_ArchiveV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ const char* R_           output_directory)
+{
+  Index_ index;
+  open_index_or_die_(ctx, input_map, &index);
+  /* Check every member before writing a single byte of plaintext. */
+  const char* error = SSC_NULL;
+  for (uint64_t i = 0; (i < index.count) && !error; ++i) {
+    const Member_* const m = &index.members[i];
+    if (!safe_name_(m->name, m->name_size))
+      error = "Error: The archive has a member whose name would leave the output directory.\n";
+    else if (!authenticate_member_(ctx, input_map->ptr, m))
+      error = AUTH_FAILED_;
+  }
+  if (!error && names_collide_(&index))
+    error = "Error: The archive has members whose names are the same or would overwrite one another.\n";
+  if (error) {
+    close_index_(&index);
+    close_input_(input_map);
+    SSC_errx("%s", error);
+  }
+  SSC_assertMsg(!MKDIR_(output_directory), "Error: Failed to create the directory %s!\n", output_directory);
+  const size_t directory_size = strlen(output_directory);
+  for (uint64_t i = 0; i < index.count; ++i) {
+    const Member_* const m = &index.members[i];
+    char* path = (char*)SSC_mallocOrDie(directory_size + 1 + m->name_size + 1);
+    memcpy(path, output_directory, directory_size);
+    path[directory_size] = '/';
+    memcpy(path + directory_size + 1, m->name, m->name_size);
+    path[directory_size + 1 + m->name_size] = '\0';
+    /* Create the member's parent directories as needed. */
+    for (char* p = path + directory_size + 1; *p; ++p) {
+      if (*p != '/')
+        continue;
+      *p = '\0';
+      SSC_assertMsg(
+       !MKDIR_(path) || (errno == EEXIST),
+       "Error: Failed to create the directory %s!\n", path);
+      *p = '/';
+    }
+    write_member_(ctx, input_map->ptr, m, path);
+    free(path);
+  }
+  close_index_(&index);
+  close_input_(input_map);
+}
+
+void
+archive_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename)
+{
+  SSC_assertMsg(
+   input_map->size >= (HEADER_BYTES_ + TRAILER_BYTES_),
+   "Error: The input file %s is too small to be an Archive_V1 encrypted file.\n", filename);
+  const uint8_t* const in = input_map->ptr;
+  const uint8_t* const keying = in + KEYING_OFFSET_;
+  const uint8_t* const trailer = in + input_map->size - TRAILER_BYTES_;
+  printf("File Header for %s\n", filename);
+  printf("Method             : Archive_V1\n");
+  keying_dump(keying);
+  threecrypt_print_hex("Tweak              : ", in + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+  printf("Members            : %" PRIu64 "\n", threecrypt_load64(trailer + TRAILER_COUNT_));
+  printf("Index Size         : %" PRIu64 " bytes\n", threecrypt_load64(trailer));
+}
+
+#endif /* ! THREECRYPT_ARCHIVE_V1_H */
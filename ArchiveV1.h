@@ -0,0 +1,114 @@
+#if !defined(THREECRYPT_ARCHIVE_V1_H) && defined(THREECRYPT_EXTERN_ENABLE_ARCHIVE_V1)
+#define THREECRYPT_ARCHIVE_V1_H
+
+#include <SSC/Macro.h>
+#include <SSC/MemMap.h>
+#include <PPQ/CSPRNG.h>
+#include "FileList.h"
+#include "Keying.h"
+#include "Primitive.h"
+
+/* Archive_V1 encrypted files hold many member files under one key-derivation, with an
+ * encrypted index of where each member lies, so a single member can be listed or extracted
+ * by authenticating and decrypting only the index and that member.
+ *
+ * Layout:
+ *   Header:
+ *     ID           (THREECRYPT_ARCHIVE_V1_ID_NBYTES)
+ *     Keying       (THREECRYPT_KEYING_BYTES)
+ *     Tweak        (PPQ_THREEFISH512_TWEAK_BYTES)
+ *     Header MAC   (64), MAC of the above.
+ *   Members, for i = 0 .. Count - 1:
+ *     Ciphertext   (Size i bytes)
+ *   Index, encrypted under Index IV, for i = 0 .. Count - 1:
+ *     Offset       (8 bytes, little-endian; where member i's ciphertext begins in the file)
+ *     Size         (8 bytes, little-endian)
+ *     CTR IV       (THREECRYPT_CTR_IV_BYTES)
+ *     Member Tag   (64), MAC of member i's ciphertext.
+ *     Name Size    (2 bytes, little-endian)
+ *     Name         (Name Size bytes; the member's '/'-separated path within the archive)
+ *   Trailer:
+ *     Index Size   (8 bytes, little-endian)
+ *     Count        (8 bytes, little-endian)
+ *     Index IV     (THREECRYPT_CTR_IV_BYTES)
+ *     Index MAC    (64), MAC of the encrypted Index and the above.
+ *
+ * Members are encrypted independently, each under its own IV, so packing encrypts them
+ * in parallel, THREECRYPT_ARCHIVE_V1_THREADS at a time. The Index MAC authenticates every
+ * member's tag, so checking one member's tag against its ciphertext authenticates that member. */
+#define THREECRYPT_ARCHIVE_V1_ID               "3CRYPT_ARCHIVE_V1"
+#define THREECRYPT_ARCHIVE_V1_ID_NBYTES        18
+#define THREECRYPT_ARCHIVE_V1_MAC_BYTES        64
+#define THREECRYPT_ARCHIVE_V1_HEADER_BYTES     (\
+ THREECRYPT_ARCHIVE_V1_ID_NBYTES +\
+ THREECRYPT_KEYING_BYTES +\
+ PPQ_THREEFISH512_TWEAK_BYTES +\
+ THREECRYPT_ARCHIVE_V1_MAC_BYTES)
+#define THREECRYPT_ARCHIVE_V1_ENTRY_BYTES      (8 + 8 + THREECRYPT_CTR_IV_BYTES + THREECRYPT_ARCHIVE_V1_MAC_BYTES + 2) /* Excluding the name. */
+#define THREECRYPT_ARCHIVE_V1_TRAILER_BYTES    (8 + 8 + THREECRYPT_CTR_IV_BYTES + THREECRYPT_ARCHIVE_V1_MAC_BYTES)
+#define THREECRYPT_ARCHIVE_V1_KEYING_OFFSET    THREECRYPT_ARCHIVE_V1_ID_NBYTES
+#define THREECRYPT_ARCHIVE_V1_MAX_NAME_BYTES   UINT16_MAX
+#ifdef THREECRYPT_EXTERN_ARCHIVE_V1_THREADS
+ #define THREECRYPT_ARCHIVE_V1_THREADS THREECRYPT_EXTERN_ARCHIVE_V1_THREADS
+#else
+ #define THREECRYPT_ARCHIVE_V1_THREADS 0 /* One per online processor. */
+#endif
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  Threecrypt_Keying keying;
+  Threecrypt_Ctr    ctr;
+  PPQ_CSPRNG        csprng; /* Only used when packing. */
+  uint64_t          enc_key  [PPQ_THREEFISH512_EXTERNAL_KEY_WORDS];
+  uint64_t          tweak    [PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS];
+  uint8_t           auth_key [PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t           derived  [PPQ_THREEFISH512_BLOCK_BYTES * 2];
+  uint8_t           mac      [THREECRYPT_ARCHIVE_V1_MAC_BYTES];
+} Threecrypt_ArchiveV1;
+
+/* Pack every file of @list into a new Archive_V1 file at @output_map, whose file must already be open,
+ * with the keying parameters in @ctx->keying. Each member is named by its path with the first
+ * @root_size bytes removed. @ctx->keying.secret and @ctx->csprng must be initialized.
+ * Unmaps and closes @output_map. */
+void
+archive_v1_pack(
+ Threecrypt_ArchiveV1* R_       ctx,
+ const Threecrypt_FileList* R_  list,
+ size_t                         root_size,
+ SSC_MemMap* R_                 output_map);
+
+/* Authenticate the index of the mapped Archive_V1 file @input_map and print the size and name
+ * of each of its members. @ctx->keying must be loaded and its secret initialized. Unmaps and closes @input_map. */
+void
+archive_v1_list(Threecrypt_ArchiveV1* R_ ctx, SSC_MemMap* R_ input_map);
+
+/* Authenticate and decrypt the member named @member of the mapped Archive_V1 file @input_map
+ * into the new file @output_filename. Only the index and that member are read.
+ * @ctx->keying must be loaded and its secret initialized. Unmaps and closes @input_map. */
+void
+archive_v1_extract(
+ Threecrypt_ArchiveV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ const char* R_           member,
+ const char* R_           output_filename);
+
+/* Authenticate and decrypt every member of the mapped Archive_V1 file @input_map beneath the
+ * new directory @output_directory. Dies before writing anything if a member's name would
+ * leave @output_directory, if two members share a name, or if one member's name is a directory
+ * in another's. Unmaps and closes @input_map. */
+void
+archive_v1_extract_all(
+ Threecrypt_ArchiveV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ const char* R_           output_directory);
+
+/* Print the header and trailer of the Archive_V1 file mapped by @input_map. */
+void
+archive_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif
@@ -0,0 +1,298 @@
+#include <SSC/Operation.h>
+#include "ChaCha20.h"
+#include "Throttle.h"
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <pthread.h>
+#endif
+
+#define R_ SSC_RESTRICT
+#define L_ THREECRYPT_CHACHA20_LANES
+
+#define ROTL_(X, N) (((X) << (N)) | ((X) >> (32 - (N))))
+/* The lane kernel is inlined into each of its ISA-specific entry points, and compiled for each. */
+#if THREECRYPT_CHACHA20_AVX2_DISPATCH
+ #define KERNEL_ static inline __attribute__((always_inline))
+#else
+ #define KERNEL_ static
+#endif
+
+static inline uint32_t
+load32_(const uint8_t* p)
+{
+  return ((uint32_t)p[0]) | (((uint32_t)p[1]) << 8) | (((uint32_t)p[2]) << 16) | (((uint32_t)p[3]) << 24);
+}
+
+static inline void
+store32_(uint8_t* p, uint32_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+/* "expand 32-byte k" */
+static void
+set_constants_(uint32_t* state)
+{
+  state[0] = UINT32_C(0x61707865);
+  state[1] = UINT32_C(0x3320646e);
+  state[2] = UINT32_C(0x79622d32);
+  state[3] = UINT32_C(0x6b206574);
+}
+
+/* Apply the 20 rounds of ChaCha20 to the single state @x. */
+static void
+rounds_(uint32_t* R_ x)
+{
+#define QR_(A, B, C, D) \
+  x[A] += x[B]; x[D] = ROTL_(x[D] ^ x[A], 16);\
+  x[C] += x[D]; x[B] = ROTL_(x[B] ^ x[C], 12);\
+  x[A] += x[B]; x[D] = ROTL_(x[D] ^ x[A], 8);\
+  x[C] += x[D]; x[B] = ROTL_(x[B] ^ x[C], 7)
+  for (int i = 0; i < 10; ++i) {
+    QR_(0, 4,  8, 12); QR_(1, 5,  9, 13); QR_(2, 6, 10, 14); QR_(3, 7, 11, 15);
+    QR_(0, 5, 10, 15); QR_(1, 6, 11, 12); QR_(2, 7,  8, 13); QR_(3, 4,  9, 14);
+  }
+#undef QR_
+}
+
+/* Apply the 20 rounds of ChaCha20 to the L_ states interleaved in @x, word i of lane l at x[i][l].
+ * The rounds are fully unrolled inside the loop over the lanes, so the compiler vectorizes
+ * that loop, with lane l of each vector register holding word i of state l. */
+KERNEL_ void
+lane_rounds_(uint32_t x [16][L_])
+{
+  for (int l = 0; l < L_; ++l) {
+    uint32_t v [16];
+    for (int i = 0; i < 16; ++i)
+      v[i] = x[i][l];
+#define QR_(A, B, C, D) \
+  v[A] += v[B]; v[D] = ROTL_(v[D] ^ v[A], 16);\
+  v[C] += v[D]; v[B] = ROTL_(v[B] ^ v[C], 12);\
+  v[A] += v[B]; v[D] = ROTL_(v[D] ^ v[A], 8);\
+  v[C] += v[D]; v[B] = ROTL_(v[B] ^ v[C], 7);
+    #pragma GCC unroll 10
+    for (int i = 0; i < 10; ++i) {
+      QR_(0, 4,  8, 12) QR_(1, 5,  9, 13) QR_(2, 6, 10, 14) QR_(3, 7, 11, 15)
+      QR_(0, 5, 10, 15) QR_(1, 6, 11, 12) QR_(2, 7,  8, 13) QR_(3, 4,  9, 14)
+    }
+#undef QR_
+    for (int i = 0; i < 16; ++i)
+      x[i][l] = v[i];
+  }
+}
+
+/* Scratch space for L_ interleaved states, word i of lane l at [i][l]. */
+typedef struct {
+  uint32_t input [16][L_];
+  uint32_t x     [16][L_];
+  uint8_t  keystream [L_ * THREECRYPT_CHACHA20_BLOCK_BYTES];
+} Lanes_;
+
+/* Compute the L_ keystream blocks beginning at block @block into @lanes->keystream. */
+KERNEL_ void
+lane_blocks_(const Threecrypt_XChaCha20* R_ ctx, uint64_t block, Lanes_* R_ lanes)
+{
+  for (int i = 0; i < 16; ++i)
+    for (int l = 0; l < L_; ++l)
+      lanes->input[i][l] = ctx->state[i];
+  for (int l = 0; l < L_; ++l) {
+    lanes->input[12][l] = (uint32_t)(block + (uint64_t)l);
+    lanes->input[13][l] = (uint32_t)((block + (uint64_t)l) >> 32);
+  }
+  memcpy(lanes->x, lanes->input, sizeof(lanes->x));
+  lane_rounds_(lanes->x);
+  for (int l = 0; l < L_; ++l)
+    for (int i = 0; i < 16; ++i)
+      store32_(lanes->keystream + (l * THREECRYPT_CHACHA20_BLOCK_BYTES) + (i * 4), lanes->x[i][l] + lanes->input[i][l]);
+}
+
+typedef void (*Blocks_)(const Threecrypt_XChaCha20* R_, uint64_t, Lanes_* R_);
+
+#if THREECRYPT_CHACHA20_AVX2_DISPATCH
+static void
+blocks_baseline_(const Threecrypt_XChaCha20* R_ ctx, uint64_t block, Lanes_* R_ lanes)
+{
+  lane_blocks_(ctx, block, lanes);
+}
+
+__attribute__((target("avx2"))) static void
+blocks_avx2_(const Threecrypt_XChaCha20* R_ ctx, uint64_t block, Lanes_* R_ lanes)
+{
+  lane_blocks_(ctx, block, lanes);
+}
+
+/* Returns the fastest lane kernel this processor can run. */
+static Blocks_
+select_blocks_(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? blocks_avx2_ : blocks_baseline_;
+}
+#else
+static Blocks_
+select_blocks_(void)
+{
+  return lane_blocks_;
+}
+#endif
+
+static void
+init_(Threecrypt_XChaCha20* R_ ctx, const uint8_t* R_ key, const uint8_t* R_ nonce)
+{
+  /* HChaCha20: the first and last rows of the rounds of the key and first 16 nonce bytes, without the feed-forward. */
+  uint32_t x [16];
+  set_constants_(x);
+  for (int i = 0; i < 8; ++i)
+    x[4 + i] = load32_(key + (i * 4));
+  for (int i = 0; i < 4; ++i)
+    x[12 + i] = load32_(nonce + (i * 4));
+  rounds_(x);
+  set_constants_(ctx->state);
+  for (int i = 0; i < 4; ++i) {
+    ctx->state[4 + i] = x[i];
+    ctx->state[8 + i] = x[12 + i];
+  }
+  ctx->state[12] = 0;
+  ctx->state[13] = 0;
+  ctx->state[14] = load32_(nonce + 16);
+  ctx->state[15] = load32_(nonce + 20);
+  SSC_secureZero(x, sizeof(x));
+}
+
+void
+threecrypt_xchacha20_xor(
+ const Threecrypt_XChaCha20* R_ ctx,
+ uint8_t*                       output,
+ const uint8_t*                 input,
+ uint64_t                       size,
+ uint64_t                       starting_byte)
+{
+  Lanes_   lanes;
+  uint64_t block  = starting_byte / THREECRYPT_CHACHA20_BLOCK_BYTES;
+  size_t   offset = (size_t)(starting_byte % THREECRYPT_CHACHA20_BLOCK_BYTES);
+  uint64_t unthrottled = 0;
+  const Blocks_ blocks = select_blocks_();
+  while (size) {
+    blocks(ctx, block, &lanes);
+    size_t n = sizeof(lanes.keystream) - offset;
+    if (n > size)
+      n = (size_t)size;
+    for (size_t i = 0; i < n; ++i)
+      output[i] = input[i] ^ lanes.keystream[offset + i];
+    output += n;
+    input  += n;
+    size   -= n;
+    block  += L_;
+    offset  = 0;
+    unthrottled += n;
+    if (unthrottled >= THREECRYPT_THROTTLE_QUANTUM) {
+      throttle_account(unthrottled);
+      unthrottled = 0;
+    }
+  }
+  if (unthrottled)
+    throttle_account(unthrottled);
+  SSC_secureZero(&lanes, sizeof(lanes));
+}
+
+/* The keystream of the ChaCha20 block test vectors #1, #2 and #5 of RFC 8439, Appendix A.1:
+ * blocks 0 and 1 of the zero key and nonce, then block 0 of the zero key and the nonce ending in 2. */
+static const uint8_t Published_Keystream_ [3][THREECRYPT_CHACHA20_BLOCK_BYTES] = {
+ {0x76, 0xb8, 0xe0, 0xad, 0xa0, 0xf1, 0x3d, 0x90, 0x40, 0x5d, 0x6a, 0xe5, 0x53, 0x86, 0xbd, 0x28,
+  0xbd, 0xd2, 0x19, 0xb8, 0xa0, 0x8d, 0xed, 0x1a, 0xa8, 0x36, 0xef, 0xcc, 0x8b, 0x77, 0x0d, 0xc7,
+  0xda, 0x41, 0x59, 0x7c, 0x51, 0x57, 0x48, 0x8d, 0x77, 0x24, 0xe0, 0x3f, 0xb8, 0xd8, 0x4a, 0x37,
+  0x6a, 0x43, 0xb8, 0xf4, 0x15, 0x18, 0xa1, 0x1c, 0xc3, 0x87, 0xb6, 0x69, 0xb2, 0xee, 0x65, 0x86},
+ {0x9f, 0x07, 0xe7, 0xbe, 0x55, 0x51, 0x38, 0x7a, 0x98, 0xba, 0x97, 0x7c, 0x73, 0x2d, 0x08, 0x0d,
+  0xcb, 0x0f, 0x29, 0xa0, 0x48, 0xe3, 0x65, 0x69, 0x12, 0xc6, 0x53, 0x3e, 0x32, 0xee, 0x7a, 0xed,
+  0x29, 0xb7, 0x21, 0x76, 0x9c, 0xe6, 0x4e, 0x43, 0xd5, 0x71, 0x33, 0xb0, 0x74, 0xd8, 0x39, 0xd5,
+  0x31, 0xed, 0x1f, 0x28, 0x51, 0x0a, 0xfb, 0x45, 0xac, 0xe1, 0x0a, 0x1f, 0x4b, 0x79, 0x4d, 0x6f},
+ {0xc2, 0xc6, 0x4d, 0x37, 0x8c, 0xd5, 0x36, 0x37, 0x4a, 0xe2, 0x04, 0xb9, 0xef, 0x93, 0x3f, 0xcd,
+  0x1a, 0x8b, 0x22, 0x88, 0xb3, 0xdf, 0xa4, 0x96, 0x72, 0xab, 0x76, 0x5b, 0x54, 0xee, 0x27, 0xc7,
+  0x8a, 0x97, 0x0e, 0x0e, 0x95, 0x5c, 0x14, 0xf3, 0xa8, 0x8e, 0x74, 0x1b, 0x97, 0xc2, 0x86, 0xf7,
+  0x5f, 0x8f, 0xc2, 0x99, 0xe8, 0x14, 0x83, 0x62, 0xfa, 0x19, 0x8a, 0x39, 0x53, 0x1b, 0xed, 0x6d}
+};
+/* The HChaCha20 subkey of the XChaCha draft (draft-irtf-cfrg-xchacha-03), section 2.2.1,
+ * of the key 00 01 .. 1f and the nonce below. */
+static const uint8_t Published_Nonce_ [16] = {
+  0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x4a, 0x00, 0x00, 0x00, 0x00, 0x31, 0x41, 0x59, 0x27
+};
+static const uint8_t Published_Subkey_ [THREECRYPT_CHACHA20_KEY_BYTES] = {
+  0x82, 0x41, 0x3b, 0x42, 0x27, 0xb2, 0x7b, 0xfe, 0xd3, 0x0e, 0x42, 0x50, 0x8a, 0x87, 0x7d, 0x73,
+  0xa0, 0xf9, 0xe4, 0xd5, 0x8a, 0x74, 0xa8, 0x53, 0xc1, 0x2e, 0xc4, 0x13, 0x26, 0xd3, 0xec, 0xdc
+};
+
+/* Beyond the published answers, every lane is checked against the single-state rounds on blocks
+ * whose counters carry into the high word. */
+enum { KAT_BLOCKS_ = L_ * 2 };
+typedef struct {
+  Threecrypt_XChaCha20 ctx;
+  uint32_t             x        [16];
+  uint8_t              key      [THREECRYPT_CHACHA20_KEY_BYTES];
+  uint8_t              nonce    [THREECRYPT_XCHACHA20_NONCE_BYTES];
+  uint8_t              output   [KAT_BLOCKS_ * THREECRYPT_CHACHA20_BLOCK_BYTES];
+  uint8_t              expected [KAT_BLOCKS_ * THREECRYPT_CHACHA20_BLOCK_BYTES];
+} Kat_;
+
+static void
+self_test_(void)
+{
+  Kat_* const kat = (Kat_*)SSC_mallocOrDie(sizeof(Kat_));
+  memset(kat, 0, sizeof(*kat));
+  set_constants_(kat->ctx.state);
+  threecrypt_xchacha20_xor(&kat->ctx, kat->output, kat->output, THREECRYPT_CHACHA20_BLOCK_BYTES * 2, 0);
+  kat->ctx.state[15] = UINT32_C(0x02000000);
+  threecrypt_xchacha20_xor(
+   &kat->ctx, kat->output + (THREECRYPT_CHACHA20_BLOCK_BYTES * 2), kat->output + (THREECRYPT_CHACHA20_BLOCK_BYTES * 2),
+   THREECRYPT_CHACHA20_BLOCK_BYTES, 0);
+  bool ok = !memcmp(kat->output, Published_Keystream_, sizeof(Published_Keystream_));
+  for (int i = 0; i < THREECRYPT_CHACHA20_KEY_BYTES; ++i)
+    kat->key[i] = (uint8_t)i;
+  memcpy(kat->nonce, Published_Nonce_, sizeof(Published_Nonce_));
+  init_(&kat->ctx, kat->key, kat->nonce);
+  for (int i = 0; i < 4; ++i) {
+    store32_(kat->expected + (i * 4), kat->ctx.state[4 + i]);
+    store32_(kat->expected + 16 + (i * 4), kat->ctx.state[8 + i]);
+  }
+  ok = ok && !memcmp(kat->expected, Published_Subkey_, sizeof(Published_Subkey_));
+  const uint64_t first = UINT64_C(0xffffffff) - L_;
+  memset(kat->output, 0, sizeof(kat->output));
+  threecrypt_xchacha20_xor(&kat->ctx, kat->output, kat->output, sizeof(kat->output), first * THREECRYPT_CHACHA20_BLOCK_BYTES);
+  for (int b = 0; b < KAT_BLOCKS_; ++b) {
+    memcpy(kat->x, kat->ctx.state, sizeof(kat->x));
+    kat->x[12] = (uint32_t)(first + (uint64_t)b);
+    kat->x[13] = (uint32_t)((first + (uint64_t)b) >> 32);
+    rounds_(kat->x);
+    for (int i = 0; i < 16; ++i) {
+      const uint32_t input = (i == 12) ? (uint32_t)(first + (uint64_t)b) :
+                             (i == 13) ? (uint32_t)((first + (uint64_t)b) >> 32) : kat->ctx.state[i];
+      store32_(kat->expected + (b * THREECRYPT_CHACHA20_BLOCK_BYTES) + (i * 4), kat->x[i] + input);
+    }
+  }
+  ok = ok && !memcmp(kat->output, kat->expected, sizeof(kat->output));
+  SSC_secureZero(kat, sizeof(*kat));
+  free(kat);
+  SSC_assertMsg(ok, "Error: ChaCha20 failed its known-answer test; 3crypt was miscompiled!\n");
+}
+
+#if defined(SSC_OS_UNIXLIKE)
+static pthread_once_t Checked_ = PTHREAD_ONCE_INIT;
+#endif
+
+void
+threecrypt_xchacha20_init(Threecrypt_XChaCha20* R_ ctx, const uint8_t* R_ key, const uint8_t* R_ nonce)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_once(&Checked_, self_test_);
+#else
+  /* Elsewhere keys are never set concurrently. */
+  static bool checked = false;
+  if (!checked) {
+    self_test_();
+    checked = true;
+  }
+#endif
+  init_(ctx, key, nonce);
+}
@@ -0,0 +1,62 @@
+#ifndef THREECRYPT_CHACHA20_H
+#define THREECRYPT_CHACHA20_H
+
+#include <SSC/Macro.h>
+
+/* XChaCha20, the extended-nonce variant of the ChaCha20 stream cipher, with a 64-bit block counter.
+ * HChaCha20 condenses the 256-bit key and the first 16 bytes of the 24 byte nonce into a subkey,
+ * and keystream block i is ChaCha20(subkey, LE64(i) || the last 8 bytes of the nonce).
+ *
+ * Keystream blocks are computed THREECRYPT_CHACHA20_LANES at a time, interleaved word by word,
+ * so every step of a round is the same operation across all lanes, which compilers turn into
+ * SIMD instructions: 8 lanes fill AVX2's 256-bit registers, and 16 fill AVX-512's.
+ *
+ * Distributed x86 binaries are built for a baseline without AVX2, so when the compiler supports it
+ * (THREECRYPT_EXTERN_AVX2_DISPATCH) the kernel is compiled twice, once for the baseline and
+ * once with __attribute__((target("avx2"))), and the AVX2 kernel is used wherever the processor
+ * has it. Builds that already target AVX2 have no need for the second kernel.
+ *
+ * The first time a key is set, the kernel and HChaCha20 are checked against the published known
+ * answers of RFC 8439, Appendix A.1, and the XChaCha draft, section 2.2.1. */
+#define THREECRYPT_CHACHA20_KEY_BYTES    32
+#define THREECRYPT_CHACHA20_BLOCK_BYTES  64
+#define THREECRYPT_XCHACHA20_NONCE_BYTES 24
+#if defined(THREECRYPT_EXTERN_CHACHA20_LANES)
+ #define THREECRYPT_CHACHA20_LANES THREECRYPT_EXTERN_CHACHA20_LANES
+#elif defined(__AVX512F__)
+ #define THREECRYPT_CHACHA20_LANES 16
+#else
+ #define THREECRYPT_CHACHA20_LANES 8
+#endif
+#if defined(THREECRYPT_EXTERN_AVX2_DISPATCH) && !defined(__AVX2__) &&\
+    (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+ #define THREECRYPT_CHACHA20_AVX2_DISPATCH 1
+#else
+ #define THREECRYPT_CHACHA20_AVX2_DISPATCH 0
+#endif
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  uint32_t state [16]; /* Constants, subkey, a zero counter, and the last 8 bytes of the nonce. */
+} Threecrypt_XChaCha20;
+
+/* Key @ctx with the THREECRYPT_CHACHA20_KEY_BYTES @key and THREECRYPT_XCHACHA20_NONCE_BYTES @nonce. */
+void
+threecrypt_xchacha20_init(Threecrypt_XChaCha20* R_ ctx, const uint8_t* R_ key, const uint8_t* R_ nonce);
+
+/* XOR @size bytes of keystream, beginning at keystream byte @starting_byte, with @input
+ * and store the result in @output. @input and @output may be the same buffer. */
+void
+threecrypt_xchacha20_xor(
+ const Threecrypt_XChaCha20* R_ ctx,
+ uint8_t*                       output,
+ const uint8_t*                 input,
+ uint64_t                       size,
+ uint64_t                       starting_byte);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
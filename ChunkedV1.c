@@ -0,0 +1,332 @@
+#include <SSC/Operation.h>
+#include "ChunkedV1.h"
+#include "Durability.h"
+#include "Journal.h"
+
+#ifdef THREECRYPT_CHUNKED_V1_H
+
+#define R_ SSC_RESTRICT
+
+#define MAC_BYTES_         THREECRYPT_CHUNKED_V1_MAC_BYTES
+#define DIGEST_BYTES_      THREECRYPT_CHUNKED_V1_DIGEST_BYTES
+#define HEADER_BYTES_      THREECRYPT_CHUNKED_V1_HEADER_BYTES
+#define ENTRY_BYTES_       THREECRYPT_CHUNKED_V1_ENTRY_BYTES
+#define TRAILER_BYTES_     THREECRYPT_CHUNKED_V1_TRAILER_BYTES
+#define KEYING_OFFSET_     THREECRYPT_CHUNKED_V1_KEYING_OFFSET
+#define TWEAK_OFFSET_      (KEYING_OFFSET_ + THREECRYPT_KEYING_BYTES)
+#define SHIFT_OFFSET_      (TWEAK_OFFSET_ + PPQ_THREEFISH512_TWEAK_BYTES)
+#define HEADER_MAC_OFFSET_ (SHIFT_OFFSET_ + 1)
+/* Offsets within a table entry. */
+#define ENTRY_DIGEST_      THREECRYPT_CTR_IV_BYTES
+#define ENTRY_TAG_         (ENTRY_DIGEST_ + DIGEST_BYTES_)
+
+#define AUTH_FAILED_       "Error: Authentication failed. The file has been corrupted or truncated.\n"
+
+/* The number of chunks of 2^@shift bytes it takes to hold @total bytes. */
+static uint64_t
+chunk_count_(uint64_t total, uint8_t shift)
+{
+  return (total >> shift) + ((total & ((UINT64_C(1) << shift) - 1)) != 0);
+}
+
+/* The size of chunk @i of a file holding @total plaintext bytes in chunks of 2^@shift bytes. */
+static uint64_t
+chunk_size_(uint64_t i, uint64_t total, uint8_t shift)
+{
+  const uint64_t begin = i << shift;
+  const uint64_t left  = total - begin;
+  return (left < (UINT64_C(1) << shift)) ? left : (UINT64_C(1) << shift);
+}
+
+/* Derive the keys from @ctx->keying and the @header of a Chunked_V1 file. */
+static void
+derive_keys_(Threecrypt_ChunkedV1* R_ ctx, const uint8_t* R_ header)
+{
+  keying_derive(
+   &ctx->keying,
+   header + KEYING_OFFSET_,
+   THREECRYPT_CHUNKED_V1_ID,
+   THREECRYPT_CHUNKED_V1_ID_NBYTES,
+   ctx->derived,
+   sizeof(ctx->derived));
+  memcpy(ctx->enc_key,    ctx->derived,                                    PPQ_THREEFISH512_BLOCK_BYTES);
+  memcpy(ctx->auth_key,   ctx->derived + PPQ_THREEFISH512_BLOCK_BYTES,     PPQ_THREEFISH512_BLOCK_BYTES);
+  memcpy(ctx->digest_key, ctx->derived + PPQ_THREEFISH512_BLOCK_BYTES * 2, PPQ_THREEFISH512_BLOCK_BYTES);
+  SSC_secureZero(ctx->derived, sizeof(ctx->derived));
+  memcpy(ctx->tweak, header + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+}
+
+/* MAC the @size bytes at @begin under the authentication key, storing the result in @out. */
+static void
+mac_(Threecrypt_ChunkedV1* R_ ctx, uint8_t* R_ out, const uint8_t* R_ begin, uint64_t size)
+{
+  PPQ_Skein512_mac(&ctx->keying.ubi512, out, begin, ctx->auth_key, MAC_BYTES_, size);
+}
+
+/* Compute the keyed digest of chunk @index, whose plaintext is the @size bytes at @plaintext.
+ * The index is mixed in so that equal chunks at different indices have unrelated digests. */
+static void
+chunk_digest_(
+ Threecrypt_ChunkedV1* R_ ctx,
+ uint8_t* R_              out,
+ uint64_t                 index,
+ const uint8_t* R_        plaintext,
+ uint64_t                 size)
+{
+  threecrypt_store64(ctx->buffer, index);
+  PPQ_Skein512_mac(&ctx->keying.ubi512, ctx->buffer + 8, plaintext, ctx->digest_key, MAC_BYTES_, size);
+  PPQ_Skein512_mac(&ctx->keying.ubi512, out, ctx->buffer, ctx->digest_key, DIGEST_BYTES_, sizeof(ctx->buffer));
+}
+
+/* Authenticate the header, trailer and table of the @size byte Chunked_V1 file at @file,
+ * storing its total plaintext size in @total. Returns an error message, or SSC_NULL. */
+static const char*
+authenticate_(Threecrypt_ChunkedV1* R_ ctx, const uint8_t* R_ file, size_t size, uint64_t* R_ total)
+{
+  if (size < (HEADER_BYTES_ + TRAILER_BYTES_))
+    return "Error: The file is too small to be a Chunked_V1 encrypted file.\n";
+  derive_keys_(ctx, file);
+  /* A wrong password or keyfile is caught here, without reading the table. */
+  mac_(ctx, ctx->mac, file, HEADER_MAC_OFFSET_);
+  if (!threecrypt_ct_equal(ctx->mac, file + HEADER_MAC_OFFSET_, MAC_BYTES_))
+    return "Error: Authentication failed. Wrong password or keyfile, or the header has been corrupted.\n";
+  const uint8_t shift = file[SHIFT_OFFSET_];
+  if ((shift < THREECRYPT_CHUNKED_V1_MIN_CHUNK_SHIFT) || (shift > THREECRYPT_CHUNKED_V1_MAX_CHUNK_SHIFT))
+    return "Error: The file has an invalid chunk size.\n";
+  const uint8_t* const trailer = file + size - TRAILER_BYTES_;
+  *total = threecrypt_load64(trailer);
+  const uint64_t data_and_table = size - HEADER_BYTES_ - TRAILER_BYTES_;
+  if ((*total > data_and_table) || ((data_and_table - *total) != (chunk_count_(*total, shift) * ENTRY_BYTES_)))
+    return AUTH_FAILED_;
+  const uint8_t* const table = file + HEADER_BYTES_ + *total;
+  mac_(ctx, ctx->mac, table, (trailer + 8) - table);
+  if (!threecrypt_ct_equal(ctx->mac, trailer + 8, MAC_BYTES_))
+    return AUTH_FAILED_;
+  return SSC_NULL;
+}
+
+void
+chunked_v1_update(
+ Threecrypt_ChunkedV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map,
+ const char* R_           output_filename)
+{
+  uint64_t old_total = 0;
+  uint64_t old_count = 0;
+  uint8_t* old_table = SSC_NULL;
+  uint64_t changed   = 0; /* Number of chunks to rewrite, plus one if the table must be rewritten regardless. */
+  uint8_t  shift;
+  Threecrypt_Journal journal = {0};
+  const size_t old_size = output_map->size;
+  if (!output_map->size) {
+    /* Create a new Chunked_V1 file, containing only a header. */
+    shift = ctx->chunk_shift;
+    output_map->size = HEADER_BYTES_;
+    SSC_File_setSizeOrDie(output_map->file, output_map->size);
+    SSC_MemMap_mapOrDie(output_map, false);
+    uint8_t* const out = output_map->ptr;
+    memcpy(out, THREECRYPT_CHUNKED_V1_ID, THREECRYPT_CHUNKED_V1_ID_NBYTES);
+    keying_store(&ctx->keying, out + KEYING_OFFSET_, &ctx->csprng);
+    PPQ_CSPRNG_get(&ctx->csprng, out + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+    out[SHIFT_OFFSET_] = shift;
+    derive_keys_(ctx, out);
+    mac_(ctx, out + HEADER_MAC_OFFSET_, out, HEADER_MAC_OFFSET_);
+    changed = 1;
+  } else {
+    const char* error = authenticate_(ctx, output_map->ptr, output_map->size, &old_total);
+    if (error) {
+      /* Leave the existing file exactly as we found it. */
+      SSC_MemMap_unmapOrDie(output_map);
+      SSC_File_closeOrDie(output_map->file);
+      if (input_map->size)
+        SSC_MemMap_unmapOrDie(input_map);
+      SSC_File_closeOrDie(input_map->file);
+      SSC_errx("%s", error);
+    }
+    shift = output_map->ptr[SHIFT_OFFSET_];
+    old_count = chunk_count_(old_total, shift);
+    /* The table moves whenever the plaintext size changes, so keep a copy of it. */
+    if (old_count) {
+      old_table = (uint8_t*)SSC_mallocOrDie(old_count * ENTRY_BYTES_);
+      memcpy(old_table, output_map->ptr + HEADER_BYTES_ + old_total, old_count * ENTRY_BYTES_);
+    }
+  }
+  const uint64_t total = (uint64_t)input_map->size;
+  const uint64_t count = chunk_count_(total, shift);
+  uint8_t* table = SSC_NULL;
+  changed += (total != old_total);
+  if (count)
+    table = (uint8_t*)SSC_mallocOrDie(count * ENTRY_BYTES_);
+  /* Digest the new plaintext, keeping the IV and tag of every chunk whose digest is unchanged.
+   * The IVs of changed chunks are zeroed here, and filled in once the file has been resized. */
+  for (uint64_t i = 0; i < count; ++i) {
+    uint8_t* const entry = table + (i * ENTRY_BYTES_);
+    const uint64_t size = chunk_size_(i, total, shift);
+    chunk_digest_(ctx, entry + ENTRY_DIGEST_, i, input_map->ptr + (i << shift), size);
+    if ((i < old_count) &&
+        (chunk_size_(i, old_total, shift) == size) &&
+        threecrypt_ct_equal(old_table + (i * ENTRY_BYTES_) + ENTRY_DIGEST_, entry + ENTRY_DIGEST_, DIGEST_BYTES_))
+    {
+      memcpy(entry,              old_table + (i * ENTRY_BYTES_),              THREECRYPT_CTR_IV_BYTES);
+      memcpy(entry + ENTRY_TAG_, old_table + (i * ENTRY_BYTES_) + ENTRY_TAG_, MAC_BYTES_);
+    } else {
+      memset(entry, 0, THREECRYPT_CTR_IV_BYTES);
+      ++changed;
+    }
+  }
+  const size_t new_size = HEADER_BYTES_ + (size_t)total + (size_t)(count * ENTRY_BYTES_) + TRAILER_BYTES_;
+  if (old_size && changed) {
+    /* Journal every range of the existing file about to be rewritten or truncated away. */
+    const uint8_t* const file = output_map->ptr;
+    threecrypt_journal_begin(&journal, output_filename, old_size);
+    for (uint64_t i = 0; i < count; ++i) {
+      if ((i < old_count) && !memcmp(table + (i * ENTRY_BYTES_), old_table + (i * ENTRY_BYTES_), THREECRYPT_CTR_IV_BYTES))
+        continue;
+      threecrypt_journal_save(&journal, file, HEADER_BYTES_ + (i << shift), chunk_size_(i, total, shift));
+    }
+    threecrypt_journal_save(&journal, file, HEADER_BYTES_ + total, (count * ENTRY_BYTES_) + TRAILER_BYTES_);
+    threecrypt_journal_save(&journal, file, new_size, old_size);
+    threecrypt_journal_seal(&journal);
+  }
+  {
+    if (new_size != output_map->size) {
+      SSC_MemMap_unmapOrDie(output_map);
+      output_map->size = new_size;
+      SSC_File_setSizeOrDie(output_map->file, output_map->size);
+      SSC_MemMap_mapOrDie(output_map, false);
+    }
+  }
+  if (changed) {
+    uint8_t* const out = output_map->ptr;
+    for (uint64_t i = 0; i < count; ++i) {
+      uint8_t* const entry = table + (i * ENTRY_BYTES_);
+      if ((i < old_count) && !memcmp(entry, old_table + (i * ENTRY_BYTES_), THREECRYPT_CTR_IV_BYTES))
+        continue; /* Unchanged; the ciphertext is already in place. */
+      const uint64_t size = chunk_size_(i, total, shift);
+      uint8_t* const chunk = out + HEADER_BYTES_ + (i << shift);
+      PPQ_CSPRNG_get(&ctx->csprng, entry, THREECRYPT_CTR_IV_BYTES);
+      threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, entry);
+      threecrypt_ctr_xor(&ctx->ctr, chunk, input_map->ptr + (i << shift), size, 0);
+      mac_(ctx, entry + ENTRY_TAG_, chunk, size);
+    }
+    uint8_t* const new_table = out + HEADER_BYTES_ + total;
+    uint8_t* const trailer   = new_table + (count * ENTRY_BYTES_);
+    if (count)
+      memcpy(new_table, table, count * ENTRY_BYTES_);
+    threecrypt_store64(trailer, total);
+    mac_(ctx, trailer + 8, new_table, (trailer + 8) - new_table);
+    SSC_MemMap_syncOrDie(output_map);
+  }
+  if (table) {
+    SSC_secureZero(table, count * ENTRY_BYTES_);
+    free(table);
+  }
+  free(old_table);
+  SSC_MemMap_unmapOrDie(output_map);
+  if (input_map->size)
+    SSC_MemMap_unmapOrDie(input_map);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+  threecrypt_journal_end(&journal);
+}
+
+void
+chunked_v1_decrypt(
+ Threecrypt_ChunkedV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map,
+ const char* R_           output_filename)
+{
+  const uint8_t* const in = input_map->ptr;
+  uint64_t total = 0;
+  const char* error = authenticate_(ctx, in, input_map->size, &total);
+  const uint8_t shift = error ? 0 : in[SHIFT_OFFSET_];
+  const uint64_t count = error ? 0 : chunk_count_(total, shift);
+  const uint8_t* const table = in + HEADER_BYTES_ + total;
+  /* Authenticate every chunk before writing a single byte of plaintext. */
+  for (uint64_t i = 0; (i < count) && !error; ++i) {
+    mac_(ctx, ctx->mac, in + HEADER_BYTES_ + (i << shift), chunk_size_(i, total, shift));
+    if (!threecrypt_ct_equal(ctx->mac, table + (i * ENTRY_BYTES_) + ENTRY_TAG_, MAC_BYTES_))
+      error = AUTH_FAILED_;
+  }
+  if (error) {
+    SSC_MemMap_unmapOrDie(input_map);
+    SSC_File_closeOrDie(input_map->file);
+    SSC_File_closeOrDie(output_map->file);
+    remove(output_filename);
+    SSC_errx("%s", error);
+  }
+  output_map->size = (size_t)total;
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  if (output_map->size) {
+    SSC_MemMap_mapOrDie(output_map, false);
+    for (uint64_t i = 0; i < count; ++i) {
+      threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, table + (i * ENTRY_BYTES_));
+      threecrypt_ctr_xor(
+       &ctx->ctr,
+       output_map->ptr + (i << shift),
+       in + HEADER_BYTES_ + (i << shift),
+       chunk_size_(i, total, shift),
+       0);
+    }
+    durability_sync_map(output_map);
+    SSC_MemMap_unmapOrDie(output_map);
+  }
+  SSC_MemMap_unmapOrDie(input_map);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+const char*
+chunked_v1_open(Threecrypt_ChunkedV1* R_ ctx, const SSC_MemMap* R_ input_map, uint64_t* R_ total)
+{
+  const char* error = authenticate_(ctx, input_map->ptr, input_map->size, total);
+  if (!error)
+    ctx->chunk_shift = input_map->ptr[SHIFT_OFFSET_];
+  return error;
+}
+
+bool
+chunked_v1_read_chunk(
+ Threecrypt_ChunkedV1* R_ ctx,
+ const SSC_MemMap* R_     input_map,
+ uint64_t                 total,
+ uint64_t                 index,
+ uint8_t* R_              output)
+{
+  const uint8_t shift = ctx->chunk_shift;
+  const uint8_t* const in    = input_map->ptr;
+  const uint8_t* const entry = in + HEADER_BYTES_ + total + (index * ENTRY_BYTES_);
+  const uint8_t* const chunk = in + HEADER_BYTES_ + (index << shift);
+  const uint64_t size = chunk_size_(index, total, shift);
+  mac_(ctx, ctx->mac, chunk, size);
+  if (!threecrypt_ct_equal(ctx->mac, entry + ENTRY_TAG_, MAC_BYTES_))
+    return false;
+  threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, entry);
+  threecrypt_ctr_xor(&ctx->ctr, output, chunk, size, 0);
+  return true;
+}
+
+void
+chunked_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename)
+{
+  SSC_assertMsg(
+   input_map->size >= (HEADER_BYTES_ + TRAILER_BYTES_),
+   "Error: The input file %s is too small to be a Chunked_V1 encrypted file.\n", filename);
+  const uint8_t* const in = input_map->ptr;
+  const uint8_t* const keying = in + KEYING_OFFSET_;
+  const uint64_t total = threecrypt_load64(in + input_map->size - TRAILER_BYTES_);
+  const uint8_t shift = in[SHIFT_OFFSET_];
+  printf("File Header for %s\n", filename);
+  printf("Method             : Chunked_V1\n");
+  keying_dump(keying);
+  threecrypt_print_hex("Tweak              : ", in + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+  if (shift < 64) {
+    printf("Chunk Size         : %" PRIu64 " bytes\n", UINT64_C(1) << shift);
+    printf("Chunks             : %" PRIu64 "\n", chunk_count_(total, shift));
+  }
+  printf("Plaintext Size     : %" PRIu64 " bytes\n", total);
+}
+
+#endif /* ! THREECRYPT_CHUNKED_V1_H */
@@ -0,0 +1,123 @@
+#if !defined(THREECRYPT_CHUNKED_V1_H) && defined(THREECRYPT_EXTERN_ENABLE_CHUNKED_V1)
+#define THREECRYPT_CHUNKED_V1_H
+
+#include <SSC/Macro.h>
+#include <SSC/MemMap.h>
+#include <PPQ/CSPRNG.h>
+#include "Keying.h"
+#include "Primitive.h"
+
+/* Chunked_V1 encrypted files store fixed-size chunks of ciphertext at fixed offsets,
+ * so a file can be updated by re-encrypting and rewriting only the chunks that changed.
+ *
+ * Layout:
+ *   Header:
+ *     ID          (THREECRYPT_CHUNKED_V1_ID_NBYTES)
+ *     Keying      (THREECRYPT_KEYING_BYTES)
+ *     Tweak       (PPQ_THREEFISH512_TWEAK_BYTES)
+ *     Chunk Shift (1 byte; chunks are 2^Chunk Shift bytes)
+ *     Header MAC  (64), MAC of the above.
+ *   Chunks, for i = 0 .. Count - 1:
+ *     Ciphertext  (2^Chunk Shift bytes; the last chunk may be shorter)
+ *   Table, for i = 0 .. Count - 1:
+ *     CTR IV      (THREECRYPT_CTR_IV_BYTES), fresh whenever chunk i is re-encrypted.
+ *     Digest      (THREECRYPT_CHUNKED_V1_DIGEST_BYTES), keyed digest of i and chunk i's plaintext.
+ *     Chunk Tag   (64), MAC of chunk i's ciphertext.
+ *   Trailer:
+ *     Total       (8 bytes, little-endian; total plaintext bytes, which determines Count)
+ *     Table MAC   (64), MAC of the Table and Total.
+ *
+ * Chunk i's position in the table binds it to its index, and the Table MAC binds the table
+ * together. The digests are keyed, so they reveal nothing about the plaintext beyond whether
+ * a chunk changed between updates, which the ciphertext reveals anyway. Updating a file
+ * authenticates the header and table, digests the new plaintext, and re-encrypts only chunks
+ * whose digests differ; unchanged ciphertext is never rewritten, so block-level replication
+ * of the encrypted file only transfers what changed. */
+#define THREECRYPT_CHUNKED_V1_ID                   "3CRYPT_CHUNKED_V1"
+#define THREECRYPT_CHUNKED_V1_ID_NBYTES            18
+#define THREECRYPT_CHUNKED_V1_MAC_BYTES            64
+#define THREECRYPT_CHUNKED_V1_DIGEST_BYTES         32
+#define THREECRYPT_CHUNKED_V1_HEADER_BYTES         (\
+ THREECRYPT_CHUNKED_V1_ID_NBYTES +\
+ THREECRYPT_KEYING_BYTES +\
+ PPQ_THREEFISH512_TWEAK_BYTES +\
+ 1 +\
+ THREECRYPT_CHUNKED_V1_MAC_BYTES)
+#define THREECRYPT_CHUNKED_V1_ENTRY_BYTES          (\
+ THREECRYPT_CTR_IV_BYTES +\
+ THREECRYPT_CHUNKED_V1_DIGEST_BYTES +\
+ THREECRYPT_CHUNKED_V1_MAC_BYTES)
+#define THREECRYPT_CHUNKED_V1_TRAILER_BYTES        (8 + THREECRYPT_CHUNKED_V1_MAC_BYTES)
+#define THREECRYPT_CHUNKED_V1_KEYING_OFFSET        THREECRYPT_CHUNKED_V1_ID_NBYTES
+#define THREECRYPT_CHUNKED_V1_DEFAULT_CHUNK_SHIFT  UINT8_C(20) /* 1 MiB chunks. */
+#define THREECRYPT_CHUNKED_V1_MIN_CHUNK_SHIFT      UINT8_C(12)
+#define THREECRYPT_CHUNKED_V1_MAX_CHUNK_SHIFT      UINT8_C(30)
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  Threecrypt_Keying keying;
+  Threecrypt_Ctr    ctr;
+  PPQ_CSPRNG        csprng; /* Only used when updating. */
+  uint64_t          enc_key    [PPQ_THREEFISH512_EXTERNAL_KEY_WORDS];
+  uint64_t          tweak      [PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS];
+  uint8_t           auth_key   [PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t           digest_key [PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t           derived    [PPQ_THREEFISH512_BLOCK_BYTES * 3];
+  uint8_t           mac        [THREECRYPT_CHUNKED_V1_MAC_BYTES];
+  uint8_t           buffer     [8 + THREECRYPT_CHUNKED_V1_MAC_BYTES];
+  uint8_t           chunk_shift; /* Chunk shift of new files, or of the file opened by chunked_v1_open(). */
+} Threecrypt_ChunkedV1;
+
+/* Make the Chunked_V1 file of @output_map hold the plaintext of the mapped @input_map.
+ * If @output_map->size is zero, @output_map is an open, empty file, and a new Chunked_V1
+ * file is created with the keying parameters in @ctx->keying and chunks of 2^@ctx->chunk_shift bytes.
+ * Otherwise @output_map must be an existing Chunked_V1 file, opened read-write and mapped, and only
+ * the chunks whose plaintext changed are re-encrypted and rewritten. @ctx->keying.secret and @ctx->csprng
+ * must be initialized. Dies without modifying an existing file if its header or table fail to
+ * authenticate. An existing file is rewritten under a journal, so a crash leaves it whole, either
+ * as it was or updated. Unmaps and closes both files. */
+void
+chunked_v1_update(
+ Threecrypt_ChunkedV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map,
+ const char* R_           output_filename);
+
+/* Authenticate every chunk of the mapped @input_map, then decrypt them into @output_map,
+ * whose file must already be open. @ctx->keying must be loaded and its secret initialized.
+ * On failure @output_filename is removed and we die. Unmaps and closes both files. */
+void
+chunked_v1_decrypt(
+ Threecrypt_ChunkedV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map,
+ const char* R_           output_filename);
+
+/* Authenticate the header and table of the mapped Chunked_V1 file @input_map, deriving its keys into @ctx,
+ * its plaintext size into @total and its chunk shift into @ctx->chunk_shift, so that its chunks can be read
+ * one at a time with chunked_v1_read_chunk(). @ctx->keying must be loaded and its secret initialized.
+ * Returns an error message, or SSC_NULL. */
+const char*
+chunked_v1_open(Threecrypt_ChunkedV1* R_ ctx, const SSC_MemMap* R_ input_map, uint64_t* R_ total);
+
+/* Authenticate chunk @index of the @total plaintext byte Chunked_V1 file @input_map, opened with chunked_v1_open(),
+ * and decrypt it into @output, which must have room for 2^@ctx->chunk_shift bytes.
+ * Returns false, without writing @output, if the chunk fails to authenticate. */
+bool
+chunked_v1_read_chunk(
+ Threecrypt_ChunkedV1* R_ ctx,
+ const SSC_MemMap* R_     input_map,
+ uint64_t                 total,
+ uint64_t                 index,
+ uint8_t* R_              output);
+
+/* Print the header and trailer of the Chunked_V1 file mapped by @input_map. */
+void
+chunked_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif
@@ -9,7 +9,7 @@
 #define R_ SSC_RESTRICT
 
 static const char* const mode_strings[THREECRYPT_MODE_MCOUNT] = {
-  "None", "Encrypt", "Decrypt", "Dump"
+  "None", "Encrypt", "Decrypt", "Dump", "Append", "Update", "Archive", "List", "Extract", "View"
 };
 
 typedef Threecrypt_Mode_t Mode_t;
@@ -30,6 +30,40 @@ set_mode_(
 }
 /*=========================================================================================================================*/
 
+#ifdef THREECRYPT_ARCHIVE_V1_H
+int archive_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  return set_mode_((Threecrypt*)state, THREECRYPT_MODE_ARCHIVE, argv[0], offset);
+}
+
+int extract_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  Threecrypt* ctx = (Threecrypt*)state;
+  SSC_assertMsg((ctx->mode == THREECRYPT_MODE_NONE), "Error: 3crypt mode already set to %s!\n", mode_strings[ctx->mode]);
+  ctx->mode = THREECRYPT_MODE_EXTRACT;
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  if (ap.to_read) {
+    ctx->member_name = (char*)SSC_mallocOrDie(ap.size + 1);
+    ctx->member_name_size = ap.size;
+    memcpy(ctx->member_name, ap.to_read, ap.size + 1);
+  }
+  return ap.consumed;
+}
+
+int list_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  return set_mode_((Threecrypt*)state, THREECRYPT_MODE_LIST, argv[0], offset);
+}
+#endif
+
+#ifdef THREECRYPT_SEGMENTED_V1_H
+int append_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  return set_mode_((Threecrypt*)state, THREECRYPT_MODE_APPEND, argv[0], offset);
+}
+#endif
+
 int decrypt_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
 {
   return set_mode_((Threecrypt*)state, THREECRYPT_MODE_SYMMETRIC_DEC, argv[0], offset);
@@ -91,6 +125,51 @@ int input_argproc(const int argc, char** R_ argv, const int offset, void* R_ sta
   return ap.consumed;
 }
 
+int keyfile_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  Threecrypt* ctx = (Threecrypt*)state;
+  SSC_assertMsg((ctx->keyfile_filename == SSC_NULL), "Error: Already specified %s as %s!\n", "keyfile", ctx->keyfile_filename);
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  if (ap.to_read) {
+    ctx->keyfile_filename = (char*)SSC_mallocOrDie(ap.size + 1);
+    ctx->keyfile_filename_size = ap.size;
+    memcpy(ctx->keyfile_filename, ap.to_read, ap.size + 1);
+  }
+  return ap.consumed;
+}
+
+#ifdef THREECRYPT_CHUNKED_V1_H
+int update_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  return set_mode_((Threecrypt*)state, THREECRYPT_MODE_UPDATE, argv[0], offset);
+}
+#endif
+
+#if THREECRYPT_USE_LAZY_VIEW
+int view_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  Threecrypt* ctx = (Threecrypt*)state;
+  SSC_assertMsg((ctx->mode == THREECRYPT_MODE_NONE), "Error: 3crypt mode already set to %s!\n", mode_strings[ctx->mode]);
+  ctx->mode = THREECRYPT_MODE_VIEW;
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  if (ap.to_read) {
+    /* <offset>[:<length>] */
+    char* const range = (char*)SSC_mallocOrDie(ap.size + 1);
+    memcpy(range, ap.to_read, ap.size + 1);
+    char* const length = strchr(range, ':');
+    if (length)
+      *length = '\0';
+    ctx->view_offset = dfly_v1_parse_padding(range, (int)strlen(range));
+    if (length)
+      ctx->view_length = dfly_v1_parse_padding(length + 1, (int)strlen(length + 1));
+    free(range);
+  }
+  return ap.consumed;
+}
+#endif
+
 #ifdef PPQ_DRAGONFLY_V1_H
 typedef uint8_t Dfly_V1_U8_f(const char* R_, const int);
 
@@ -162,6 +241,220 @@ int output_argproc(const int argc, char** R_ argv, const int offset, void* R_ st
   return ap.consumed;
 }
 
+int method_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  Threecrypt* ctx = (Threecrypt*)state;
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  if (ap.to_read) {
+    Threecrypt_Method_t method = THREECRYPT_METHOD_NONE;
+#if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
+    if (!strcmp(ap.to_read, "dragonfly_v1"))
+      method = THREECRYPT_METHOD_DRAGONFLY_V1;
+#endif
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+    if (!strcmp(ap.to_read, "dragonfly_v2"))
+      method = THREECRYPT_METHOD_DRAGONFLY_V2;
+#endif
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+    if (!strcmp(ap.to_read, "keyfile_v1"))
+      method = THREECRYPT_METHOD_KEYFILE_V1;
+#endif
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+    if (!strcmp(ap.to_read, "sparse_v1"))
+      method = THREECRYPT_METHOD_SPARSE_V1;
+#endif
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+    if (!strcmp(ap.to_read, "xchacha_v1"))
+      method = THREECRYPT_METHOD_XCHACHA_V1;
+#endif
+    SSC_assertMsg(method != THREECRYPT_METHOD_NONE, "Error: Unrecognized method '%s'! See 3crypt --help=encrypt.\n", ap.to_read);
+    ctx->method = method;
+  }
+  return ap.consumed;
+}
+
+#if THREECRYPT_USE_KDF_BUDGET
+int kdf_budget_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  Threecrypt* ctx = (Threecrypt*)state;
+  if (ap.to_read)
+    ctx->kdf_budget = dfly_v1_parse_padding(ap.to_read, ap.size);
+  return ap.consumed;
+}
+
+int kdf_ledger_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  Threecrypt* ctx = (Threecrypt*)state;
+  SSC_assertMsg(ctx->kdf_ledger_filename == SSC_NULL, "Error: Already specified %s as %s!\n", "key-derivation ledger", ctx->kdf_ledger_filename);
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  if (ap.to_read) {
+    ctx->kdf_ledger_filename = (char*)SSC_mallocOrDie(ap.size + 1);
+    ctx->kdf_ledger_filename_size = ap.size;
+    memcpy(ctx->kdf_ledger_filename, ap.to_read, ap.size + 1);
+  }
+  return ap.consumed;
+}
+#endif
+
+#if THREECRYPT_USE_THROTTLE
+int max_io_rate_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  Threecrypt* ctx = (Threecrypt*)state;
+  if (ap.to_read) {
+    ctx->max_io_rate = dfly_v1_parse_padding(ap.to_read, ap.size);
+    SSC_assertMsg(ctx->max_io_rate, "Error: The maximum I/O rate must be at least one byte per second.\n");
+  }
+  return ap.consumed;
+}
+
+int max_cpu_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  Threecrypt* ctx = (Threecrypt*)state;
+  if (ap.to_read) {
+    char* end;
+    long percent = strtol(ap.to_read, &end, 10);
+    if (*end == '%')
+      ++end;
+    SSC_assertMsg(
+     (end != ap.to_read) && (*end == '\0') && (percent >= 1) && (percent <= 100),
+     "Error: Invalid CPU percentage: %s\n", ap.to_read);
+    ctx->max_cpu = (unsigned)percent;
+  }
+  return ap.consumed;
+}
+
+int ionice_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  Threecrypt* ctx = (Threecrypt*)state;
+  if (ap.to_read) {
+    /* <class>[:<level>] */
+    const char* level = strchr(ap.to_read, ':');
+    const size_t class_size = level ? (size_t)(level - ap.to_read) : (size_t)ap.size;
+    #define CLASS_IS_(Name) ((class_size == sizeof(Name) - 1) && !memcmp(ap.to_read, Name, class_size))
+    if (CLASS_IS_("idle"))
+      ctx->ionice_class = THREECRYPT_IONICE_IDLE;
+    else if (CLASS_IS_("best-effort"))
+      ctx->ionice_class = THREECRYPT_IONICE_BEST_EFFORT;
+    else if (CLASS_IS_("realtime"))
+      ctx->ionice_class = THREECRYPT_IONICE_REALTIME;
+    else
+      SSC_errx("Error: Unrecognized I/O scheduling class '%s'! See 3crypt --help.\n", ap.to_read);
+    #undef CLASS_IS_
+    if (level) {
+      SSC_assertMsg(
+       (level[1] >= '0') && (level[1] <= '7') && (level[2] == '\0'),
+       "Error: I/O priority levels range from 0 to 7!\n");
+      ctx->ionice_level = level[1] - '0';
+    }
+  }
+  return ap.consumed;
+}
+#endif
+
+#if THREECRYPT_USE_WINDOW
+int window_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  Threecrypt* ctx = (Threecrypt*)state;
+  if (ap.to_read)
+    ctx->window = dfly_v1_parse_padding(ap.to_read, ap.size);
+  return ap.consumed;
+}
+#endif
+
+#if THREECRYPT_USE_DURABILITY
+int durability_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  Threecrypt* ctx = (Threecrypt*)state;
+  if (ap.to_read) {
+    #define POLICY_IS_(Name) (((size_t)ap.size == sizeof(Name) - 1) && !memcmp(ap.to_read, Name, (size_t)ap.size))
+    if (POLICY_IS_("none"))
+      ctx->durability = THREECRYPT_DURABILITY_NONE;
+    else if (POLICY_IS_("file"))
+      ctx->durability = THREECRYPT_DURABILITY_FILE;
+    else if (POLICY_IS_("batch"))
+      ctx->durability = THREECRYPT_DURABILITY_BATCH;
+    else
+      SSC_errx("Error: Unrecognized durability policy '%s'! See 3crypt --help.\n", ap.to_read);
+    #undef POLICY_IS_
+  }
+  return ap.consumed;
+}
+#endif
+
+#ifdef THREECRYPT_SEGMENTED_V1_H
+int resume_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  Threecrypt* ctx = (Threecrypt*)state;
+  ctx->resume = true;
+  return SSC_1opt(argv[0][offset]);
+}
+#endif
+
+#ifdef THREECRYPT_SPARSE_V1_H
+int sparse_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  Threecrypt* ctx = (Threecrypt*)state;
+  ctx->method = THREECRYPT_METHOD_SPARSE_V1;
+  return SSC_1opt(argv[0][offset]);
+}
+#endif
+
+int recursive_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  Threecrypt* ctx = (Threecrypt*)state;
+  ctx->recursive = true;
+  return SSC_1opt(argv[0][offset]);
+}
+
+int passphrase_fd_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  Threecrypt* ctx = (Threecrypt*)state;
+  SSC_assertMsg(
+   (ctx->passphrase_fd == THREECRYPT_PASSPHRASE_FD_NONE) && (ctx->passphrase_filename == SSC_NULL),
+   "Error: Already specified where to read the passphrase from!\n");
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  if (ap.to_read) {
+    char* end;
+    long fd = strtol(ap.to_read, &end, 10);
+    SSC_assertMsg(
+     (end != ap.to_read) && (*end == '\0') && (fd >= 0) && (fd <= INT_MAX),
+     "Error: Invalid passphrase file descriptor: %s\n", ap.to_read);
+    ctx->passphrase_fd = (int)fd;
+  }
+  return ap.consumed;
+}
+
+int passphrase_file_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
+{
+  Threecrypt* ctx = (Threecrypt*)state;
+  SSC_assertMsg(
+   (ctx->passphrase_fd == THREECRYPT_PASSPHRASE_FD_NONE) && (ctx->passphrase_filename == SSC_NULL),
+   "Error: Already specified where to read the passphrase from!\n");
+  SSC_ArgParser ap;
+  SSC_ArgParser_init(&ap, argv[0] + offset, argc, argv);
+  if (ap.to_read) {
+    ctx->passphrase_filename = (char*)SSC_mallocOrDie(ap.size + 1);
+    ctx->passphrase_filename_size = ap.size;
+    memcpy(ctx->passphrase_filename, ap.to_read, ap.size + 1);
+  }
+  return ap.consumed;
+}
+
 #ifdef PPQ_DRAGONFLY_V1_H
 
 int pad_as_if_argproc(const int argc, char** R_ argv, const int offset, void* R_ state)
@@ -7,6 +7,22 @@
 #define R_ SSC_RESTRICT
 SSC_BEGIN_C_DECLS
 
+#ifdef THREECRYPT_SEGMENTED_V1_H
+int
+append_argproc(const int, char** R_, const int, void* R_);
+#endif
+
+#ifdef THREECRYPT_ARCHIVE_V1_H
+int
+archive_argproc(const int, char** R_, const int, void* R_);
+
+int
+extract_argproc(const int, char** R_, const int, void* R_);
+
+int
+list_argproc(const int, char** R_, const int, void* R_);
+#endif
+
 int
 decrypt_argproc(const int, char** R_, const int, void* R_);
 
@@ -25,6 +41,9 @@ help_argproc(const int, char** R_, const int, void* R_);
 int
 input_argproc(const int, char** R_, const int, void* R_);
 
+int
+keyfile_argproc(const int, char** R_, const int, void* R_);
+
 int
 iterations_argproc(const int, char** R_, const int, void* R_);
 
@@ -39,6 +58,57 @@ min_memory_argproc(const int, char** R_, const int, void* R_);
 int
 output_argproc(const int, char** R_, const int, void* R_);
 
+int
+method_argproc(const int, char** R_, const int, void* R_);
+
+#if THREECRYPT_USE_KDF_BUDGET
+int
+kdf_budget_argproc(const int, char** R_, const int, void* R_);
+
+int
+kdf_ledger_argproc(const int, char** R_, const int, void* R_);
+#endif
+
+#if THREECRYPT_USE_THROTTLE
+int
+max_io_rate_argproc(const int, char** R_, const int, void* R_);
+
+int
+max_cpu_argproc(const int, char** R_, const int, void* R_);
+
+int
+ionice_argproc(const int, char** R_, const int, void* R_);
+#endif
+
+#if THREECRYPT_USE_WINDOW
+int
+window_argproc(const int, char** R_, const int, void* R_);
+#endif
+
+#if THREECRYPT_USE_DURABILITY
+int
+durability_argproc(const int, char** R_, const int, void* R_);
+#endif
+
+#ifdef THREECRYPT_SEGMENTED_V1_H
+int
+resume_argproc(const int, char** R_, const int, void* R_);
+#endif
+
+#ifdef THREECRYPT_SPARSE_V1_H
+int
+sparse_argproc(const int, char** R_, const int, void* R_);
+#endif
+
+int
+recursive_argproc(const int, char** R_, const int, void* R_);
+
+int
+passphrase_fd_argproc(const int, char** R_, const int, void* R_);
+
+int
+passphrase_file_argproc(const int, char** R_, const int, void* R_);
+
 #ifdef PPQ_DRAGONFLY_V1_H
 int
 pad_as_if_argproc(const int, char** R_, const int, void* R_);
@@ -56,6 +126,16 @@ int
 use_phi_argproc(const int, char** R_, const int, void* R_);
 #endif
 
+#ifdef THREECRYPT_CHUNKED_V1_H
+int
+update_argproc(const int, char** R_, const int, void* R_);
+#endif
+
+#if THREECRYPT_USE_LAZY_VIEW
+int
+view_argproc(const int, char** R_, const int, void* R_);
+#endif
+
 SSC_END_C_DECLS
 #undef R_
 
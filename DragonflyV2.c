@@ -0,0 +1,420 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For sysconf(_SC_NPROCESSORS_ONLN). */
+#endif
+#include <SSC/Operation.h>
+#include "DragonflyV2.h"
+#include "Prefetch.h"
+
+#ifdef THREECRYPT_DRAGONFLY_V2_H
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <pthread.h>
+ #include <unistd.h>
+#endif
+
+#define R_ SSC_RESTRICT
+
+#define MAC_BYTES_          THREECRYPT_DRAGONFLY_V2_MAC_BYTES
+#define HEADER_BYTES_       THREECRYPT_DRAGONFLY_V2_HEADER_BYTES
+#define FLAGS_OFFSET_       THREECRYPT_DRAGONFLY_V2_FLAGS_OFFSET
+#define KEYING_OFFSET_      THREECRYPT_DRAGONFLY_V2_KEYING_OFFSET
+#define TWEAK_OFFSET_       (KEYING_OFFSET_ + THREECRYPT_KEYING_BYTES)
+#define IV_OFFSET_          (TWEAK_OFFSET_ + PPQ_THREEFISH512_TWEAK_BYTES)
+#define CONFIRM_OFFSET_     (IV_OFFSET_ + THREECRYPT_CTR_IV_BYTES)
+#define BATCH_LEAVES_       256 /* Leaves that may be hashed ahead of the first not yet added to the tree. */
+#define MAX_THREADS_        64
+
+/* Derive the keys from @ctx->keying and the @header of a Dragonfly_V2 file, and key the cipher. */
+static void
+derive_keys_(Threecrypt_DragonflyV2* R_ ctx, const uint8_t* R_ header)
+{
+  keying_derive(
+   &ctx->keying,
+   header + KEYING_OFFSET_,
+   THREECRYPT_DRAGONFLY_V2_ID,
+   THREECRYPT_DRAGONFLY_V2_ID_NBYTES,
+   ctx->derived,
+   sizeof(ctx->derived));
+  memcpy(ctx->enc_key,  ctx->derived,                                PPQ_THREEFISH512_BLOCK_BYTES);
+  memcpy(ctx->auth_key, ctx->derived + PPQ_THREEFISH512_BLOCK_BYTES, PPQ_THREEFISH512_BLOCK_BYTES);
+  SSC_secureZero(ctx->derived, sizeof(ctx->derived));
+  memcpy(ctx->tweak, header + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+  threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, header + IV_OFFSET_);
+}
+
+/* MAC the @size bytes at @begin, storing the result in @ctx->mac. */
+static void
+mac_(Threecrypt_DragonflyV2* R_ ctx, const uint8_t* R_ begin, uint64_t size)
+{
+  PPQ_Skein512_mac(&ctx->keying.ubi512, ctx->mac, begin, ctx->auth_key, MAC_BYTES_, size);
+}
+
+/* Tree-mode MACs. The workers are started once per file. Every worker has its own cipher state and
+ * windows, and claims the next leaf to hash until none are left, as long as it falls within
+ * BATCH_LEAVES_ of the first leaf not yet added to the tree. Chaining values are added in order by
+ * whichever worker completes the leaf they are waiting on, which frees its slot for a later leaf. */
+typedef struct {
+  Threecrypt_DragonflyV2* ctx;
+  SSC_MemMap*             message;      /* The file being authenticated; the output when encrypting. */
+  SSC_MemMap*             plaintext;    /* The input when encrypting, otherwise SSC_NULL. */
+  uint64_t                message_size; /* The bytes of @message before the MAC. */
+  uint64_t                leaves;
+  uint64_t                next;         /* The next leaf to claim. */
+  uint64_t                added;        /* The leaves already added to the tree. */
+  bool                    done            [BATCH_LEAVES_];
+  uint8_t                 chaining_values [BATCH_LEAVES_ * MAC_BYTES_]; /* Leaf i's in slot i % BATCH_LEAVES_. */
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_mutex_t         lock;
+  pthread_cond_t          added_more;
+#endif
+} Work_;
+
+/* Claim the next leaf into @i, waiting for its slot if need be. Returns false once every leaf is claimed.
+ * @work->lock must be held. */
+static bool
+claim_(Work_* R_ work, uint64_t* R_ i)
+{
+  while ((work->next < work->leaves) && (work->next >= (work->added + BATCH_LEAVES_))) {
+#if defined(SSC_OS_UNIXLIKE)
+    pthread_cond_wait(&work->added_more, &work->lock);
+#endif
+  }
+  if (work->next >= work->leaves)
+    return false;
+  *i = work->next++;
+  return true;
+}
+
+/* Mark leaf @i hashed, and add every chaining value now ready to the tree, in order.
+ * @work->lock must be held. */
+static void
+complete_(Work_* R_ work, uint64_t i)
+{
+  work->done[i % BATCH_LEAVES_] = true;
+  const uint64_t added = work->added;
+  while ((work->added < work->leaves) && work->done[work->added % BATCH_LEAVES_]) {
+    const size_t slot = (size_t)(work->added % BATCH_LEAVES_);
+    threecrypt_tree_mac_add(&work->ctx->tree_mac, work->chaining_values + (slot * MAC_BYTES_));
+    work->done[slot] = false;
+    ++work->added;
+  }
+#if defined(SSC_OS_UNIXLIKE)
+  if (work->added != added)
+    pthread_cond_broadcast(&work->added_more);
+#else
+  (void)added;
+#endif
+}
+
+/* Hash leaf @index of the message, storing its chaining value at @chaining_value. When encrypting,
+ * the part of the leaf past the header is encrypted first, from the plaintext or, for the padding
+ * size and padding, in place, since the file was extended with zeroes. */
+static void
+hash_leaf_(
+ Work_* R_             work,
+ Threecrypt_Ctr* R_    ctr,
+ Threecrypt_Window* R_ message,
+ Threecrypt_Window* R_ plaintext,
+ uint64_t              index,
+ uint8_t* R_           chaining_value)
+{
+  Threecrypt_DragonflyV2* const ctx = work->ctx;
+  Threecrypt_Mac leaf;
+  const uint64_t begin = index * ctx->tree_mac.leaf_bytes;
+  uint64_t end = begin + ctx->tree_mac.leaf_bytes;
+  if (end > work->message_size)
+    end = work->message_size;
+  const uint64_t plaintext_offset = HEADER_BYTES_ + 8 + ctx->padding;
+  threecrypt_tree_mac_leaf_init(&ctx->tree_mac, &leaf, index);
+  for (uint64_t offset = begin; offset < end; ) {
+    uint64_t n = end - offset;
+    if (!work->plaintext || (offset < HEADER_BYTES_)) {
+      if (work->plaintext && (n > (HEADER_BYTES_ - offset)))
+        n = HEADER_BYTES_ - offset;
+      const uint8_t* const src = threecrypt_window_get(message, offset, &n);
+      threecrypt_mac_update(&leaf, src, n);
+    } else {
+      uint8_t* const dst = threecrypt_window_get(message, offset, &n);
+      const uint8_t* src = dst;
+      if (offset < plaintext_offset) {
+        if (n > (plaintext_offset - offset))
+          n = plaintext_offset - offset;
+      } else
+        src = threecrypt_window_get(plaintext, offset - plaintext_offset, &n);
+      threecrypt_ctr_xor(ctr, dst, src, n, offset - HEADER_BYTES_);
+      threecrypt_mac_update(&leaf, dst, n);
+    }
+    offset += n;
+  }
+  threecrypt_tree_mac_leaf_final(&leaf, chaining_value);
+}
+
+static void*
+leaf_worker_(void* arg)
+{
+  Work_* const work = (Work_*)arg;
+  Threecrypt_Ctr    ctr;
+  Threecrypt_Window message;
+  Threecrypt_Window plaintext = {0};
+  memcpy(&ctr, &work->ctx->ctr, sizeof(ctr));
+  threecrypt_window_open(&message, work->message, !work->plaintext);
+  if (work->plaintext)
+    threecrypt_window_open(&plaintext, work->plaintext, true);
+  uint64_t i;
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_mutex_lock(&work->lock);
+#endif
+  while (claim_(work, &i)) {
+#if defined(SSC_OS_UNIXLIKE)
+    pthread_mutex_unlock(&work->lock);
+#endif
+    /* The slot is ours until the leaf is completed. */
+    hash_leaf_(work, &ctr, &message, &plaintext, i, work->chaining_values + ((i % BATCH_LEAVES_) * MAC_BYTES_));
+#if defined(SSC_OS_UNIXLIKE)
+    pthread_mutex_lock(&work->lock);
+#endif
+    complete_(work, i);
+  }
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_mutex_unlock(&work->lock);
+#endif
+  threecrypt_window_release(&message);
+  if (work->plaintext)
+    threecrypt_window_release(&plaintext);
+  SSC_secureZero(&ctr, sizeof(ctr));
+  return SSC_NULL;
+}
+
+static size_t
+thread_count_(uint64_t count)
+{
+  long n = THREECRYPT_DRAGONFLY_V2_THREADS;
+#if defined(SSC_OS_UNIXLIKE) && defined(_SC_NPROCESSORS_ONLN)
+  if (n <= 0)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (n <= 0)
+    n = 1;
+  if (n > MAX_THREADS_)
+    n = MAX_THREADS_;
+  return ((uint64_t)n < count) ? (size_t)n : (count ? (size_t)count : 1);
+}
+
+/* Hash every leaf of the message of @work into @ctx->tree_mac, which must be initialized. */
+static void
+hash_leaves_(Work_* R_ work)
+{
+  work->leaves = threecrypt_tree_mac_leaves(&work->ctx->tree_mac);
+  work->next   = 0;
+  work->added  = 0;
+  memset(work->done, 0, sizeof(work->done));
+  const size_t n = thread_count_(work->leaves);
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_t threads [MAX_THREADS_];
+  size_t started = 0;
+  pthread_mutex_init(&work->lock, SSC_NULL);
+  pthread_cond_init(&work->added_more, SSC_NULL);
+  /* The calling thread is a worker too. */
+  for (; (started + 1) < n; ++started) {
+    if (pthread_create(&threads[started], SSC_NULL, leaf_worker_, work))
+      break; /* Carry on with fewer threads. */
+  }
+  leaf_worker_(work);
+  for (size_t i = 0; i < started; ++i)
+    pthread_join(threads[i], SSC_NULL);
+  pthread_cond_destroy(&work->added_more);
+  pthread_mutex_destroy(&work->lock);
+#else
+  (void)n;
+  leaf_worker_(work);
+#endif
+  SSC_assertMsg(work->added == work->leaves, "Error: Not every leaf was added to the tree!\n");
+  SSC_secureZero(work->chaining_values, sizeof(work->chaining_values));
+}
+
+void
+dragonfly_v2_encrypt(
+ Threecrypt_DragonflyV2* R_ ctx,
+ SSC_MemMap* R_             input_map,
+ SSC_MemMap* R_             output_map)
+{
+  const uint64_t size = (uint64_t)input_map->size;
+  SSC_assertMsg(
+   ctx->padding <= (SIZE_MAX - THREECRYPT_DRAGONFLY_V2_METADATA_BYTES - size),
+   "Error: Too many padding bytes (%" PRIu64 ")!\n", ctx->padding);
+  const uint64_t body_size = 8 + ctx->padding + size;
+  Threecrypt_Window in, out;
+  threecrypt_window_open(&in, input_map, true);
+  output_map->size = (size_t)(HEADER_BYTES_ + body_size + MAC_BYTES_);
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  threecrypt_window_open(&out, output_map, false);
+  {
+    uint64_t n = HEADER_BYTES_;
+    uint8_t* const header = threecrypt_window_get(&out, 0, &n);
+    memcpy(header, THREECRYPT_DRAGONFLY_V2_ID, THREECRYPT_DRAGONFLY_V2_ID_NBYTES);
+    header[FLAGS_OFFSET_] = THREECRYPT_DRAGONFLY_V2_FLAG_TREE_MAC;
+    keying_store(&ctx->keying, header + KEYING_OFFSET_, &ctx->csprng);
+    PPQ_CSPRNG_get(&ctx->csprng, header + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES + THREECRYPT_CTR_IV_BYTES);
+    Threecrypt_Prefetch prefetch = {0};
+    if (ctx->keying.kind == THREECRYPT_KEYING_PASSWORD)
+      threecrypt_prefetch_begin(&prefetch, input_map, 0, output_map);
+    derive_keys_(ctx, header);
+    threecrypt_prefetch_end(&prefetch);
+    mac_(ctx, header, CONFIRM_OFFSET_);
+    memcpy(header + CONFIRM_OFFSET_, ctx->mac, MAC_BYTES_);
+  }
+  {
+    uint64_t n = 8;
+    threecrypt_store64(threecrypt_window_get(&out, HEADER_BYTES_, &n), ctx->padding);
+  }
+  threecrypt_tree_mac_init(
+   &ctx->tree_mac,
+   ctx->auth_key,
+   MAC_BYTES_,
+   HEADER_BYTES_ + body_size,
+   THREECRYPT_DRAGONFLY_V2_LEAF_LOG2,
+   THREECRYPT_DRAGONFLY_V2_FANOUT_LOG2);
+  {
+    Work_ work;
+    work.ctx          = ctx;
+    work.message      = output_map;
+    work.plaintext    = input_map;
+    work.message_size = HEADER_BYTES_ + body_size;
+    hash_leaves_(&work);
+  }
+  {
+    uint64_t n = MAC_BYTES_;
+    threecrypt_tree_mac_final(&ctx->tree_mac, threecrypt_window_get(&out, HEADER_BYTES_ + body_size, &n));
+  }
+  threecrypt_window_close(&out);
+  threecrypt_window_close(&in);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+/* Confirm the key and authenticate the Dragonfly_V2 file of @in, storing the number of padding
+ * bytes in @padding. Returns an error message, or SSC_NULL. */
+static const char*
+authenticate_(Threecrypt_DragonflyV2* R_ ctx, Threecrypt_Window* R_ in, uint64_t* R_ padding)
+{
+  const uint64_t size = (uint64_t)in->map->size;
+  if (size < THREECRYPT_DRAGONFLY_V2_METADATA_BYTES)
+    return "Error: The file is too small to be a Dragonfly_V2 encrypted file.\n";
+  uint8_t flags;
+  {
+    uint64_t n = HEADER_BYTES_;
+    const uint8_t* const header = threecrypt_window_get(in, 0, &n);
+    flags = header[FLAGS_OFFSET_];
+    if (flags & ~THREECRYPT_DRAGONFLY_V2_KNOWN_FLAGS)
+      return "Error: The file uses Dragonfly_V2 features this version of 3crypt does not support.\n";
+    /* The MAC pass reads the file from the beginning. */
+    Threecrypt_Prefetch prefetch = {0};
+    if (ctx->keying.kind == THREECRYPT_KEYING_PASSWORD)
+      threecrypt_prefetch_begin(&prefetch, in->map, 0, SSC_NULL);
+    derive_keys_(ctx, header);
+    threecrypt_prefetch_end(&prefetch);
+    /* A wrong password or keyfile is rejected here, right after key-derivation, without reading the ciphertext. */
+    mac_(ctx, header, CONFIRM_OFFSET_);
+    if (!threecrypt_ct_equal(ctx->mac, header + CONFIRM_OFFSET_, MAC_BYTES_))
+      return "Error: Authentication failed. Wrong password or keyfile, or the header has been corrupted.\n";
+  }
+  if (flags & THREECRYPT_DRAGONFLY_V2_FLAG_TREE_MAC) {
+    threecrypt_tree_mac_init(
+     &ctx->tree_mac,
+     ctx->auth_key,
+     MAC_BYTES_,
+     size - MAC_BYTES_,
+     THREECRYPT_DRAGONFLY_V2_LEAF_LOG2,
+     THREECRYPT_DRAGONFLY_V2_FANOUT_LOG2);
+    Work_ work;
+    work.ctx          = ctx;
+    work.message      = in->map;
+    work.plaintext    = SSC_NULL;
+    work.message_size = size - MAC_BYTES_;
+    hash_leaves_(&work);
+    threecrypt_tree_mac_final(&ctx->tree_mac, ctx->mac);
+  } else {
+    threecrypt_mac_init(&ctx->body_mac, ctx->auth_key, MAC_BYTES_);
+    for (uint64_t done = 0; done < (size - MAC_BYTES_); ) {
+      uint64_t n = size - MAC_BYTES_ - done;
+      const uint8_t* const src = threecrypt_window_get(in, done, &n);
+      threecrypt_mac_update(&ctx->body_mac, src, n);
+      done += n;
+    }
+    threecrypt_mac_final(&ctx->body_mac, ctx->mac);
+  }
+  {
+    uint64_t n = MAC_BYTES_;
+    if (!threecrypt_ct_equal(ctx->mac, threecrypt_window_get(in, size - MAC_BYTES_, &n), MAC_BYTES_))
+      return "Error: Authentication failed. The file has been corrupted or truncated.\n";
+  }
+  uint8_t field [8];
+  {
+    uint64_t n = sizeof(field);
+    threecrypt_ctr_xor(&ctx->ctr, field, threecrypt_window_get(in, HEADER_BYTES_, &n), sizeof(field), 0);
+  }
+  *padding = threecrypt_load64(field);
+  if (*padding > (size - THREECRYPT_DRAGONFLY_V2_METADATA_BYTES))
+    return "Error: The file has an invalid padding size.\n";
+  return SSC_NULL;
+}
+
+void
+dragonfly_v2_decrypt(
+ Threecrypt_DragonflyV2* R_ ctx,
+ SSC_MemMap* R_             input_map,
+ SSC_MemMap* R_             output_map,
+ const char* R_             output_filename)
+{
+  Threecrypt_Window in;
+  uint64_t padding;
+  threecrypt_window_open(&in, input_map, true);
+  const char* error = authenticate_(ctx, &in, &padding);
+  if (error) {
+    threecrypt_window_close(&in);
+    SSC_File_closeOrDie(input_map->file);
+    SSC_File_closeOrDie(output_map->file);
+    remove(output_filename);
+    SSC_errx("%s", error);
+  }
+  output_map->size = (size_t)(input_map->size - THREECRYPT_DRAGONFLY_V2_METADATA_BYTES - padding);
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  Threecrypt_Window out;
+  threecrypt_window_open(&out, output_map, false);
+  const uint64_t first = HEADER_BYTES_ + 8 + padding;
+  for (uint64_t done = 0; done < (uint64_t)output_map->size; ) {
+    uint64_t n = (uint64_t)output_map->size - done;
+    const uint8_t* const src = threecrypt_window_get(&in, first + done, &n);
+    uint8_t* const dst = threecrypt_window_get(&out, done, &n);
+    threecrypt_ctr_xor(&ctx->ctr, dst, src, n, 8 + padding + done);
+    done += n;
+  }
+  threecrypt_window_close(&out);
+  threecrypt_window_close(&in);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+void
+dragonfly_v2_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename)
+{
+  SSC_assertMsg(
+   input_map->size >= THREECRYPT_DRAGONFLY_V2_METADATA_BYTES,
+   "Error: The input file %s is too small to be a Dragonfly_V2 encrypted file.\n", filename);
+  const uint8_t* const in = input_map->ptr;
+  const uint8_t* const keying = in + KEYING_OFFSET_;
+  printf("File Header for %s\n", filename);
+  printf("Method             : Dragonfly_V2\n");
+  printf("Flags              : 0x%02x\n", (unsigned)in[FLAGS_OFFSET_]);
+  printf(
+   "MAC                : %s\n",
+   (in[FLAGS_OFFSET_] & THREECRYPT_DRAGONFLY_V2_FLAG_TREE_MAC) ? "Skein-512 Tree, 1 MiB Leaves" : "Skein-512");
+  keying_dump(keying);
+  threecrypt_print_hex("Tweak              : ", in + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+  threecrypt_print_hex("CTR IV             : ", in + IV_OFFSET_, THREECRYPT_CTR_IV_BYTES);
+  printf(
+   "Encrypted Size     : %" PRIu64 " bytes, including padding\n",
+   (uint64_t)(input_map->size - THREECRYPT_DRAGONFLY_V2_METADATA_BYTES));
+}
+
+#endif /* ! THREECRYPT_DRAGONFLY_V2_H */
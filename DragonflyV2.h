@@ -0,0 +1,105 @@
+#if !defined(THREECRYPT_DRAGONFLY_V2_H) && defined(THREECRYPT_EXTERN_ENABLE_DRAGONFLY_V2)
+#define THREECRYPT_DRAGONFLY_V2_H
+
+#include <SSC/Macro.h>
+#include <SSC/MemMap.h>
+#include <PPQ/CSPRNG.h>
+#include "Keying.h"
+#include "Primitive.h"
+#include "Window.h"
+
+/* Dragonfly_V2 encrypted files are Dragonfly_V1 files revised so that a wrong password is rejected
+ * immediately after key-derivation. Dragonfly_V1 can only tell a wrong password from a corrupted
+ * file by MACing the whole ciphertext; Dragonfly_V2 stores a key-confirmation tag in its header,
+ * so rejecting a typo costs the key-derivation and nothing more. The whole file is still
+ * authenticated before any plaintext is written.
+ *
+ * Layout:
+ *   Header:
+ *     ID               (THREECRYPT_DRAGONFLY_V2_ID_NBYTES)
+ *     Flags            (1), THREECRYPT_DRAGONFLY_V2_FLAG_* bits; unknown bits are rejected.
+ *     Keying           (THREECRYPT_KEYING_BYTES)
+ *     Tweak            (PPQ_THREEFISH512_TWEAK_BYTES)
+ *     CTR IV           (THREECRYPT_CTR_IV_BYTES)
+ *     Key Confirmation (64), Skein-512 MAC of the above.
+ *   Encrypted, with keystream beginning at byte 0:
+ *     Padding Size     (8 bytes, little-endian)
+ *     Padding          (Padding Size), zeroes.
+ *     Plaintext
+ *   MAC                (64), Skein-512 MAC of everything before it.
+ *
+ * The padding size is encrypted, so padding hides the size of the plaintext as Dragonfly_V1's does.
+ *
+ * With THREECRYPT_DRAGONFLY_V2_FLAG_TREE_MAC, which 3crypt sets on every file it encrypts, the MAC is
+ * a Skein-512 tree-mode MAC with leaves of 2^THREECRYPT_DRAGONFLY_V2_LEAF_LOG2 blocks (1 MiB) and
+ * nodes of 2^THREECRYPT_DRAGONFLY_V2_FANOUT_LOG2 chaining values. Its leaves are encrypted and hashed
+ * in parallel, THREECRYPT_DRAGONFLY_V2_THREADS at a time, so authentication scales with cores instead
+ * of running at the speed of one sequential Skein chain. Files without the flag use the sequential MAC. */
+#define THREECRYPT_DRAGONFLY_V2_ID              "3CRYPT_DRAGONFLY_V2"
+#define THREECRYPT_DRAGONFLY_V2_ID_NBYTES       20
+#define THREECRYPT_DRAGONFLY_V2_MAC_BYTES       64
+#define THREECRYPT_DRAGONFLY_V2_FLAG_TREE_MAC  0x01
+#define THREECRYPT_DRAGONFLY_V2_KNOWN_FLAGS     THREECRYPT_DRAGONFLY_V2_FLAG_TREE_MAC
+#define THREECRYPT_DRAGONFLY_V2_LEAF_LOG2       14
+#define THREECRYPT_DRAGONFLY_V2_FANOUT_LOG2     8
+#define THREECRYPT_DRAGONFLY_V2_HEADER_BYTES    (\
+ THREECRYPT_DRAGONFLY_V2_ID_NBYTES +\
+ 1 +\
+ THREECRYPT_KEYING_BYTES +\
+ PPQ_THREEFISH512_TWEAK_BYTES +\
+ THREECRYPT_CTR_IV_BYTES +\
+ THREECRYPT_DRAGONFLY_V2_MAC_BYTES)
+#define THREECRYPT_DRAGONFLY_V2_METADATA_BYTES  (THREECRYPT_DRAGONFLY_V2_HEADER_BYTES + 8 + THREECRYPT_DRAGONFLY_V2_MAC_BYTES)
+#define THREECRYPT_DRAGONFLY_V2_FLAGS_OFFSET    THREECRYPT_DRAGONFLY_V2_ID_NBYTES
+#define THREECRYPT_DRAGONFLY_V2_KEYING_OFFSET   (THREECRYPT_DRAGONFLY_V2_FLAGS_OFFSET + 1)
+#ifdef THREECRYPT_EXTERN_DRAGONFLY_V2_THREADS
+ #define THREECRYPT_DRAGONFLY_V2_THREADS THREECRYPT_EXTERN_DRAGONFLY_V2_THREADS
+#else
+ #define THREECRYPT_DRAGONFLY_V2_THREADS 0 /* One per online processor. */
+#endif
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  Threecrypt_Keying  keying;
+  Threecrypt_Ctr     ctr;
+  PPQ_CSPRNG         csprng;   /* Only used when encrypting. */
+  uint64_t           padding;  /* Only used when encrypting; the number of padding bytes to add. */
+  uint64_t           enc_key   [PPQ_THREEFISH512_EXTERNAL_KEY_WORDS];
+  uint64_t           tweak     [PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS];
+  uint8_t            auth_key  [PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t            derived   [PPQ_THREEFISH512_BLOCK_BYTES * 2];
+  uint8_t            mac       [THREECRYPT_DRAGONFLY_V2_MAC_BYTES];
+  Threecrypt_Mac     body_mac; /* Only used to decrypt files without the tree MAC. */
+  Threecrypt_TreeMac tree_mac;
+} Threecrypt_DragonflyV2;
+
+/* Encrypt @input_map into @output_map, whose files must already be open, with the keying parameters
+ * in @ctx->keying, adding @ctx->padding bytes of padding. The files are mapped whole or a window at
+ * a time, as threecrypt_window_bytes() directs. @ctx->keying.secret and @ctx->csprng must be
+ * initialized. Unmaps and closes both files. */
+void
+dragonfly_v2_encrypt(
+ Threecrypt_DragonflyV2* R_ ctx,
+ SSC_MemMap* R_             input_map,
+ SSC_MemMap* R_             output_map);
+
+/* Confirm the key, authenticate @input_map, then decrypt it into @output_map, whose files must
+ * already be open, mapping them as dragonfly_v2_encrypt() does. @ctx->keying must be loaded and its
+ * secret initialized. On failure @output_filename is removed and we die. Unmaps and closes both files. */
+void
+dragonfly_v2_decrypt(
+ Threecrypt_DragonflyV2* R_ ctx,
+ SSC_MemMap* R_             input_map,
+ SSC_MemMap* R_             output_map,
+ const char* R_             output_filename);
+
+/* Print the header of the Dragonfly_V2 file mapped by @input_map. */
+void
+dragonfly_v2_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif
@@ -0,0 +1,230 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For syncfs() and renameat2(). */
+#endif
+#include <errno.h>
+#include <stdio.h>
+#include <SSC/Operation.h>
+#include "Durability.h"
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <fcntl.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+#define R_ SSC_RESTRICT
+
+static int Policy_ = THREECRYPT_DURABILITY_DEFAULT;
+
+#if defined(SSC_OS_UNIXLIKE)
+/* Outputs of the current group, complete under their temporary names. */
+static char*  Temp_[THREECRYPT_DURABILITY_GROUP_FILES];
+static char*  Final_[THREECRYPT_DURABILITY_GROUP_FILES];
+static size_t Pending_ = 0;
+
+/* Returns a newly allocated copy of @s. */
+static char*
+copy_(const char* R_ s)
+{
+  const size_t size = strlen(s) + 1;
+  char* const copy = (char*)SSC_mallocOrDie(size);
+  memcpy(copy, s, size);
+  return copy;
+}
+
+/* Sync the file or directory @filename. */
+static void
+sync_path_(const char* R_ filename)
+{
+  const int fd = open(filename, O_RDONLY);
+  SSC_assertMsg(fd != -1, "Error: Failed to open %s to sync it (%s)!\n", filename, strerror(errno));
+  SSC_assertMsg(!fsync(fd), "Error: Failed to sync %s (%s)!\n", filename, strerror(errno));
+  close(fd);
+}
+
+/* Rename @temp_filename to @output_filename, which must not exist; unlike rename(), never replace it.
+ * Outputs may be committed long after their names were checked, and a file that appeared there since wins. */
+static void
+rename_(const char* R_ temp_filename, const char* R_ output_filename)
+{
+  int result;
+#ifdef RENAME_NOREPLACE
+  result = renameat2(AT_FDCWD, temp_filename, AT_FDCWD, output_filename, RENAME_NOREPLACE);
+  if (result && ((errno == EINVAL) || (errno == ENOSYS)))
+#endif
+  {
+    /* Without renameat2(), or on a filesystem that does not support it, link() refuses to replace too. */
+    result = link(temp_filename, output_filename);
+    if (!result)
+      SSC_assertMsg(!unlink(temp_filename), "Error: Failed to remove %s (%s)!\n", temp_filename, strerror(errno));
+  }
+  SSC_assertMsg(
+   !result || (errno != EEXIST),
+   "Error: The output file %s already seems to exist; the output was left as %s.\n", output_filename, temp_filename);
+  SSC_assertMsg(
+   !result,
+   "Error: Failed to rename %s to %s (%s)!\n", temp_filename, output_filename, strerror(errno));
+}
+
+/* Sync the data of every pending output. Linux syncs each filesystem holding one at once. */
+static void
+sync_pending_data_(void)
+{
+#if defined(__linux__)
+  dev_t synced[THREECRYPT_DURABILITY_GROUP_FILES];
+  size_t synced_count = 0;
+  for (size_t i = 0; i < Pending_; ++i) {
+    const int fd = open(Temp_[i], O_RDONLY);
+    SSC_assertMsg(fd != -1, "Error: Failed to open %s to sync it (%s)!\n", Temp_[i], strerror(errno));
+    struct stat st;
+    SSC_assertMsg(!fstat(fd, &st), "Error: Failed to stat %s (%s)!\n", Temp_[i], strerror(errno));
+    bool seen = false;
+    for (size_t j = 0; (j < synced_count) && !seen; ++j)
+      seen = (synced[j] == st.st_dev);
+    if (!seen) {
+      SSC_assertMsg(!syncfs(fd), "Error: Failed to sync the filesystem holding %s (%s)!\n", Temp_[i], strerror(errno));
+      synced[synced_count++] = st.st_dev;
+    }
+    close(fd);
+  }
+#else
+  for (size_t i = 0; i < Pending_; ++i)
+    sync_path_(Temp_[i]);
+#endif
+}
+#endif /* ! SSC_OS_UNIXLIKE */
+
+void
+durability_configure(int policy)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  SSC_assert((policy >= THREECRYPT_DURABILITY_DEFAULT) && (policy <= THREECRYPT_DURABILITY_BATCH));
+  Policy_ = policy;
+#else
+  if (policy != THREECRYPT_DURABILITY_DEFAULT)
+    SSC_errx("Error: Durability policies are not supported on this platform.\n");
+#endif
+}
+
+bool
+durability_is_configured(void)
+{
+  return Policy_ != THREECRYPT_DURABILITY_DEFAULT;
+}
+
+bool
+durability_sync_on_close(void)
+{
+  return (Policy_ == THREECRYPT_DURABILITY_DEFAULT) || (Policy_ == THREECRYPT_DURABILITY_FILE);
+}
+
+void
+durability_sync_map(SSC_MemMap* R_ map)
+{
+  if (durability_sync_on_close())
+    SSC_MemMap_syncOrDie(map);
+}
+
+char*
+durability_temp_name(const char* R_ output_filename)
+{
+  const size_t size = strlen(output_filename) + sizeof(THREECRYPT_DURABILITY_TEMP_SUFFIX);
+  char* temp = (char*)SSC_mallocOrDie(size);
+  snprintf(temp, size, "%s" THREECRYPT_DURABILITY_TEMP_SUFFIX, output_filename);
+  return temp;
+}
+
+char*
+durability_parent(const char* R_ filename)
+{
+  const char* const slash = strrchr(filename, '/');
+  size_t size;
+  if (!slash) {
+    filename = ".";
+    size = 1;
+  } else if (slash == filename) {
+    size = 1;
+  } else {
+    size = (size_t)(slash - filename);
+  }
+  char* parent = (char*)SSC_mallocOrDie(size + 1);
+  memcpy(parent, filename, size);
+  parent[size] = '\0';
+  return parent;
+}
+
+void
+durability_sync_parent(const char* R_ filename)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  char* parent = durability_parent(filename);
+  sync_path_(parent);
+  free(parent);
+#else
+  (void)filename;
+#endif
+}
+
+void
+durability_commit(const char* R_ temp_filename, const char* R_ output_filename)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  switch (Policy_) {
+    case THREECRYPT_DURABILITY_NONE:
+      rename_(temp_filename, output_filename);
+      break;
+    case THREECRYPT_DURABILITY_FILE:
+      /* The data was synced as the output was closed. */
+      rename_(temp_filename, output_filename);
+      durability_sync_parent(output_filename);
+      break;
+    case THREECRYPT_DURABILITY_BATCH:
+      if (Pending_ == THREECRYPT_DURABILITY_GROUP_FILES)
+        durability_flush();
+      Temp_[Pending_]  = copy_(temp_filename);
+      Final_[Pending_] = copy_(output_filename);
+      ++Pending_;
+      break;
+    default:
+      SSC_errx("Error: No durability policy was configured!\n");
+  }
+#else
+  (void)temp_filename;
+  (void)output_filename;
+  SSC_errx("Error: Durability policies are not supported on this platform.\n");
+#endif
+}
+
+void
+durability_flush(void)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  if (!Pending_)
+    return;
+  /* Every output's data must be on disk before any of its names, and every name before we return. */
+  sync_pending_data_();
+  for (size_t i = 0; i < Pending_; ++i)
+    rename_(Temp_[i], Final_[i]);
+  char* synced[THREECRYPT_DURABILITY_GROUP_FILES];
+  size_t synced_count = 0;
+  for (size_t i = 0; i < Pending_; ++i) {
+    char* parent = durability_parent(Final_[i]);
+    bool seen = false;
+    for (size_t j = 0; (j < synced_count) && !seen; ++j)
+      seen = !strcmp(parent, synced[j]);
+    if (seen) {
+      free(parent);
+      continue;
+    }
+    sync_path_(parent);
+    synced[synced_count++] = parent;
+  }
+  for (size_t i = 0; i < synced_count; ++i)
+    free(synced[i]);
+  for (size_t i = 0; i < Pending_; ++i) {
+    free(Temp_[i]);
+    free(Final_[i]);
+  }
+  Pending_ = 0;
+#endif
+}
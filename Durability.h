@@ -0,0 +1,78 @@
+#ifndef THREECRYPT_DURABILITY_H
+#define THREECRYPT_DURABILITY_H
+
+#include <SSC/Macro.h>
+#include <SSC/MemMap.h>
+
+/* How the outputs of encryption and decryption reach the disk, chosen with --durability.
+ *
+ * By default each output is written in place under its own name and synced as it is closed.
+ * Under any of the policies, each output is instead written under a temporary name beside it,
+ * "<output>" THREECRYPT_DURABILITY_TEMP_SUFFIX, and renamed into place once it is complete, so
+ * no output ever appears under its name partially written:
+ *   none:  Nothing is synced. Fastest, but a crash may lose recent outputs, renamed or not.
+ *   file:  Each output is synced before it is renamed, and its directory after.
+ *   batch: Outputs are committed in groups of up to THREECRYPT_DURABILITY_GROUP_FILES. The data of
+ *          the whole group is synced at once, every output renamed, then each directory synced
+ *          once. As crash-safe as file, for a few syncs per group instead of two per file.
+ * After a crash, an output either exists whole under its name or not at all, and any temporary
+ * files left behind may be removed.
+ *
+ * Every encrypted or decrypted output, --view's included, is synced through durability_sync_map()
+ * or the window it was written through. The syncs outside the policy happen even under none:
+ * an in-place update (--append, --update) is synced before its journal is removed, as is a
+ * replayed journal, and a --resume segment before the checkpoint that records it, since recovery
+ * depends on that order; and a generated keyfile is always synced, since losing it loses every
+ * file it keys. */
+#define THREECRYPT_DURABILITY_DEFAULT     0
+#define THREECRYPT_DURABILITY_NONE        1
+#define THREECRYPT_DURABILITY_FILE        2
+#define THREECRYPT_DURABILITY_BATCH       3
+#define THREECRYPT_DURABILITY_TEMP_SUFFIX ".3c-tmp"
+#define THREECRYPT_DURABILITY_GROUP_FILES 1024
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+/* Write outputs under @policy, one of THREECRYPT_DURABILITY_*. */
+void
+durability_configure(int policy);
+
+/* Returns true if a policy other than the default was configured. */
+bool
+durability_is_configured(void);
+
+/* Returns true if outputs are synced as each is closed. */
+bool
+durability_sync_on_close(void);
+
+/* Sync the mapped output @map, if outputs are synced as each is closed. */
+void
+durability_sync_map(SSC_MemMap* R_ map);
+
+/* Returns the temporary name @output_filename is to be written under, which the caller frees. */
+char*
+durability_temp_name(const char* R_ output_filename);
+
+/* Returns the directory holding @filename, which the caller frees. */
+char*
+durability_parent(const char* R_ filename);
+
+/* Sync the directory holding @filename, so that its creation, renaming or removal is durable.
+ * Does nothing where directories cannot be synced. */
+void
+durability_sync_parent(const char* R_ filename);
+
+/* Put the complete output written as @temp_filename into place as @output_filename,
+ * now or with the rest of its group. Never replaces an existing @output_filename. */
+void
+durability_commit(const char* R_ temp_filename, const char* R_ output_filename);
+
+/* Commit every output still waiting for the rest of its group. */
+void
+durability_flush(void);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
@@ -0,0 +1,121 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For lstat(). */
+#endif
+#include <SSC/Operation.h>
+#include "FileList.h"
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <dirent.h>
+ #include <sys/stat.h>
+#endif
+
+#define R_ SSC_RESTRICT
+
+#if defined(SSC_OS_UNIXLIKE)
+static bool
+ends_with_(const char* R_ s, size_t size, const char* R_ suffix)
+{
+  const size_t suffix_size = strlen(suffix);
+  return (size >= suffix_size) && !memcmp(s + size - suffix_size, suffix, suffix_size);
+}
+
+static void
+push_(Threecrypt_FileList* R_ list, char* path)
+{
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? (list->capacity * 2) : 64;
+    list->paths = (char**)SSC_reallocOrDie(list->paths, list->capacity * sizeof(char*));
+  }
+  list->paths[list->count++] = path;
+}
+
+static int
+compare_(const void* a, const void* b)
+{
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void
+walk_(
+ Threecrypt_FileList* R_ list,
+ const char* R_          directory,
+ const char* R_          suffix,
+ const char* R_          skip_suffix)
+{
+  DIR* dir = opendir(directory);
+  SSC_assertMsg(dir != SSC_NULL, "Error: Failed to open the directory %s!\n", directory);
+  const size_t directory_size = strlen(directory);
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != SSC_NULL) {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      continue;
+    const size_t name_size = strlen(entry->d_name);
+    char* path = (char*)SSC_mallocOrDie(directory_size + 1 + name_size + 1);
+    memcpy(path, directory, directory_size);
+    path[directory_size] = '/';
+    memcpy(path + directory_size + 1, entry->d_name, name_size + 1);
+    struct stat st;
+    bool keep = false;
+    if (!lstat(path, &st)) {
+      if (S_ISDIR(st.st_mode))
+        walk_(list, path, suffix, skip_suffix);
+      else if (S_ISREG(st.st_mode))
+        keep = suffix ?
+         ends_with_(entry->d_name, name_size, suffix) :
+         (!skip_suffix || !ends_with_(entry->d_name, name_size, skip_suffix));
+    }
+    if (keep)
+      push_(list, path);
+    else
+      free(path);
+  }
+  closedir(dir);
+}
+#endif
+
+void
+file_list_collect(
+ Threecrypt_FileList* R_ list,
+ const char* R_          root,
+ const char* R_          suffix,
+ const char* R_          skip_suffix)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  walk_(list, root, suffix, skip_suffix);
+  if (list->count)
+    qsort(list->paths, list->count, sizeof(char*), compare_);
+#else
+  SSC_errx("Error: Recursive operation is not supported on this platform.\n");
+#endif
+}
+
+void
+file_list_exclude(Threecrypt_FileList* R_ list, const char* R_ path)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  struct stat excluded;
+  if (stat(path, &excluded))
+    return;
+  size_t kept = 0;
+  for (size_t i = 0; i < list->count; ++i) {
+    struct stat st;
+    if (!lstat(list->paths[i], &st) && (st.st_dev == excluded.st_dev) && (st.st_ino == excluded.st_ino))
+      free(list->paths[i]);
+    else
+      list->paths[kept++] = list->paths[i];
+  }
+  list->count = kept;
+#else
+  (void)list;
+  (void)path;
+#endif
+}
+
+void
+file_list_free(Threecrypt_FileList* R_ list)
+{
+  for (size_t i = 0; i < list->count; ++i)
+    free(list->paths[i]);
+  free(list->paths);
+  *list = THREECRYPT_FILELIST_NULL_LITERAL;
+}
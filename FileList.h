@@ -0,0 +1,42 @@
+#ifndef THREECRYPT_FILELIST_H
+#define THREECRYPT_FILELIST_H
+
+#include <SSC/Macro.h>
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+/* A list of the regular files beneath a directory, for recursive operation. */
+typedef struct {
+  char** paths;
+  size_t count;
+  size_t capacity;
+} Threecrypt_FileList;
+
+#define THREECRYPT_FILELIST_NULL_LITERAL SSC_COMPOUND_LITERAL(Threecrypt_FileList, SSC_NULL, 0, 0)
+
+/* Collect the paths of the regular files beneath the directory @root into @list, sorted.
+ * Symbolic links are not followed. If @suffix is not NULL, only files whose names end
+ * in @suffix are collected; otherwise only files whose names do not end in @skip_suffix are,
+ * or every file if @skip_suffix is NULL too.
+ * Dies if @root is not a directory that can be read. */
+void
+file_list_collect(
+ Threecrypt_FileList* R_ list,
+ const char* R_          root,
+ const char* R_          suffix,
+ const char* R_          skip_suffix);
+
+/* Remove from @list every path naming the same file as @path, such as an output created beneath
+ * the collected directory. Does nothing if @path does not exist. */
+void
+file_list_exclude(Threecrypt_FileList* R_ list, const char* R_ path);
+
+/* Free the paths of @list, and the list itself. */
+void
+file_list_free(Threecrypt_FileList* R_ list);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
@@ -0,0 +1,203 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For fileno() and fsync(). */
+#endif
+#include <errno.h>
+#include <SSC/Operation.h>
+#include <SSC/MemMap.h>
+#include "Journal.h"
+#include "Durability.h"
+#include "Primitive.h"
+
+#if   defined(SSC_OS_UNIXLIKE)
+ #include <unistd.h>
+ #define SYNC_FILE_(File) fsync(fileno(File))
+#elif defined(SSC_OS_WINDOWS)
+ #include <io.h>
+ #define SYNC_FILE_(File) _commit(_fileno(File))
+#endif
+
+#define R_ SSC_RESTRICT
+
+#define SEAL_         UINT64_MAX
+#define BUFFER_BYTES_ 65536
+
+/* Write the 8 byte little-endian @value to the journal. */
+static void
+write64_(Threecrypt_Journal* R_ journal, uint64_t value)
+{
+  uint8_t bytes [8];
+  threecrypt_store64(bytes, value);
+  SSC_assertMsg(fwrite(bytes, 1, sizeof(bytes), journal->file) == sizeof(bytes), "Error: Failed to write the journal %s!\n", journal->filename);
+}
+
+/* Flush and sync the journal to the disk. */
+static void
+sync_(Threecrypt_Journal* R_ journal)
+{
+  SSC_assertMsg(
+   !fflush(journal->file) && !SYNC_FILE_(journal->file),
+   "Error: Failed to sync the journal %s!\n", journal->filename);
+}
+
+/* Read an 8 byte little-endian value from @f into @value. Returns false at the end of the file. */
+static bool
+read64_(FILE* R_ f, uint64_t* R_ value)
+{
+  uint8_t bytes [8];
+  if (fread(bytes, 1, sizeof(bytes), f) != sizeof(bytes))
+    return false;
+  *value = threecrypt_load64(bytes);
+  return true;
+}
+
+/* Read the @size bytes that follow in @f into @dest, or skip them if @dest is SSC_NULL.
+ * Returns false if the file ends first. */
+static bool
+read_bytes_(FILE* R_ f, uint8_t* dest, uint64_t size, uint8_t* R_ buffer)
+{
+  while (size) {
+    const size_t n = (size < BUFFER_BYTES_) ? (size_t)size : BUFFER_BYTES_;
+    if (fread(dest ? dest : buffer, 1, n, f) != n)
+      return false;
+    if (dest)
+      dest += n;
+    size -= n;
+  }
+  return true;
+}
+
+/* Check that the journal @f, positioned after its ID, is sealed and every record lies within
+ * @original_size bytes. Returns false if it was never sealed, and dies if it is sealed but malformed. */
+static bool
+check_(FILE* R_ f, const char* R_ name, uint64_t original_size, uint8_t* R_ buffer)
+{
+  uint64_t count = 0;
+  uint64_t offset;
+  uint64_t size;
+  while (read64_(f, &offset) && read64_(f, &size)) {
+    if (offset == SEAL_) {
+      SSC_assertMsg((size == count) && (fgetc(f) == EOF), "Error: The journal %s is malformed!\n", name);
+      return true;
+    }
+    SSC_assertMsg(
+     (offset <= original_size) && (size <= (original_size - offset)),
+     "Error: The journal %s is malformed!\n", name);
+    if (!read_bytes_(f, SSC_NULL, size, buffer))
+      return false;
+    ++count;
+  }
+  return false;
+}
+
+char*
+threecrypt_journal_name(const char* R_ filename)
+{
+  return threecrypt_with_suffix(filename, THREECRYPT_JOURNAL_SUFFIX);
+}
+
+void
+threecrypt_journal_begin(Threecrypt_Journal* R_ journal, const char* R_ filename, uint64_t original_size)
+{
+  journal->filename = threecrypt_journal_name(filename);
+  journal->original_size = original_size;
+  journal->count = 0;
+  /* An existing journal belongs to a rewrite that has not been rolled back yet; never replace it. */
+  journal->file = fopen(journal->filename, "wbx");
+  SSC_assertMsg(journal->file != SSC_NULL, "Error: Failed to create the journal %s!\n", journal->filename);
+  SSC_assertMsg(
+   fwrite(THREECRYPT_JOURNAL_ID, 1, THREECRYPT_JOURNAL_ID_NBYTES, journal->file) == THREECRYPT_JOURNAL_ID_NBYTES,
+   "Error: Failed to write the journal %s!\n", journal->filename);
+  write64_(journal, original_size);
+}
+
+void
+threecrypt_journal_save(Threecrypt_Journal* R_ journal, const uint8_t* R_ file, uint64_t offset, uint64_t size)
+{
+  if (offset >= journal->original_size)
+    return; /* Beyond the original end; truncating the file undoes it. */
+  if (size > (journal->original_size - offset))
+    size = journal->original_size - offset;
+  if (!size)
+    return;
+  write64_(journal, offset);
+  write64_(journal, size);
+  SSC_assertMsg(
+   fwrite(file + offset, 1, (size_t)size, journal->file) == (size_t)size,
+   "Error: Failed to write the journal %s!\n", journal->filename);
+  ++journal->count;
+}
+
+void
+threecrypt_journal_seal(Threecrypt_Journal* R_ journal)
+{
+  /* The records must be on the disk before the seal that vouches for them. */
+  sync_(journal);
+  write64_(journal, SEAL_);
+  write64_(journal, journal->count);
+  sync_(journal);
+  durability_sync_parent(journal->filename);
+}
+
+void
+threecrypt_journal_end(Threecrypt_Journal* R_ journal)
+{
+  if (!journal->filename)
+    return;
+  SSC_assertMsg(!fclose(journal->file), "Error: Failed to close the journal %s!\n", journal->filename);
+  SSC_assertMsg(!remove(journal->filename), "Error: Failed to remove the journal %s!\n", journal->filename);
+  durability_sync_parent(journal->filename);
+  free(journal->filename);
+  journal->filename = SSC_NULL;
+  journal->file = SSC_NULL;
+}
+
+bool
+threecrypt_journal_recover(const char* R_ filename)
+{
+  char* name = threecrypt_journal_name(filename);
+  FILE* f = fopen(name, "rb");
+  if (!f) {
+    free(name);
+    return false;
+  }
+  uint8_t  id [THREECRYPT_JOURNAL_ID_NBYTES];
+  const size_t id_size = fread(id, 1, sizeof(id), f);
+  /* A journal may have been abandoned partway through its ID, but a file that is not one at all is left alone. */
+  if (memcmp(id, THREECRYPT_JOURNAL_ID, id_size)) {
+    fclose(f);
+    SSC_errx("Error: %s is in the way of the journal of %s; move it elsewhere.\n", name, filename);
+  }
+  uint8_t* buffer = (uint8_t*)SSC_mallocOrDie(BUFFER_BYTES_);
+  uint64_t original_size = 0;
+  const bool sealed =
+   (id_size == sizeof(id)) &&
+   read64_(f, &original_size) &&
+   check_(f, name, original_size, buffer);
+  if (sealed) {
+    /* Restore the original size, then the original contents of every range. */
+    SSC_MemMap map = SSC_MEMMAP_NULL_LITERAL;
+    map.file = SSC_FilePath_openOrDie(filename, false);
+    map.size = (size_t)original_size;
+    SSC_File_setSizeOrDie(map.file, map.size);
+    if (map.size)
+      SSC_MemMap_mapOrDie(&map, false);
+    SSC_assertMsg(!fseek(f, THREECRYPT_JOURNAL_ID_NBYTES + 8, SEEK_SET), "Error: Failed to read the journal %s!\n", name);
+    uint64_t offset;
+    uint64_t size;
+    while (read64_(f, &offset) && read64_(f, &size) && (offset != SEAL_))
+      SSC_assertMsg(read_bytes_(f, map.ptr + offset, size, buffer), "Error: Failed to read the journal %s!\n", name);
+    if (map.size) {
+      SSC_MemMap_syncOrDie(&map);
+      SSC_MemMap_unmapOrDie(&map);
+    }
+    SSC_File_closeOrDie(map.file);
+    fprintf(stderr, "Rolled back an interrupted rewrite of %s.\n", filename);
+  }
+  /* An unsealed journal was abandoned before the file was touched. */
+  fclose(f);
+  free(buffer);
+  SSC_assertMsg(!remove(name), "Error: Failed to remove the journal %s!\n", name);
+  durability_sync_parent(name);
+  free(name);
+  return sealed;
+}
@@ -0,0 +1,72 @@
+#ifndef THREECRYPT_JOURNAL_H
+#define THREECRYPT_JOURNAL_H
+
+#include <stdio.h>
+#include <SSC/Macro.h>
+
+/* Rollback journals make the in-place rewrites of --append and --update atomic.
+ *
+ * Before an existing file is rewritten, every byte of it about to be overwritten or truncated
+ * away is saved in "<file>" THREECRYPT_JOURNAL_SUFFIX, and the journal is sealed and synced.
+ * Only then is the file touched; once it has been synced, the journal is removed, which is the
+ * moment the rewrite takes effect. If 3crypt dies in between, the next 3crypt to append to,
+ * update, decrypt or view the file restores the saved bytes and the original size, so the file
+ * is always either as it was before the rewrite or as it is after it. A journal that was never
+ * sealed means the file was never touched, and is simply removed.
+ *
+ * Layout:
+ *   ID            (THREECRYPT_JOURNAL_ID_NBYTES)
+ *   Original Size (8 bytes, little-endian)
+ *   Records, for each saved range:
+ *     Offset      (8 bytes, little-endian)
+ *     Size        (8 bytes, little-endian)
+ *     Bytes       (Size), the original contents of the range.
+ *   Seal:
+ *     UINT64_MAX  (8 bytes)
+ *     Count       (8 bytes, little-endian; the number of records)
+ * The journal holds only ciphertext and authenticated metadata, so it needs no protection of its own. */
+#define THREECRYPT_JOURNAL_ID        "3CRYPT_JOURNAL_V1"
+#define THREECRYPT_JOURNAL_ID_NBYTES 18
+#define THREECRYPT_JOURNAL_SUFFIX    ".journal"
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  FILE*    file;
+  char*    filename;      /* The journal's own name, or SSC_NULL if none was begun. */
+  uint64_t original_size; /* The size of the file before it is rewritten. */
+  uint64_t count;         /* The number of records saved. */
+} Threecrypt_Journal;
+
+/* Returns the name of the journal of @filename, which the caller frees. */
+char*
+threecrypt_journal_name(const char* R_ filename);
+
+/* Begin journaling a rewrite of @filename, currently @original_size bytes.
+ * @journal must be zeroed beforehand, so threecrypt_journal_end() may be called whether or not one was begun. */
+void
+threecrypt_journal_begin(Threecrypt_Journal* R_ journal, const char* R_ filename, uint64_t original_size);
+
+/* Save the original contents of the @size bytes at @offset of the file mapped at @file, as far as they
+ * lie within its original size. */
+void
+threecrypt_journal_save(Threecrypt_Journal* R_ journal, const uint8_t* R_ file, uint64_t offset, uint64_t size);
+
+/* Seal and sync the journal. The file may be rewritten once this returns. */
+void
+threecrypt_journal_seal(Threecrypt_Journal* R_ journal);
+
+/* Remove the journal, once the rewritten file has been synced, committing the rewrite. */
+void
+threecrypt_journal_end(Threecrypt_Journal* R_ journal);
+
+/* If @filename has a journal, roll back the interrupted rewrite it records and remove it.
+ * Returns true if the file was rolled back. Dies if the journal is sealed but malformed. */
+bool
+threecrypt_journal_recover(const char* R_ filename);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
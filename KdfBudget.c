@@ -0,0 +1,254 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For flock(). */
+#endif
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <SSC/Operation.h>
+#include "KdfBudget.h"
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <fcntl.h>
+ #include <signal.h>
+ #include <sys/file.h>
+ #include <sys/stat.h>
+ #include <time.h>
+ #include <unistd.h>
+#endif
+
+#define R_ SSC_RESTRICT
+
+#define MEBIBYTE_       UINT64_C(1048576)
+#define MIN_WAIT_NSEC_  (50L * 1000L * 1000L)  /* Poll the ledger every 50ms at first, */
+#define MAX_WAIT_NSEC_  (999L * 1000L * 1000L) /* backing off to about once a second. */
+
+static uint64_t    Budget_ = 0;
+static const char* Ledger_ = SSC_NULL;
+static bool        Holding_ = false;
+
+#if defined(SSC_OS_UNIXLIKE) && !defined(THREECRYPT_KDF_LEDGER_DEFAULT)
+static char* Default_Ledger_ = SSC_NULL;
+
+/* Returns "@dir/@name", which the caller frees. */
+static char*
+join_(const char* R_ dir, const char* R_ name)
+{
+  const size_t dir_size = strlen(dir);
+  const size_t name_size = strlen(name);
+  char* path = (char*)SSC_mallocOrDie(dir_size + 1 + name_size + 1);
+  memcpy(path, dir, dir_size);
+  path[dir_size] = '/';
+  memcpy(path + dir_size + 1, name, name_size + 1);
+  return path;
+}
+
+/* Returns the user's own ledger, in $XDG_RUNTIME_DIR or else in ~/.cache, which the caller frees. */
+static char*
+default_ledger_(void)
+{
+  const char* runtime = getenv("XDG_RUNTIME_DIR");
+  if (runtime && runtime[0])
+    return join_(runtime, THREECRYPT_KDF_LEDGER_NAME);
+  const char* home = getenv("HOME");
+  SSC_assertMsg(
+   home && home[0],
+   "Error: Neither XDG_RUNTIME_DIR nor HOME is set; specify a key-derivation ledger with --kdf-ledger.\n");
+  char* cache = join_(home, ".cache");
+  SSC_assertMsg(
+   !mkdir(cache, 0700) || (errno == EEXIST),
+   "Error: Failed to create %s for the key-derivation ledger!\n", cache);
+  char* ledger = join_(cache, THREECRYPT_KDF_LEDGER_NAME);
+  free(cache);
+  return ledger;
+}
+#endif
+
+void kdf_budget_configure(uint64_t budget, const char* R_ ledger_filename)
+{
+#if !defined(SSC_OS_UNIXLIKE)
+  SSC_assertMsg(!budget, "Error: Key-derivation memory budgets are not supported on this platform.\n");
+#endif
+  Budget_ = budget;
+  if (!budget)
+    Ledger_ = SSC_NULL;
+  else if (ledger_filename)
+    Ledger_ = ledger_filename;
+  else {
+#if defined(THREECRYPT_KDF_LEDGER_DEFAULT)
+    Ledger_ = THREECRYPT_KDF_LEDGER_DEFAULT;
+#elif defined(SSC_OS_UNIXLIKE)
+    if (!Default_Ledger_)
+      Default_Ledger_ = default_ledger_();
+    Ledger_ = Default_Ledger_;
+#endif
+  }
+}
+
+const char* kdf_budget_ledger(void)
+{
+  return Ledger_;
+}
+
+uint64_t kdf_budget_bytes(uint8_t g_high)
+{
+  if (g_high >= 58)
+    return UINT64_MAX;
+  return UINT64_C(64) << g_high;
+}
+
+#if defined(SSC_OS_UNIXLIKE)
+typedef struct {
+  long     pid;
+  uint64_t bytes;
+  char     state; /* 'R'unning or 'W'aiting. */
+} Entry_;
+
+typedef struct {
+  Entry_* entries;
+  size_t  count;
+  size_t  capacity;
+  int     fd;
+} Ledger_t_;
+
+static void
+push_(Ledger_t_* R_ ledger, long pid, uint64_t bytes, char state)
+{
+  if (ledger->count == ledger->capacity) {
+    ledger->capacity = ledger->capacity ? (ledger->capacity * 2) : 16;
+    ledger->entries = (Entry_*)SSC_reallocOrDie(ledger->entries, ledger->capacity * sizeof(Entry_));
+  }
+  ledger->entries[ledger->count++] = (Entry_){pid, bytes, state};
+}
+
+/* Open and lock the ledger, then read its live entries. */
+static void
+lock_(Ledger_t_* R_ ledger)
+{
+  ledger->entries = SSC_NULL;
+  ledger->count = 0;
+  ledger->capacity = 0;
+  ledger->fd = open(Ledger_, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+  SSC_assertMsg(ledger->fd != -1, "Error: Failed to open the key-derivation ledger %s!\n", Ledger_);
+  /* Whoever owns the ledger decides when we may derive keys; it must be ourselves. */
+  struct stat st;
+  SSC_assertMsg(
+   !fstat(ledger->fd, &st) && S_ISREG(st.st_mode) && (st.st_uid == geteuid()),
+   "Error: The key-derivation ledger %s is not a regular file owned by you!\n", Ledger_);
+  while (flock(ledger->fd, LOCK_EX) == -1)
+    SSC_assertMsg(errno == EINTR, "Error: Failed to lock the key-derivation ledger %s!\n", Ledger_);
+  FILE* f = fdopen(dup(ledger->fd), "r");
+  SSC_assertMsg(f != SSC_NULL, "Error: Failed to read the key-derivation ledger %s!\n", Ledger_);
+  long     pid;
+  uint64_t bytes;
+  char     state;
+  while (fscanf(f, "%ld %" SCNu64 " %c", &pid, &bytes, &state) == 3) {
+    /* Prune the entries of processes that died without releasing their memory. */
+    if ((pid <= 0) || ((kill((pid_t)pid, 0) == -1) && (errno == ESRCH)))
+      continue;
+    if ((state == 'R') || (state == 'W'))
+      push_(ledger, pid, bytes, state);
+  }
+  fclose(f);
+}
+
+/* Rewrite the ledger with @ledger's entries, then unlock it. */
+static void
+unlock_(Ledger_t_* R_ ledger)
+{
+  char   line [64];
+  size_t size = 0;
+  char*  text = SSC_NULL;
+  for (size_t i = 0; i < ledger->count; ++i) {
+    const Entry_* e = &ledger->entries[i];
+    int n = snprintf(line, sizeof(line), "%ld %" PRIu64 " %c\n", e->pid, e->bytes, e->state);
+    text = (char*)SSC_reallocOrDie(text, size + (size_t)n);
+    memcpy(text + size, line, (size_t)n);
+    size += (size_t)n;
+  }
+  SSC_assertMsg(
+   (ftruncate(ledger->fd, 0) == 0) && (pwrite(ledger->fd, text, size, 0) == (ssize_t)size),
+   "Error: Failed to write the key-derivation ledger %s!\n", Ledger_);
+  free(text);
+  free(ledger->entries);
+  close(ledger->fd); /* Releases the lock. */
+}
+
+static Entry_*
+find_(Ledger_t_* R_ ledger, long pid)
+{
+  for (size_t i = 0; i < ledger->count; ++i) {
+    if (ledger->entries[i].pid == pid)
+      return &ledger->entries[i];
+  }
+  return SSC_NULL;
+}
+#endif /* ! SSC_OS_UNIXLIKE */
+
+void kdf_budget_reserve(uint8_t g_high)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  if (!Budget_)
+    return;
+  SSC_assertMsg(!Holding_, "Error: Key-derivation memory was reserved twice!\n");
+  const long     self = (long)getpid();
+  const uint64_t bytes = kdf_budget_bytes(g_high);
+  Ledger_t_ ledger;
+  long delay = MIN_WAIT_NSEC_;
+  bool announced = false;
+  for (;;) {
+    lock_(&ledger);
+    Entry_* mine = find_(&ledger, self);
+    if (!mine) {
+      push_(&ledger, self, bytes, 'W');
+      mine = &ledger.entries[ledger.count - 1];
+    }
+    /* Admit the first waiter once the running reservations leave room for it. */
+    uint64_t running = 0;
+    Entry_*  first_waiting = SSC_NULL;
+    for (size_t i = 0; i < ledger.count; ++i) {
+      Entry_* e = &ledger.entries[i];
+      if (e->state == 'R')
+        running = (running > UINT64_MAX - e->bytes) ? UINT64_MAX : (running + e->bytes);
+      else if (!first_waiting)
+        first_waiting = e;
+    }
+    const bool admit = (first_waiting == mine) && (!running || ((running <= Budget_) && (bytes <= Budget_ - running)));
+    if (admit)
+      mine->state = 'R';
+    unlock_(&ledger);
+    if (admit)
+      break;
+    if (!announced) {
+      fprintf(
+       stderr, "Waiting for %" PRIu64 " MiB of key-derivation memory (%" PRIu64 " MiB in use of a %" PRIu64 " MiB budget)...\n",
+       bytes / MEBIBYTE_, running / MEBIBYTE_, Budget_ / MEBIBYTE_);
+      announced = true;
+    }
+    struct timespec ts = {0, delay};
+    nanosleep(&ts, SSC_NULL);
+    delay = (delay * 2 > MAX_WAIT_NSEC_) ? MAX_WAIT_NSEC_ : (delay * 2);
+  }
+  Holding_ = true;
+#else
+  (void)g_high;
+#endif
+}
+
+void kdf_budget_release(void)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  if (!Holding_)
+    return;
+  const long self = (long)getpid();
+  Ledger_t_ ledger;
+  lock_(&ledger);
+  size_t kept = 0;
+  for (size_t i = 0; i < ledger.count; ++i) {
+    if (ledger.entries[i].pid != self)
+      ledger.entries[kept++] = ledger.entries[i];
+  }
+  ledger.count = kept;
+  unlock_(&ledger);
+  Holding_ = false;
+#endif
+}
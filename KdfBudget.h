@@ -0,0 +1,65 @@
+#ifndef THREECRYPT_KDFBUDGET_H
+#define THREECRYPT_KDFBUDGET_H
+
+#include <SSC/Macro.h>
+
+/* Admission control for memory-hard key-derivation.
+ *
+ * Catena consumes 64 * 2^g_high bytes, so several 3crypt processes starting at once on a shared
+ * host can easily exhaust its memory. When a budget is configured, every key-derivation first
+ * reserves its memory in a ledger file shared by all of the user's 3crypt processes, and waits
+ * in first-come first-served order until the reservations already running leave room for it.
+ * A key-derivation is always admitted when nothing else is running, even if it alone exceeds the budget.
+ *
+ * The ledger is a text file with one "<pid> <bytes> <R|W>" line per running (R) or waiting (W)
+ * key-derivation, in arrival order, guarded by an exclusive flock(). Entries of processes that
+ * no longer exist are pruned, so a killed process never holds memory it is not using.
+ *
+ * Unless a ledger is configured, it is THREECRYPT_KDF_LEDGER_NAME in $XDG_RUNTIME_DIR, or else in
+ * ~/.cache, which is created with mode 0700 if need be. Ledgers are opened without following
+ * symbolic links, created with mode 0600, and must be regular files owned by the user, so no
+ * other user can plant or tamper with one.
+ *
+ * The methods 3crypt implements itself hold a reservation only while Catena runs. Dragonfly_V1
+ * files are derived, encrypted and written inside a single PPQ_DragonflyV1_encrypt() or
+ * PPQ_DragonflyV1_decrypt() call, so their reservation is held for the whole call, I/O included,
+ * and a large Dragonfly_V1 file keeps others waiting until it is done. */
+#ifdef THREECRYPT_EXTERN_KDF_LEDGER
+ #define THREECRYPT_KDF_LEDGER_DEFAULT THREECRYPT_EXTERN_KDF_LEDGER
+#endif
+#define THREECRYPT_KDF_LEDGER_NAME "3crypt-kdf.ledger"
+#ifdef THREECRYPT_EXTERN_KDF_BUDGET_MIB
+ #define THREECRYPT_KDF_BUDGET_DEFAULT ((uint64_t)(THREECRYPT_EXTERN_KDF_BUDGET_MIB) * UINT64_C(1048576))
+#else
+ #define THREECRYPT_KDF_BUDGET_DEFAULT UINT64_C(0) /* No admission control. */
+#endif
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+/* Reserve at most @budget bytes of key-derivation memory through the ledger @ledger_filename,
+ * or the default ledger if it is NULL. A @budget of zero disables admission control. */
+void
+kdf_budget_configure(uint64_t budget, const char* R_ ledger_filename);
+
+/* Returns the ledger configured by kdf_budget_configure(), or SSC_NULL if admission control is disabled. */
+const char*
+kdf_budget_ledger(void);
+
+/* Returns the number of bytes Catena consumes with a garlic of @g_high. */
+uint64_t
+kdf_budget_bytes(uint8_t g_high);
+
+/* Wait until the memory for a key-derivation with a garlic of @g_high may be used, then reserve it.
+ * Returns immediately if admission control is disabled. */
+void
+kdf_budget_reserve(uint8_t g_high);
+
+/* Release the memory reserved by kdf_budget_reserve(). */
+void
+kdf_budget_release(void);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
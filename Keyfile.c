@@ -0,0 +1,69 @@
+#include <SSC/MemMap.h>
+#include <SSC/Operation.h>
+#include "Keyfile.h"
+
+#if   defined(SSC_OS_UNIXLIKE)
+ #include <fcntl.h>
+ #include <unistd.h>
+ #define CREATE_EXCL_(Path)    open(Path, O_WRONLY | O_CREAT | O_EXCL, 0600)
+ #define WRITE_(Fd, Buf, Size) write(Fd, Buf, Size)
+ #define SYNC_(Fd)             fsync(Fd)
+ #define CLOSE_(Fd)            close(Fd)
+#elif defined(SSC_OS_WINDOWS)
+ #include <fcntl.h>
+ #include <io.h>
+ #include <sys/stat.h>
+ #define CREATE_EXCL_(Path)    _open(Path, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE)
+ #define WRITE_(Fd, Buf, Size) _write(Fd, Buf, (unsigned)(Size))
+ #define SYNC_(Fd)             _commit(Fd)
+ #define CLOSE_(Fd)            _close(Fd)
+#endif
+
+#define R_ SSC_RESTRICT
+
+void
+keyfile_generate(const char* R_ filename, PPQ_CSPRNG* R_ csprng, uint8_t* R_ key)
+{
+  uint8_t buffer [THREECRYPT_KEYFILE_BYTES];
+  PPQ_CSPRNG_get(csprng, key, THREECRYPT_KEYFILE_KEY_BYTES);
+  memcpy(buffer, THREECRYPT_KEYFILE_ID, THREECRYPT_KEYFILE_ID_NBYTES);
+  memcpy(buffer + THREECRYPT_KEYFILE_ID_NBYTES, key, THREECRYPT_KEYFILE_KEY_BYTES);
+  int fd = CREATE_EXCL_(filename);
+  if (fd == -1) {
+    SSC_secureZero(buffer, sizeof(buffer));
+    SSC_errx("Error: Failed to create the keyfile %s!\n", filename);
+  }
+  size_t written = 0;
+  while (written < sizeof(buffer)) {
+    int w = (int)WRITE_(fd, buffer + written, sizeof(buffer) - written);
+    if (w <= 0) {
+      SSC_secureZero(buffer, sizeof(buffer));
+      CLOSE_(fd);
+      remove(filename);
+      SSC_errx("Error: Failed to write the keyfile %s!\n", filename);
+    }
+    written += (size_t)w;
+  }
+  SSC_secureZero(buffer, sizeof(buffer));
+  /* The data encrypted with this key is unrecoverable without it, so
+   * make sure it reaches the disk before anything gets encrypted. */
+  SSC_assertMsg(SYNC_(fd) == 0, "Error: Failed to sync the keyfile %s!\n", filename);
+  SSC_assertMsg(CLOSE_(fd) == 0, "Error: Failed to close the keyfile %s!\n", filename);
+}
+
+void
+keyfile_load(const char* R_ filename, uint8_t* R_ key)
+{
+  SSC_assertMsg(SSC_FilePath_exists(filename), "Error: The keyfile %s does not seem to exist.\n", filename);
+  SSC_MemMap map = SSC_MEMMAP_NULL_LITERAL;
+  map.size = SSC_FilePath_getSizeOrDie(filename);
+  SSC_assertMsg(map.size == THREECRYPT_KEYFILE_BYTES, "Error: %s is not a valid 3crypt keyfile.\n", filename);
+  map.file = SSC_FilePath_openOrDie(filename, true);
+  SSC_MemMap_mapOrDie(&map, true);
+  SSC_assertMsg(
+   !memcmp(map.ptr, THREECRYPT_KEYFILE_ID, THREECRYPT_KEYFILE_ID_NBYTES),
+   "Error: %s is not a valid 3crypt keyfile.\n", filename);
+  memcpy(key, map.ptr + THREECRYPT_KEYFILE_ID_NBYTES, THREECRYPT_KEYFILE_KEY_BYTES);
+  SSC_MemMap_unmapOrDie(&map);
+  SSC_File_closeOrDie(map.file);
+}
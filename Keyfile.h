@@ -0,0 +1,29 @@
+#ifndef THREECRYPT_KEYFILE_H
+#define THREECRYPT_KEYFILE_H
+
+#include <SSC/Macro.h>
+#include <PPQ/CSPRNG.h>
+
+/* A keyfile is THREECRYPT_KEYFILE_ID followed by THREECRYPT_KEYFILE_KEY_BYTES
+ * of uniformly random key material. */
+#define THREECRYPT_KEYFILE_ID        "3CRYPT_KEY_V1"
+#define THREECRYPT_KEYFILE_ID_NBYTES 14
+#define THREECRYPT_KEYFILE_KEY_BYTES 64
+#define THREECRYPT_KEYFILE_BYTES     (THREECRYPT_KEYFILE_ID_NBYTES + THREECRYPT_KEYFILE_KEY_BYTES)
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+/* Fill @key with random bytes from @csprng and write it to a new keyfile at
+ * @filename, readable only by its owner. Dies if @filename already exists. */
+void
+keyfile_generate(const char* R_ filename, PPQ_CSPRNG* R_ csprng, uint8_t* R_ key);
+
+/* Load the key stored in the keyfile at @filename into @key, or die. */
+void
+keyfile_load(const char* R_ filename, uint8_t* R_ key);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
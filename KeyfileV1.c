@@ -0,0 +1,343 @@
+#include <SSC/Operation.h>
+#include "KeyfileV1.h"
+#include "Durability.h"
+
+#ifdef THREECRYPT_KEYFILE_V1_H
+
+#define R_ SSC_RESTRICT
+
+#define TWEAK_OFFSET_  (THREECRYPT_KEYFILE_V1_ID_NBYTES + 8)
+#define SALT_OFFSET_   (TWEAK_OFFSET_ + PPQ_THREEFISH512_TWEAK_BYTES)
+#define CTR_IV_OFFSET_ (SALT_OFFSET_ + THREECRYPT_KDF_SALT_BYTES)
+
+/* Derive the encryption and authentication keys from @ctx->key and the @header
+ * of a Keyfile_V1 file. */
+static void
+derive_keys_(Threecrypt_KeyfileV1* R_ ctx, const uint8_t* R_ header)
+{
+  threecrypt_kdf(
+   &ctx->ubi512,
+   ctx->derived,
+   sizeof(ctx->derived),
+   ctx->key,
+   THREECRYPT_KEYFILE_V1_ID,
+   THREECRYPT_KEYFILE_V1_ID_NBYTES,
+   header + SALT_OFFSET_);
+  memcpy(ctx->enc_key,  ctx->derived,                                PPQ_THREEFISH512_BLOCK_BYTES);
+  memcpy(ctx->auth_key, ctx->derived + PPQ_THREEFISH512_BLOCK_BYTES, PPQ_THREEFISH512_BLOCK_BYTES);
+  SSC_secureZero(ctx->derived, sizeof(ctx->derived));
+  memcpy(ctx->tweak, header + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+}
+
+void
+keyfile_v1_encrypt(
+ Threecrypt_KeyfileV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map)
+{
+  Threecrypt_Window in, out;
+  threecrypt_window_open(&in, input_map, true);
+  output_map->size = input_map->size + THREECRYPT_KEYFILE_V1_METADATA_BYTES;
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  threecrypt_window_open(&out, output_map, false);
+  {
+    uint64_t n = THREECRYPT_KEYFILE_V1_HEADER_BYTES;
+    uint8_t* const header = threecrypt_window_get(&out, 0, &n);
+    memcpy(header, THREECRYPT_KEYFILE_V1_ID, THREECRYPT_KEYFILE_V1_ID_NBYTES);
+    threecrypt_store64(header + THREECRYPT_KEYFILE_V1_ID_NBYTES, (uint64_t)output_map->size);
+    PPQ_CSPRNG_get(
+     &ctx->csprng,
+     header + TWEAK_OFFSET_,
+     PPQ_THREEFISH512_TWEAK_BYTES + THREECRYPT_KDF_SALT_BYTES + THREECRYPT_CTR_IV_BYTES);
+    derive_keys_(ctx, header);
+    threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, header + CTR_IV_OFFSET_);
+    threecrypt_mac_init(&ctx->body_mac, ctx->auth_key, THREECRYPT_KEYFILE_V1_MAC_BYTES);
+    threecrypt_mac_update(&ctx->body_mac, header, THREECRYPT_KEYFILE_V1_HEADER_BYTES);
+  }
+  for (uint64_t done = 0; done < (uint64_t)input_map->size; ) {
+    uint64_t n = (uint64_t)input_map->size - done;
+    const uint8_t* const src = threecrypt_window_get(&in, done, &n);
+    uint8_t* const dst = threecrypt_window_get(&out, THREECRYPT_KEYFILE_V1_HEADER_BYTES + done, &n);
+    threecrypt_ctr_xor(&ctx->ctr, dst, src, n, done);
+    threecrypt_mac_update(&ctx->body_mac, dst, n);
+    done += n;
+  }
+  {
+    uint64_t n = THREECRYPT_KEYFILE_V1_MAC_BYTES;
+    threecrypt_mac_final(
+     &ctx->body_mac,
+     threecrypt_window_get(&out, output_map->size - THREECRYPT_KEYFILE_V1_MAC_BYTES, &n));
+  }
+  threecrypt_window_close(&out);
+  threecrypt_window_close(&in);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+void
+keyfile_v1_decrypt(
+ Threecrypt_KeyfileV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map,
+ const char* R_           output_filename)
+{
+  Threecrypt_Window in;
+  const char* error = SSC_NULL;
+  threecrypt_window_open(&in, input_map, true);
+  if (input_map->size < THREECRYPT_KEYFILE_V1_METADATA_BYTES)
+    error = "Error: The input file is too small to be a Keyfile_V1 encrypted file.\n";
+  else {
+    uint64_t n = THREECRYPT_KEYFILE_V1_HEADER_BYTES;
+    const uint8_t* const header = threecrypt_window_get(&in, 0, &n);
+    if (threecrypt_load64(header + THREECRYPT_KEYFILE_V1_ID_NBYTES) != (uint64_t)input_map->size)
+      error = "Error: The input file size does not match the size recorded in its header.\n";
+    else {
+      derive_keys_(ctx, header);
+      threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, header + CTR_IV_OFFSET_);
+    }
+  }
+  if (!error) {
+    /* Authenticate everything before writing a single byte of plaintext. */
+    const uint64_t mac_offset = (uint64_t)input_map->size - THREECRYPT_KEYFILE_V1_MAC_BYTES;
+    threecrypt_mac_init(&ctx->body_mac, ctx->auth_key, THREECRYPT_KEYFILE_V1_MAC_BYTES);
+    for (uint64_t done = 0; done < mac_offset; ) {
+      uint64_t n = mac_offset - done;
+      const uint8_t* const src = threecrypt_window_get(&in, done, &n);
+      threecrypt_mac_update(&ctx->body_mac, src, n);
+      done += n;
+    }
+    threecrypt_mac_final(&ctx->body_mac, ctx->mac);
+    uint64_t n = THREECRYPT_KEYFILE_V1_MAC_BYTES;
+    if (!threecrypt_ct_equal(ctx->mac, threecrypt_window_get(&in, mac_offset, &n), THREECRYPT_KEYFILE_V1_MAC_BYTES))
+      error = "Error: Authentication failed. Wrong keyfile, or the file has been corrupted.\n";
+  }
+  if (error) {
+    threecrypt_window_close(&in);
+    SSC_File_closeOrDie(input_map->file);
+    SSC_File_closeOrDie(output_map->file);
+    remove(output_filename);
+    SSC_errx("%s", error);
+  }
+  output_map->size = input_map->size - THREECRYPT_KEYFILE_V1_METADATA_BYTES;
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  Threecrypt_Window out;
+  threecrypt_window_open(&out, output_map, false);
+  for (uint64_t done = 0; done < (uint64_t)output_map->size; ) {
+    uint64_t n = (uint64_t)output_map->size - done;
+    const uint8_t* const src = threecrypt_window_get(&in, THREECRYPT_KEYFILE_V1_HEADER_BYTES + done, &n);
+    uint8_t* const dst = threecrypt_window_get(&out, done, &n);
+    threecrypt_ctr_xor(&ctx->ctr, dst, src, n, done);
+    done += n;
+  }
+  threecrypt_window_close(&out);
+  threecrypt_window_close(&in);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+/* The keys of one file of a batch. */
+typedef struct {
+  uint64_t enc_key  [PPQ_THREEFISH512_EXTERNAL_KEY_WORDS];
+  uint64_t tweak    [PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS];
+  uint8_t  auth_key [PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t  mac      [THREECRYPT_KEYFILE_V1_MAC_BYTES];
+  bool     failed;
+} BatchKeys_;
+
+/* Long CTR streams are split into jobs of this many bytes, so that a large file in a batch
+ * is spread across the lanes instead of occupying one of them alone. */
+#define CTR_JOB_BYTES_ (UINT64_C(1) << 16)
+
+/* Derive the keys of the Keyfile_V1 file with @header into @keys. */
+static void
+derive_batch_keys_(Threecrypt_KeyfileV1* R_ ctx, BatchKeys_* R_ keys, const uint8_t* R_ header)
+{
+  derive_keys_(ctx, header);
+  memcpy(keys->enc_key,  ctx->enc_key,  sizeof(keys->enc_key));
+  memcpy(keys->tweak,    ctx->tweak,    sizeof(keys->tweak));
+  memcpy(keys->auth_key, ctx->auth_key, sizeof(keys->auth_key));
+  SSC_secureZero(ctx->enc_key,  sizeof(ctx->enc_key));
+  SSC_secureZero(ctx->auth_key, sizeof(ctx->auth_key));
+}
+
+/* Append the CTR jobs for the @size bytes of a Keyfile_V1 file's data to @jobs, returning the new job count. */
+static size_t
+add_ctr_jobs_(
+ Threecrypt_MbCtrJob* R_ jobs,
+ size_t                  count,
+ const BatchKeys_* R_    keys,
+ const uint8_t* R_       iv,
+ const uint8_t*          input,
+ uint8_t*                output,
+ uint64_t                size)
+{
+  for (uint64_t offset = 0; offset < size; offset += CTR_JOB_BYTES_) {
+    const uint64_t left = size - offset;
+    jobs[count++] = (Threecrypt_MbCtrJob){
+     keys->enc_key,
+     keys->tweak,
+     iv,
+     input + offset,
+     output + offset,
+     (left < CTR_JOB_BYTES_) ? left : CTR_JOB_BYTES_,
+     offset / PPQ_THREEFISH512_BLOCK_BYTES};
+  }
+  return count;
+}
+
+/* The number of CTR jobs add_ctr_jobs_() creates for @size bytes. */
+static size_t
+count_ctr_jobs_(uint64_t size)
+{
+  return (size_t)((size / CTR_JOB_BYTES_) + ((size % CTR_JOB_BYTES_) != 0));
+}
+
+void
+keyfile_v1_encrypt_batch(
+ Threecrypt_KeyfileV1* R_ ctx,
+ SSC_MemMap*              input_maps,
+ SSC_MemMap*              output_maps,
+ size_t                   count)
+{
+  BatchKeys_* const keys = (BatchKeys_*)SSC_mallocOrDie(count * sizeof(BatchKeys_));
+  size_t ctr_count = 0;
+  for (size_t i = 0; i < count; ++i) {
+    SSC_MemMap* const output_map = &output_maps[i];
+    output_map->size = input_maps[i].size + THREECRYPT_KEYFILE_V1_METADATA_BYTES;
+    SSC_File_setSizeOrDie(output_map->file, output_map->size);
+    SSC_MemMap_mapOrDie(output_map, false);
+    uint8_t* const out = output_map->ptr;
+    memcpy(out, THREECRYPT_KEYFILE_V1_ID, THREECRYPT_KEYFILE_V1_ID_NBYTES);
+    threecrypt_store64(out + THREECRYPT_KEYFILE_V1_ID_NBYTES, (uint64_t)output_map->size);
+    PPQ_CSPRNG_get(
+     &ctx->csprng,
+     out + TWEAK_OFFSET_,
+     PPQ_THREEFISH512_TWEAK_BYTES + THREECRYPT_KDF_SALT_BYTES + THREECRYPT_CTR_IV_BYTES);
+    derive_batch_keys_(ctx, &keys[i], out);
+    ctr_count += count_ctr_jobs_(input_maps[i].size);
+  }
+  {
+    /* Encrypt every file, then MAC every file. */
+    Threecrypt_MbCtrJob* const ctr_jobs = (Threecrypt_MbCtrJob*)SSC_mallocOrDie((ctr_count + 1) * sizeof(Threecrypt_MbCtrJob));
+    Threecrypt_MbMacJob* const mac_jobs = (Threecrypt_MbMacJob*)SSC_mallocOrDie(count * sizeof(Threecrypt_MbMacJob));
+    ctr_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+      uint8_t* const out = output_maps[i].ptr;
+      const size_t mac_offset = output_maps[i].size - THREECRYPT_KEYFILE_V1_MAC_BYTES;
+      ctr_count = add_ctr_jobs_(
+       ctr_jobs, ctr_count, &keys[i], out + CTR_IV_OFFSET_,
+       input_maps[i].ptr, out + THREECRYPT_KEYFILE_V1_HEADER_BYTES, input_maps[i].size);
+      mac_jobs[i] = (Threecrypt_MbMacJob){keys[i].auth_key, out, out + mac_offset, mac_offset, THREECRYPT_KEYFILE_V1_MAC_BYTES};
+    }
+    threecrypt_mb_ctr_xor(ctr_jobs, ctr_count);
+    threecrypt_mb_skein512_mac(mac_jobs, count);
+    free(ctr_jobs);
+    free(mac_jobs);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    durability_sync_map(&output_maps[i]);
+    SSC_MemMap_unmapOrDie(&output_maps[i]);
+    if (input_maps[i].size)
+      SSC_MemMap_unmapOrDie(&input_maps[i]);
+    SSC_File_closeOrDie(output_maps[i].file);
+    SSC_File_closeOrDie(input_maps[i].file);
+  }
+  SSC_secureZero(keys, count * sizeof(BatchKeys_));
+  free(keys);
+}
+
+size_t
+keyfile_v1_decrypt_batch(
+ Threecrypt_KeyfileV1* R_ ctx,
+ SSC_MemMap*              input_maps,
+ SSC_MemMap*              output_maps,
+ char* const*             input_filenames,
+ char* const*             output_filenames,
+ size_t                   count)
+{
+  BatchKeys_* const keys = (BatchKeys_*)SSC_mallocOrDie(count * sizeof(BatchKeys_));
+  Threecrypt_MbMacJob* const mac_jobs = (Threecrypt_MbMacJob*)SSC_mallocOrDie((count + 1) * sizeof(Threecrypt_MbMacJob));
+  size_t mac_count = 0;
+  size_t failures  = 0;
+  size_t ctr_count = 0;
+  /* Authenticate every file before writing a single byte of plaintext. */
+  for (size_t i = 0; i < count; ++i) {
+    const uint8_t* const in = input_maps[i].ptr;
+    keys[i].failed = (input_maps[i].size < THREECRYPT_KEYFILE_V1_METADATA_BYTES) ||
+                     (threecrypt_load64(in + THREECRYPT_KEYFILE_V1_ID_NBYTES) != (uint64_t)input_maps[i].size);
+    if (keys[i].failed)
+      continue;
+    const size_t mac_offset = input_maps[i].size - THREECRYPT_KEYFILE_V1_MAC_BYTES;
+    derive_batch_keys_(ctx, &keys[i], in);
+    mac_jobs[mac_count++] = (Threecrypt_MbMacJob){keys[i].auth_key, in, keys[i].mac, mac_offset, THREECRYPT_KEYFILE_V1_MAC_BYTES};
+  }
+  threecrypt_mb_skein512_mac(mac_jobs, mac_count);
+  free(mac_jobs);
+  for (size_t i = 0; i < count; ++i) {
+    const size_t size = input_maps[i].size;
+    if (!keys[i].failed &&
+        !threecrypt_ct_equal(keys[i].mac, input_maps[i].ptr + size - THREECRYPT_KEYFILE_V1_MAC_BYTES, THREECRYPT_KEYFILE_V1_MAC_BYTES))
+      keys[i].failed = true;
+    if (keys[i].failed) {
+      fprintf(stderr, "Error: Authentication failed for %s. Wrong keyfile, or the file has been corrupted.\n", input_filenames[i]);
+      if (size)
+        SSC_MemMap_unmapOrDie(&input_maps[i]);
+      SSC_File_closeOrDie(input_maps[i].file);
+      SSC_File_closeOrDie(output_maps[i].file);
+      remove(output_filenames[i]);
+      ++failures;
+      continue;
+    }
+    output_maps[i].size = size - THREECRYPT_KEYFILE_V1_METADATA_BYTES;
+    SSC_File_setSizeOrDie(output_maps[i].file, output_maps[i].size);
+    if (output_maps[i].size)
+      SSC_MemMap_mapOrDie(&output_maps[i], false);
+    ctr_count += count_ctr_jobs_(output_maps[i].size);
+  }
+  {
+    Threecrypt_MbCtrJob* const ctr_jobs = (Threecrypt_MbCtrJob*)SSC_mallocOrDie((ctr_count + 1) * sizeof(Threecrypt_MbCtrJob));
+    ctr_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+      if (keys[i].failed)
+        continue;
+      const uint8_t* const in = input_maps[i].ptr;
+      ctr_count = add_ctr_jobs_(
+       ctr_jobs, ctr_count, &keys[i], in + CTR_IV_OFFSET_,
+       in + THREECRYPT_KEYFILE_V1_HEADER_BYTES, output_maps[i].ptr, output_maps[i].size);
+    }
+    threecrypt_mb_ctr_xor(ctr_jobs, ctr_count);
+    free(ctr_jobs);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (keys[i].failed)
+      continue;
+    if (output_maps[i].size) {
+      durability_sync_map(&output_maps[i]);
+      SSC_MemMap_unmapOrDie(&output_maps[i]);
+    }
+    SSC_MemMap_unmapOrDie(&input_maps[i]);
+    SSC_File_closeOrDie(output_maps[i].file);
+    SSC_File_closeOrDie(input_maps[i].file);
+  }
+  SSC_secureZero(keys, count * sizeof(BatchKeys_));
+  free(keys);
+  return failures;
+}
+
+void
+keyfile_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename)
+{
+  SSC_assertMsg(
+   input_map->size >= THREECRYPT_KEYFILE_V1_METADATA_BYTES,
+   "Error: The input file %s is too small to be a Keyfile_V1 encrypted file.\n", filename);
+  const uint8_t* const in = input_map->ptr;
+  printf("File Header for %s\n", filename);
+  printf("Method             : Keyfile_V1\n");
+  printf("Total Size         : %" PRIu64 " bytes\n", threecrypt_load64(in + THREECRYPT_KEYFILE_V1_ID_NBYTES));
+  threecrypt_print_hex("Tweak              : ", in + TWEAK_OFFSET_,  PPQ_THREEFISH512_TWEAK_BYTES);
+  threecrypt_print_hex("Salt               : ", in + SALT_OFFSET_,   THREECRYPT_KDF_SALT_BYTES);
+  threecrypt_print_hex("CTR IV             : ", in + CTR_IV_OFFSET_, THREECRYPT_CTR_IV_BYTES);
+  threecrypt_print_hex("MAC                : ", in + input_map->size - THREECRYPT_KEYFILE_V1_MAC_BYTES, THREECRYPT_KEYFILE_V1_MAC_BYTES);
+}
+
+#endif /* ! THREECRYPT_KEYFILE_V1_H */
@@ -0,0 +1,101 @@
+#if !defined(THREECRYPT_KEYFILE_V1_H) && defined(THREECRYPT_EXTERN_ENABLE_KEYFILE_V1)
+#define THREECRYPT_KEYFILE_V1_H
+
+#include <SSC/Macro.h>
+#include <SSC/MemMap.h>
+#include <PPQ/CSPRNG.h>
+#include "Keyfile.h"
+#include "Multibuffer.h"
+#include "Primitive.h"
+#include "Window.h"
+
+/* Keyfile_V1 encrypted files are keyed with a 512-bit keyfile instead of a password,
+ * so the memory-hard KDF is skipped entirely; encryption and authentication keys are
+ * derived from the keyfile with threecrypt_kdf(), a single Skein-512 MAC invocation.
+ *
+ * Layout:
+ *   ID          (THREECRYPT_KEYFILE_V1_ID_NBYTES)
+ *   Total Size  (8 bytes, little-endian)
+ *   Tweak       (PPQ_THREEFISH512_TWEAK_BYTES)
+ *   Salt        (THREECRYPT_KDF_SALT_BYTES)
+ *   CTR IV      (THREECRYPT_CTR_IV_BYTES)
+ *   Ciphertext  (Total Size - THREECRYPT_KEYFILE_V1_METADATA_BYTES)
+ *   MAC         (THREECRYPT_KEYFILE_V1_MAC_BYTES), Skein-512 MAC of everything before it. */
+#define THREECRYPT_KEYFILE_V1_ID           "3CRYPT_KEYFILE_V1"
+#define THREECRYPT_KEYFILE_V1_ID_NBYTES    18
+#define THREECRYPT_KEYFILE_V1_MAC_BYTES    64
+#define THREECRYPT_KEYFILE_V1_HEADER_BYTES (\
+ THREECRYPT_KEYFILE_V1_ID_NBYTES +\
+ 8 +\
+ PPQ_THREEFISH512_TWEAK_BYTES +\
+ THREECRYPT_KDF_SALT_BYTES +\
+ THREECRYPT_CTR_IV_BYTES)
+#define THREECRYPT_KEYFILE_V1_METADATA_BYTES (THREECRYPT_KEYFILE_V1_HEADER_BYTES + THREECRYPT_KEYFILE_V1_MAC_BYTES)
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  Threecrypt_Ctr ctr;
+  PPQ_UBI512     ubi512;
+  PPQ_CSPRNG     csprng; /* Only used during encryption. */
+  uint64_t       enc_key  [PPQ_THREEFISH512_EXTERNAL_KEY_WORDS];
+  uint64_t       tweak    [PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS];
+  uint8_t        auth_key [PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t        key      [THREECRYPT_KEYFILE_KEY_BYTES];
+  uint8_t        derived  [PPQ_THREEFISH512_BLOCK_BYTES * 2];
+  uint8_t        mac      [THREECRYPT_KEYFILE_V1_MAC_BYTES];
+  Threecrypt_Mac body_mac;
+} Threecrypt_KeyfileV1;
+
+/* Encrypt @input_map into @output_map, whose files must already be open. The files are mapped
+ * whole or a window at a time, as threecrypt_window_bytes() directs.
+ * @ctx->key and @ctx->csprng must be initialized. Unmaps and closes both files. */
+void
+keyfile_v1_encrypt(
+ Threecrypt_KeyfileV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map);
+
+/* Authenticate then decrypt @input_map into @output_map, whose files must already be open, mapping
+ * them as keyfile_v1_encrypt() does. @ctx->key must be initialized. On authentication failure @output_filename is removed and we die.
+ * Unmaps and closes both files. */
+void
+keyfile_v1_decrypt(
+ Threecrypt_KeyfileV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map,
+ const char* R_           output_filename);
+
+/* Encrypt each of the @count mapped @input_maps into the corresponding @output_maps, whose files
+ * must already be open, running the CTR and MAC passes of every file through the multi-buffer engine.
+ * Empty input files must not be mapped. @ctx->key and @ctx->csprng must be initialized.
+ * Unmaps and closes every file. */
+void
+keyfile_v1_encrypt_batch(
+ Threecrypt_KeyfileV1* R_ ctx,
+ SSC_MemMap*              input_maps,
+ SSC_MemMap*              output_maps,
+ size_t                   count);
+
+/* Authenticate then decrypt each of the @count mapped @input_maps into the corresponding @output_maps,
+ * whose files must already be open, through the multi-buffer engine. @ctx->key must be initialized.
+ * Files that fail to authenticate are reported, and their @output_filenames removed.
+ * Unmaps and closes every file. Returns the number of files that failed. */
+size_t
+keyfile_v1_decrypt_batch(
+ Threecrypt_KeyfileV1* R_ ctx,
+ SSC_MemMap*              input_maps,
+ SSC_MemMap*              output_maps,
+ char* const*             input_filenames,
+ char* const*             output_filenames,
+ size_t                   count);
+
+/* Print the header of the Keyfile_V1 encrypted file mapped by @input_map. */
+void
+keyfile_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif
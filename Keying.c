@@ -0,0 +1,92 @@
+#include <SSC/Operation.h>
+#include "Keying.h"
+#include "KdfBudget.h"
+#include "Throttle.h"
+
+#define R_ SSC_RESTRICT
+
+#define SALT_OFFSET_ 5
+
+void
+keying_store(const Threecrypt_Keying* R_ ctx, uint8_t* R_ block, PPQ_CSPRNG* R_ csprng)
+{
+  block[0] = ctx->kind;
+  block[1] = ctx->g_low;
+  block[2] = ctx->g_high;
+  block[3] = ctx->lambda;
+  block[4] = ctx->use_phi;
+  PPQ_CSPRNG_get(csprng, block + SALT_OFFSET_, THREECRYPT_KDF_SALT_BYTES);
+}
+
+bool
+keying_load(Threecrypt_Keying* R_ ctx, const uint8_t* R_ block)
+{
+  ctx->kind    = block[0];
+  ctx->g_low   = block[1];
+  ctx->g_high  = block[2];
+  ctx->lambda  = block[3];
+  ctx->use_phi = block[4];
+  switch (ctx->kind) {
+  case THREECRYPT_KEYING_PASSWORD:
+    return (ctx->g_low >= 1) && (ctx->g_low <= ctx->g_high) && (ctx->g_high <= 63) && (ctx->lambda >= 1) && (ctx->use_phi <= 1);
+  case THREECRYPT_KEYING_KEYFILE:
+    return !ctx->g_low && !ctx->g_high && !ctx->lambda && !ctx->use_phi;
+  }
+  return false;
+}
+
+void
+keying_derive(
+ Threecrypt_Keying* R_ ctx,
+ const uint8_t* R_     block,
+ const char* R_        id,
+ size_t                id_size,
+ uint8_t* R_           output,
+ uint64_t              output_size)
+{
+  const uint8_t* master = ctx->secret;
+  if (ctx->kind == THREECRYPT_KEYING_PASSWORD) {
+    memcpy(ctx->catena512.salt, block + SALT_OFFSET_, THREECRYPT_KDF_SALT_BYTES);
+    kdf_budget_reserve(ctx->g_high);
+    int ret = PPQ_Catena512_call(
+     &ctx->catena512,
+     ctx->master,
+     ctx->secret,
+     ctx->secret_size,
+     ctx->g_low,
+     ctx->g_high,
+     ctx->lambda,
+     ctx->use_phi);
+    kdf_budget_release();
+    throttle_restart(); /* Only the data path that follows is throttled. */
+    SSC_assertMsg(ret == PPQ_CATENA512_SUCCESS, "Error: Failed to allocate memory for key-derivation!\n");
+    master = ctx->master;
+  }
+  threecrypt_kdf(&ctx->ubi512, output, output_size, master, id, id_size, block + SALT_OFFSET_);
+  SSC_secureZero(ctx->master, sizeof(ctx->master));
+}
+
+/* Print the memory bound of garlic @garlic, 2^@garlic 64 byte blocks, if it fits in 64 bits. */
+static void
+print_bound_(const char* R_ label, uint8_t garlic)
+{
+  if (garlic <= 57)
+    printf("%s%" PRIu64 " bytes\n", label, (UINT64_C(1) << garlic) * 64);
+  else
+    printf("%sInvalid (garlic %d)\n", label, (int)garlic);
+}
+
+void
+keying_dump(const uint8_t* R_ block)
+{
+  if (block[0] == THREECRYPT_KEYING_KEYFILE)
+    printf("Keying             : Keyfile\n");
+  else {
+    printf("Keying             : Password\n");
+    print_bound_("Lower Memory Bound : ", block[1]);
+    print_bound_("Upper Memory Bound : ", block[2]);
+    printf("Iterations         : %d\n", (int)block[3]);
+    printf("Phi Function       : %s\n", block[4] ? "Enabled" : "Disabled");
+  }
+  threecrypt_print_hex("Salt               : ", block + SALT_OFFSET_, THREECRYPT_KDF_SALT_BYTES);
+}
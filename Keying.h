@@ -0,0 +1,67 @@
+#ifndef THREECRYPT_KEYING_H
+#define THREECRYPT_KEYING_H
+
+#include <SSC/Macro.h>
+#include <PPQ/Catena512.h>
+#include <PPQ/Common.h>
+#include <PPQ/CSPRNG.h>
+#include "Keyfile.h"
+#include "Primitive.h"
+
+/* How a file format that supports both passwords and keyfiles derives its keys.
+ * Such formats store a keying block in their header:
+ *   Kind    (1 byte): THREECRYPT_KEYING_PASSWORD or THREECRYPT_KEYING_KEYFILE
+ *   g_low, g_high, lambda, use_phi (1 byte each): Catena parameters, zero for keyfiles.
+ *   Salt    (THREECRYPT_KDF_SALT_BYTES)
+ * Password-keyed files run Catena over the password; keyfile-keyed files use
+ * the keyfile key directly. Either 512-bit result is then fed to threecrypt_kdf(). */
+#define THREECRYPT_KEYING_PASSWORD UINT8_C(0x01)
+#define THREECRYPT_KEYING_KEYFILE  UINT8_C(0x02)
+#define THREECRYPT_KEYING_BYTES    (1 + 4 + THREECRYPT_KDF_SALT_BYTES)
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  PPQ_Catena512 catena512;
+  PPQ_UBI512    ubi512;
+  uint8_t       secret [PPQ_COMMON_MAX_PASSWORD_BYTES + 1]; /* The password, or the keyfile key. */
+  uint8_t       master [PPQ_CATENA512_OUTPUT_BYTES];
+  int           secret_size;
+  uint8_t       kind;
+  uint8_t       g_low;
+  uint8_t       g_high;
+  uint8_t       lambda;
+  uint8_t       use_phi;
+} Threecrypt_Keying;
+
+/* Serialize the keying parameters of @ctx, with a fresh salt from @csprng, into the
+ * THREECRYPT_KEYING_BYTES at @block. */
+void
+keying_store(const Threecrypt_Keying* R_ ctx, uint8_t* R_ block, PPQ_CSPRNG* R_ csprng);
+
+/* Load the keying parameters serialized at @block into @ctx.
+ * Returns false if they are malformed. */
+bool
+keying_load(Threecrypt_Keying* R_ ctx, const uint8_t* R_ block);
+
+/* Derive @output_size bytes of keying material from @ctx->secret and the salt in @block,
+ * domain-separated by the format @id. Dies if Catena cannot allocate its memory. */
+void
+keying_derive(
+ Threecrypt_Keying* R_ ctx,
+ const uint8_t* R_     block,
+ const char* R_        id,
+ size_t                id_size,
+ uint8_t* R_           output,
+ uint64_t              output_size);
+
+/* Print the keying parameters and salt serialized at @block, for dumping a file header.
+ * The block is untrusted, so memory bounds too large to compute are printed as invalid. */
+void
+keying_dump(const uint8_t* R_ block);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
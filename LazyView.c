@@ -0,0 +1,204 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For syscall(). */
+#endif
+#include <errno.h>
+#include <SSC/Operation.h>
+#include "LazyView.h"
+
+#ifdef THREECRYPT_LAZY_VIEW_H
+
+#if defined(__linux__) && defined(__has_include)
+ #if __has_include(<linux/userfaultfd.h>)
+  #include <fcntl.h>
+  #include <poll.h>
+  #include <sys/ioctl.h>
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+  #include <linux/userfaultfd.h>
+  #if defined(SYS_userfaultfd)
+   #define HAVE_USERFAULTFD_ 1
+  #endif
+ #endif
+#endif
+#ifndef HAVE_USERFAULTFD_
+ #define HAVE_USERFAULTFD_ 0
+#endif
+
+#define R_ SSC_RESTRICT
+
+#define AUTH_FAILED_ "Error: Authentication failed. Chunk %" PRIu64 " has been corrupted.\n"
+
+/* Authenticate and decrypt chunk @index into @out, or die. */
+static void
+read_chunk_(Threecrypt_LazyView* R_ view, uint64_t index, uint8_t* R_ out)
+{
+  if (!chunked_v1_read_chunk(view->chunked, view->input_map, view->size, index, out))
+    SSC_errx(AUTH_FAILED_, index);
+}
+
+/* Authenticate and decrypt every chunk of the view into memory up front. */
+static void
+open_eager_(Threecrypt_LazyView* R_ view)
+{
+  const uint8_t  shift = view->chunked->chunk_shift;
+  const uint64_t count = view->mapped >> shift;
+  view->base = (uint8_t*)SSC_mallocOrDie(view->mapped);
+  for (uint64_t i = 0; i < count; ++i)
+    read_chunk_(view, i, view->base + (i << shift));
+}
+
+#if HAVE_USERFAULTFD_
+/* Fill chunk @index of the view from the staging buffer, waking whoever faulted on it. */
+static void
+fill_chunk_(Threecrypt_LazyView* R_ view, uint64_t index)
+{
+  const uint8_t  shift = view->chunked->chunk_shift;
+  const uint64_t chunk = UINT64_C(1) << shift;
+  const uint64_t begin = index << shift;
+  /* The view ends on a chunk boundary; whatever lies past the plaintext reads as zero. */
+  if ((view->size - begin) < chunk)
+    memset(view->staging + (view->size - begin), 0, (size_t)(chunk - (view->size - begin)));
+  read_chunk_(view, index, view->staging);
+  struct uffdio_copy copy = {
+   .dst = (uint64_t)(uintptr_t)(view->base + begin), .src = (uint64_t)(uintptr_t)view->staging, .len = chunk, .mode = 0};
+  if (ioctl(view->uffd, UFFDIO_COPY, &copy)) {
+    /* Another fault in the same chunk was queued before we filled it. */
+    SSC_assertMsg(errno == EEXIST, "Error: Failed to fill chunk %" PRIu64 " of the view.\n", index);
+    struct uffdio_range range = {.start = copy.dst, .len = chunk};
+    ioctl(view->uffd, UFFDIO_WAKE, &range);
+  }
+  SSC_secureZero(view->staging, (size_t)chunk);
+}
+
+static void*
+handle_faults_(void* arg)
+{
+  Threecrypt_LazyView* const view = (Threecrypt_LazyView*)arg;
+  struct pollfd fds [2] = {{view->uffd, POLLIN, 0}, {view->stop[0], POLLIN, 0}};
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      SSC_assertMsg(errno == EINTR, "Error: Failed to wait for faults on the view.\n");
+      continue;
+    }
+    if (fds[1].revents)
+      break;
+    struct uffd_msg msg;
+    if (read(view->uffd, &msg, sizeof(msg)) != (ssize_t)sizeof(msg)) {
+      SSC_assertMsg(
+       (errno == EAGAIN) || (errno == EINTR), "Error: Failed to read faults on the view.\n");
+      continue;
+    }
+    if (msg.event != UFFD_EVENT_PAGEFAULT)
+      continue;
+    const uint64_t offset = (uint64_t)msg.arg.pagefault.address - (uint64_t)(uintptr_t)view->base;
+    fill_chunk_(view, offset >> view->chunked->chunk_shift);
+  }
+  return SSC_NULL;
+}
+
+/* Open a userfaultfd, falling back to one that handles user-mode faults alone on kernels
+ * that do not allow unprivileged processes to handle kernel-mode faults. Returns -1 if userfaultfd
+ * is unavailable. */
+static int
+open_userfaultfd_(void)
+{
+  int fd = -1;
+ #ifdef UFFD_USER_MODE_ONLY
+  fd = (int)syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+ #endif
+  if (fd < 0)
+    fd = (int)syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+  if (fd < 0)
+    return -1;
+  struct uffdio_api api = {.api = UFFD_API, .features = 0};
+  if (ioctl(fd, UFFDIO_API, &api)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Reserve the view and register it with a userfaultfd, to be filled on demand.
+ * Returns false, leaving nothing to undo, if that is not possible. */
+static bool
+open_lazy_(Threecrypt_LazyView* R_ view)
+{
+  /* UFFDIO_COPY fills whole pages, so each chunk must be a whole number of them. */
+  const long page = sysconf(_SC_PAGESIZE);
+  const uint64_t chunk = UINT64_C(1) << view->chunked->chunk_shift;
+  if ((page <= 0) || (chunk % (uint64_t)page))
+    return false;
+  if ((view->uffd = open_userfaultfd_()) < 0)
+    return false;
+  void* base = mmap(SSC_NULL, view->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    close(view->uffd);
+    return false;
+  }
+  view->base = (uint8_t*)base;
+  struct uffdio_register reg = {
+   .range = {.start = (uint64_t)(uintptr_t)base, .len = view->mapped}, .mode = UFFDIO_REGISTER_MODE_MISSING};
+  if (ioctl(view->uffd, UFFDIO_REGISTER, &reg) || pipe(view->stop)) {
+    munmap(base, view->mapped);
+    close(view->uffd);
+    return false;
+  }
+  view->staging = (uint8_t*)SSC_mallocOrDie((size_t)1 << view->chunked->chunk_shift);
+  SSC_assertMsg(
+   !pthread_create(&view->handler, SSC_NULL, handle_faults_, view),
+   "Error: Failed to start the fault handler of the view.\n");
+  return true;
+}
+#endif /* ! HAVE_USERFAULTFD_ */
+
+const char*
+lazy_view_open(Threecrypt_LazyView* R_ view, Threecrypt_ChunkedV1* R_ ctx, const SSC_MemMap* R_ input_map)
+{
+  memset(view, 0, sizeof(*view));
+  view->chunked   = ctx;
+  view->input_map = input_map;
+  view->uffd      = -1;
+  const char* error = chunked_v1_open(ctx, input_map, &view->size);
+  if (error)
+    return error;
+  const uint64_t mask = (UINT64_C(1) << ctx->chunk_shift) - 1;
+  const uint64_t mapped = (view->size + mask) & ~mask;
+  SSC_assertMsg(mapped == (size_t)mapped, "Error: The file is too large to view on this platform.\n");
+  view->mapped = (size_t)mapped;
+  if (!view->mapped)
+    return SSC_NULL;
+#if HAVE_USERFAULTFD_
+  if (open_lazy_(view))
+    return SSC_NULL;
+#endif
+  open_eager_(view);
+  return SSC_NULL;
+}
+
+void
+lazy_view_close(Threecrypt_LazyView* R_ view)
+{
+#if HAVE_USERFAULTFD_
+  if (view->uffd >= 0) {
+    const uint8_t stop = 0;
+    SSC_assertMsg(write(view->stop[1], &stop, 1) == 1, "Error: Failed to stop the fault handler of the view.\n");
+    pthread_join(view->handler, SSC_NULL);
+    /* Chunks that were never read were never decrypted; the kernel zeroes the rest before reusing them. */
+    munmap(view->base, view->mapped);
+    close(view->stop[0]);
+    close(view->stop[1]);
+    close(view->uffd);
+    free(view->staging);
+    memset(view, 0, sizeof(*view));
+    return;
+  }
+#endif
+  if (view->base) {
+    SSC_secureZero(view->base, view->mapped);
+    free(view->base);
+  }
+  memset(view, 0, sizeof(*view));
+}
+
+#endif /* ! THREECRYPT_LAZY_VIEW_H */
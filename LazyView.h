@@ -0,0 +1,54 @@
+#if !defined(THREECRYPT_LAZY_VIEW_H) && defined(THREECRYPT_EXTERN_ENABLE_CHUNKED_V1)
+#define THREECRYPT_LAZY_VIEW_H
+
+#include <SSC/Macro.h>
+#include <SSC/MemMap.h>
+#include "ChunkedV1.h"
+
+#if defined(__linux__)
+ #include <pthread.h>
+#endif
+
+/* Decrypt-on-access views of Chunked_V1 encrypted files.
+ *
+ * A view is a region of memory, the size of the plaintext, that reads as the plaintext of
+ * a Chunked_V1 file. On Linux, where userfaultfd(2) is available, nothing is decrypted when the
+ * view is opened: the first access to each chunk faults, and a handler thread authenticates and
+ * decrypts that whole chunk into the view before the access completes. Only the chunks that are
+ * actually read are ever authenticated or decrypted, so reading a few bytes of a large file costs
+ * the key-derivation and one chunk, not the whole file. A chunk that fails to authenticate is never
+ * exposed; we die instead. Elsewhere, where userfaultfd is not permitted, or where chunks are
+ * smaller than a page, every chunk is authenticated and decrypted when the view is opened. */
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  Threecrypt_ChunkedV1* chunked;   /* Keys and cipher state; used only by the view while it is open. */
+  const SSC_MemMap*     input_map; /* The mapped Chunked_V1 file. */
+  uint8_t*              base;      /* The first byte of the view. */
+  uint64_t              size;      /* Plaintext bytes visible through the view. */
+  size_t                mapped;    /* Bytes reserved for the view; a whole number of chunks. */
+  uint8_t*              staging;   /* One chunk of plaintext on its way into the view. */
+  int                   uffd;      /* The userfaultfd, or -1 if the view was decrypted eagerly. */
+  int                   stop [2];  /* A pipe; writing to stop[1] stops the fault handler. */
+#if defined(__linux__)
+  pthread_t             handler;
+#endif
+} Threecrypt_LazyView;
+
+/* Authenticate the header and table of the mapped Chunked_V1 file @input_map and open a view of
+ * its plaintext in @view. @ctx->keying must be loaded and its secret initialized, and @ctx and
+ * @input_map must not be used by anything else until the view is closed.
+ * Returns an error message, leaving nothing to close, or SSC_NULL. */
+const char*
+lazy_view_open(Threecrypt_LazyView* R_ view, Threecrypt_ChunkedV1* R_ ctx, const SSC_MemMap* R_ input_map);
+
+/* Close the view @view, discarding its plaintext. */
+void
+lazy_view_close(Threecrypt_LazyView* R_ view);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif
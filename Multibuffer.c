@@ -0,0 +1,457 @@
+#include <SSC/Operation.h>
+#include "Multibuffer.h"
+#include "Throttle.h"
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <pthread.h>
+#endif
+
+#define R_ SSC_RESTRICT
+#define L_ THREECRYPT_MB_LANES
+#define BLOCK_BYTES_ PPQ_THREEFISH512_BLOCK_BYTES
+#define C240_ UINT64_C(0x1BD11BDAA9FC1A22)
+
+/* Skein-512 UBI type values. */
+#define TYPE_KEY_ UINT64_C(0)
+#define TYPE_CFG_ UINT64_C(4)
+#define TYPE_MSG_ UINT64_C(48)
+#define TYPE_OUT_ UINT64_C(63)
+#define CFG_BYTES_ 32
+
+static const int Rotations_[8][4] = {
+  {46, 36, 19, 37}, {33, 27, 14, 42}, {17, 49, 36, 39}, {44,  9, 54, 56},
+  {39, 30, 34, 24}, {13, 50, 10, 17}, {25, 29, 39, 43}, { 8, 35, 56, 22}
+};
+static const int Permutation_[8] = {2, 1, 4, 7, 6, 5, 0, 3};
+
+/* Encipher the lane-interleaved blocks @v, each lane under its own @key and @tweak,
+ * whose parity words (key[8], tweak[2]) must already be computed. */
+static void
+threefish512_lanes_(uint64_t v[8][L_], uint64_t key[9][L_], uint64_t tweak[3][L_])
+{
+  uint64_t f [8][L_];
+  for (int s = 0; s < 18; ++s) {
+    for (int i = 0; i < 8; ++i)
+      for (int l = 0; l < L_; ++l)
+        v[i][l] += key[(s + i) % 9][l];
+    for (int l = 0; l < L_; ++l) {
+      v[5][l] += tweak[s % 3][l];
+      v[6][l] += tweak[(s + 1) % 3][l];
+      v[7][l] += (uint64_t)s;
+    }
+    for (int r = 0; r < 4; ++r) {
+      const int* const rot = Rotations_[((s % 2) * 4) + r];
+      for (int j = 0; j < 4; ++j) {
+        for (int l = 0; l < L_; ++l) {
+          const uint64_t x = v[2 * j][l] + v[(2 * j) + 1][l];
+          const uint64_t y = v[(2 * j) + 1][l];
+          f[2 * j][l]       = x;
+          f[(2 * j) + 1][l] = ((y << rot[j]) | (y >> (64 - rot[j]))) ^ x;
+        }
+      }
+      for (int i = 0; i < 8; ++i)
+        for (int l = 0; l < L_; ++l)
+          v[i][l] = f[Permutation_[i]][l];
+    }
+  }
+  for (int i = 0; i < 8; ++i)
+    for (int l = 0; l < L_; ++l)
+      v[i][l] += key[(18 + i) % 9][l];
+  for (int l = 0; l < L_; ++l) {
+    v[5][l] += tweak[18 % 3][l];
+    v[6][l] += tweak[(18 + 1) % 3][l];
+    v[7][l] += UINT64_C(18);
+  }
+  SSC_secureZero(f, sizeof(f));
+}
+
+/* Compute the key parity word of lane @l. */
+static void
+key_parity_(uint64_t key[9][L_], int l)
+{
+  key[8][l] = C240_;
+  for (int i = 0; i < 8; ++i)
+    key[8][l] ^= key[i][l];
+}
+
+typedef struct {
+  const Threecrypt_MbCtrJob* job; /* SSC_NULL when the lane is idle. */
+  uint64_t                   block;
+} CtrLane_;
+
+/* Give lane @l the next non-empty job from @jobs, if any are left. */
+static void
+ctr_assign_(
+ CtrLane_*                  lane,
+ uint64_t                   key[9][L_],
+ uint64_t                   tweak[3][L_],
+ int                        l,
+ const Threecrypt_MbCtrJob* jobs,
+ size_t                     count,
+ size_t*                    next)
+{
+  lane->job = SSC_NULL;
+  while ((*next < count) && !jobs[*next].size)
+    ++(*next);
+  if (*next == count)
+    return;
+  lane->job   = &jobs[(*next)++];
+  lane->block = lane->job->first_block;
+  for (int i = 0; i < 8; ++i)
+    key[i][l] = lane->job->key[i];
+  key_parity_(key, l);
+  tweak[0][l] = lane->job->tweak[0];
+  tweak[1][l] = lane->job->tweak[1];
+  tweak[2][l] = tweak[0][l] ^ tweak[1][l];
+}
+
+static void
+ctr_lanes_(const Threecrypt_MbCtrJob* R_ jobs, size_t count)
+{
+  uint64_t key   [9][L_] = {{0}};
+  uint64_t tweak [3][L_] = {{0}};
+  uint64_t v     [8][L_];
+  uint8_t  keystream [BLOCK_BYTES_];
+  CtrLane_ lanes [L_];
+  size_t   next = 0;
+  int      active = 0;
+  for (int l = 0; l < L_; ++l) {
+    ctr_assign_(&lanes[l], key, tweak, l, jobs, count, &next);
+    active += (lanes[l].job != SSC_NULL);
+  }
+  while (active) {
+    /* Keystream block i of a lane is LE64(i) || 0^24 || iv, as in threecrypt_ctr_xor(). */
+    for (int l = 0; l < L_; ++l) {
+      const CtrLane_* const lane = &lanes[l];
+      v[0][l] = lane->job ? lane->block : 0;
+      v[1][l] = 0;
+      v[2][l] = 0;
+      v[3][l] = 0;
+      for (int i = 4; i < 8; ++i)
+        v[i][l] = lane->job ? threecrypt_load64(lane->job->iv + ((i - 4) * 8)) : 0;
+    }
+    threefish512_lanes_(v, key, tweak);
+    for (int l = 0; l < L_; ++l) {
+      CtrLane_* const lane = &lanes[l];
+      if (!lane->job)
+        continue;
+      for (int i = 0; i < 8; ++i)
+        threecrypt_store64(keystream + (i * 8), v[i][l]);
+      const uint64_t offset = (lane->block - lane->job->first_block) * BLOCK_BYTES_;
+      uint64_t n = lane->job->size - offset;
+      if (n > BLOCK_BYTES_)
+        n = BLOCK_BYTES_;
+      for (uint64_t i = 0; i < n; ++i)
+        lane->job->output[offset + i] = lane->job->input[offset + i] ^ keystream[i];
+      if ((offset + n) == lane->job->size) {
+        ctr_assign_(lane, key, tweak, l, jobs, count, &next);
+        active -= (lane->job == SSC_NULL);
+      } else
+        ++lane->block;
+    }
+  }
+  SSC_secureZero(key, sizeof(key));
+  SSC_secureZero(v, sizeof(v));
+  SSC_secureZero(keystream, sizeof(keystream));
+}
+
+enum {
+  STAGE_KEY_ = 0,
+  STAGE_CFG_ = 1,
+  STAGE_MSG_ = 2,
+  STAGE_OUT_ = 3
+};
+
+typedef struct {
+  const Threecrypt_MbMacJob* job; /* SSC_NULL when the lane is idle. */
+  const uint8_t*             data;
+  uint64_t                   size;
+  uint64_t                   pos;
+  uint64_t                   type;
+  uint64_t                   out_block;
+  uint64_t                   g [8]; /* The chaining value after the message, for output blocks. */
+  int                        stage;
+  bool                       first;
+  uint8_t                    buffer [CFG_BYTES_]; /* The config block, or an output block counter. */
+} MacLane_;
+
+/* Begin the UBI invocation of lane @l over the @size bytes at @data. */
+static void
+mac_begin_ubi_(MacLane_* lane, const uint8_t* data, uint64_t size, uint64_t type)
+{
+  lane->data  = data;
+  lane->size  = size;
+  lane->pos   = 0;
+  lane->type  = type;
+  lane->first = true;
+}
+
+/* Begin the configuration UBI invocation of @lane, for an output of its job's size. */
+static void
+mac_begin_cfg_(MacLane_* lane)
+{
+  memset(lane->buffer, 0, sizeof(lane->buffer));
+  memcpy(lane->buffer, "SHA3", 4);
+  lane->buffer[4] = 1;
+  threecrypt_store64(lane->buffer + 8, lane->job->output_size * 8);
+  lane->stage = STAGE_CFG_;
+  mac_begin_ubi_(lane, lane->buffer, CFG_BYTES_, TYPE_CFG_);
+}
+
+/* Give lane @l the next job from @jobs, if any are left. */
+static void
+mac_assign_(
+ MacLane_*                  lane,
+ uint64_t                   key[9][L_],
+ int                        l,
+ const Threecrypt_MbMacJob* jobs,
+ size_t                     count,
+ size_t*                    next)
+{
+  lane->job = SSC_NULL;
+  if (*next == count)
+    return;
+  lane->job   = &jobs[(*next)++];
+  lane->stage = STAGE_KEY_;
+  for (int i = 0; i < 8; ++i)
+    key[i][l] = 0;
+  if (lane->job->key)
+    mac_begin_ubi_(lane, lane->job->key, BLOCK_BYTES_, TYPE_KEY_);
+  else
+    mac_begin_cfg_(lane);
+}
+
+/* Lane @l finished a UBI invocation, leaving its chaining value in @key. Begin the next one,
+ * or the next job. Returns false if the lane has become idle. */
+static bool
+mac_advance_(
+ MacLane_*                  lane,
+ uint64_t                   key[9][L_],
+ int                        l,
+ const Threecrypt_MbMacJob* jobs,
+ size_t                     count,
+ size_t*                    next)
+{
+  switch (lane->stage) {
+  case STAGE_KEY_:
+    mac_begin_cfg_(lane);
+    return true;
+  case STAGE_CFG_:
+    mac_begin_ubi_(lane, lane->job->input, lane->job->size, TYPE_MSG_);
+    break;
+  case STAGE_MSG_:
+    for (int i = 0; i < 8; ++i)
+      lane->g[i] = key[i][l];
+    lane->out_block = 0;
+    threecrypt_store64(lane->buffer, 0);
+    mac_begin_ubi_(lane, lane->buffer, 8, TYPE_OUT_);
+    break;
+  case STAGE_OUT_: {
+    uint8_t block [BLOCK_BYTES_];
+    for (int i = 0; i < 8; ++i)
+      threecrypt_store64(block + (i * 8), key[i][l]);
+    const uint64_t offset = lane->out_block * BLOCK_BYTES_;
+    uint64_t n = lane->job->output_size - offset;
+    if (n > BLOCK_BYTES_)
+      n = BLOCK_BYTES_;
+    memcpy(lane->job->output + offset, block, n);
+    SSC_secureZero(block, sizeof(block));
+    if ((offset + n) < lane->job->output_size) {
+      for (int i = 0; i < 8; ++i)
+        key[i][l] = lane->g[i];
+      threecrypt_store64(lane->buffer, ++lane->out_block);
+      mac_begin_ubi_(lane, lane->buffer, 8, TYPE_OUT_);
+      return true; /* Still in STAGE_OUT_. */
+    }
+    mac_assign_(lane, key, l, jobs, count, next);
+    return lane->job != SSC_NULL;
+  }
+  }
+  ++lane->stage;
+  return true;
+}
+
+static void
+mac_lanes_(const Threecrypt_MbMacJob* R_ jobs, size_t count)
+{
+  uint64_t key   [9][L_] = {{0}};
+  uint64_t tweak [3][L_] = {{0}};
+  uint64_t v     [8][L_];
+  uint64_t m     [8][L_];
+  uint8_t  block [BLOCK_BYTES_];
+  MacLane_ lanes [L_];
+  size_t   next = 0;
+  int      active = 0;
+  for (int l = 0; l < L_; ++l) {
+    mac_assign_(&lanes[l], key, l, jobs, count, &next);
+    active += (lanes[l].job != SSC_NULL);
+  }
+  while (active) {
+    bool final [L_];
+    for (int l = 0; l < L_; ++l) {
+      MacLane_* const lane = &lanes[l];
+      final[l] = false;
+      memset(block, 0, sizeof(block));
+      if (lane->job) {
+        uint64_t n = lane->size - lane->pos;
+        if (n > BLOCK_BYTES_)
+          n = BLOCK_BYTES_;
+        if (n)
+          memcpy(block, lane->data + lane->pos, n);
+        lane->pos += n;
+        final[l] = (lane->pos == lane->size);
+        tweak[0][l] = lane->pos;
+        tweak[1][l] = (lane->type << 56) | ((uint64_t)lane->first << 62) | ((uint64_t)final[l] << 63);
+        lane->first = false;
+      }
+      tweak[2][l] = tweak[0][l] ^ tweak[1][l];
+      key_parity_(key, l);
+      for (int i = 0; i < 8; ++i)
+        m[i][l] = v[i][l] = threecrypt_load64(block + (i * 8));
+    }
+    threefish512_lanes_(v, key, tweak);
+    for (int i = 0; i < 8; ++i)
+      for (int l = 0; l < L_; ++l)
+        key[i][l] = v[i][l] ^ m[i][l];
+    for (int l = 0; l < L_; ++l) {
+      if (lanes[l].job && final[l] && !mac_advance_(&lanes[l], key, l, jobs, count, &next))
+        --active;
+    }
+  }
+  SSC_secureZero(key, sizeof(key));
+  SSC_secureZero(v, sizeof(v));
+  SSC_secureZero(m, sizeof(m));
+  SSC_secureZero(block, sizeof(block));
+  SSC_secureZero(lanes, sizeof(lanes));
+}
+
+/* The Skein-512-512 known answers of the Skein 1.3 specification, Appendix C.3, for the messages
+ * of 1, 64 and 128 bytes counting down from 0xFF. */
+enum { PUBLISHED_JOBS_ = 3 };
+static const uint64_t Published_Sizes_[PUBLISHED_JOBS_] = {1, 64, 128};
+static const uint8_t  Published_Digests_[PUBLISHED_JOBS_][64] = {
+ {0x71, 0xb7, 0xbc, 0xe6, 0xfe, 0x64, 0x52, 0x22, 0x7b, 0x9c, 0xed, 0x60, 0x14, 0x24, 0x9e, 0x5b,
+  0xf9, 0xa9, 0x75, 0x4c, 0x3a, 0xd6, 0x18, 0xcc, 0xc4, 0xe0, 0xaa, 0xe1, 0x6b, 0x31, 0x6c, 0xc8,
+  0xca, 0x69, 0x8d, 0x86, 0x43, 0x07, 0xed, 0x3e, 0x80, 0xb6, 0xef, 0x15, 0x70, 0x81, 0x2a, 0xc5,
+  0x27, 0x2d, 0xc4, 0x09, 0xb5, 0xa0, 0x12, 0xdf, 0x2a, 0x57, 0x91, 0x02, 0xf3, 0x40, 0x61, 0x7a},
+ {0x45, 0x86, 0x3b, 0xa3, 0xbe, 0x0c, 0x4d, 0xfc, 0x27, 0xe7, 0x5d, 0x35, 0x84, 0x96, 0xf4, 0xac,
+  0x9a, 0x73, 0x6a, 0x50, 0x5d, 0x93, 0x13, 0xb4, 0x2b, 0x2f, 0x5e, 0xad, 0xa7, 0x9f, 0xc1, 0x7f,
+  0x63, 0x86, 0x1e, 0x94, 0x7a, 0xfb, 0x1d, 0x05, 0x6a, 0xa1, 0x99, 0x57, 0x5a, 0xd3, 0xf8, 0xc9,
+  0xa3, 0xcc, 0x17, 0x80, 0xb5, 0xe5, 0xfa, 0x4c, 0xae, 0x05, 0x0e, 0x98, 0x98, 0x76, 0x62, 0x5b},
+ {0x91, 0xcc, 0xa5, 0x10, 0xc2, 0x63, 0xc4, 0xdd, 0xd0, 0x10, 0x53, 0x0a, 0x33, 0x07, 0x33, 0x09,
+  0x62, 0x86, 0x31, 0xf3, 0x08, 0x74, 0x7e, 0x1b, 0xcb, 0xaa, 0x90, 0xe4, 0x51, 0xca, 0xb9, 0x2e,
+  0x51, 0x88, 0x08, 0x7a, 0xf4, 0x18, 0x87, 0x73, 0xa3, 0x32, 0x30, 0x3e, 0x66, 0x67, 0xa7, 0xa2,
+  0x10, 0x85, 0x6f, 0x74, 0x21, 0x39, 0x00, 0x00, 0x71, 0xf4, 0x8e, 0x8b, 0xa2, 0xa5, 0xad, 0xb7}
+};
+
+/* Beyond the published answers, more jobs of awkward sizes than there are lanes, drawn from a fixed
+ * generator, each checked against the single-stream Threecrypt_Ctr and PPQ_Skein512_mac(). */
+enum { KAT_JOBS_ = 19, KAT_MAX_ = (BLOCK_BYTES_ * 3) + 1 };
+typedef struct {
+  uint8_t  data  [KAT_MAX_];
+  uint8_t  keys  [KAT_JOBS_][BLOCK_BYTES_];
+  uint64_t words [KAT_JOBS_][PPQ_THREEFISH512_EXTERNAL_KEY_WORDS + PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS];
+  uint8_t  output [2][KAT_JOBS_][KAT_MAX_]; /* Of the CTR jobs, then of the MAC jobs. */
+  uint8_t  expected [KAT_MAX_];
+  uint8_t  published [PUBLISHED_JOBS_][64];
+  Threecrypt_MbCtrJob ctr_jobs [KAT_JOBS_];
+  Threecrypt_MbMacJob mac_jobs [KAT_JOBS_];
+  Threecrypt_MbMacJob published_jobs [PUBLISHED_JOBS_];
+  Threecrypt_Ctr      ctr;
+  PPQ_UBI512          ubi512;
+} Kat_;
+
+static void
+kat_init_(Kat_* R_ kat)
+{
+  static const uint64_t sizes [11] = {0, 1, 63, 64, 65, 127, 128, 129, 191, 192, 193};
+  uint64_t x = UINT64_C(0x9E3779B97F4A7C15);
+  memset(kat, 0, sizeof(*kat));
+  for (size_t i = 0; i < sizeof(kat->data); ++i)
+    kat->data[i] = (uint8_t)((x = (x * UINT64_C(6364136223846793005)) + 1) >> 56);
+  for (int j = 0; j < KAT_JOBS_; ++j) {
+    for (int i = 0; i < BLOCK_BYTES_; ++i)
+      kat->keys[j][i] = (uint8_t)((x = (x * UINT64_C(6364136223846793005)) + 1) >> 56);
+    for (int i = 0; i < (int)(sizeof(kat->words[j]) / sizeof(uint64_t)); ++i)
+      kat->words[j][i] = (x = (x * UINT64_C(6364136223846793005)) + 1);
+    const uint64_t size = sizes[j % 11];
+    kat->ctr_jobs[j] = (Threecrypt_MbCtrJob){
+     kat->words[j], kat->words[j] + PPQ_THREEFISH512_EXTERNAL_KEY_WORDS, kat->keys[j], kat->data, kat->output[0][j],
+     size, (uint64_t)j};
+    kat->mac_jobs[j] = (Threecrypt_MbMacJob){
+     kat->keys[j], kat->data, kat->output[1][j], size, (j % 3) ? BLOCK_BYTES_ : (BLOCK_BYTES_ * 2) + 3};
+  }
+  /* The published messages are prefixes of one countdown; the unkeyed jobs are plain Skein-512 hashes. */
+  for (int i = 0; i < BLOCK_BYTES_ * 2; ++i)
+    kat->expected[i] = (uint8_t)(0xff - i);
+  for (int j = 0; j < PUBLISHED_JOBS_; ++j)
+    kat->published_jobs[j] = (Threecrypt_MbMacJob){SSC_NULL, kat->expected, kat->published[j], Published_Sizes_[j], 64};
+}
+
+/* Run the engine on the known-answer test, dying if it disagrees with the published answers, or with
+ * the single-stream primitives, in any byte. */
+static void
+self_test_(void)
+{
+  Kat_* const kat = (Kat_*)SSC_mallocOrDie(sizeof(Kat_));
+  kat_init_(kat);
+  mac_lanes_(kat->published_jobs, PUBLISHED_JOBS_);
+  bool ok = !memcmp(kat->published, Published_Digests_, sizeof(Published_Digests_));
+  ctr_lanes_(kat->ctr_jobs, KAT_JOBS_);
+  mac_lanes_(kat->mac_jobs, KAT_JOBS_);
+  for (int j = 0; (j < KAT_JOBS_) && ok; ++j) {
+    /* Threecrypt_Ctr stores the key schedule's parity word, so it is keyed with a copy. */
+    uint64_t words [PPQ_THREEFISH512_EXTERNAL_KEY_WORDS + PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS];
+    memcpy(words, kat->words[j], sizeof(words));
+    const Threecrypt_MbCtrJob* const c = &kat->ctr_jobs[j];
+    threecrypt_ctr_init(&kat->ctr, words, words + PPQ_THREEFISH512_EXTERNAL_KEY_WORDS, c->iv);
+    threecrypt_ctr_xor(&kat->ctr, kat->expected, c->input, c->size, c->first_block * BLOCK_BYTES_);
+    ok = !memcmp(kat->expected, c->output, (size_t)c->size);
+    const Threecrypt_MbMacJob* const m = &kat->mac_jobs[j];
+    PPQ_Skein512_mac(&kat->ubi512, kat->expected, m->input, m->key, m->output_size, m->size);
+    ok = ok && !memcmp(kat->expected, m->output, (size_t)m->output_size);
+  }
+  SSC_secureZero(kat, sizeof(*kat));
+  free(kat);
+  SSC_assertMsg(
+   ok, "Error: The multi-buffer Threefish-512 engine failed its known-answer test; 3crypt was miscompiled!\n");
+}
+
+#if defined(SSC_OS_UNIXLIKE)
+static pthread_once_t Checked_ = PTHREAD_ONCE_INIT;
+#endif
+
+/* Run the known-answer test the first time the engine is used, once even if batches begin concurrently. */
+static void
+check_(void)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_once(&Checked_, self_test_);
+#else
+  /* Elsewhere batches are never run concurrently. */
+  static bool checked = false;
+  if (!checked) {
+    self_test_();
+    checked = true;
+  }
+#endif
+}
+
+void
+threecrypt_mb_ctr_xor(const Threecrypt_MbCtrJob* R_ jobs, size_t count)
+{
+  check_();
+  ctr_lanes_(jobs, count);
+  /* The lanes are throttled a batch at a time. */
+  uint64_t total = 0;
+  for (size_t i = 0; i < count; ++i)
+    total += jobs[i].size;
+  throttle_account(total);
+}
+
+void
+threecrypt_mb_skein512_mac(const Threecrypt_MbMacJob* R_ jobs, size_t count)
+{
+  check_();
+  mac_lanes_(jobs, count);
+}
@@ -0,0 +1,66 @@
+#ifndef THREECRYPT_MULTIBUFFER_H
+#define THREECRYPT_MULTIBUFFER_H
+
+#include <SSC/Macro.h>
+#include <PPQ/Skein512.h>
+#include "Primitive.h"
+
+/* A multi-buffer engine, running THREECRYPT_MB_LANES independent Threefish-512 computations
+ * in lockstep. The lanes are interleaved word by word, so every step of a round is the same
+ * operation across all lanes, which compilers turn into SIMD instructions.
+ *
+ * A single CTR stream or Skein-512 UBI chain is a long serial dependency chain, so encrypting
+ * or MACing one small file leaves most of the vector units idle. Given a batch of independent
+ * jobs, the engine keeps every lane busy with a different job, refilling lanes from the batch
+ * as their jobs finish, so a batch of small files approaches the cipher's peak throughput.
+ *
+ * The first time it is used, the engine checks itself against the published Skein-512-512 known
+ * answers, and against the single-stream Threecrypt_Ctr and PPQ_Skein512_mac() on jobs of awkward
+ * sizes, and dies if any byte differs. */
+#if defined(THREECRYPT_EXTERN_MB_LANES)
+ #define THREECRYPT_MB_LANES THREECRYPT_EXTERN_MB_LANES
+#elif defined(__AVX512F__)
+ #define THREECRYPT_MB_LANES 8
+#else
+ #define THREECRYPT_MB_LANES 4
+#endif
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+/* XOR the keystream of Threecrypt_Ctr keyed with @key, @tweak and @iv, beginning at keystream
+ * block @first_block, with the @size bytes at @input, storing the result at @output.
+ * A long stream may be split into several jobs, which then run in parallel. */
+typedef struct {
+  const uint64_t* key;   /* PPQ_THREEFISH512_EXTERNAL_KEY_WORDS */
+  const uint64_t* tweak; /* PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS */
+  const uint8_t*  iv;    /* THREECRYPT_CTR_IV_BYTES */
+  const uint8_t*  input;
+  uint8_t*        output;
+  uint64_t        size;
+  uint64_t        first_block;
+} Threecrypt_MbCtrJob;
+
+/* Compute the @output_size byte Skein-512 MAC of the @size bytes at @input under the 64 byte @key,
+ * exactly as PPQ_Skein512_mac() does, storing it at @output. If @key is SSC_NULL, compute the plain
+ * Skein-512 hash instead. */
+typedef struct {
+  const uint8_t* key;
+  const uint8_t* input;
+  uint8_t*       output;
+  uint64_t       size;
+  uint64_t       output_size;
+} Threecrypt_MbMacJob;
+
+/* Run the @count CTR @jobs. */
+void
+threecrypt_mb_ctr_xor(const Threecrypt_MbCtrJob* R_ jobs, size_t count);
+
+/* Run the @count MAC @jobs. */
+void
+threecrypt_mb_skein512_mac(const Threecrypt_MbMacJob* R_ jobs, size_t count);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
@@ -0,0 +1,366 @@
+#include <SSC/Operation.h>
+#include "Poly1305.h"
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <pthread.h>
+#endif
+
+#define R_ SSC_RESTRICT
+#define L_ THREECRYPT_POLY1305_LANES
+
+#define MASK26_ UINT32_C(0x3ffffff)
+#define HIBIT_  (UINT32_C(1) << 24)
+/* Shorter runs of blocks are absorbed faster one at a time than split across the lanes and recombined. */
+#define LANE_MIN_BYTES_ 512
+/* The lane kernel is inlined into each of its ISA-specific entry points, and compiled for each. */
+#if THREECRYPT_POLY1305_AVX2_DISPATCH
+ #define KERNEL_ static inline __attribute__((always_inline))
+#else
+ #define KERNEL_ static
+#endif
+
+static inline uint32_t
+load32_(const uint8_t* p)
+{
+  return ((uint32_t)p[0]) | (((uint32_t)p[1]) << 8) | (((uint32_t)p[2]) << 16) | (((uint32_t)p[3]) << 24);
+}
+
+static inline void
+store32_(uint8_t* p, uint32_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+/* h *= r, mod 2^130 - 5, partially. */
+static inline void
+mul_(uint32_t* R_ h, const uint32_t* R_ r)
+{
+  const uint32_t s1 = r[1] * 5, s2 = r[2] * 5, s3 = r[3] * 5, s4 = r[4] * 5;
+  uint64_t d0 = ((uint64_t)h[0] * r[0]) + ((uint64_t)h[1] * s4) + ((uint64_t)h[2] * s3) + ((uint64_t)h[3] * s2) + ((uint64_t)h[4] * s1);
+  uint64_t d1 = ((uint64_t)h[0] * r[1]) + ((uint64_t)h[1] * r[0]) + ((uint64_t)h[2] * s4) + ((uint64_t)h[3] * s3) + ((uint64_t)h[4] * s2);
+  uint64_t d2 = ((uint64_t)h[0] * r[2]) + ((uint64_t)h[1] * r[1]) + ((uint64_t)h[2] * r[0]) + ((uint64_t)h[3] * s4) + ((uint64_t)h[4] * s3);
+  uint64_t d3 = ((uint64_t)h[0] * r[3]) + ((uint64_t)h[1] * r[2]) + ((uint64_t)h[2] * r[1]) + ((uint64_t)h[3] * r[0]) + ((uint64_t)h[4] * s4);
+  uint64_t d4 = ((uint64_t)h[0] * r[4]) + ((uint64_t)h[1] * r[3]) + ((uint64_t)h[2] * r[2]) + ((uint64_t)h[3] * r[1]) + ((uint64_t)h[4] * r[0]);
+  uint32_t c;
+  c = (uint32_t)(d0 >> 26); h[0] = (uint32_t)d0 & MASK26_;
+  d1 += c; c = (uint32_t)(d1 >> 26); h[1] = (uint32_t)d1 & MASK26_;
+  d2 += c; c = (uint32_t)(d2 >> 26); h[2] = (uint32_t)d2 & MASK26_;
+  d3 += c; c = (uint32_t)(d3 >> 26); h[3] = (uint32_t)d3 & MASK26_;
+  d4 += c; c = (uint32_t)(d4 >> 26); h[4] = (uint32_t)d4 & MASK26_;
+  h[0] += c * 5; c = h[0] >> 26; h[0] &= MASK26_;
+  h[1] += c;
+}
+
+static void
+init_(Threecrypt_Poly1305* R_ ctx, const uint8_t* R_ key)
+{
+  /* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+  ctx->r[0] = (load32_(key +  0)     ) & UINT32_C(0x3ffffff);
+  ctx->r[1] = (load32_(key +  3) >> 2) & UINT32_C(0x3ffff03);
+  ctx->r[2] = (load32_(key +  6) >> 4) & UINT32_C(0x3ffc0ff);
+  ctx->r[3] = (load32_(key +  9) >> 6) & UINT32_C(0x3f03fff);
+  ctx->r[4] = (load32_(key + 12) >> 8) & UINT32_C(0x00fffff);
+  memcpy(ctx->powers[L_ - 1], ctx->r, sizeof(ctx->r));
+  for (int i = L_ - 2; i >= 0; --i) {
+    memcpy(ctx->powers[i], ctx->powers[i + 1], sizeof(ctx->r));
+    mul_(ctx->powers[i], ctx->r);
+  }
+  for (int i = 0; i < 5; ++i)
+    ctx->h[i] = 0;
+  for (int i = 0; i < 4; ++i)
+    ctx->pad[i] = load32_(key + 16 + (i * 4));
+  ctx->leftover = 0;
+}
+
+/* Load the L_ consecutive blocks at @m into the limbs @n, limb i of block l at n[i][l], each with 2^128 added. */
+static inline void
+load_lanes_(uint32_t n [5][L_], const uint8_t* R_ m)
+{
+  for (int l = 0; l < L_; ++l) {
+    n[0][l] = (load32_(m + (l * 16) +  0)     ) & MASK26_;
+    n[1][l] = (load32_(m + (l * 16) +  3) >> 2) & MASK26_;
+    n[2][l] = (load32_(m + (l * 16) +  6) >> 4) & MASK26_;
+    n[3][l] = (load32_(m + (l * 16) +  9) >> 6) & MASK26_;
+    n[4][l] = (load32_(m + (l * 16) + 12) >> 8) | HIBIT_;
+  }
+}
+
+/* Absorb the @size bytes at @m, a multiple of L_ blocks no fewer than 2 * L_, block j into accumulator j % L_.
+ * The loop over the lanes holds no dependency between them, so the compiler vectorizes it. */
+KERNEL_ void
+lane_blocks_(Threecrypt_Poly1305* R_ ctx, const uint8_t* R_ m, uint64_t size)
+{
+  uint32_t h [5][L_];
+  uint32_t n [5][L_];
+  uint32_t r [5], s [5];
+  for (int i = 0; i < 5; ++i) {
+    r[i] = ctx->powers[0][i];
+    s[i] = r[i] * 5;
+  }
+  load_lanes_(h, m);
+  for (int i = 0; i < 5; ++i)
+    h[i][0] += ctx->h[i];
+  m    += L_ * 16;
+  size -= L_ * 16;
+  while (size) {
+    load_lanes_(n, m);
+    /* h = (h * r^L_) + m, mod 2^130 - 5, partially. */
+    for (int l = 0; l < L_; ++l) {
+      const uint64_t h0 = h[0][l], h1 = h[1][l], h2 = h[2][l], h3 = h[3][l], h4 = h[4][l];
+      uint64_t d0 = (h0 * r[0]) + (h1 * s[4]) + (h2 * s[3]) + (h3 * s[2]) + (h4 * s[1]);
+      uint64_t d1 = (h0 * r[1]) + (h1 * r[0]) + (h2 * s[4]) + (h3 * s[3]) + (h4 * s[2]);
+      uint64_t d2 = (h0 * r[2]) + (h1 * r[1]) + (h2 * r[0]) + (h3 * s[4]) + (h4 * s[3]);
+      uint64_t d3 = (h0 * r[3]) + (h1 * r[2]) + (h2 * r[1]) + (h3 * r[0]) + (h4 * s[4]);
+      uint64_t d4 = (h0 * r[4]) + (h1 * r[3]) + (h2 * r[2]) + (h3 * r[1]) + (h4 * r[0]);
+      d1 += d0 >> 26; d0 &= MASK26_;
+      d2 += d1 >> 26; d1 &= MASK26_;
+      d3 += d2 >> 26; d2 &= MASK26_;
+      d4 += d3 >> 26; d3 &= MASK26_;
+      d0 += (d4 >> 26) * 5; d4 &= MASK26_;
+      d1 += d0 >> 26; d0 &= MASK26_;
+      h[0][l] = (uint32_t)d0 + n[0][l];
+      h[1][l] = (uint32_t)d1 + n[1][l];
+      h[2][l] = (uint32_t)d2 + n[2][l];
+      h[3][l] = (uint32_t)d3 + n[3][l];
+      h[4][l] = (uint32_t)d4 + n[4][l];
+    }
+    m    += L_ * 16;
+    size -= L_ * 16;
+  }
+  /* Accumulator l still owes r^(L_ - l), one r for each block of the run that follows its last. */
+  uint32_t sum [5] = {0};
+  for (int l = 0; l < L_; ++l) {
+    uint32_t t [5] = {h[0][l], h[1][l], h[2][l], h[3][l], h[4][l]};
+    mul_(t, ctx->powers[l]);
+    for (int i = 0; i < 5; ++i)
+      sum[i] += t[i];
+  }
+  uint32_t c;
+  c = sum[0] >> 26; sum[0] &= MASK26_;
+  sum[1] += c; c = sum[1] >> 26; sum[1] &= MASK26_;
+  sum[2] += c; c = sum[2] >> 26; sum[2] &= MASK26_;
+  sum[3] += c; c = sum[3] >> 26; sum[3] &= MASK26_;
+  sum[4] += c; c = sum[4] >> 26; sum[4] &= MASK26_;
+  sum[0] += c * 5; c = sum[0] >> 26; sum[0] &= MASK26_;
+  sum[1] += c;
+  memcpy(ctx->h, sum, sizeof(sum));
+  SSC_secureZero(h, sizeof(h));
+  SSC_secureZero(n, sizeof(n));
+}
+
+typedef void (*Lanes_)(Threecrypt_Poly1305* R_, const uint8_t* R_, uint64_t);
+
+#if THREECRYPT_POLY1305_AVX2_DISPATCH
+static void
+lanes_baseline_(Threecrypt_Poly1305* R_ ctx, const uint8_t* R_ m, uint64_t size)
+{
+  lane_blocks_(ctx, m, size);
+}
+
+__attribute__((target("avx2"))) static void
+lanes_avx2_(Threecrypt_Poly1305* R_ ctx, const uint8_t* R_ m, uint64_t size)
+{
+  lane_blocks_(ctx, m, size);
+}
+
+/* Returns the fastest lane kernel this processor can run. */
+static Lanes_
+select_lanes_(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? lanes_avx2_ : lanes_baseline_;
+}
+#else
+static Lanes_
+select_lanes_(void)
+{
+  return lane_blocks_;
+}
+#endif
+
+/* Absorb the whole 16 byte blocks of the @size bytes at @m, each with 2^128 added unless @final. */
+static void
+blocks_(Threecrypt_Poly1305* R_ ctx, const uint8_t* R_ m, uint64_t size, bool final)
+{
+  if (!final && (size >= LANE_MIN_BYTES_)) {
+    const uint64_t whole = size & ~(uint64_t)((L_ * 16) - 1);
+    select_lanes_()(ctx, m, whole);
+    m    += whole;
+    size -= whole;
+  }
+  const uint32_t hibit = final ? 0 : HIBIT_;
+  const uint32_t r0 = ctx->r[0], r1 = ctx->r[1], r2 = ctx->r[2], r3 = ctx->r[3], r4 = ctx->r[4];
+  const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+  uint32_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2], h3 = ctx->h[3], h4 = ctx->h[4];
+  while (size >= 16) {
+    /* h += m */
+    h0 += (load32_(m +  0)     ) & MASK26_;
+    h1 += (load32_(m +  3) >> 2) & MASK26_;
+    h2 += (load32_(m +  6) >> 4) & MASK26_;
+    h3 += (load32_(m +  9) >> 6) & MASK26_;
+    h4 += (load32_(m + 12) >> 8) | hibit;
+    /* h *= r, mod 2^130 - 5, partially. */
+    uint64_t d0 = ((uint64_t)h0 * r0) + ((uint64_t)h1 * s4) + ((uint64_t)h2 * s3) + ((uint64_t)h3 * s2) + ((uint64_t)h4 * s1);
+    uint64_t d1 = ((uint64_t)h0 * r1) + ((uint64_t)h1 * r0) + ((uint64_t)h2 * s4) + ((uint64_t)h3 * s3) + ((uint64_t)h4 * s2);
+    uint64_t d2 = ((uint64_t)h0 * r2) + ((uint64_t)h1 * r1) + ((uint64_t)h2 * r0) + ((uint64_t)h3 * s4) + ((uint64_t)h4 * s3);
+    uint64_t d3 = ((uint64_t)h0 * r3) + ((uint64_t)h1 * r2) + ((uint64_t)h2 * r1) + ((uint64_t)h3 * r0) + ((uint64_t)h4 * s4);
+    uint64_t d4 = ((uint64_t)h0 * r4) + ((uint64_t)h1 * r3) + ((uint64_t)h2 * r2) + ((uint64_t)h3 * r1) + ((uint64_t)h4 * r0);
+    uint32_t c;
+    c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & MASK26_;
+    d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & MASK26_;
+    d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & MASK26_;
+    d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & MASK26_;
+    d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & MASK26_;
+    h0 += c * 5; c = h0 >> 26; h0 &= MASK26_;
+    h1 += c;
+    m    += 16;
+    size -= 16;
+  }
+  ctx->h[0] = h0; ctx->h[1] = h1; ctx->h[2] = h2; ctx->h[3] = h3; ctx->h[4] = h4;
+}
+
+/* The known answer of RFC 8439, section 2.5.2. */
+static const uint8_t Published_Key_ [THREECRYPT_POLY1305_KEY_BYTES] = {
+  0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+  0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b
+};
+static const char    Published_Message_ [] = "Cryptographic Forum Research Group";
+static const uint8_t Published_Tag_ [THREECRYPT_POLY1305_TAG_BYTES] = {
+  0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6, 0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9
+};
+
+/* Beyond the published answer, messages long enough for the lanes, drawn from a fixed generator, are
+ * each checked against absorbing them a block at a time, which never reaches the lanes. */
+enum { KAT_MAX_ = 1000 };
+
+static void
+self_test_(void)
+{
+  static const size_t sizes [] = {LANE_MIN_BYTES_, LANE_MIN_BYTES_ + 63, KAT_MAX_};
+  Threecrypt_Poly1305 ctx;
+  uint8_t key [THREECRYPT_POLY1305_KEY_BYTES];
+  uint8_t data [KAT_MAX_];
+  uint8_t tag [2][THREECRYPT_POLY1305_TAG_BYTES];
+  uint64_t x = UINT64_C(0x9E3779B97F4A7C15);
+  for (size_t i = 0; i < sizeof(key); ++i)
+    key[i] = (uint8_t)((x = (x * UINT64_C(6364136223846793005)) + 1) >> 56);
+  for (size_t i = 0; i < sizeof(data); ++i)
+    data[i] = (uint8_t)((x = (x * UINT64_C(6364136223846793005)) + 1) >> 56);
+  init_(&ctx, Published_Key_);
+  threecrypt_poly1305_update(&ctx, (const uint8_t*)Published_Message_, sizeof(Published_Message_) - 1);
+  threecrypt_poly1305_final(&ctx, tag[0]);
+  bool ok = !memcmp(tag[0], Published_Tag_, sizeof(Published_Tag_));
+  for (size_t j = 0; (j < sizeof(sizes) / sizeof(*sizes)) && ok; ++j) {
+    init_(&ctx, key);
+    threecrypt_poly1305_update(&ctx, data, sizes[j]);
+    threecrypt_poly1305_final(&ctx, tag[0]);
+    init_(&ctx, key);
+    for (size_t i = 0; i < sizes[j]; i += 16)
+      threecrypt_poly1305_update(&ctx, data + i, ((sizes[j] - i) < 16) ? (sizes[j] - i) : 16);
+    threecrypt_poly1305_final(&ctx, tag[1]);
+    ok = !memcmp(tag[0], tag[1], sizeof(tag[0]));
+  }
+  SSC_assertMsg(ok, "Error: Poly1305 failed its known-answer test; 3crypt was miscompiled!\n");
+}
+
+#if defined(SSC_OS_UNIXLIKE)
+static pthread_once_t Checked_ = PTHREAD_ONCE_INIT;
+#endif
+
+void
+threecrypt_poly1305_init(Threecrypt_Poly1305* R_ ctx, const uint8_t* R_ key)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_once(&Checked_, self_test_);
+#else
+  /* Elsewhere keys are never set concurrently. */
+  static bool checked = false;
+  if (!checked) {
+    self_test_();
+    checked = true;
+  }
+#endif
+  init_(ctx, key);
+}
+
+void
+threecrypt_poly1305_update(Threecrypt_Poly1305* R_ ctx, const uint8_t* R_ input, uint64_t size)
+{
+  if (ctx->leftover) {
+    size_t want = 16 - ctx->leftover;
+    if (want > size)
+      want = (size_t)size;
+    memcpy(ctx->buffer + ctx->leftover, input, want);
+    ctx->leftover += want;
+    input += want;
+    size  -= want;
+    if (ctx->leftover < 16)
+      return;
+    blocks_(ctx, ctx->buffer, 16, false);
+    ctx->leftover = 0;
+  }
+  if (size >= 16) {
+    const uint64_t whole = size & ~UINT64_C(15);
+    blocks_(ctx, input, whole, false);
+    input += whole;
+    size  -= whole;
+  }
+  if (size) {
+    memcpy(ctx->buffer, input, (size_t)size);
+    ctx->leftover = (size_t)size;
+  }
+}
+
+void
+threecrypt_poly1305_final(Threecrypt_Poly1305* R_ ctx, uint8_t* R_ tag)
+{
+  if (ctx->leftover) {
+    /* The last partial block is padded with a 1 byte, in place of the 2^128 bit. */
+    ctx->buffer[ctx->leftover] = 1;
+    memset(ctx->buffer + ctx->leftover + 1, 0, 16 - ctx->leftover - 1);
+    blocks_(ctx, ctx->buffer, 16, true);
+  }
+  uint32_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2], h3 = ctx->h[3], h4 = ctx->h[4];
+  uint32_t c;
+  /* Fully carry h. */
+  c = h1 >> 26; h1 &= MASK26_;
+  h2 += c; c = h2 >> 26; h2 &= MASK26_;
+  h3 += c; c = h3 >> 26; h3 &= MASK26_;
+  h4 += c; c = h4 >> 26; h4 &= MASK26_;
+  h0 += c * 5; c = h0 >> 26; h0 &= MASK26_;
+  h1 += c;
+  /* g = h + -p */
+  uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= MASK26_;
+  uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= MASK26_;
+  uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= MASK26_;
+  uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= MASK26_;
+  uint32_t g4 = h4 + c - (UINT32_C(1) << 26);
+  /* Select h if h < p, or g if h >= p, in constant time. */
+  uint32_t mask = (g4 >> 31) - 1;
+  g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+  mask = ~mask;
+  h0 = (h0 & mask) | g0;
+  h1 = (h1 & mask) | g1;
+  h2 = (h2 & mask) | g2;
+  h3 = (h3 & mask) | g3;
+  h4 = (h4 & mask) | g4;
+  /* h %= 2^128 */
+  h0 = ((h0      ) | (h1 << 26));
+  h1 = ((h1 >>  6) | (h2 << 20));
+  h2 = ((h2 >> 12) | (h3 << 14));
+  h3 = ((h3 >> 18) | (h4 <<  8));
+  /* tag = (h + pad) % 2^128 */
+  uint64_t f;
+  f = (uint64_t)h0 + ctx->pad[0];             h0 = (uint32_t)f;
+  f = (uint64_t)h1 + ctx->pad[1] + (f >> 32); h1 = (uint32_t)f;
+  f = (uint64_t)h2 + ctx->pad[2] + (f >> 32); h2 = (uint32_t)f;
+  f = (uint64_t)h3 + ctx->pad[3] + (f >> 32); h3 = (uint32_t)f;
+  store32_(tag +  0, h0);
+  store32_(tag +  4, h1);
+  store32_(tag +  8, h2);
+  store32_(tag + 12, h3);
+  SSC_secureZero(ctx, sizeof(*ctx));
+}
@@ -0,0 +1,57 @@
+#ifndef THREECRYPT_POLY1305_H
+#define THREECRYPT_POLY1305_H
+
+#include <SSC/Macro.h>
+
+/* The Poly1305 one-time authenticator. A key must never be used for more than one message.
+ * The accumulator is kept in five 26-bit limbs, so only 32x32->64-bit multiplies are needed.
+ *
+ * Evaluating the polynomial one block at a time is a serial chain of multiplies, so long runs of
+ * blocks are split across THREECRYPT_POLY1305_LANES accumulators instead: accumulator l absorbs
+ * blocks l, l + 8, l + 16, ... multiplying by r^8 each time, and at the end of the run the
+ * accumulators are multiplied by r^8, r^7, ... r and summed. The lanes are interleaved limb by
+ * limb, so compilers vectorize them, four 64-bit products to an AVX2 register. Eight lanes rather
+ * than four keep the compiler from unrolling the lanes into scalar code. As with ChaCha20,
+ * when the compiler supports it (THREECRYPT_EXTERN_AVX2_DISPATCH) the lanes are compiled for both
+ * the baseline and AVX2, and the AVX2 kernel is used wherever the processor has it.
+ *
+ * The first time a key is set, the tag is checked against the published known answer of RFC 8439,
+ * section 2.5.2, and the lanes against the serial evaluation of a long message. */
+#define THREECRYPT_POLY1305_KEY_BYTES 32
+#define THREECRYPT_POLY1305_TAG_BYTES 16
+#define THREECRYPT_POLY1305_LANES     8
+#if defined(THREECRYPT_EXTERN_AVX2_DISPATCH) && !defined(__AVX2__) &&\
+    (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+ #define THREECRYPT_POLY1305_AVX2_DISPATCH 1
+#else
+ #define THREECRYPT_POLY1305_AVX2_DISPATCH 0
+#endif
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  uint32_t r        [5];
+  uint32_t powers   [THREECRYPT_POLY1305_LANES][5]; /* r^8, r^7, ... r. */
+  uint32_t h        [5];
+  uint32_t pad      [4];
+  uint8_t  buffer   [16];
+  size_t   leftover;
+} Threecrypt_Poly1305;
+
+/* Key @ctx with the THREECRYPT_POLY1305_KEY_BYTES @key. */
+void
+threecrypt_poly1305_init(Threecrypt_Poly1305* R_ ctx, const uint8_t* R_ key);
+
+/* Absorb the @size bytes at @input. */
+void
+threecrypt_poly1305_update(Threecrypt_Poly1305* R_ ctx, const uint8_t* R_ input, uint64_t size);
+
+/* Store the THREECRYPT_POLY1305_TAG_BYTES tag of everything absorbed in @tag, and zero @ctx. */
+void
+threecrypt_poly1305_final(Threecrypt_Poly1305* R_ ctx, uint8_t* R_ tag);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
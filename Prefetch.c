@@ -0,0 +1,116 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For fallocate() and readahead(). */
+#endif
+#include <SSC/Operation.h>
+#include "Prefetch.h"
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
+
+#define R_ SSC_RESTRICT
+#define CHUNK_BYTES_ (UINT64_C(1) << 20)
+
+#if defined(SSC_OS_UNIXLIKE)
+/* Have the kernel read the @n bytes at @offset of @file into the page cache, without copying
+ * them anywhere. Where it cannot be asked to, read them into @buffer and wipe it. Returns false
+ * once nothing more can be read. */
+static bool
+read_ahead_(int file, uint64_t offset, uint64_t n, uint8_t* R_ buffer)
+{
+#if defined(__linux__)
+  (void)buffer;
+  return !readahead(file, (off64_t)offset, (size_t)n);
+#elif defined(POSIX_FADV_WILLNEED)
+  (void)buffer;
+  return !posix_fadvise(file, (off_t)offset, (off_t)n, POSIX_FADV_WILLNEED);
+#else
+  const ssize_t got = pread(file, buffer, (size_t)n, (off_t)offset);
+  if (got > 0)
+    SSC_secureZero(buffer, (size_t)got);
+  return got == (ssize_t)n;
+#endif
+}
+
+static bool
+stopped_(Threecrypt_Prefetch* R_ ctx)
+{
+  pthread_mutex_lock(&ctx->lock);
+  const bool stop = ctx->stop;
+  pthread_mutex_unlock(&ctx->lock);
+  return stop;
+}
+
+static void*
+prepare_(void* arg)
+{
+  Threecrypt_Prefetch* const ctx = (Threecrypt_Prefetch*)arg;
+  /* Failing to reserve the output is harmless; it is then allocated as it is written. */
+#if defined(__linux__)
+  if (ctx->output && ctx->output->size)
+    (void)fallocate(ctx->output->file, 0, 0, (off_t)ctx->output->size);
+#endif
+  const uint64_t size = (uint64_t)ctx->input->size;
+  if (ctx->input_offset >= size)
+    return SSC_NULL;
+  uint64_t end = size;
+  if ((end - ctx->input_offset) > THREECRYPT_PREFETCH_MAX_BYTES)
+    end = ctx->input_offset + THREECRYPT_PREFETCH_MAX_BYTES;
+#ifdef POSIX_FADV_SEQUENTIAL
+  (void)posix_fadvise(ctx->input->file, (off_t)ctx->input_offset, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#if defined(__linux__) || defined(POSIX_FADV_WILLNEED)
+  uint8_t* const buffer = SSC_NULL;
+#else
+  uint8_t* const buffer = (uint8_t*)malloc((size_t)CHUNK_BYTES_);
+  if (!buffer)
+    return SSC_NULL;
+#endif
+  /* A chunk at a time, so we stop soon after the key is ready. */
+  for (uint64_t offset = ctx->input_offset; (offset < end) && !stopped_(ctx); ) {
+    const uint64_t n = ((end - offset) < CHUNK_BYTES_) ? (end - offset) : CHUNK_BYTES_;
+    if (!read_ahead_(ctx->input->file, offset, n, buffer))
+      break;
+    offset += n;
+  }
+  free(buffer);
+  return SSC_NULL;
+}
+#endif /* ! SSC_OS_UNIXLIKE */
+
+void
+threecrypt_prefetch_begin(
+ Threecrypt_Prefetch* R_ ctx,
+ const SSC_MemMap*       input,
+ uint64_t                input_offset,
+ const SSC_MemMap*       output)
+{
+  ctx->input        = input;
+  ctx->output       = output;
+  ctx->input_offset = input_offset;
+  ctx->started      = false;
+#if defined(SSC_OS_UNIXLIKE)
+  ctx->stop = false;
+  pthread_mutex_init(&ctx->lock, SSC_NULL);
+  /* Without a helper thread, the data pass simply begins cold. */
+  ctx->started = !pthread_create(&ctx->thread, SSC_NULL, prepare_, ctx);
+  if (!ctx->started)
+    pthread_mutex_destroy(&ctx->lock);
+#endif
+}
+
+void
+threecrypt_prefetch_end(Threecrypt_Prefetch* R_ ctx)
+{
+  if (!ctx->started)
+    return;
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_mutex_lock(&ctx->lock);
+  ctx->stop = true;
+  pthread_mutex_unlock(&ctx->lock);
+  pthread_join(ctx->thread, SSC_NULL);
+  pthread_mutex_destroy(&ctx->lock);
+#endif
+  ctx->started = false;
+}
@@ -0,0 +1,58 @@
+#ifndef THREECRYPT_PREFETCH_H
+#define THREECRYPT_PREFETCH_H
+
+#include <SSC/Macro.h>
+#include <SSC/MemMap.h>
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <pthread.h>
+#endif
+
+/* Preparation of the files of an encryption or decryption while its key is derived.
+ *
+ * A password-keyed file spends seconds in Catena before the data pass touches the files, which then
+ * waits on the disk for its first reads and on the filesystem to allocate the output. Instead, a
+ * helper thread reserves the blocks of the output and has the kernel read the input ahead into the
+ * page cache, with readahead(2) or POSIX_FADV_WILLNEED, from where the data pass will begin, for as
+ * long as the key-derivation runs, up to THREECRYPT_PREFETCH_MAX_BYTES. The data pass then starts
+ * on a warm cache. No copy of the input is made outside the page cache, except where the kernel
+ * cannot be asked to read ahead, and that copy is wiped as soon as it is read. */
+#ifdef THREECRYPT_EXTERN_PREFETCH_MAX_MIB
+ #define THREECRYPT_PREFETCH_MAX_BYTES ((uint64_t)THREECRYPT_EXTERN_PREFETCH_MAX_MIB << 20)
+#else
+ #define THREECRYPT_PREFETCH_MAX_BYTES (UINT64_C(256) << 20)
+#endif
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  const SSC_MemMap* input;        /* Read ahead from @input_offset. */
+  const SSC_MemMap* output;       /* Allocated, unless SSC_NULL. */
+  uint64_t          input_offset;
+#if defined(SSC_OS_UNIXLIKE)
+  pthread_t         thread;
+  pthread_mutex_t   lock;
+  bool              stop;         /* The key is ready; stop reading ahead. */
+#endif
+  bool              started;
+} Threecrypt_Prefetch;
+
+/* Begin preparing @input, read ahead from @input_offset, and @output, unless SSC_NULL, on a helper
+ * thread. The files must be open and their sizes set. @ctx must be zeroed before the first call, so
+ * threecrypt_prefetch_end() may be called whether or not preparation was begun. */
+void
+threecrypt_prefetch_begin(
+ Threecrypt_Prefetch* R_ ctx,
+ const SSC_MemMap*       input,
+ uint64_t                input_offset,
+ const SSC_MemMap*       output);
+
+/* Stop preparing, once the key is ready, and wait for the helper thread. */
+void
+threecrypt_prefetch_end(Threecrypt_Prefetch* R_ ctx);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
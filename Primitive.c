@@ -0,0 +1,320 @@
+#include <SSC/Operation.h>
+#include "Primitive.h"
+#include "Throttle.h"
+
+#define R_ SSC_RESTRICT
+#define BLOCK_BYTES_ PPQ_THREEFISH512_BLOCK_BYTES
+#define MAX_ID_BYTES_ 64
+
+void
+threecrypt_ctr_init(
+ Threecrypt_Ctr* R_ ctx,
+ uint64_t* R_       key,
+ uint64_t* R_       tweak,
+ const uint8_t* R_  iv)
+{
+  PPQ_Threefish512Static_init(&ctx->threefish512, key, tweak);
+  memset(ctx->block, 0, sizeof(ctx->block));
+  memcpy(ctx->block + (BLOCK_BYTES_ - THREECRYPT_CTR_IV_BYTES), iv, THREECRYPT_CTR_IV_BYTES);
+}
+
+void
+threecrypt_ctr_xor(
+ Threecrypt_Ctr* R_ ctx,
+ uint8_t*           output,
+ const uint8_t*     input,
+ uint64_t           size,
+ uint64_t           starting_byte)
+{
+  uint64_t counter = starting_byte / BLOCK_BYTES_;
+  uint64_t offset  = starting_byte % BLOCK_BYTES_;
+  uint64_t unthrottled = 0;
+  while (size) {
+    threecrypt_store64(ctx->block, counter++);
+    PPQ_Threefish512Static_encipher(&ctx->threefish512, ctx->keystream, ctx->block);
+    uint64_t n = BLOCK_BYTES_ - offset;
+    if (n > size)
+      n = size;
+    for (uint64_t i = 0; i < n; ++i)
+      output[i] = input[i] ^ ctx->keystream[offset + i];
+    output += n;
+    input  += n;
+    size   -= n;
+    offset  = 0;
+    unthrottled += n;
+    if (unthrottled >= THREECRYPT_THROTTLE_QUANTUM) {
+      throttle_account(unthrottled);
+      unthrottled = 0;
+    }
+  }
+  if (unthrottled)
+    throttle_account(unthrottled);
+  SSC_secureZero(ctx->keystream, sizeof(ctx->keystream));
+}
+
+/* Skein-512 UBI type values. */
+#define TYPE_KEY_ UINT64_C(0)
+#define TYPE_CFG_ UINT64_C(4)
+#define TYPE_MSG_ UINT64_C(48)
+#define TYPE_OUT_ UINT64_C(63)
+#define CFG_BYTES_ 32
+
+/* Chain one UBI @block of @type, ending at message byte @position, into @ctx->chain. */
+static void
+ubi_block_(Threecrypt_Mac* R_ ctx, const uint8_t* R_ block, uint64_t position, uint64_t type, bool first, bool final)
+{
+  uint8_t enciphered [BLOCK_BYTES_];
+  ctx->tweak[0] = position;
+  ctx->tweak[1] = (ctx->level << 48) | (type << 56) | ((uint64_t)first << 62) | ((uint64_t)final << 63);
+  PPQ_Threefish512Static_init(&ctx->threefish512, ctx->chain, ctx->tweak);
+  PPQ_Threefish512Static_encipher(&ctx->threefish512, enciphered, block);
+  for (int i = 0; i < 8; ++i)
+    ctx->chain[i] = threecrypt_load64(enciphered + (i * 8)) ^ threecrypt_load64(block + (i * 8));
+  SSC_secureZero(enciphered, sizeof(enciphered));
+}
+
+/* Chain a UBI invocation of @type over the @size bytes at @data, which fit in one block. */
+static void
+ubi_short_(Threecrypt_Mac* R_ ctx, const uint8_t* R_ data, size_t size, uint64_t type)
+{
+  uint8_t block [BLOCK_BYTES_] = {0};
+  memcpy(block, data, size);
+  ubi_block_(ctx, block, size, type, true, true);
+  SSC_secureZero(block, sizeof(block));
+}
+
+/* Chain the key and a configuration block with the given tree parameters, all zero for sequential hashing. */
+static void
+key_config_(
+ Threecrypt_Mac* R_ ctx,
+ const uint8_t* R_  key,
+ uint64_t           output_size,
+ unsigned           leaf_log2,
+ unsigned           fanout_log2,
+ unsigned           max_height)
+{
+  uint8_t config [CFG_BYTES_] = {'S', 'H', 'A', '3', 1};
+  memset(ctx->chain, 0, sizeof(ctx->chain));
+  ctx->level = 0;
+  ubi_short_(ctx, key, BLOCK_BYTES_, TYPE_KEY_);
+  threecrypt_store64(config + 8, output_size * 8);
+  config[16] = (uint8_t)leaf_log2;
+  config[17] = (uint8_t)fanout_log2;
+  config[18] = (uint8_t)max_height;
+  ubi_short_(ctx, config, sizeof(config), TYPE_CFG_);
+  ctx->start       = 0;
+  ctx->position    = 0;
+  ctx->output_size = output_size;
+  ctx->buffered    = 0;
+}
+
+/* Chain the last, final, message block. */
+static void
+ubi_final_(Threecrypt_Mac* R_ ctx)
+{
+  memset(ctx->buffer + ctx->buffered, 0, BLOCK_BYTES_ - ctx->buffered);
+  ubi_block_(ctx, ctx->buffer, ctx->position, TYPE_MSG_, (ctx->position - ctx->start) <= BLOCK_BYTES_, true);
+}
+
+/* Run the output transform from @ctx->chain, storing @ctx->output_size bytes at @output. */
+static void
+output_(Threecrypt_Mac* R_ ctx, uint8_t* R_ output)
+{
+  uint64_t message [PPQ_THREEFISH512_BLOCK_WORDS];
+  memcpy(message, ctx->chain, sizeof(message));
+  ctx->level = 0;
+  for (uint64_t i = 0; (i * BLOCK_BYTES_) < ctx->output_size; ++i) {
+    uint8_t counter [8];
+    uint8_t block   [BLOCK_BYTES_];
+    memcpy(ctx->chain, message, sizeof(message));
+    threecrypt_store64(counter, i);
+    ubi_short_(ctx, counter, sizeof(counter), TYPE_OUT_);
+    for (int j = 0; j < 8; ++j)
+      threecrypt_store64(block + (j * 8), ctx->chain[j]);
+    uint64_t n = ctx->output_size - (i * BLOCK_BYTES_);
+    if (n > BLOCK_BYTES_)
+      n = BLOCK_BYTES_;
+    memcpy(output + (i * BLOCK_BYTES_), block, (size_t)n);
+    SSC_secureZero(block, sizeof(block));
+  }
+  SSC_secureZero(message, sizeof(message));
+}
+
+void
+threecrypt_mac_init(Threecrypt_Mac* R_ ctx, const uint8_t* R_ key, uint64_t output_size)
+{
+  key_config_(ctx, key, output_size, 0, 0, 0);
+}
+
+void
+threecrypt_mac_update(Threecrypt_Mac* R_ ctx, const uint8_t* R_ input, uint64_t size)
+{
+  /* A full buffer is only chained once more input arrives, since the last block is flagged final. */
+  while (size) {
+    if (ctx->buffered == BLOCK_BYTES_) {
+      ubi_block_(ctx, ctx->buffer, ctx->position, TYPE_MSG_, (ctx->position - ctx->start) == BLOCK_BYTES_, false);
+      ctx->buffered = 0;
+    }
+    uint64_t n = BLOCK_BYTES_ - ctx->buffered;
+    if (n > size)
+      n = size;
+    memcpy(ctx->buffer + ctx->buffered, input, (size_t)n);
+    ctx->buffered += (size_t)n;
+    ctx->position += n;
+    input += n;
+    size  -= n;
+  }
+}
+
+void
+threecrypt_mac_final(Threecrypt_Mac* R_ ctx, uint8_t* R_ output)
+{
+  ubi_final_(ctx);
+  output_(ctx, output);
+  SSC_secureZero(ctx, sizeof(*ctx));
+}
+
+/* Tree levels never reach the maximum height, which would collapse the top of the tree. */
+#define MAX_HEIGHT_ 255
+
+/* Begin the UBI invocation of the node at tree @level whose input begins at byte @start of its level. */
+static void
+node_init_(const Threecrypt_TreeMac* R_ ctx, Threecrypt_Mac* R_ node, uint64_t level, uint64_t start)
+{
+  memcpy(node->chain, ctx->key.chain, sizeof(node->chain));
+  node->start    = start;
+  node->position = start;
+  node->level    = level;
+  node->buffered = 0;
+}
+
+void
+threecrypt_tree_mac_init(
+ Threecrypt_TreeMac* R_ ctx,
+ const uint8_t* R_      key,
+ uint64_t               output_size,
+ uint64_t               message_size,
+ unsigned               leaf_log2,
+ unsigned               fanout_log2)
+{
+  SSC_assert((leaf_log2 >= 1) && (leaf_log2 <= 32) && (fanout_log2 >= 1) && (fanout_log2 <= 32));
+  key_config_(&ctx->key, key, output_size, leaf_log2, fanout_log2, MAX_HEIGHT_);
+  ctx->leaf_bytes = (uint64_t)BLOCK_BYTES_ << leaf_log2;
+  ctx->fanout     = UINT64_C(1) << fanout_log2;
+  memset(ctx->width, 0, sizeof(ctx->width));
+  memset(ctx->added, 0, sizeof(ctx->added));
+  /* An empty message is a single empty leaf. */
+  uint64_t width = message_size ? (((message_size - 1) / ctx->leaf_bytes) + 1) : 1;
+  ctx->width[1] = width;
+  for (int level = 2; width > 1; ++level) {
+    SSC_assert(level < THREECRYPT_TREE_MAC_MAX_LEVELS);
+    width = ((width - 1) / ctx->fanout) + 1;
+    ctx->width[level] = width;
+  }
+}
+
+void
+threecrypt_tree_mac_leaf_init(const Threecrypt_TreeMac* R_ ctx, Threecrypt_Mac* R_ leaf, uint64_t index)
+{
+  node_init_(ctx, leaf, 1, index * ctx->leaf_bytes);
+}
+
+/* Finish @node, storing its chaining value at @output, and wipe it. */
+static void
+node_final_(Threecrypt_Mac* R_ node, uint8_t* R_ output)
+{
+  ubi_final_(node);
+  for (int i = 0; i < 8; ++i)
+    threecrypt_store64(output + (i * 8), node->chain[i]);
+  SSC_secureZero(node, sizeof(*node));
+}
+
+void
+threecrypt_tree_mac_leaf_final(Threecrypt_Mac* R_ leaf, uint8_t* R_ output)
+{
+  node_final_(leaf, output);
+}
+
+/* Add the next chaining value of @level to the node above it, closing that node once it is full
+ * or has the last chaining value of @level. The one chaining value of the top level is the root. */
+static void
+add_(Threecrypt_TreeMac* R_ ctx, int level, const uint8_t* R_ chaining_value)
+{
+  if (ctx->width[level] == 1) {
+    memcpy(ctx->root, chaining_value, sizeof(ctx->root));
+    return;
+  }
+  Threecrypt_Mac* const node = &ctx->nodes[level + 1];
+  const uint64_t i = ctx->added[level]++;
+  if (!(i % ctx->fanout))
+    node_init_(ctx, node, (uint64_t)(level + 1), (i / ctx->fanout) * ctx->fanout * BLOCK_BYTES_);
+  threecrypt_mac_update(node, chaining_value, BLOCK_BYTES_);
+  if ((((i + 1) % ctx->fanout) == 0) || ((i + 1) == ctx->width[level])) {
+    uint8_t above [BLOCK_BYTES_];
+    node_final_(node, above);
+    add_(ctx, level + 1, above);
+    SSC_secureZero(above, sizeof(above));
+  }
+}
+
+void
+threecrypt_tree_mac_add(Threecrypt_TreeMac* R_ ctx, const uint8_t* R_ chaining_value)
+{
+  add_(ctx, 1, chaining_value);
+}
+
+void
+threecrypt_tree_mac_final(Threecrypt_TreeMac* R_ ctx, uint8_t* R_ output)
+{
+  for (int i = 0; i < 8; ++i)
+    ctx->key.chain[i] = threecrypt_load64(ctx->root + (i * 8));
+  output_(&ctx->key, output);
+  SSC_secureZero(ctx, sizeof(*ctx));
+}
+
+void
+threecrypt_kdf(
+ PPQ_UBI512* R_    ubi512,
+ uint8_t* R_       output,
+ uint64_t          output_size,
+ const uint8_t* R_ master_key,
+ const char* R_    id,
+ size_t            id_size,
+ const uint8_t* R_ salt)
+{
+  uint8_t message [MAX_ID_BYTES_ + THREECRYPT_KDF_SALT_BYTES];
+  SSC_assert(id_size <= MAX_ID_BYTES_);
+  memcpy(message, id, id_size);
+  memcpy(message + id_size, salt, THREECRYPT_KDF_SALT_BYTES);
+  PPQ_Skein512_mac(ubi512, output, message, master_key, output_size, id_size + THREECRYPT_KDF_SALT_BYTES);
+  SSC_secureZero(message, sizeof(message));
+}
+
+bool
+threecrypt_ct_equal(const uint8_t* R_ a, const uint8_t* R_ b, size_t size)
+{
+  uint8_t diff = 0;
+  for (size_t i = 0; i < size; ++i)
+    diff |= (uint8_t)(a[i] ^ b[i]);
+  return diff == 0;
+}
+
+char*
+threecrypt_with_suffix(const char* R_ path, const char* R_ suffix)
+{
+  const size_t path_size = strlen(path);
+  const size_t suffix_size = strlen(suffix);
+  char* const s = (char*)SSC_mallocOrDie(path_size + suffix_size + 1);
+  memcpy(s, path, path_size);
+  memcpy(s + path_size, suffix, suffix_size + 1);
+  return s;
+}
+
+void
+threecrypt_print_hex(const char* R_ label, const uint8_t* R_ bytes, size_t size)
+{
+  printf("%s", label);
+  for (size_t i = 0; i < size; ++i)
+    printf("%02x", bytes[i]);
+  putchar('\n');
+}
@@ -0,0 +1,161 @@
+#ifndef THREECRYPT_PRIMITIVE_H
+#define THREECRYPT_PRIMITIVE_H
+
+#include <SSC/Macro.h>
+#include <PPQ/Skein512.h>
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+/* Threefish-512 in counter mode, as used by the file formats 3crypt implements itself.
+ * Keystream block i is Threefish-512(key, tweak, LE64(i) || 0^24 || iv). */
+#define THREECRYPT_CTR_IV_BYTES 32
+typedef struct {
+  PPQ_Threefish512Static threefish512;
+  uint8_t                block     [PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t                keystream [PPQ_THREEFISH512_BLOCK_BYTES];
+} Threecrypt_Ctr;
+
+/* Key @ctx with @key and @tweak. @key must have room for PPQ_THREEFISH512_EXTERNAL_KEY_WORDS
+ * and @tweak for PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS. */
+void
+threecrypt_ctr_init(
+ Threecrypt_Ctr* R_ ctx,
+ uint64_t* R_       key,
+ uint64_t* R_       tweak,
+ const uint8_t* R_  iv);
+
+/* XOR @size bytes of keystream, beginning at keystream byte @starting_byte, with @input
+ * and store the result in @output. @input and @output may be the same buffer. */
+void
+threecrypt_ctr_xor(
+ Threecrypt_Ctr* R_ ctx,
+ uint8_t*           output,
+ const uint8_t*     input,
+ uint64_t           size,
+ uint64_t           starting_byte);
+
+/* Skein-512-MAC computed incrementally, for messages that are never in memory all at once.
+ * The result is exactly that of PPQ_Skein512_mac() over the concatenation of every update. */
+typedef struct {
+  PPQ_Threefish512Static threefish512;
+  uint64_t               chain  [PPQ_THREEFISH512_EXTERNAL_KEY_WORDS];
+  uint64_t               tweak  [PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS];
+  uint8_t                buffer [PPQ_THREEFISH512_BLOCK_BYTES]; /* The last, possibly final, message block. */
+  uint64_t               start;       /* The message position of the first byte, for tree nodes. */
+  uint64_t               position;    /* The message position of the next byte. */
+  uint64_t               output_size; /* Bytes of MAC to produce. */
+  uint64_t               level;       /* The tree level of a tree node, otherwise zero. */
+  size_t                 buffered;
+} Threecrypt_Mac;
+
+/* Begin an @output_size byte MAC under the 64 byte @key. */
+void
+threecrypt_mac_init(Threecrypt_Mac* R_ ctx, const uint8_t* R_ key, uint64_t output_size);
+
+/* Append the @size bytes at @input to the message. */
+void
+threecrypt_mac_update(Threecrypt_Mac* R_ ctx, const uint8_t* R_ input, uint64_t size);
+
+/* Store the MAC of the whole message at @output, and wipe @ctx. */
+void
+threecrypt_mac_final(Threecrypt_Mac* R_ ctx, uint8_t* R_ output);
+
+/* Skein-512-MAC in Skein's tree mode, so long messages can be authenticated on many cores.
+ * The message is split into leaves of 2^leaf_log2 blocks, each hashed on its own, in any order and
+ * on any thread, with threecrypt_tree_mac_leaf_*(). Their chaining values are then added in order
+ * and combined 2^fanout_log2 to a node, level by level, up to the single root the MAC is output from.
+ * Only the leaves are hashed in parallel; the levels above hold a 2^(leaf_log2 + 6)th of the message. */
+#define THREECRYPT_TREE_MAC_MAX_LEVELS 8
+typedef struct {
+  Threecrypt_Mac key;   /* Chained through the key and the tree configuration. */
+  Threecrypt_Mac nodes [THREECRYPT_TREE_MAC_MAX_LEVELS]; /* The open node of each level above the leaves. */
+  uint64_t       width [THREECRYPT_TREE_MAC_MAX_LEVELS]; /* The chaining values of each level; level 1 is the leaves. */
+  uint64_t       added [THREECRYPT_TREE_MAC_MAX_LEVELS]; /* Those added to the level above so far. */
+  uint64_t       leaf_bytes;
+  uint64_t       fanout;
+  uint8_t        root  [PPQ_THREEFISH512_BLOCK_BYTES];
+} Threecrypt_TreeMac;
+
+/* Begin an @output_size byte MAC under the 64 byte @key of a @message_size byte message,
+ * hashed in leaves of 2^@leaf_log2 blocks and nodes of 2^@fanout_log2 chaining values. */
+void
+threecrypt_tree_mac_init(
+ Threecrypt_TreeMac* R_ ctx,
+ const uint8_t* R_      key,
+ uint64_t               output_size,
+ uint64_t               message_size,
+ unsigned               leaf_log2,
+ unsigned               fanout_log2);
+
+/* Returns the number of leaves the message is split into; leaf i begins at message byte
+ * i * @ctx->leaf_bytes. */
+static inline uint64_t
+threecrypt_tree_mac_leaves(const Threecrypt_TreeMac* ctx)
+{
+  return ctx->width[1];
+}
+
+/* Begin hashing leaf @index into @leaf, whose bytes are then appended with threecrypt_mac_update().
+ * Only reads @ctx, so any number of leaves may be hashed at once. */
+void
+threecrypt_tree_mac_leaf_init(const Threecrypt_TreeMac* R_ ctx, Threecrypt_Mac* R_ leaf, uint64_t index);
+
+/* Store the 64 byte chaining value of @leaf at @output, and wipe @leaf. */
+void
+threecrypt_tree_mac_leaf_final(Threecrypt_Mac* R_ leaf, uint8_t* R_ output);
+
+/* Add the chaining value of the next leaf, in order. */
+void
+threecrypt_tree_mac_add(Threecrypt_TreeMac* R_ ctx, const uint8_t* R_ chaining_value);
+
+/* Once every leaf has been added, store the MAC at @output, and wipe @ctx. */
+void
+threecrypt_tree_mac_final(Threecrypt_TreeMac* R_ ctx, uint8_t* R_ output);
+
+/* Derive @output_size bytes of keying material from the 512-bit @master_key.
+ * The derivation is domain-separated by the @id of the file format using it
+ * and a per-file random @salt: Skein512-MAC(@master_key, @id || @salt). */
+#define THREECRYPT_KDF_SALT_BYTES 32
+void
+threecrypt_kdf(
+ PPQ_UBI512* R_    ubi512,
+ uint8_t* R_       output,
+ uint64_t          output_size,
+ const uint8_t* R_ master_key,
+ const char* R_    id,
+ size_t            id_size,
+ const uint8_t* R_ salt);
+
+/* Compare @size bytes of @a and @b in constant time. */
+bool
+threecrypt_ct_equal(const uint8_t* R_ a, const uint8_t* R_ b, size_t size);
+
+/* Returns @path with @suffix appended, which the caller frees. */
+char*
+threecrypt_with_suffix(const char* R_ path, const char* R_ suffix);
+
+/* Print @label, then the @size bytes at @bytes in hex, then a newline. For dumping file headers. */
+void
+threecrypt_print_hex(const char* R_ label, const uint8_t* R_ bytes, size_t size);
+
+static inline void
+threecrypt_store64(uint8_t* p, uint64_t v)
+{
+  for (int i = 0; i < 8; ++i)
+    p[i] = (uint8_t)(v >> (i * 8));
+}
+
+static inline uint64_t
+threecrypt_load64(const uint8_t* p)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < 8; ++i)
+    v |= ((uint64_t)p[i]) << (i * 8);
+  return v;
+}
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
@@ -0,0 +1,553 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For fileno() and fsync(). */
+#endif
+#include <stdio.h>
+#include <SSC/Operation.h>
+#include "SegmentedV1.h"
+#include "Durability.h"
+#include "Journal.h"
+
+#ifdef THREECRYPT_SEGMENTED_V1_H
+
+#if   defined(SSC_OS_UNIXLIKE)
+ #include <sys/stat.h>
+ #include <unistd.h>
+ #define SYNC_FILE_(File) fsync(fileno(File))
+#elif defined(SSC_OS_WINDOWS)
+ #include <io.h>
+ #define SYNC_FILE_(File) _commit(_fileno(File))
+#endif
+
+#define R_ SSC_RESTRICT
+
+#define MAC_BYTES_            THREECRYPT_SEGMENTED_V1_MAC_BYTES
+#define HEADER_BYTES_         THREECRYPT_SEGMENTED_V1_HEADER_BYTES
+#define SEGMENT_HEADER_BYTES_ THREECRYPT_SEGMENTED_V1_SEGMENT_HEADER_BYTES
+#define SEGMENT_META_BYTES_   THREECRYPT_SEGMENTED_V1_SEGMENT_META_BYTES
+#define TRAILER_BYTES_        THREECRYPT_SEGMENTED_V1_TRAILER_BYTES
+#define KEYING_OFFSET_        THREECRYPT_SEGMENTED_V1_KEYING_OFFSET
+#define TWEAK_OFFSET_         (KEYING_OFFSET_ + THREECRYPT_KEYING_BYTES)
+#define HEADER_MAC_OFFSET_    (TWEAK_OFFSET_ + PPQ_THREEFISH512_TWEAK_BYTES)
+#define CKPT_ID_BYTES_        THREECRYPT_SEGMENTED_V1_CHECKPOINT_ID_NBYTES
+#define CKPT_BYTES_           THREECRYPT_SEGMENTED_V1_CHECKPOINT_BYTES
+#define CKPT_SEALED_BYTES_    THREECRYPT_SEGMENTED_V1_CHECKPOINT_SEALED_BYTES
+#define CKPT_IV_OFFSET_       CKPT_ID_BYTES_
+#define CKPT_SEALED_OFFSET_   (CKPT_IV_OFFSET_ + THREECRYPT_CTR_IV_BYTES)
+#define CKPT_MAC_OFFSET_      (CKPT_SEALED_OFFSET_ + CKPT_SEALED_BYTES_)
+#define CKPT_DIGEST_WINDOW_   UINT64_C(4096)
+
+/* Derive the keys from @ctx->keying and the @header of a Segmented_V1 file. */
+static void
+derive_keys_(Threecrypt_SegmentedV1* R_ ctx, const uint8_t* R_ header)
+{
+  keying_derive(
+   &ctx->keying,
+   header + KEYING_OFFSET_,
+   THREECRYPT_SEGMENTED_V1_ID,
+   THREECRYPT_SEGMENTED_V1_ID_NBYTES,
+   ctx->derived,
+   sizeof(ctx->derived));
+  memcpy(ctx->enc_key,  ctx->derived,                                PPQ_THREEFISH512_BLOCK_BYTES);
+  memcpy(ctx->auth_key, ctx->derived + PPQ_THREEFISH512_BLOCK_BYTES, PPQ_THREEFISH512_BLOCK_BYTES);
+  SSC_secureZero(ctx->derived, sizeof(ctx->derived));
+  memcpy(ctx->tweak, header + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+}
+
+/* MAC the @size bytes at @begin, storing the result in @ctx->mac. */
+static void
+mac_(Threecrypt_SegmentedV1* R_ ctx, const uint8_t* R_ begin, uint64_t size)
+{
+  PPQ_Skein512_mac(&ctx->keying.ubi512, ctx->mac, begin, ctx->auth_key, MAC_BYTES_, size);
+}
+
+/* MAC the @size bytes at @begin, and compare the result with the tag that follows them. */
+static bool
+verify_(Threecrypt_SegmentedV1* R_ ctx, const uint8_t* R_ begin, uint64_t size)
+{
+  mac_(ctx, begin, size);
+  return threecrypt_ct_equal(ctx->mac, begin + size, MAC_BYTES_);
+}
+
+/* Walk and authenticate every segment of the @size byte Segmented_V1 file at @file,
+ * storing the total plaintext size in @total. Returns an error message, or SSC_NULL. */
+static const char*
+authenticate_(Threecrypt_SegmentedV1* R_ ctx, const uint8_t* R_ file, size_t size, uint64_t* R_ total)
+{
+  const size_t end = size - TRAILER_BYTES_;
+  size_t   offset = HEADER_BYTES_;
+  uint64_t count  = 0;
+  *total = 0;
+  while (offset < end) {
+    if ((end - offset) < SEGMENT_META_BYTES_)
+      return "Error: The input file has a truncated segment.\n";
+    const uint8_t* const segment = file + offset;
+    const uint64_t segment_size = threecrypt_load64(segment + 8);
+    if ((threecrypt_load64(segment) != count) || (segment_size > (end - offset - SEGMENT_META_BYTES_)))
+      return "Error: The input file has a malformed segment.\n";
+    if (!verify_(ctx, segment - MAC_BYTES_, MAC_BYTES_ + SEGMENT_HEADER_BYTES_ + segment_size))
+      return "Error: Authentication failed. The input file has been corrupted, truncated or reordered.\n";
+    *total += segment_size;
+    offset += SEGMENT_META_BYTES_ + (size_t)segment_size;
+    ++count;
+  }
+  const uint8_t* const trailer = file + end;
+  if ((threecrypt_load64(trailer) != count) || (threecrypt_load64(trailer + 8) != *total))
+    return "Error: Authentication failed. The input file has been corrupted, truncated or reordered.\n";
+  if (!verify_(ctx, trailer - MAC_BYTES_, MAC_BYTES_ + 16))
+    return "Error: Authentication failed. The input file has been corrupted, truncated or reordered.\n";
+  return SSC_NULL;
+}
+
+/* Write the header of a new Segmented_V1 file into @output_map, an open, empty file,
+ * deriving the keys. Leaves @output_map mapped. */
+static void
+create_header_(Threecrypt_SegmentedV1* R_ ctx, SSC_MemMap* R_ output_map)
+{
+  output_map->size = HEADER_BYTES_;
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  SSC_MemMap_mapOrDie(output_map, false);
+  uint8_t* const out = output_map->ptr;
+  memcpy(out, THREECRYPT_SEGMENTED_V1_ID, THREECRYPT_SEGMENTED_V1_ID_NBYTES);
+  keying_store(&ctx->keying, out + KEYING_OFFSET_, &ctx->csprng);
+  PPQ_CSPRNG_get(&ctx->csprng, out + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+  derive_keys_(ctx, out);
+  mac_(ctx, out, HEADER_MAC_OFFSET_);
+  memcpy(out + HEADER_MAC_OFFSET_, ctx->mac, MAC_BYTES_);
+}
+
+/* Encrypt the @size bytes at @input as segment @index at @segment, which directly follows the previous tag. */
+static void
+write_segment_(Threecrypt_SegmentedV1* R_ ctx, uint8_t* R_ segment, uint64_t index, const uint8_t* R_ input, uint64_t size)
+{
+  threecrypt_store64(segment,     index);
+  threecrypt_store64(segment + 8, size);
+  PPQ_CSPRNG_get(&ctx->csprng, segment + 16, THREECRYPT_CTR_IV_BYTES);
+  threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, segment + 16);
+  threecrypt_ctr_xor(&ctx->ctr, segment + SEGMENT_HEADER_BYTES_, input, size, 0);
+  mac_(ctx, segment - MAC_BYTES_, MAC_BYTES_ + SEGMENT_HEADER_BYTES_ + size);
+  memcpy(segment + SEGMENT_HEADER_BYTES_ + size, ctx->mac, MAC_BYTES_);
+}
+
+/* Write the trailer of a file of @count segments holding @total plaintext bytes at @trailer,
+ * which directly follows the last tag. */
+static void
+write_trailer_(Threecrypt_SegmentedV1* R_ ctx, uint8_t* R_ trailer, uint64_t count, uint64_t total)
+{
+  threecrypt_store64(trailer,     count);
+  threecrypt_store64(trailer + 8, total);
+  mac_(ctx, trailer - MAC_BYTES_, MAC_BYTES_ + 16);
+  memcpy(trailer + 16, ctx->mac, MAC_BYTES_);
+}
+
+void
+segmented_v1_append(
+ Threecrypt_SegmentedV1* R_ ctx,
+ SSC_MemMap* R_             input_map,
+ SSC_MemMap* R_             output_map,
+ const char* R_             output_filename)
+{
+  uint64_t count = 0;
+  uint64_t total = 0;
+  size_t   offset = 0; /* Where the new segment begins. */
+  Threecrypt_Journal journal = {0};
+  if (!output_map->size) {
+    /* Create a new Segmented_V1 file, containing only a header. */
+    create_header_(ctx, output_map);
+    offset = HEADER_BYTES_;
+  } else {
+    /* Authenticate the header, then the trailer; nothing else needs to be read. */
+    const uint8_t* const file = output_map->ptr;
+    const char* error = SSC_NULL;
+    if (output_map->size < (HEADER_BYTES_ + TRAILER_BYTES_))
+      error = "Error: The output file is too small to be a Segmented_V1 encrypted file.\n";
+    if (!error) {
+      derive_keys_(ctx, file);
+      if (!verify_(ctx, file, HEADER_MAC_OFFSET_))
+        error = "Error: Authentication failed. Wrong password or keyfile, or the header has been corrupted.\n";
+    }
+    if (!error) {
+      offset = output_map->size - TRAILER_BYTES_;
+      count = threecrypt_load64(file + offset);
+      total = threecrypt_load64(file + offset + 8);
+      if (!verify_(ctx, file + offset - MAC_BYTES_, MAC_BYTES_ + 16))
+        error = "Error: Authentication failed. The output file has been corrupted or truncated.\n";
+      else if ((count == UINT64_MAX) || (total > (UINT64_MAX - input_map->size)))
+        error = "Error: The output file cannot hold any more segments.\n";
+    }
+    if (error) {
+      /* Leave the existing file exactly as we found it. */
+      SSC_MemMap_unmapOrDie(output_map);
+      SSC_File_closeOrDie(output_map->file);
+      if (input_map->size)
+        SSC_MemMap_unmapOrDie(input_map);
+      SSC_File_closeOrDie(input_map->file);
+      SSC_errx("%s", error);
+    }
+    /* The trailer is all of the file that is overwritten; keep it until the new one is on the disk. */
+    threecrypt_journal_begin(&journal, output_filename, output_map->size);
+    threecrypt_journal_save(&journal, file, offset, TRAILER_BYTES_);
+    threecrypt_journal_seal(&journal);
+    SSC_MemMap_unmapOrDie(output_map);
+  }
+  /* Replace the trailer (if any) with the new segment, followed by the new trailer. */
+  output_map->size = offset + SEGMENT_META_BYTES_ + input_map->size + TRAILER_BYTES_;
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  SSC_MemMap_mapOrDie(output_map, false);
+  write_segment_(ctx, output_map->ptr + offset, count, input_map->ptr, input_map->size);
+  write_trailer_(ctx, output_map->ptr + output_map->size - TRAILER_BYTES_, count + 1, total + input_map->size);
+  SSC_MemMap_syncOrDie(output_map);
+  SSC_MemMap_unmapOrDie(output_map);
+  threecrypt_journal_end(&journal);
+  if (input_map->size)
+    SSC_MemMap_unmapOrDie(input_map);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+/* The progress of a resumable encryption, as recorded in its checkpoint. */
+typedef struct {
+  uint64_t offset;
+  uint64_t count;
+  uint64_t total;
+  uint64_t input_size;
+  uint8_t  digest [64];
+  uint8_t  tag    [MAC_BYTES_];
+} Progress_;
+
+static void
+derive_checkpoint_keys_(Threecrypt_SegmentedV1* R_ ctx)
+{
+  uint8_t keys [PPQ_THREEFISH512_BLOCK_BYTES * 2];
+  PPQ_Skein512_mac(
+   &ctx->keying.ubi512, keys, (const uint8_t*)THREECRYPT_SEGMENTED_V1_CHECKPOINT_ID, ctx->auth_key, sizeof(keys), CKPT_ID_BYTES_);
+  memcpy(ctx->checkpoint_enc_key,  keys,                                PPQ_THREEFISH512_BLOCK_BYTES);
+  memcpy(ctx->checkpoint_auth_key, keys + PPQ_THREEFISH512_BLOCK_BYTES, PPQ_THREEFISH512_BLOCK_BYTES);
+  SSC_secureZero(keys, sizeof(keys));
+}
+
+/* Digest the first and the last (up to) CKPT_DIGEST_WINDOW_ bytes of the @total bytes at @input
+ * into @digest, so that resuming with a different input is caught. */
+static void
+input_digest_(Threecrypt_SegmentedV1* R_ ctx, const uint8_t* input, uint64_t total, uint8_t* R_ digest)
+{
+  const uint64_t window = (total < CKPT_DIGEST_WINDOW_) ? total : CKPT_DIGEST_WINDOW_;
+  uint8_t windows [64 * 2];
+  PPQ_Skein512_mac(&ctx->keying.ubi512, windows,      input,                                  ctx->checkpoint_auth_key, 64, window);
+  PPQ_Skein512_mac(&ctx->keying.ubi512, windows + 64, window ? (input + total - window) : input, ctx->checkpoint_auth_key, 64, window);
+  PPQ_Skein512_mac(&ctx->keying.ubi512, digest, windows, ctx->checkpoint_auth_key, 64, sizeof(windows));
+}
+
+/* Set @progress to the start of the encryption of the @input_size bytes at @input into the file at @file,
+ * which holds only its header so far. */
+static void
+initial_progress_(Threecrypt_SegmentedV1* R_ ctx, Progress_* R_ progress, const uint8_t* R_ file, const uint8_t* input, size_t input_size)
+{
+  memset(progress, 0, sizeof(*progress));
+  progress->offset = HEADER_BYTES_;
+  progress->input_size = (uint64_t)input_size;
+  memcpy(progress->tag, file + HEADER_MAC_OFFSET_, MAC_BYTES_);
+  input_digest_(ctx, input, 0, progress->digest);
+}
+
+/* Atomically replace @checkpoint_filename with the @size bytes at @data, by way of @temp_filename. */
+static void
+replace_checkpoint_(const uint8_t* R_ data, size_t size, const char* R_ checkpoint_filename, const char* R_ temp_filename)
+{
+  FILE* f = fopen(temp_filename, "wb");
+  SSC_assertMsg(f != SSC_NULL, "Error: Failed to create the checkpoint %s!\n", temp_filename);
+  const bool ok = (fwrite(data, 1, size, f) == size) && !fflush(f) && !SYNC_FILE_(f);
+  SSC_assertMsg(!fclose(f) && ok, "Error: Failed to write the checkpoint %s!\n", temp_filename);
+#if defined(SSC_OS_WINDOWS)
+  remove(checkpoint_filename); /* Windows will not rename over an existing file. */
+#endif
+  SSC_assertMsg(
+   !rename(temp_filename, checkpoint_filename),
+   "Error: Failed to replace the checkpoint %s!\n", checkpoint_filename);
+}
+
+/* Store the unstarted marker of the open @file in @marker. Returns false where files cannot be identified. */
+static bool
+unstarted_marker_(SSC_File_t file, uint8_t* R_ marker)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  struct stat st;
+  if (fstat(file, &st))
+    return false;
+  memcpy(marker, THREECRYPT_SEGMENTED_V1_UNSTARTED_ID, THREECRYPT_SEGMENTED_V1_UNSTARTED_ID_NBYTES);
+  threecrypt_store64(marker + THREECRYPT_SEGMENTED_V1_UNSTARTED_ID_NBYTES,     (uint64_t)st.st_dev);
+  threecrypt_store64(marker + THREECRYPT_SEGMENTED_V1_UNSTARTED_ID_NBYTES + 8, (uint64_t)st.st_ino);
+  return true;
+#else
+  (void)file;
+  (void)marker;
+  return false;
+#endif
+}
+
+/* Claim the new, empty output @file with an unstarted marker at @checkpoint_filename, before anything is written to it. */
+static void
+write_unstarted_(SSC_File_t file, const char* R_ checkpoint_filename, const char* R_ temp_filename)
+{
+  uint8_t marker [THREECRYPT_SEGMENTED_V1_UNSTARTED_BYTES];
+  if (!unstarted_marker_(file, marker))
+    return;
+  replace_checkpoint_(marker, sizeof(marker), checkpoint_filename, temp_filename);
+  durability_sync_parent(checkpoint_filename);
+}
+
+void
+segmented_v1_discard_unstarted(const char* R_ output_filename)
+{
+  char* const checkpoint_filename = threecrypt_with_suffix(output_filename, THREECRYPT_SEGMENTED_V1_CHECKPOINT_SUFFIX);
+  uint8_t stored [THREECRYPT_SEGMENTED_V1_UNSTARTED_BYTES + 1];
+  size_t  stored_size = 0;
+  FILE* f = fopen(checkpoint_filename, "rb");
+  if (f) {
+    stored_size = fread(stored, 1, sizeof(stored), f);
+    fclose(f);
+  }
+  bool discard = false;
+  if (stored_size == THREECRYPT_SEGMENTED_V1_UNSTARTED_BYTES) {
+    /* The marker must name this very file, which must hold no more than a header and trailer. */
+    uint8_t marker [THREECRYPT_SEGMENTED_V1_UNSTARTED_BYTES];
+    SSC_File_t file = SSC_FilePath_openOrDie(output_filename, true);
+    discard = unstarted_marker_(file, marker) && !memcmp(marker, stored, sizeof(marker)) &&
+     (SSC_FilePath_getSizeOrDie(output_filename) <= (size_t)(HEADER_BYTES_ + TRAILER_BYTES_));
+    SSC_File_closeOrDie(file);
+  }
+  if (discard) {
+    SSC_assertMsg(!remove(output_filename), "Error: Failed to remove the unstarted output %s!\n", output_filename);
+    remove(checkpoint_filename);
+    durability_sync_parent(output_filename);
+  }
+  free(checkpoint_filename);
+}
+
+/* Seal @progress into a checkpoint, and atomically replace @checkpoint_filename with it by way of @temp_filename. */
+static void
+write_checkpoint_(
+ Threecrypt_SegmentedV1* R_ ctx,
+ const Progress_* R_        progress,
+ const char* R_             checkpoint_filename,
+ const char* R_             temp_filename)
+{
+  uint8_t* const c = ctx->checkpoint;
+  uint8_t* const sealed = c + CKPT_SEALED_OFFSET_;
+  memcpy(c, THREECRYPT_SEGMENTED_V1_CHECKPOINT_ID, CKPT_ID_BYTES_);
+  PPQ_CSPRNG_get(&ctx->csprng, c + CKPT_IV_OFFSET_, THREECRYPT_CTR_IV_BYTES);
+  threecrypt_store64(sealed,      progress->offset);
+  threecrypt_store64(sealed + 8,  progress->count);
+  threecrypt_store64(sealed + 16, progress->total);
+  threecrypt_store64(sealed + 24, progress->input_size);
+  memcpy(sealed + 32,                             progress->digest, sizeof(progress->digest));
+  memcpy(sealed + 32 + sizeof(progress->digest), progress->tag,    sizeof(progress->tag));
+  threecrypt_ctr_init(&ctx->ctr, ctx->checkpoint_enc_key, ctx->tweak, c + CKPT_IV_OFFSET_);
+  threecrypt_ctr_xor(&ctx->ctr, sealed, sealed, CKPT_SEALED_BYTES_, 0);
+  PPQ_Skein512_mac(&ctx->keying.ubi512, c + CKPT_MAC_OFFSET_, c, ctx->checkpoint_auth_key, MAC_BYTES_, CKPT_MAC_OFFSET_);
+  replace_checkpoint_(c, CKPT_BYTES_, checkpoint_filename, temp_filename);
+}
+
+/* Read, authenticate and unseal the checkpoint @checkpoint_filename into @progress.
+ * Returns an error message, or SSC_NULL. */
+static const char*
+read_checkpoint_(Threecrypt_SegmentedV1* R_ ctx, const char* R_ checkpoint_filename, Progress_* R_ progress)
+{
+  uint8_t* const c = ctx->checkpoint;
+  FILE* f = fopen(checkpoint_filename, "rb");
+  if (!f)
+    return "Error: The output file exists, but there is no checkpoint to resume it from.\n";
+  const size_t size = fread(c, 1, CKPT_BYTES_, f);
+  const int    extra = fgetc(f);
+  fclose(f);
+  if ((size != CKPT_BYTES_) || (extra != EOF) || memcmp(c, THREECRYPT_SEGMENTED_V1_CHECKPOINT_ID, CKPT_ID_BYTES_))
+    return "Error: The checkpoint is malformed.\n";
+  PPQ_Skein512_mac(&ctx->keying.ubi512, ctx->mac, c, ctx->checkpoint_auth_key, MAC_BYTES_, CKPT_MAC_OFFSET_);
+  if (!threecrypt_ct_equal(ctx->mac, c + CKPT_MAC_OFFSET_, MAC_BYTES_))
+    return "Error: Authentication failed. The checkpoint has been corrupted, or belongs to another file.\n";
+  uint8_t* const sealed = c + CKPT_SEALED_OFFSET_;
+  threecrypt_ctr_init(&ctx->ctr, ctx->checkpoint_enc_key, ctx->tweak, c + CKPT_IV_OFFSET_);
+  threecrypt_ctr_xor(&ctx->ctr, sealed, sealed, CKPT_SEALED_BYTES_, 0);
+  progress->offset     = threecrypt_load64(sealed);
+  progress->count      = threecrypt_load64(sealed + 8);
+  progress->total      = threecrypt_load64(sealed + 16);
+  progress->input_size = threecrypt_load64(sealed + 24);
+  memcpy(progress->digest, sealed + 32,                             sizeof(progress->digest));
+  memcpy(progress->tag,    sealed + 32 + sizeof(progress->digest), sizeof(progress->tag));
+  SSC_secureZero(c, CKPT_BYTES_);
+  return SSC_NULL;
+}
+
+/* Check that the authentic checkpoint @progress describes the @output_size byte @file, and the @input_size byte @input.
+ * Returns an error message, or SSC_NULL. */
+static const char*
+check_progress_(
+ Threecrypt_SegmentedV1* R_ ctx,
+ const Progress_* R_        progress,
+ const uint8_t* R_          file,
+ size_t                     output_size,
+ const uint8_t*             input,
+ size_t                     input_size)
+{
+  if (progress->input_size != (uint64_t)input_size)
+    return "Error: The input file has changed size since the checkpoint; it cannot be resumed.\n";
+  if ((progress->offset < HEADER_BYTES_) || (progress->offset > output_size) || (progress->total > progress->input_size))
+    return "Error: The output file is shorter than its checkpoint; it cannot be resumed.\n";
+  if (!threecrypt_ct_equal(progress->tag, file + progress->offset - MAC_BYTES_, MAC_BYTES_))
+    return "Error: The output file does not match its checkpoint; it cannot be resumed.\n";
+  input_digest_(ctx, input, progress->total, ctx->mac);
+  if (!threecrypt_ct_equal(progress->digest, ctx->mac, sizeof(progress->digest)))
+    return "Error: The input file has changed since the checkpoint; it cannot be resumed.\n";
+  return SSC_NULL;
+}
+
+void
+segmented_v1_encrypt_resumable(
+ Threecrypt_SegmentedV1* R_ ctx,
+ SSC_MemMap* R_             input_map,
+ SSC_MemMap* R_             output_map,
+ const char* R_             output_filename)
+{
+  char* const checkpoint_filename = threecrypt_with_suffix(output_filename, THREECRYPT_SEGMENTED_V1_CHECKPOINT_SUFFIX);
+  char* const temp_filename       = threecrypt_with_suffix(output_filename, THREECRYPT_SEGMENTED_V1_CHECKPOINT_TEMP_SUFFIX);
+  const uint8_t* const in = input_map->ptr;
+  Progress_ progress;
+  memset(&progress, 0, sizeof(progress));
+  if (!output_map->size) {
+    write_unstarted_(output_map->file, checkpoint_filename, temp_filename);
+    create_header_(ctx, output_map);
+    derive_checkpoint_keys_(ctx);
+    initial_progress_(ctx, &progress, output_map->ptr, in, input_map->size);
+  } else {
+    const uint8_t* const file = output_map->ptr;
+    const char* error = SSC_NULL;
+    if (output_map->size < HEADER_BYTES_)
+      error = "Error: The output file is too small to be a Segmented_V1 encrypted file.\n";
+    if (!error) {
+      derive_keys_(ctx, file);
+      if (!verify_(ctx, file, HEADER_MAC_OFFSET_))
+        error = "Error: Authentication failed. Wrong password or keyfile, or the header has been corrupted.\n";
+    }
+    if (!error) {
+      derive_checkpoint_keys_(ctx);
+      error = read_checkpoint_(ctx, checkpoint_filename, &progress);
+      if (!error)
+        error = check_progress_(ctx, &progress, file, output_map->size, in, input_map->size);
+    }
+    if (error) {
+      /* Leave the existing file and its checkpoint exactly as we found them. */
+      SSC_MemMap_unmapOrDie(output_map);
+      SSC_File_closeOrDie(output_map->file);
+      if (input_map->size)
+        SSC_MemMap_unmapOrDie(input_map);
+      SSC_File_closeOrDie(input_map->file);
+      free(checkpoint_filename);
+      free(temp_filename);
+      SSC_errx("%s", error);
+    }
+  }
+  SSC_MemMap_unmapOrDie(output_map);
+  /* Discard anything written after the last complete segment, and end the file there. */
+  output_map->size = (size_t)progress.offset + TRAILER_BYTES_;
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  SSC_MemMap_mapOrDie(output_map, false);
+  write_trailer_(ctx, output_map->ptr + progress.offset, progress.count, progress.total);
+  SSC_MemMap_syncOrDie(output_map);
+  SSC_MemMap_unmapOrDie(output_map);
+  write_checkpoint_(ctx, &progress, checkpoint_filename, temp_filename);
+  while (progress.total < progress.input_size) {
+    const uint64_t remaining = progress.input_size - progress.total;
+    const uint64_t size = (remaining < THREECRYPT_SEGMENTED_V1_CHECKPOINT_INTERVAL) ? remaining : THREECRYPT_SEGMENTED_V1_CHECKPOINT_INTERVAL;
+    output_map->size = (size_t)(progress.offset + SEGMENT_META_BYTES_ + size) + TRAILER_BYTES_;
+    SSC_File_setSizeOrDie(output_map->file, output_map->size);
+    SSC_MemMap_mapOrDie(output_map, false);
+    uint8_t* const segment = output_map->ptr + progress.offset;
+    write_segment_(ctx, segment, progress.count, in + progress.total, size);
+    write_trailer_(ctx, segment + SEGMENT_META_BYTES_ + size, progress.count + 1, progress.total + size);
+    SSC_MemMap_syncOrDie(output_map);
+    memcpy(progress.tag, segment + SEGMENT_HEADER_BYTES_ + size, MAC_BYTES_);
+    SSC_MemMap_unmapOrDie(output_map);
+    progress.offset += SEGMENT_META_BYTES_ + size;
+    progress.count  += 1;
+    progress.total  += size;
+    input_digest_(ctx, in, progress.total, progress.digest);
+    write_checkpoint_(ctx, &progress, checkpoint_filename, temp_filename);
+  }
+  /* The file is complete, so its trailer alone vouches for it. */
+  remove(checkpoint_filename);
+  free(checkpoint_filename);
+  free(temp_filename);
+  SSC_secureZero(&progress, sizeof(progress));
+  if (input_map->size)
+    SSC_MemMap_unmapOrDie(input_map);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+void
+segmented_v1_decrypt(
+ Threecrypt_SegmentedV1* R_ ctx,
+ SSC_MemMap* R_             input_map,
+ SSC_MemMap* R_             output_map,
+ const char* R_             output_filename)
+{
+  const uint8_t* const in = input_map->ptr;
+  const char* error = SSC_NULL;
+  uint64_t total = 0;
+  if (input_map->size < (HEADER_BYTES_ + TRAILER_BYTES_))
+    error = "Error: The input file is too small to be a Segmented_V1 encrypted file.\n";
+  if (!error) {
+    derive_keys_(ctx, in);
+    /* A wrong password or keyfile is caught here, without reading any segments. */
+    if (!verify_(ctx, in, HEADER_MAC_OFFSET_))
+      error = "Error: Authentication failed. Wrong password or keyfile, or the header has been corrupted.\n";
+  }
+  /* Authenticate everything before writing a single byte of plaintext. */
+  if (!error)
+    error = authenticate_(ctx, in, input_map->size, &total);
+  if (error) {
+    SSC_MemMap_unmapOrDie(input_map);
+    SSC_File_closeOrDie(input_map->file);
+    SSC_File_closeOrDie(output_map->file);
+    remove(output_filename);
+    SSC_errx("%s", error);
+  }
+  output_map->size = (size_t)total;
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  if (output_map->size) {
+    SSC_MemMap_mapOrDie(output_map, false);
+    uint8_t* out = output_map->ptr;
+    const size_t end = input_map->size - TRAILER_BYTES_;
+    for (size_t offset = HEADER_BYTES_; offset < end;) {
+      const uint8_t* const segment = in + offset;
+      const uint64_t segment_size = threecrypt_load64(segment + 8);
+      threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, segment + 16);
+      threecrypt_ctr_xor(&ctx->ctr, out, segment + SEGMENT_HEADER_BYTES_, segment_size, 0);
+      out    += segment_size;
+      offset += SEGMENT_META_BYTES_ + (size_t)segment_size;
+    }
+    durability_sync_map(output_map);
+    SSC_MemMap_unmapOrDie(output_map);
+  }
+  SSC_MemMap_unmapOrDie(input_map);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+void
+segmented_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename)
+{
+  SSC_assertMsg(
+   input_map->size >= (HEADER_BYTES_ + TRAILER_BYTES_),
+   "Error: The input file %s is too small to be a Segmented_V1 encrypted file.\n", filename);
+  const uint8_t* const in = input_map->ptr;
+  const uint8_t* const keying = in + KEYING_OFFSET_;
+  const uint8_t* const trailer = in + input_map->size - TRAILER_BYTES_;
+  printf("File Header for %s\n", filename);
+  printf("Method             : Segmented_V1\n");
+  keying_dump(keying);
+  threecrypt_print_hex("Tweak              : ", in + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+  printf("Segments           : %" PRIu64 "\n", threecrypt_load64(trailer));
+  printf("Plaintext Size     : %" PRIu64 " bytes\n", threecrypt_load64(trailer + 8));
+}
+
+#endif /* ! THREECRYPT_SEGMENTED_V1_H */
@@ -0,0 +1,163 @@
+#if !defined(THREECRYPT_SEGMENTED_V1_H) && defined(THREECRYPT_EXTERN_ENABLE_SEGMENTED_V1)
+#define THREECRYPT_SEGMENTED_V1_H
+
+#include <SSC/Macro.h>
+#include <SSC/MemMap.h>
+#include <PPQ/CSPRNG.h>
+#include "Keying.h"
+#include "Primitive.h"
+
+/* Segmented_V1 encrypted files grow by appending independently encrypted segments,
+ * so encrypting new data costs time proportional to the new data, not the file.
+ *
+ * Layout:
+ *   Header:
+ *     ID         (THREECRYPT_SEGMENTED_V1_ID_NBYTES)
+ *     Keying     (THREECRYPT_KEYING_BYTES)
+ *     Tweak      (PPQ_THREEFISH512_TWEAK_BYTES)
+ *     Header MAC (64), MAC of the above.
+ *   Segments, for i = 0, 1, ...:
+ *     Index      (8 bytes, little-endian; equal to i)
+ *     Size       (8 bytes, little-endian; plaintext bytes in this segment)
+ *     CTR IV     (THREECRYPT_CTR_IV_BYTES), fresh for every segment.
+ *     Ciphertext (Size)
+ *     Tag        (64), MAC of the previous tag (or the header MAC), Index, Size, CTR IV and Ciphertext.
+ *   Trailer:
+ *     Count      (8 bytes, little-endian; number of segments)
+ *     Total      (8 bytes, little-endian; total plaintext bytes)
+ *     Tag        (64), MAC of the last segment's tag (or the header MAC), Count and Total.
+ *
+ * Each MAC input is the contiguous run of file bytes ending just before the MAC, starting
+ * at the previous tag, so the tags form a chain: segments cannot be reordered, dropped or
+ * spliced between files, and truncation is detected because only the holder of the keys
+ * can write a trailer. Appending authenticates only the header and the trailer before
+ * replacing the trailer with the new segment and a new trailer. */
+#define THREECRYPT_SEGMENTED_V1_ID                  "3CRYPT_SEGMENTED_V1"
+#define THREECRYPT_SEGMENTED_V1_ID_NBYTES           20
+#define THREECRYPT_SEGMENTED_V1_MAC_BYTES           64
+#define THREECRYPT_SEGMENTED_V1_HEADER_BYTES        (\
+ THREECRYPT_SEGMENTED_V1_ID_NBYTES +\
+ THREECRYPT_KEYING_BYTES +\
+ PPQ_THREEFISH512_TWEAK_BYTES +\
+ THREECRYPT_SEGMENTED_V1_MAC_BYTES)
+#define THREECRYPT_SEGMENTED_V1_SEGMENT_HEADER_BYTES (8 + 8 + THREECRYPT_CTR_IV_BYTES)
+#define THREECRYPT_SEGMENTED_V1_SEGMENT_META_BYTES  (THREECRYPT_SEGMENTED_V1_SEGMENT_HEADER_BYTES + THREECRYPT_SEGMENTED_V1_MAC_BYTES)
+#define THREECRYPT_SEGMENTED_V1_TRAILER_BYTES       (8 + 8 + THREECRYPT_SEGMENTED_V1_MAC_BYTES)
+#define THREECRYPT_SEGMENTED_V1_KEYING_OFFSET       THREECRYPT_SEGMENTED_V1_ID_NBYTES
+
+/* Resumable encryption writes a Segmented_V1 file one segment at a time, recording its progress
+ * after every segment in a sealed checkpoint file beside the output, so that an interrupted
+ * encryption can continue from the last complete segment instead of starting over.
+ *
+ * Checkpoint layout:
+ *   ID          (THREECRYPT_SEGMENTED_V1_CHECKPOINT_ID_NBYTES)
+ *   CTR IV      (THREECRYPT_CTR_IV_BYTES), fresh for every checkpoint.
+ *   Sealed, encrypted under the checkpoint key:
+ *     Offset    (8 bytes, little-endian; where the last complete segment ends in the output)
+ *     Count     (8 bytes, little-endian; complete segments)
+ *     Total     (8 bytes, little-endian; plaintext bytes encrypted so far)
+ *     Input Size   (8 bytes, little-endian)
+ *     Input Digest (64), keyed digest of the first and last (up to) 4 KiB of the input preceding Total.
+ *     Last Tag  (64), the tag ending at Offset (the header MAC if Count is zero).
+ *   MAC         (64), MAC of everything above under the checkpoint MAC key.
+ * The checkpoint keys are derived from the file's authentication key, so only the holder
+ * of the password or keyfile can read or forge a checkpoint.
+ *
+ * Until the header and first checkpoint reach the disk there is nothing to seal a checkpoint
+ * with, so a new output is first claimed by an unstarted marker in the checkpoint's place:
+ *   ID          (THREECRYPT_SEGMENTED_V1_UNSTARTED_ID_NBYTES)
+ *   Device      (8 bytes, little-endian) and
+ *   Inode       (8 bytes, little-endian) of the output file this encryption created.
+ * An output that a marker proves was created by an interrupted resumable encryption, and that
+ * holds no more than a header and trailer, may be discarded and the encryption begun again. */
+#define THREECRYPT_SEGMENTED_V1_CHECKPOINT_ID       "3CRYPT_CHECKPOINT_V1"
+#define THREECRYPT_SEGMENTED_V1_CHECKPOINT_ID_NBYTES 21
+#define THREECRYPT_SEGMENTED_V1_CHECKPOINT_SEALED_BYTES (8 + 8 + 8 + 8 + 64 + THREECRYPT_SEGMENTED_V1_MAC_BYTES)
+#define THREECRYPT_SEGMENTED_V1_CHECKPOINT_BYTES    (\
+ THREECRYPT_SEGMENTED_V1_CHECKPOINT_ID_NBYTES +\
+ THREECRYPT_CTR_IV_BYTES +\
+ THREECRYPT_SEGMENTED_V1_CHECKPOINT_SEALED_BYTES +\
+ THREECRYPT_SEGMENTED_V1_MAC_BYTES)
+#define THREECRYPT_SEGMENTED_V1_UNSTARTED_ID        "3CRYPT_UNSTARTED_V1"
+#define THREECRYPT_SEGMENTED_V1_UNSTARTED_ID_NBYTES 20
+#define THREECRYPT_SEGMENTED_V1_UNSTARTED_BYTES     (THREECRYPT_SEGMENTED_V1_UNSTARTED_ID_NBYTES + 8 + 8)
+#define THREECRYPT_SEGMENTED_V1_CHECKPOINT_SUFFIX   ".ckpt"
+#define THREECRYPT_SEGMENTED_V1_CHECKPOINT_TEMP_SUFFIX ".ckpt.tmp"
+#ifdef THREECRYPT_EXTERN_CHECKPOINT_INTERVAL_MIB
+ #define THREECRYPT_SEGMENTED_V1_CHECKPOINT_INTERVAL ((uint64_t)(THREECRYPT_EXTERN_CHECKPOINT_INTERVAL_MIB) * UINT64_C(1048576))
+#else
+ #define THREECRYPT_SEGMENTED_V1_CHECKPOINT_INTERVAL (UINT64_C(1) << 30) /* Checkpoint after every GiB. */
+#endif
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  Threecrypt_Keying keying;
+  Threecrypt_Ctr    ctr;
+  PPQ_CSPRNG        csprng; /* Only used when appending. */
+  uint64_t          enc_key  [PPQ_THREEFISH512_EXTERNAL_KEY_WORDS];
+  uint64_t          tweak    [PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS];
+  uint8_t           auth_key [PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t           derived  [PPQ_THREEFISH512_BLOCK_BYTES * 2];
+  uint8_t           mac      [THREECRYPT_SEGMENTED_V1_MAC_BYTES];
+  uint64_t          checkpoint_enc_key  [PPQ_THREEFISH512_EXTERNAL_KEY_WORDS]; /* Only used when resumable. */
+  uint8_t           checkpoint_auth_key [PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t           checkpoint          [THREECRYPT_SEGMENTED_V1_CHECKPOINT_BYTES];
+} Threecrypt_SegmentedV1;
+
+/* Append the mapped @input_map as a new segment of @output_map.
+ * If @output_map->size is zero, @output_map is an open, empty file, and a new Segmented_V1
+ * file is created with the keying parameters in @ctx->keying. Otherwise @output_map must be
+ * an existing Segmented_V1 file, opened read-write and mapped. @ctx->keying.secret and @ctx->csprng
+ * must be initialized. Dies without modifying an existing file if its header or trailer fail to
+ * authenticate. An existing file is rewritten under a journal, so a crash leaves it whole, with or
+ * without the new segment. Unmaps and closes both files. */
+void
+segmented_v1_append(
+ Threecrypt_SegmentedV1* R_ ctx,
+ SSC_MemMap* R_             input_map,
+ SSC_MemMap* R_             output_map,
+ const char* R_             output_filename);
+
+/* Encrypt the mapped @input_map into the Segmented_V1 file of @output_map one segment of
+ * THREECRYPT_SEGMENTED_V1_CHECKPOINT_INTERVAL bytes at a time, writing a checkpoint to
+ * @output_filename with THREECRYPT_SEGMENTED_V1_CHECKPOINT_SUFFIX appended after each, and removing
+ * it once the whole input is encrypted. If @output_map->size is zero, @output_map is an open, empty file,
+ * and a new file is created with the keying parameters in @ctx->keying. Otherwise @output_map must be
+ * the existing output of an interrupted resumable encryption of the same input, opened read-write and
+ * mapped, and encryption resumes from its checkpoint. A new file is claimed with an unstarted
+ * marker before its header is written. @ctx->keying.secret and @ctx->csprng must be initialized.
+ * Dies without modifying an existing file if it or its checkpoint fail to authenticate,
+ * or the checkpoint does not match the input. Unmaps and closes both files. */
+void
+segmented_v1_encrypt_resumable(
+ Threecrypt_SegmentedV1* R_ ctx,
+ SSC_MemMap* R_             input_map,
+ SSC_MemMap* R_             output_map,
+ const char* R_             output_filename);
+
+/* Remove @output_filename and its unstarted marker if the marker proves the file was created by a
+ * resumable encryption interrupted before its first checkpoint, so the encryption can begin again.
+ * Any other file is left alone. */
+void
+segmented_v1_discard_unstarted(const char* R_ output_filename);
+
+/* Authenticate every segment of the mapped @input_map, then decrypt them into @output_map,
+ * whose file must already be open. @ctx->keying must be loaded and its secret initialized.
+ * On failure @output_filename is removed and we die. Unmaps and closes both files. */
+void
+segmented_v1_decrypt(
+ Threecrypt_SegmentedV1* R_ ctx,
+ SSC_MemMap* R_             input_map,
+ SSC_MemMap* R_             output_map,
+ const char* R_             output_filename);
+
+/* Print the header and trailer of the Segmented_V1 file mapped by @input_map. */
+void
+segmented_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif
@@ -0,0 +1,259 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For SEEK_DATA and SEEK_HOLE. */
+#endif
+#include <errno.h>
+#include <SSC/Operation.h>
+#include "SparseV1.h"
+#include "Durability.h"
+
+#ifdef THREECRYPT_SPARSE_V1_H
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <unistd.h>
+#endif
+#if defined(SSC_OS_UNIXLIKE) && defined(SEEK_DATA) && defined(SEEK_HOLE)
+ #define HAVE_SEEK_HOLE_ 1
+#else
+ #define HAVE_SEEK_HOLE_ 0
+#endif
+
+#define R_ SSC_RESTRICT
+
+#define MAC_BYTES_         THREECRYPT_SPARSE_V1_MAC_BYTES
+#define EXTENT_BYTES_      THREECRYPT_SPARSE_V1_EXTENT_BYTES
+#define FIXED_BYTES_       THREECRYPT_SPARSE_V1_FIXED_BYTES
+#define KEYING_OFFSET_     THREECRYPT_SPARSE_V1_KEYING_OFFSET
+#define TWEAK_OFFSET_      (KEYING_OFFSET_ + THREECRYPT_KEYING_BYTES)
+#define IV_OFFSET_         (TWEAK_OFFSET_ + PPQ_THREEFISH512_TWEAK_BYTES)
+#define APPARENT_OFFSET_   (IV_OFFSET_ + THREECRYPT_CTR_IV_BYTES)
+#define COUNT_OFFSET_      (APPARENT_OFFSET_ + 8)
+#define MAP_OFFSET_        FIXED_BYTES_
+
+#define AUTH_FAILED_       "Error: Authentication failed. The file has been corrupted or truncated.\n"
+
+typedef struct {
+  uint64_t* pairs; /* Offset, then length, of each extent. */
+  uint64_t  count;
+  uint64_t  capacity;
+  uint64_t  data;  /* Total bytes in all extents. */
+} Extents_;
+
+static void
+push_(Extents_* R_ extents, uint64_t offset, uint64_t length)
+{
+  /* Extents separated by nothing are merged, so the map stays as small as possible. */
+  if (extents->count) {
+    uint64_t* last = extents->pairs + ((extents->count - 1) * 2);
+    if ((last[0] + last[1]) == offset) {
+      last[1] += length;
+      extents->data += length;
+      return;
+    }
+  }
+  if (extents->count == extents->capacity) {
+    extents->capacity = extents->capacity ? (extents->capacity * 2) : 64;
+    extents->pairs = (uint64_t*)SSC_reallocOrDie(extents->pairs, (size_t)(extents->capacity * 2 * sizeof(uint64_t)));
+  }
+  extents->pairs[extents->count * 2]     = offset;
+  extents->pairs[extents->count * 2 + 1] = length;
+  ++extents->count;
+  extents->data += length;
+}
+
+/* Find the data extents of the @size byte file @file. */
+static void
+find_extents_(Extents_* R_ extents, SSC_File_t file, uint64_t size)
+{
+#if HAVE_SEEK_HOLE_
+  uint64_t pos = 0;
+  while (pos < size) {
+    off_t data = lseek(file, (off_t)pos, SEEK_DATA);
+    if (data == -1) {
+      if (errno == ENXIO)
+        break; /* Nothing but a hole remains. */
+      /* This filesystem cannot report holes, so treat whatever remains as data. */
+      push_(extents, pos, size - pos);
+      break;
+    }
+    off_t hole = lseek(file, data, SEEK_HOLE);
+    SSC_assertMsg(hole != -1, "Error: Failed to find the holes of the input file!\n");
+    if ((uint64_t)hole > size)
+      hole = (off_t)size;
+    if ((uint64_t)hole > (uint64_t)data)
+      push_(extents, (uint64_t)data, (uint64_t)(hole - data));
+    pos = (uint64_t)hole;
+  }
+  lseek(file, 0, SEEK_SET);
+#else
+  (void)file;
+  if (size)
+    push_(extents, 0, size);
+#endif
+}
+
+/* Derive the keys from @ctx->keying and the @header of a Sparse_V1 file. */
+static void
+derive_keys_(Threecrypt_SparseV1* R_ ctx, const uint8_t* R_ header)
+{
+  keying_derive(
+   &ctx->keying,
+   header + KEYING_OFFSET_,
+   THREECRYPT_SPARSE_V1_ID,
+   THREECRYPT_SPARSE_V1_ID_NBYTES,
+   ctx->derived,
+   sizeof(ctx->derived));
+  memcpy(ctx->enc_key,  ctx->derived,                                PPQ_THREEFISH512_BLOCK_BYTES);
+  memcpy(ctx->auth_key, ctx->derived + PPQ_THREEFISH512_BLOCK_BYTES, PPQ_THREEFISH512_BLOCK_BYTES);
+  SSC_secureZero(ctx->derived, sizeof(ctx->derived));
+  memcpy(ctx->tweak, header + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+}
+
+/* MAC the @size bytes at @begin under the authentication key, storing the result in @out. */
+static void
+mac_(Threecrypt_SparseV1* R_ ctx, uint8_t* R_ out, const uint8_t* R_ begin, uint64_t size)
+{
+  PPQ_Skein512_mac(&ctx->keying.ubi512, out, begin, ctx->auth_key, MAC_BYTES_, size);
+}
+
+void
+sparse_v1_encrypt(
+ Threecrypt_SparseV1* R_ ctx,
+ SSC_MemMap* R_          input_map,
+ SSC_MemMap* R_          output_map)
+{
+  const uint64_t apparent = (uint64_t)input_map->size;
+  Extents_ extents = {SSC_NULL, 0, 0, 0};
+  find_extents_(&extents, input_map->file, apparent);
+  const uint64_t header_mac_offset = MAP_OFFSET_ + (extents.count * EXTENT_BYTES_);
+  output_map->size = (size_t)(header_mac_offset + MAC_BYTES_ + extents.data + MAC_BYTES_);
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  SSC_MemMap_mapOrDie(output_map, false);
+  uint8_t* const out = output_map->ptr;
+  memcpy(out, THREECRYPT_SPARSE_V1_ID, THREECRYPT_SPARSE_V1_ID_NBYTES);
+  keying_store(&ctx->keying, out + KEYING_OFFSET_, &ctx->csprng);
+  PPQ_CSPRNG_get(&ctx->csprng, out + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+  PPQ_CSPRNG_get(&ctx->csprng, out + IV_OFFSET_, THREECRYPT_CTR_IV_BYTES);
+  threecrypt_store64(out + APPARENT_OFFSET_, apparent);
+  threecrypt_store64(out + COUNT_OFFSET_, extents.count);
+  for (uint64_t i = 0; i < (extents.count * 2); ++i)
+    threecrypt_store64(out + MAP_OFFSET_ + (i * 8), extents.pairs[i]);
+  derive_keys_(ctx, out);
+  mac_(ctx, out + header_mac_offset, out, header_mac_offset);
+  /* Only the data extents of the input are ever touched, so its holes are never read. */
+  threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, out + IV_OFFSET_);
+  uint8_t* ciphertext = out + header_mac_offset + MAC_BYTES_;
+  for (uint64_t i = 0; i < extents.count; ++i) {
+    const uint64_t offset = extents.pairs[i * 2];
+    const uint64_t length = extents.pairs[i * 2 + 1];
+    threecrypt_ctr_xor(&ctx->ctr, ciphertext, input_map->ptr + offset, length, offset);
+    ciphertext += length;
+  }
+  mac_(ctx, ciphertext, out + header_mac_offset, MAC_BYTES_ + extents.data);
+  free(extents.pairs);
+  durability_sync_map(output_map);
+  SSC_MemMap_unmapOrDie(output_map);
+  if (input_map->size)
+    SSC_MemMap_unmapOrDie(input_map);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+/* Authenticate the @size byte Sparse_V1 file at @file and check its extent map,
+ * storing its apparent size in @apparent and its number of extents in @count.
+ * Returns an error message, or SSC_NULL. */
+static const char*
+authenticate_(Threecrypt_SparseV1* R_ ctx, const uint8_t* R_ file, size_t size, uint64_t* R_ apparent, uint64_t* R_ count)
+{
+  if (size < THREECRYPT_SPARSE_V1_METADATA_BYTES)
+    return "Error: The file is too small to be a Sparse_V1 encrypted file.\n";
+  *apparent = threecrypt_load64(file + APPARENT_OFFSET_);
+  *count    = threecrypt_load64(file + COUNT_OFFSET_);
+  if (*count > ((size - THREECRYPT_SPARSE_V1_METADATA_BYTES) / EXTENT_BYTES_))
+    return AUTH_FAILED_;
+  const uint64_t header_mac_offset = MAP_OFFSET_ + (*count * EXTENT_BYTES_);
+  derive_keys_(ctx, file);
+  /* A wrong password or keyfile is caught here, without reading the ciphertext. */
+  mac_(ctx, ctx->mac, file, header_mac_offset);
+  if (!threecrypt_ct_equal(ctx->mac, file + header_mac_offset, MAC_BYTES_))
+    return "Error: Authentication failed. Wrong password or keyfile, or the header has been corrupted.\n";
+  /* The map is authentic, but must still describe sorted, disjoint extents within the apparent size. */
+  uint64_t end  = 0;
+  uint64_t data = 0;
+  for (uint64_t i = 0; i < *count; ++i) {
+    const uint64_t offset = threecrypt_load64(file + MAP_OFFSET_ + (i * EXTENT_BYTES_));
+    const uint64_t length = threecrypt_load64(file + MAP_OFFSET_ + (i * EXTENT_BYTES_) + 8);
+    if (!length || (offset < end) || (offset > *apparent) || (length > (*apparent - offset)))
+      return "Error: The file has an invalid extent map.\n";
+    end   = offset + length;
+    data += length;
+  }
+  if (data != (size - THREECRYPT_SPARSE_V1_METADATA_BYTES - (*count * EXTENT_BYTES_)))
+    return AUTH_FAILED_;
+  mac_(ctx, ctx->mac, file + header_mac_offset, MAC_BYTES_ + data);
+  if (!threecrypt_ct_equal(ctx->mac, file + size - MAC_BYTES_, MAC_BYTES_))
+    return AUTH_FAILED_;
+  return SSC_NULL;
+}
+
+void
+sparse_v1_decrypt(
+ Threecrypt_SparseV1* R_ ctx,
+ SSC_MemMap* R_          input_map,
+ SSC_MemMap* R_          output_map,
+ const char* R_          output_filename)
+{
+  const uint8_t* const in = input_map->ptr;
+  uint64_t apparent = 0;
+  uint64_t count = 0;
+  const char* error = authenticate_(ctx, in, input_map->size, &apparent, &count);
+  if (error) {
+    SSC_MemMap_unmapOrDie(input_map);
+    SSC_File_closeOrDie(input_map->file);
+    SSC_File_closeOrDie(output_map->file);
+    remove(output_filename);
+    SSC_errx("%s", error);
+  }
+  /* Extending the new, empty output file leaves it one hole, so only the extents are ever written. */
+  output_map->size = (size_t)apparent;
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  if (count) {
+    SSC_MemMap_mapOrDie(output_map, false);
+    threecrypt_ctr_init(&ctx->ctr, ctx->enc_key, ctx->tweak, in + IV_OFFSET_);
+    const uint8_t* ciphertext = in + MAP_OFFSET_ + (count * EXTENT_BYTES_) + MAC_BYTES_;
+    for (uint64_t i = 0; i < count; ++i) {
+      const uint64_t offset = threecrypt_load64(in + MAP_OFFSET_ + (i * EXTENT_BYTES_));
+      const uint64_t length = threecrypt_load64(in + MAP_OFFSET_ + (i * EXTENT_BYTES_) + 8);
+      threecrypt_ctr_xor(&ctx->ctr, output_map->ptr + offset, ciphertext, length, offset);
+      ciphertext += length;
+    }
+    durability_sync_map(output_map);
+    SSC_MemMap_unmapOrDie(output_map);
+  }
+  SSC_MemMap_unmapOrDie(input_map);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+void
+sparse_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename)
+{
+  SSC_assertMsg(
+   input_map->size >= THREECRYPT_SPARSE_V1_METADATA_BYTES,
+   "Error: The input file %s is too small to be a Sparse_V1 encrypted file.\n", filename);
+  const uint8_t* const in = input_map->ptr;
+  const uint8_t* const keying = in + KEYING_OFFSET_;
+  const uint64_t count = threecrypt_load64(in + COUNT_OFFSET_);
+  printf("File Header for %s\n", filename);
+  printf("Method             : Sparse_V1\n");
+  keying_dump(keying);
+  threecrypt_print_hex("Tweak              : ", in + TWEAK_OFFSET_, PPQ_THREEFISH512_TWEAK_BYTES);
+  threecrypt_print_hex("CTR IV             : ", in + IV_OFFSET_, THREECRYPT_CTR_IV_BYTES);
+  printf("Apparent Size      : %" PRIu64 " bytes\n", threecrypt_load64(in + APPARENT_OFFSET_));
+  printf("Extents            : %" PRIu64 "\n", count);
+  if (count <= ((input_map->size - THREECRYPT_SPARSE_V1_METADATA_BYTES) / EXTENT_BYTES_))
+    printf(
+     "Data Size          : %" PRIu64 " bytes\n",
+     (uint64_t)(input_map->size - THREECRYPT_SPARSE_V1_METADATA_BYTES - (count * EXTENT_BYTES_)));
+}
+
+#endif /* ! THREECRYPT_SPARSE_V1_H */
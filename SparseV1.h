@@ -0,0 +1,89 @@
+#if !defined(THREECRYPT_SPARSE_V1_H) && defined(THREECRYPT_EXTERN_ENABLE_SPARSE_V1)
+#define THREECRYPT_SPARSE_V1_H
+
+#include <SSC/Macro.h>
+#include <SSC/MemMap.h>
+#include <PPQ/CSPRNG.h>
+#include "Keying.h"
+#include "Primitive.h"
+
+/* Sparse_V1 encrypted files store only the data extents of a sparse file, so that encrypting
+ * and decrypting it take time and space proportional to its allocated size, not its apparent size.
+ *
+ * Layout:
+ *   Header:
+ *     ID            (THREECRYPT_SPARSE_V1_ID_NBYTES)
+ *     Keying        (THREECRYPT_KEYING_BYTES)
+ *     Tweak         (PPQ_THREEFISH512_TWEAK_BYTES)
+ *     CTR IV        (THREECRYPT_CTR_IV_BYTES)
+ *     Apparent Size (8 bytes, little-endian; the size of the plaintext, holes included)
+ *     Extent Count  (8 bytes, little-endian)
+ *     Extent Map, for i = 0 .. Extent Count - 1:
+ *       Offset      (8 bytes, little-endian)
+ *       Length      (8 bytes, little-endian)
+ *     Header MAC    (64), MAC of the above.
+ *   Ciphertext of each extent in turn, whose lengths sum to the ciphertext size.
+ *   Tag             (64), MAC of the Header MAC and the ciphertext.
+ *
+ * Extents are sorted, non-empty, and disjoint, and everything outside them is a hole reading as zero.
+ * The plaintext of extent i is encrypted with keystream beginning at byte Offset i, so no keystream
+ * byte is used twice. Holes are found with SEEK_DATA and SEEK_HOLE where the platform has them;
+ * elsewhere the whole input is a single extent. */
+#define THREECRYPT_SPARSE_V1_ID               "3CRYPT_SPARSE_V1"
+#define THREECRYPT_SPARSE_V1_ID_NBYTES        17
+#define THREECRYPT_SPARSE_V1_MAC_BYTES        64
+#define THREECRYPT_SPARSE_V1_EXTENT_BYTES     16
+#define THREECRYPT_SPARSE_V1_FIXED_BYTES      (\
+ THREECRYPT_SPARSE_V1_ID_NBYTES +\
+ THREECRYPT_KEYING_BYTES +\
+ PPQ_THREEFISH512_TWEAK_BYTES +\
+ THREECRYPT_CTR_IV_BYTES +\
+ 8 +\
+ 8)
+#define THREECRYPT_SPARSE_V1_METADATA_BYTES   (THREECRYPT_SPARSE_V1_FIXED_BYTES + THREECRYPT_SPARSE_V1_MAC_BYTES * 2)
+#define THREECRYPT_SPARSE_V1_KEYING_OFFSET    THREECRYPT_SPARSE_V1_ID_NBYTES
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  Threecrypt_Keying keying;
+  Threecrypt_Ctr    ctr;
+  PPQ_CSPRNG        csprng; /* Only used when encrypting. */
+  uint64_t          enc_key  [PPQ_THREEFISH512_EXTERNAL_KEY_WORDS];
+  uint64_t          tweak    [PPQ_THREEFISH512_EXTERNAL_TWEAK_WORDS];
+  uint8_t           auth_key [PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t           derived  [PPQ_THREEFISH512_BLOCK_BYTES * 2];
+  uint8_t           mac      [THREECRYPT_SPARSE_V1_MAC_BYTES];
+} Threecrypt_SparseV1;
+
+/* Encrypt the data extents of the file of @input_map, which must be open and, unless it is empty,
+ * mapped, into @output_map, whose file must already be open, with the keying parameters in @ctx->keying.
+ * @ctx->keying.secret and @ctx->csprng must be initialized. Only the data extents of the input are read.
+ * Dies, leaving the output file empty, if the extents of the input cannot be found. Unmaps and closes
+ * both files. */
+void
+sparse_v1_encrypt(
+ Threecrypt_SparseV1* R_ ctx,
+ SSC_MemMap* R_          input_map,
+ SSC_MemMap* R_          output_map);
+
+/* Authenticate the mapped @input_map, then recreate its plaintext in @output_map, whose file must
+ * already be open and empty, writing only the data extents and leaving the rest as holes.
+ * @ctx->keying must be loaded and its secret initialized. On failure @output_filename is removed
+ * and we die. Unmaps and closes both files. */
+void
+sparse_v1_decrypt(
+ Threecrypt_SparseV1* R_ ctx,
+ SSC_MemMap* R_          input_map,
+ SSC_MemMap* R_          output_map,
+ const char* R_          output_filename);
+
+/* Print the header of the Sparse_V1 file mapped by @input_map. */
+void
+sparse_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif
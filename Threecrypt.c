@@ -1,5 +1,5 @@
 #include <ctype.h>
-
+#include <errno.h>
 #include <SSC/MemLock.h>
 #include <SSC/MemMap.h>
 #include <SSC/Operation.h>
@@ -7,6 +7,21 @@
 
 #include "Threecrypt.h"
 #include "CommandLineArg.h"
+#include "FileList.h"
+
+#if   defined(SSC_OS_UNIXLIKE)
+ #include <fcntl.h>
+ #include <unistd.h>
+ #define OPEN_RDONLY_(Path)      open(Path, O_RDONLY)
+ #define READ_(Fd, Buf, Size)    read(Fd, Buf, Size)
+ #define CLOSE_(Fd)              close(Fd)
+#elif defined(SSC_OS_WINDOWS)
+ #include <fcntl.h>
+ #include <io.h>
+ #define OPEN_RDONLY_(Path)      _open(Path, _O_RDONLY | _O_BINARY)
+ #define READ_(Fd, Buf, Size)    _read(Fd, Buf, Size)
+ #define CLOSE_(Fd)              _close(Fd)
+#endif
 
 #ifdef SSC_MEMLOCK_H
  #define LOCK_INIT_                SSC_MemLock_Global_initHandled() /* Initialize the global memorylocking variable @SSC_Mlock_g. */
@@ -24,6 +39,27 @@
 
 typedef PPQ_DragonflyV1Encrypt Encrypt_t;
 typedef PPQ_DragonflyV1Decrypt Decrypt_t;
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+typedef Threecrypt_KeyfileV1   Keyfile_t;
+#endif
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+typedef Threecrypt_SegmentedV1 Segmented_t;
+#endif
+#if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+typedef Threecrypt_ChunkedV1   Chunked_t;
+#endif
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+typedef Threecrypt_SparseV1    Sparse_t;
+#endif
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+typedef Threecrypt_ArchiveV1   Archive_t;
+#endif
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+typedef Threecrypt_XChaChaV1   XChaCha_t;
+#endif
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+typedef Threecrypt_DragonflyV2 DragonflyV2_t;
+#endif
 
 static char const * Help_Suggestion =  "(Use 3crypt --help for more information)\n";
 static char const * Help = "Usage: 3crypt <Mode> [Switches...]\n"
@@ -39,9 +75,7 @@ static char const * Help = "Usage: 3crypt <Mode> [Switches...]\n"
                            "-i, --input  <filename>\t\tSpecifies the input file.\n"
                            "-o, --output <filename>\t\tSpecifies the output file.\n"
                            "-E, --entropy\t\t\tProvide random input characters to increase the entropy of the pseudorandom number generator.\n\n"
-#if !THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
- #error "Dragonfly_V1 is the only supported method!"
-#endif
+#if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
                            "Dragonfly_V1 Encryption Options\n"
                            "-------------------------------\n"
                            "--min-memory  <number_bytes>[K|M|G]\tThe minimum amount of memory to consume during key-derivation. Minimum memory cost.\n"
@@ -57,7 +91,9 @@ static char const * Help = "Usage: 3crypt <Mode> [Switches...]\n"
                            "    WARNING: The optional phi function hardens the key-derivation function against\n"
                            "    parallel adversaries, greatly increasing the work necessary to attack your\n"
                            "    password, but introduces the potential for cache-timing attacks...\n"
-                           "    Do NOT use this feature unless you understand the security implications!\n";
+                           "    Do NOT use this feature unless you understand the security implications!\n"
+#endif
+                           ;
 
 static Threecrypt_Method_t
 determine_crypto_method_(SSC_MemMap*);
@@ -71,18 +107,177 @@ threecrypt_decrypt_(Threecrypt*);
 static void
 threecrypt_dump_(Threecrypt*);
 
+/* Read a passphrase into @buffer from the file descriptor or file specified
+ * with --passphrase-fd or --passphrase-file, bypassing the terminal entirely.
+ * Returns the passphrase size, or NO_PASSPHRASE_SOURCE_ if neither was specified. */
+#define NO_PASSPHRASE_SOURCE_ (-1)
+static int
+read_passphrase_(Threecrypt*, uint8_t*);
+
+/* Reseed @csprng with the hash of random keyboard input, using @buffer
+ * of @buffer_size bytes and @hash_out as scratch space. */
+static void
+supplement_entropy_(PPQ_CSPRNG*, PPQ_UBI512*, uint8_t*, size_t, uint8_t*);
+
+/* Get a password into @buffer, from read_passphrase_() if possible, otherwise from the terminal.
+ * If @check_buffer is not NULL, a terminal password must be entered twice. Returns the password size. */
+static int
+get_password_(Threecrypt*, uint8_t*, uint8_t*);
+
+/* Fill in the Catena parameters of @input the user did not specify with our defaults. */
+static void
+set_catena_defaults_(PPQ_Catena512Input*);
+
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+static void
+keyfile_v1_encrypt_(Threecrypt*);
+
+static void
+keyfile_v1_decrypt_(Threecrypt*);
+#endif
+
+#if THREECRYPT_USE_RECURSIVE
+/* Encrypt or decrypt every file beneath the input directory, in batches. */
+static void
+threecrypt_recursive_(Threecrypt*);
+#endif
+
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+static void
+threecrypt_append_(Threecrypt*);
+
+static void
+segmented_v1_decrypt_(Threecrypt*);
+
+/* Encrypt into a Segmented_V1 file with checkpoints, resuming from the last one if the output exists. */
+static void
+threecrypt_resume_(Threecrypt*);
+#endif
+
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+static void
+sparse_v1_encrypt_(Threecrypt*);
+
+static void
+sparse_v1_decrypt_(Threecrypt*);
+#endif
+
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+static void
+threecrypt_archive_(Threecrypt*);
+
+static void
+threecrypt_list_(Threecrypt*);
+
+static void
+threecrypt_extract_(Threecrypt*);
+
+static void
+archive_v1_decrypt_(Threecrypt*);
+#endif
+
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+static void
+xchacha_v1_encrypt_(Threecrypt*);
+
+/* Decrypt the input, whose @header has been read. */
+static void
+xchacha_v1_decrypt_(Threecrypt*, const uint8_t*);
+#endif
+
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+static void
+dragonfly_v2_encrypt_(Threecrypt*);
+
+/* Decrypt the input, whose @header has been read. */
+static void
+dragonfly_v2_decrypt_(Threecrypt*, const uint8_t*);
+#endif
+
+#if THREECRYPT_USE_JOURNAL
+/* Roll back an interrupted rewrite of the file this mode rewrites or reads, if there was one. */
+static void
+recover_(Threecrypt*);
+
+/* Allow the journal of the file @filename, rewritten in place, and its directory. */
+static void
+unveil_journal_(const char*);
+#endif
+
+#if THREECRYPT_USE_DURABILITY
+/* Allow the temporary file the output @output_filename is written under, and its directory. */
+static void
+unveil_durable_(const char*);
+
+/* Run @operation, writing the output under a temporary name and committing it under its own. */
+static void
+durably_(Threecrypt*, void (*)(Threecrypt*));
+#endif
+
+/* Turn the --pad-to or --pad-as-if target into a number of padding bytes to add,
+ * for a method whose encrypted files have @metadata_bytes bytes besides the plaintext and padding. */
+static void
+resolve_padding_(Threecrypt*, uint64_t);
+
+#if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+static void
+threecrypt_update_(Threecrypt*);
+
+static void
+chunked_v1_decrypt_(Threecrypt*);
+#endif
+
+#if THREECRYPT_USE_LAZY_VIEW
+static void
+threecrypt_view_(Threecrypt*);
+#endif
+
 #define ARG_ARR_SIZE_(Array, Type) ((sizeof(Array) / sizeof(Type)) - 1)
 
 static const SSC_ArgLong longs[] = {
+  #if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+  SSC_ARGLONG_LITERAL(append_argproc,  "append"),
+  #endif
+  #if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+  SSC_ARGLONG_LITERAL(archive_argproc, "archive"),
+  #endif
   SSC_ARGLONG_LITERAL(decrypt_argproc, "decrypt"),
   SSC_ARGLONG_LITERAL(dump_argproc,    "dump"),
+  #if THREECRYPT_USE_DURABILITY
+  SSC_ARGLONG_LITERAL(durability_argproc, "durability"),
+  #endif
   SSC_ARGLONG_LITERAL(encrypt_argproc, "encrypt"),
   SSC_ARGLONG_LITERAL(entropy_argproc, "entropy"),
+  #if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+  SSC_ARGLONG_LITERAL(extract_argproc, "extract"),
+  #endif
   SSC_ARGLONG_LITERAL(help_argproc,    "help"),
   SSC_ARGLONG_LITERAL(input_argproc,   "input"),
+  #if THREECRYPT_USE_THROTTLE
+  SSC_ARGLONG_LITERAL(ionice_argproc,  "ionice"),
+  #endif
   #if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
   SSC_ARGLONG_LITERAL(iterations_argproc, "iterations"),
+  #endif
+  #if THREECRYPT_USE_KDF_BUDGET
+  SSC_ARGLONG_LITERAL(kdf_budget_argproc, "kdf-budget"),
+  SSC_ARGLONG_LITERAL(kdf_ledger_argproc, "kdf-ledger"),
+  #endif
+  #if THREECRYPT_USE_KEYFILES
+  SSC_ARGLONG_LITERAL(keyfile_argproc,    "keyfile"),
+  #endif
+  #if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+  SSC_ARGLONG_LITERAL(list_argproc,       "list"),
+  #endif
+  #if THREECRYPT_USE_THROTTLE
+  SSC_ARGLONG_LITERAL(max_cpu_argproc,     "max-cpu"),
+  SSC_ARGLONG_LITERAL(max_io_rate_argproc, "max-io-rate"),
+  #endif
+  #if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
   SSC_ARGLONG_LITERAL(max_memory_argproc, "max-memory"),
+  #endif
+  SSC_ARGLONG_LITERAL(method_argproc,     "method"),
+  #if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
   SSC_ARGLONG_LITERAL(min_memory_argproc, "min-memory"),
   #endif
   SSC_ARGLONG_LITERAL(output_argproc, "output"),
@@ -90,9 +285,31 @@ static const SSC_ArgLong longs[] = {
   SSC_ARGLONG_LITERAL(pad_as_if_argproc,  "pad-as-if"),
   SSC_ARGLONG_LITERAL(pad_by_argproc,     "pad-by"),
   SSC_ARGLONG_LITERAL(pad_to_argproc,     "pad-to"),
+  #endif
+  SSC_ARGLONG_LITERAL(passphrase_fd_argproc,   "passphrase-fd"),
+  SSC_ARGLONG_LITERAL(passphrase_file_argproc, "passphrase-file"),
+  #if THREECRYPT_USE_RECURSIVE
+  SSC_ARGLONG_LITERAL(recursive_argproc,  "recursive"),
+  #endif
+  #if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+  SSC_ARGLONG_LITERAL(resume_argproc,     "resume"),
+  #endif
+  #if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+  SSC_ARGLONG_LITERAL(sparse_argproc,     "sparse"),
+  #endif
+  #if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
   SSC_ARGLONG_LITERAL(use_memory_argproc, "use-memory"),
   SSC_ARGLONG_LITERAL(use_phi_argproc,    "use-phi"),
   #endif
+  #if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+  SSC_ARGLONG_LITERAL(update_argproc,     "update"),
+  #endif
+  #if THREECRYPT_USE_LAZY_VIEW
+  SSC_ARGLONG_LITERAL(view_argproc,       "view"),
+  #endif
+  #if THREECRYPT_USE_WINDOW
+  SSC_ARGLONG_LITERAL(window_argproc,     "window"),
+  #endif
   SSC_ARGLONG_NULL_LITERAL
 };
 #define NUM_LONGS_ ARG_ARR_SIZE_(longs, SSC_ArgLong)
@@ -100,11 +317,17 @@ static const SSC_ArgLong longs[] = {
 static const SSC_ArgShort shorts[] = {
   SSC_ARGSHORT_LITERAL(dump_argproc   , 'D'),
   SSC_ARGSHORT_LITERAL(entropy_argproc, 'E'),
+  #if THREECRYPT_USE_KEYFILES
+  SSC_ARGSHORT_LITERAL(keyfile_argproc, 'K'),
+  #endif
   SSC_ARGSHORT_LITERAL(decrypt_argproc, 'd'),
   SSC_ARGSHORT_LITERAL(encrypt_argproc, 'e'),
   SSC_ARGSHORT_LITERAL(help_argproc,    'h'),
   SSC_ARGSHORT_LITERAL(input_argproc,   'i'),
   SSC_ARGSHORT_LITERAL(output_argproc,  'o'),
+  #if THREECRYPT_USE_RECURSIVE
+  SSC_ARGSHORT_LITERAL(recursive_argproc, 'r'),
+  #endif
   SSC_ARGSHORT_NULL_LITERAL
 };
 #define NUM_SHORTS_ ARG_ARR_SIZE_(shorts, SSC_ArgShort)
@@ -122,6 +345,10 @@ void threecrypt(int argc, char** argv)
   SSC_assertMsg(tcrypt.mode != THREECRYPT_MODE_NONE, "Error: No mode specified.\n%s", Help_Suggestion);
   /* Error: Input file not specified. Mode supplied, input file not supplied. */
   SSC_assertMsg(tcrypt.input_filename != NULL, "Error: Input file was not specified.\n%s", Help_Suggestion);
+#if THREECRYPT_USE_JOURNAL
+  /* Roll back an interrupted append or update before anything is unveiled, which would hide its journal. */
+  recover_(&tcrypt);
+#endif
   /* On OpenBSD, we call unveil with "r" so we're allowed to
    * read from the input file. */
   SSC_OPENBSD_UNVEIL(tcrypt.input_filename, "r");
@@ -129,10 +356,97 @@ void threecrypt(int argc, char** argv)
   SSC_assertMsg(
    SSC_FilePath_exists(tcrypt.input_filename), "Error: The input file %s does not seem to exist.\n%s",
    tcrypt.input_filename, Help_Suggestion);
+  /* We must also be allowed to read the passphrase file, if one was specified. */
+  if (tcrypt.passphrase_filename) {
+    SSC_OPENBSD_UNVEIL(tcrypt.passphrase_filename, "r");
+  }
+  /* Likewise the keyfile, which may also need to be created when encrypting. */
+  if (tcrypt.keyfile_filename) {
+    SSC_OPENBSD_UNVEIL(
+     tcrypt.keyfile_filename,
+     ((tcrypt.mode == THREECRYPT_MODE_SYMMETRIC_ENC) ||
+      (tcrypt.mode == THREECRYPT_MODE_APPEND) ||
+      (tcrypt.mode == THREECRYPT_MODE_UPDATE) ||
+      (tcrypt.mode == THREECRYPT_MODE_ARCHIVE)) ? "rwc" : "r");
+  }
+  /* Likewise the key-derivation ledger, if memory is budgeted. */
+  kdf_budget_configure(tcrypt.kdf_budget, tcrypt.kdf_ledger_filename);
+  if (tcrypt.kdf_budget && (tcrypt.mode != THREECRYPT_MODE_DUMP)) {
+    SSC_OPENBSD_UNVEIL(kdf_budget_ledger(), "rwc");
+  }
+  /* Throttle the data path, and lower our I/O priority, if asked to. */
+  throttle_configure(tcrypt.max_io_rate, tcrypt.max_cpu);
+  if (tcrypt.ionice_class != THREECRYPT_IONICE_NONE)
+    throttle_ionice(tcrypt.ionice_class, tcrypt.ionice_level);
+  /* Map the input and output a window at a time, if asked to. Only plain encryption and decryption stream. */
+  if (tcrypt.window) {
+    SSC_assertMsg(
+     ((tcrypt.mode == THREECRYPT_MODE_SYMMETRIC_ENC) || (tcrypt.mode == THREECRYPT_MODE_SYMMETRIC_DEC)) &&
+      !tcrypt.recursive && !tcrypt.resume,
+     "Error: --window can only be used to encrypt or decrypt a single file with -e or -d.\n%s", Help_Suggestion);
+    threecrypt_window_configure(tcrypt.window);
+  }
+#if THREECRYPT_USE_DURABILITY
+  /* Rename each output into place under a durability policy, if asked to. Only plain encryption and decryption
+   * write new files whole. */
+  if (tcrypt.durability != THREECRYPT_DURABILITY_DEFAULT) {
+    SSC_assertMsg(
+     ((tcrypt.mode == THREECRYPT_MODE_SYMMETRIC_ENC) || (tcrypt.mode == THREECRYPT_MODE_SYMMETRIC_DEC)) &&
+      !tcrypt.resume,
+     "Error: --durability can only be used to encrypt or decrypt with -e, -d or -r.\n%s", Help_Suggestion);
+    durability_configure(tcrypt.durability);
+  }
+#endif
+#if THREECRYPT_USE_RECURSIVE
+  /* Recursive operation writes each output file beside its input, anywhere beneath the input directory. */
+  if (tcrypt.recursive) {
+    SSC_OPENBSD_UNVEIL(tcrypt.input_filename, "rwc");
+    SSC_OPENBSD_UNVEIL(SSC_NULL, SSC_NULL);
+    threecrypt_recursive_(&tcrypt);
+    free(tcrypt.input_filename);
+    free(tcrypt.passphrase_filename);
+    free(tcrypt.keyfile_filename);
+    free(tcrypt.kdf_ledger_filename);
+    return;
+  }
+#endif
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+  /* Archiving packs every file beneath the input directory into one encrypted file,
+   * "<input_directory>.3c" unless the output file is explicitly specified. */
+  if (tcrypt.mode == THREECRYPT_MODE_ARCHIVE) {
+    while ((tcrypt.input_filename_size > 1) && (tcrypt.input_filename[tcrypt.input_filename_size - 1] == '/'))
+      tcrypt.input_filename[--tcrypt.input_filename_size] = '\0';
+    if (!tcrypt.output_filename) {
+      tcrypt.output_filename = threecrypt_with_suffix(tcrypt.input_filename, ".3c");
+      tcrypt.output_filename_size = tcrypt.input_filename_size + 3;
+    }
+    SSC_OPENBSD_UNVEIL(tcrypt.output_filename, "rwc");
+    SSC_OPENBSD_UNVEIL(SSC_NULL, SSC_NULL);
+    SSC_assertMsg(
+     !SSC_FilePath_exists(tcrypt.output_filename),
+     "Error: The output file %s already seems to exist.\n", tcrypt.output_filename);
+    threecrypt_archive_(&tcrypt);
+    free(tcrypt.input_filename);
+    free(tcrypt.output_filename);
+    free(tcrypt.passphrase_filename);
+    free(tcrypt.keyfile_filename);
+    free(tcrypt.kdf_ledger_filename);
+    return;
+  }
+#endif
   /* Get the size of the input file, and store it in the input_map. */
   tcrypt.input_map.size = SSC_FilePath_getSizeOrDie(tcrypt.input_filename);
   switch (tcrypt.mode) {
   case THREECRYPT_MODE_SYMMETRIC_ENC: {
+    /* Encrypting with a keyfile implies Keyfile_V1. */
+    if (tcrypt.method == THREECRYPT_METHOD_NONE) {
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+      if (tcrypt.keyfile_filename)
+        tcrypt.method = THREECRYPT_METHOD_KEYFILE_V1;
+      else
+#endif
+        tcrypt.method = THREECRYPT_METHOD_DEFAULT;
+    }
     /* We're encrypting. During encryption output filename need not be specified.
      * If it isn't explicitly specified, it is assumed to be "<input_filename>.3c" */
     if (!tcrypt.output_filename) {
@@ -146,11 +460,51 @@ void threecrypt(int argc, char** argv)
      * read/write/create the output file, then follow up with two
      * NULL pointers to prevent further calls to unveil. */
 #define OPENBSD_UNVEIL_OUTPUT_(output_filename_v) SSC_OPENBSD_UNVEIL(output_filename_v, "rwc"); SSC_OPENBSD_UNVEIL(SSC_NULL, SSC_NULL)
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+    if (tcrypt.resume) {
+ #if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+      SSC_assertMsg(
+       tcrypt.method != THREECRYPT_METHOD_SPARSE_V1,
+       "Error: --resume and --sparse cannot be used together.\n%s", Help_Suggestion);
+ #endif
+ #if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+      SSC_assertMsg(
+       tcrypt.method != THREECRYPT_METHOD_XCHACHA_V1,
+       "Error: --resume cannot be used with XChaCha_V1.\n%s", Help_Suggestion);
+ #endif
+      /* The output of a resumable encryption may already exist, and is checkpointed beside itself. */
+      {
+        char* checkpoint = threecrypt_with_suffix(tcrypt.output_filename, THREECRYPT_SEGMENTED_V1_CHECKPOINT_SUFFIX);
+        char* temp       = threecrypt_with_suffix(tcrypt.output_filename, THREECRYPT_SEGMENTED_V1_CHECKPOINT_TEMP_SUFFIX);
+        SSC_OPENBSD_UNVEIL(checkpoint, "rwc");
+        SSC_OPENBSD_UNVEIL(temp, "rwc");
+        free(checkpoint);
+        free(temp);
+        /* The directory is opened to sync the creation of the unstarted marker. */
+        char* parent = durability_parent(tcrypt.output_filename);
+        SSC_OPENBSD_UNVEIL(parent, "r");
+        free(parent);
+      }
+      OPENBSD_UNVEIL_OUTPUT_(tcrypt.output_filename);
+      threecrypt_resume_(&tcrypt);
+      break;
+    }
+#endif
+#if THREECRYPT_USE_DURABILITY
+    if (durability_is_configured())
+      unveil_durable_(tcrypt.output_filename);
+#endif
     OPENBSD_UNVEIL_OUTPUT_(tcrypt.output_filename);
     /* If there is already a file with the specified output filename, error out. */
     SSC_assertMsg(
      !SSC_FilePath_exists(tcrypt.output_filename),
      "Error: The output file %s already seems to exist.\n", tcrypt.output_filename);
+#if THREECRYPT_USE_DURABILITY
+    if (durability_is_configured()) {
+      durably_(&tcrypt, threecrypt_encrypt_);
+      break;
+    }
+#endif
     threecrypt_encrypt_(&tcrypt);
   } break; /* THREECRYPT_MODE_SYMMETRIC_ENC */
   case THREECRYPT_MODE_SYMMETRIC_DEC: {
@@ -167,9 +521,19 @@ void threecrypt(int argc, char** argv)
       memcpy(tcrypt.output_filename, tcrypt.input_filename, tcrypt.output_filename_size);
       tcrypt.output_filename[tcrypt.output_filename_size] = '\0';
     }
+#if THREECRYPT_USE_DURABILITY
+    if (durability_is_configured())
+      unveil_durable_(tcrypt.output_filename);
+#endif
     OPENBSD_UNVEIL_OUTPUT_(tcrypt.output_filename);
     SSC_assertMsg(!SSC_FilePath_exists(tcrypt.output_filename),
      "Error: The output file %s already seems to exist.\n", tcrypt.output_filename);
+#if THREECRYPT_USE_DURABILITY
+    if (durability_is_configured()) {
+      durably_(&tcrypt, threecrypt_decrypt_);
+      break;
+    }
+#endif
     threecrypt_decrypt_(&tcrypt);
   } break; /* THREECRYPT_MODE_SYMMETRIC_DEC */
   case THREECRYPT_MODE_DUMP: {
@@ -177,12 +541,74 @@ void threecrypt(int argc, char** argv)
     SSC_OPENBSD_PLEDGE("stdio rpath tty", NULL);
     threecrypt_dump_(&tcrypt);
   } break; /* THREECRYPT_MODE_DUMP */
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+  case THREECRYPT_MODE_APPEND: {
+    /* We're appending the input to an encrypted file, which may not exist yet,
+     * so the output file must be explicitly specified. */
+    SSC_assertMsg(tcrypt.output_filename != SSC_NULL, "Error: No output file specified.\n%s", Help_Suggestion);
+#if THREECRYPT_USE_JOURNAL
+    unveil_journal_(tcrypt.output_filename);
+#endif
+    OPENBSD_UNVEIL_OUTPUT_(tcrypt.output_filename);
+    threecrypt_append_(&tcrypt);
+  } break; /* THREECRYPT_MODE_APPEND */
+#endif
+#if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+  case THREECRYPT_MODE_UPDATE: {
+    /* We're making an encrypted file, which may not exist yet, match the input,
+     * so the output file must be explicitly specified. */
+    SSC_assertMsg(tcrypt.output_filename != SSC_NULL, "Error: No output file specified.\n%s", Help_Suggestion);
+    unveil_journal_(tcrypt.output_filename);
+    OPENBSD_UNVEIL_OUTPUT_(tcrypt.output_filename);
+    threecrypt_update_(&tcrypt);
+  } break; /* THREECRYPT_MODE_UPDATE */
+#endif
+#if THREECRYPT_USE_LAZY_VIEW
+  case THREECRYPT_MODE_VIEW: {
+    /* We're reading a range of the plaintext of an encrypted file, to the output file if
+     * one is specified, otherwise to stdout. */
+    if (tcrypt.output_filename) {
+      OPENBSD_UNVEIL_OUTPUT_(tcrypt.output_filename);
+      SSC_assertMsg(!SSC_FilePath_exists(tcrypt.output_filename),
+       "Error: The output file %s already seems to exist.\n", tcrypt.output_filename);
+    } else {
+      SSC_OPENBSD_UNVEIL(SSC_NULL, SSC_NULL);
+    }
+    threecrypt_view_(&tcrypt);
+  } break; /* THREECRYPT_MODE_VIEW */
+#endif
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+  case THREECRYPT_MODE_LIST: {
+    SSC_OPENBSD_UNVEIL(SSC_NULL, SSC_NULL);
+    threecrypt_list_(&tcrypt);
+  } break; /* THREECRYPT_MODE_LIST */
+  case THREECRYPT_MODE_EXTRACT: {
+    /* We're extracting one member of an archive. Unless the output file is explicitly
+     * specified, it is the last component of the member's name, in the working directory. */
+    SSC_assertMsg(tcrypt.member_name != SSC_NULL, "Error: No archive member specified.\n%s", Help_Suggestion);
+    if (!tcrypt.output_filename) {
+      const char* base = strrchr(tcrypt.member_name, '/');
+      base = base ? (base + 1) : tcrypt.member_name;
+      SSC_assertMsg(*base, "Error: No output file specified.\n");
+      tcrypt.output_filename = threecrypt_with_suffix(base, "");
+      tcrypt.output_filename_size = strlen(base);
+    }
+    OPENBSD_UNVEIL_OUTPUT_(tcrypt.output_filename);
+    SSC_assertMsg(!SSC_FilePath_exists(tcrypt.output_filename),
+     "Error: The output file %s already seems to exist.\n", tcrypt.output_filename);
+    threecrypt_extract_(&tcrypt);
+  } break; /* THREECRYPT_MODE_EXTRACT */
+#endif
   default:
     SSC_errx("Error: Invalid, unrecognized mode (%d)\n%s", tcrypt.mode, Help_Suggestion);
     break;
   } /* switch( tcrypt.mode ) */
   free(tcrypt.input_filename);
   free(tcrypt.output_filename);
+  free(tcrypt.passphrase_filename);
+  free(tcrypt.keyfile_filename);
+  free(tcrypt.kdf_ledger_filename);
+  free(tcrypt.member_name);
 }
 
 Threecrypt_Method_t
@@ -199,41 +625,156 @@ determine_crypto_method_(SSC_MemMap* map)
 }
 #else
  #error "Only supported method!"
+#endif
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+{
+  SSC_STATIC_ASSERT(sizeof(THREECRYPT_KEYFILE_V1_ID) == THREECRYPT_KEYFILE_V1_ID_NBYTES, "ID size mismatch.");
+  if (map->size >= sizeof(THREECRYPT_KEYFILE_V1_ID) &&
+      !memcmp(map->ptr, THREECRYPT_KEYFILE_V1_ID, sizeof(THREECRYPT_KEYFILE_V1_ID)))
+    return THREECRYPT_METHOD_KEYFILE_V1;
+}
+#endif
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+{
+  SSC_STATIC_ASSERT(sizeof(THREECRYPT_SEGMENTED_V1_ID) == THREECRYPT_SEGMENTED_V1_ID_NBYTES, "ID size mismatch.");
+  if (map->size >= sizeof(THREECRYPT_SEGMENTED_V1_ID) &&
+      !memcmp(map->ptr, THREECRYPT_SEGMENTED_V1_ID, sizeof(THREECRYPT_SEGMENTED_V1_ID)))
+    return THREECRYPT_METHOD_SEGMENTED_V1;
+}
+#endif
+#if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+{
+  SSC_STATIC_ASSERT(sizeof(THREECRYPT_CHUNKED_V1_ID) == THREECRYPT_CHUNKED_V1_ID_NBYTES, "ID size mismatch.");
+  if (map->size >= sizeof(THREECRYPT_CHUNKED_V1_ID) &&
+      !memcmp(map->ptr, THREECRYPT_CHUNKED_V1_ID, sizeof(THREECRYPT_CHUNKED_V1_ID)))
+    return THREECRYPT_METHOD_CHUNKED_V1;
+}
+#endif
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+{
+  SSC_STATIC_ASSERT(sizeof(THREECRYPT_SPARSE_V1_ID) == THREECRYPT_SPARSE_V1_ID_NBYTES, "ID size mismatch.");
+  if (map->size >= sizeof(THREECRYPT_SPARSE_V1_ID) &&
+      !memcmp(map->ptr, THREECRYPT_SPARSE_V1_ID, sizeof(THREECRYPT_SPARSE_V1_ID)))
+    return THREECRYPT_METHOD_SPARSE_V1;
+}
+#endif
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+{
+  SSC_STATIC_ASSERT(sizeof(THREECRYPT_ARCHIVE_V1_ID) == THREECRYPT_ARCHIVE_V1_ID_NBYTES, "ID size mismatch.");
+  if (map->size >= sizeof(THREECRYPT_ARCHIVE_V1_ID) &&
+      !memcmp(map->ptr, THREECRYPT_ARCHIVE_V1_ID, sizeof(THREECRYPT_ARCHIVE_V1_ID)))
+    return THREECRYPT_METHOD_ARCHIVE_V1;
+}
+#endif
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+{
+  SSC_STATIC_ASSERT(sizeof(THREECRYPT_XCHACHA_V1_ID) == THREECRYPT_XCHACHA_V1_ID_NBYTES, "ID size mismatch.");
+  if (map->size >= sizeof(THREECRYPT_XCHACHA_V1_ID) &&
+      !memcmp(map->ptr, THREECRYPT_XCHACHA_V1_ID, sizeof(THREECRYPT_XCHACHA_V1_ID)))
+    return THREECRYPT_METHOD_XCHACHA_V1;
+}
+#endif
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+{
+  SSC_STATIC_ASSERT(sizeof(THREECRYPT_DRAGONFLY_V2_ID) == THREECRYPT_DRAGONFLY_V2_ID_NBYTES, "ID size mismatch.");
+  if (map->size >= sizeof(THREECRYPT_DRAGONFLY_V2_ID) &&
+      !memcmp(map->ptr, THREECRYPT_DRAGONFLY_V2_ID, sizeof(THREECRYPT_DRAGONFLY_V2_ID)))
+    return THREECRYPT_METHOD_DRAGONFLY_V2;
+}
 #endif
   return THREECRYPT_METHOD_NONE;
 }
 
-void threecrypt_encrypt_ (Threecrypt* ctx) {
-  switch (ctx->input.padding_mode) {
-  case PPQ_COMMON_PAD_MODE_TARGET: {
-    uint64_t target = ctx->input.padding_bytes;
-    SSC_assertMsg(
-     target >= PPQ_DRAGONFLY_V1_VISIBLE_METADATA_BYTES,
-     "Error: The --pad-to target (%" PRIu64 ") is too small!\n", target);
-    SSC_assertMsg(
-     (target - PPQ_DRAGONFLY_V1_VISIBLE_METADATA_BYTES) >= ctx->input_map.size,
-     "Error: The input file size (%zu) is too large to --pad-to %" PRIu64 "\n",
-     ctx->input_map.size, target);
-    target -= ctx->input_map.size;
-    target -= PPQ_DRAGONFLY_V1_VISIBLE_METADATA_BYTES;
-    ctx->input.padding_bytes = target;
-    ctx->input.padding_mode = PPQ_COMMON_PAD_MODE_ADD;
-  } break;
-  case PPQ_COMMON_PAD_MODE_ASIF: {
-    uint64_t target = ctx->input.padding_bytes;
-    SSC_assertMsg(target >= 1, "Error: The --pad-as-if target (%" PRIu64 ") is too small!\n", target);
-    SSC_assertMsg(
-     target >= ctx->input_map.size,
-     "Error: The input file size (%zu) is too large to --pad-as-if %" PRIu64 "\n",
-     ctx->input_map.size, target);
-    target -= ctx->input_map.size;
-    ctx->input.padding_bytes = target;
-    ctx->input.padding_mode = PPQ_COMMON_PAD_MODE_ADD;
-  } break;
-  } /* ! switch(ctx->input.padding_mode) */
-  ctx->input_map.file = SSC_FilePath_openOrDie(ctx->input_filename, true);
-  SSC_MemMap_mapOrDie(&ctx->input_map, true);
-  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+int read_passphrase_(Threecrypt* ctx, uint8_t* buffer)
+{
+  int fd = ctx->passphrase_fd;
+  if (ctx->passphrase_filename) {
+    fd = OPEN_RDONLY_(ctx->passphrase_filename);
+    SSC_assertMsg(fd != -1, "Error: Failed to open the passphrase file %s!\n", ctx->passphrase_filename);
+  } else if (fd == THREECRYPT_PASSPHRASE_FD_NONE)
+    return NO_PASSPHRASE_SOURCE_;
+  /* Read one byte at a time, so that nothing past the first newline
+   * is consumed from a shared pipe. */
+  int size = 0;
+  uint8_t c = 0;
+  for (;;) {
+    int r = (int)READ_(fd, &c, 1);
+    if (r == 0)
+      break;
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      SSC_secureZero(buffer, PPQ_COMMON_MAX_PASSWORD_BYTES + 1);
+      SSC_errx("Error: Failed to read the passphrase!\n");
+    }
+    if (c == '\n')
+      break;
+    if (size == PPQ_COMMON_MAX_PASSWORD_BYTES) {
+      SSC_secureZero(buffer, PPQ_COMMON_MAX_PASSWORD_BYTES + 1);
+      SSC_secureZero(&c, sizeof(c));
+      SSC_errx("Error: The passphrase is longer than %d bytes!\n", PPQ_COMMON_MAX_PASSWORD_BYTES);
+    }
+    buffer[size++] = c;
+  }
+  SSC_secureZero(&c, sizeof(c));
+  if (size && (buffer[size - 1] == '\r'))
+    buffer[--size] = 0;
+  if (ctx->passphrase_filename)
+    CLOSE_(fd);
+  SSC_assertMsg(size >= 1, "Error: The passphrase was empty!\n");
+  return size;
+}
+
+void supplement_entropy_(
+ PPQ_CSPRNG* csprng,
+ PPQ_UBI512* ubi512,
+ uint8_t*    buffer,
+ size_t      buffer_size,
+ uint8_t*    hash_out)
+{
+  SSC_Terminal_init();
+  memset(buffer, 0, buffer_size);
+  int size = SSC_Terminal_getPassword(
+   buffer,
+   PPQ_COMMON_ENTROPY_PROMPT,
+   1,
+   PPQ_COMMON_MAX_PASSWORD_BYTES,
+   (PPQ_COMMON_MAX_PASSWORD_BYTES + 1));
+  SSC_Terminal_end();
+  PPQ_Skein512_hashNative(ubi512, hash_out, buffer, size);
+  SSC_secureZero(buffer, buffer_size);
+  PPQ_CSPRNG_reseed(csprng, hash_out);
+  SSC_secureZero(hash_out, PPQ_THREEFISH512_BLOCK_BYTES);
+}
+
+int get_password_(Threecrypt* ctx, uint8_t* buffer, uint8_t* check_buffer)
+{
+  memset(buffer, 0, PPQ_COMMON_MAX_PASSWORD_BYTES + 1);
+  int size = read_passphrase_(ctx, buffer);
+  if (size != NO_PASSPHRASE_SOURCE_)
+    return size;
+  SSC_Terminal_init();
+  if (check_buffer) {
+    memset(check_buffer, 0, PPQ_COMMON_MAX_PASSWORD_BYTES + 1);
+    size = SSC_Terminal_getPasswordChecked(
+     buffer,
+     check_buffer,
+     PPQ_COMMON_PASSWORD_PROMPT,
+     PPQ_COMMON_REENTRY_PROMPT,
+     1,
+     PPQ_COMMON_MAX_PASSWORD_BYTES,
+     (PPQ_COMMON_MAX_PASSWORD_BYTES + 1));
+  } else {
+    size = SSC_Terminal_getPassword(
+     buffer,
+     PPQ_COMMON_PASSWORD_PROMPT,
+     1,
+     PPQ_COMMON_MAX_PASSWORD_BYTES,
+     (PPQ_COMMON_MAX_PASSWORD_BYTES + 1));
+  }
+  SSC_Terminal_end();
+  return size;
+}
 
 #ifdef THREECRYPT_EXTERN_DRAGONFLY_V1_DEFAULT_GARLIC
  #define DEFAULT_GARLIC_IMPL_(v) UINT8_C(v)
@@ -244,94 +785,997 @@ void threecrypt_encrypt_ (Threecrypt* ctx) {
  #define DEFAULT_GARLIC_ UINT8_C(24)
 #endif
 
-  if (!ctx->input.g_low)
-    ctx->input.g_low = DEFAULT_GARLIC_;
-  if (!ctx->input.g_high)
-    ctx->input.g_high = DEFAULT_GARLIC_;
-  if (ctx->input.g_low > ctx->input.g_high)
-    ctx->input.g_high = ctx->input.g_low;
-  if (!ctx->input.lambda)
-    ctx->input.lambda = UINT8_C(1);
-  Encrypt_t* enc_p;
+void set_catena_defaults_(PPQ_Catena512Input* input)
+{
+  if (!input->g_low)
+    input->g_low = DEFAULT_GARLIC_;
+  if (!input->g_high)
+    input->g_high = DEFAULT_GARLIC_;
+  if (input->g_low > input->g_high)
+    input->g_high = input->g_low;
+  if (!input->lambda)
+    input->lambda = UINT8_C(1);
+}
+
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+void keyfile_v1_encrypt_(Threecrypt* ctx)
+{
+  /* The memory-hardness and padding options only make sense for passwords. */
   SSC_assertMsg(
-   (enc_p = (Encrypt_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Encrypt_t))) != SSC_NULL,
+   !ctx->input.g_low && !ctx->input.g_high && !ctx->input.lambda && !ctx->input.use_phi && !ctx->input.padding_bytes,
+   "Error: Dragonfly_V1 options cannot be used when encrypting with a keyfile.\n%s", Help_Suggestion);
+  ctx->input_map.file = SSC_FilePath_openOrDie(ctx->input_filename, true);
+  Keyfile_t* kf_p;
+  SSC_assertMsg(
+   (kf_p = (Keyfile_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Keyfile_t))) != SSC_NULL,
    "Error: Memory allocation failed!\n");
-  PPQ_DragonflyV1Encrypt_init(enc_p);
-  memcpy(&(enc_p->secret.input), &ctx->input, sizeof(ctx->input));
-  SSC_secureZero(&ctx->input, sizeof(ctx->input));
-  {
-    SSC_Terminal_init();
-    memset(enc_p->secret.input.password_buffer, 0, sizeof(enc_p->secret.input.password_buffer));
-    memset(enc_p->secret.input.check_buffer   , 0, sizeof(enc_p->secret.input.check_buffer)   );
-    int pw_size = SSC_Terminal_getPasswordChecked(
-     enc_p->secret.input.password_buffer,
-     enc_p->secret.input.check_buffer,
-     PPQ_COMMON_PASSWORD_PROMPT,
-     PPQ_COMMON_REENTRY_PROMPT,
-     1,
-     PPQ_COMMON_MAX_PASSWORD_BYTES,
-     (PPQ_COMMON_MAX_PASSWORD_BYTES + 1));
-    enc_p->secret.input.password_size = pw_size;
-    SSC_Terminal_end();
-  }
-  {
-    PPQ_CSPRNG* const csprng_p = &enc_p->secret.input.csprng;
-    PPQ_CSPRNG_init(csprng_p);
-    if (enc_p->secret.input.supplement_entropy) {
-      SSC_Terminal_init();
-      memset(enc_p->secret.input.check_buffer, 0, sizeof(enc_p->secret.input.check_buffer));
-      int pw_size = SSC_Terminal_getPassword(
-       enc_p->secret.input.check_buffer,
-       PPQ_COMMON_ENTROPY_PROMPT,
-       1,
-       PPQ_COMMON_MAX_PASSWORD_BYTES,
-       (PPQ_COMMON_MAX_PASSWORD_BYTES + 1));
-      SSC_Terminal_end();
-      PPQ_Skein512_hashNative(
-       &enc_p->secret.ubi512,
-       enc_p->secret.hash_out,
-       enc_p->secret.input.check_buffer,
-       pw_size);
-      SSC_secureZero(enc_p->secret.input.check_buffer, sizeof(enc_p->secret.input.check_buffer));
-      PPQ_CSPRNG_reseed(csprng_p, enc_p->secret.hash_out);
-      SSC_secureZero(enc_p->secret.hash_out, sizeof(enc_p->secret.hash_out));
-    }
+  PPQ_CSPRNG_init(&kf_p->csprng);
+  if (ctx->input.supplement_entropy) {
+    uint8_t buffer [PPQ_COMMON_MAX_PASSWORD_BYTES + 1];
+    supplement_entropy_(&kf_p->csprng, &kf_p->ubi512, buffer, sizeof(buffer), kf_p->mac);
   }
-  PPQ_DragonflyV1_encrypt(enc_p, &ctx->input_map, &ctx->output_map, ctx->output_filename);
-  SSC_secureZero(enc_p, sizeof(*enc_p));
-  DEALLOC_M_(enc_p);
+  /* Use the keyfile if it already exists, otherwise generate it. */
+  if (SSC_FilePath_exists(ctx->keyfile_filename))
+    keyfile_load(ctx->keyfile_filename, kf_p->key);
+  else
+    keyfile_generate(ctx->keyfile_filename, &kf_p->csprng, kf_p->key);
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  keyfile_v1_encrypt(kf_p, &ctx->input_map, &ctx->output_map);
+  SSC_secureZero(kf_p, sizeof(*kf_p));
+  DEALLOC_M_(kf_p);
 }
 
-void threecrypt_decrypt_ (Threecrypt * ctx) {
-  ctx->input_map.file = SSC_FilePath_openOrDie(ctx->input_filename, true);
-  SSC_MemMap_mapOrDie(&ctx->input_map, true);
+void keyfile_v1_decrypt_(Threecrypt* ctx)
+{
+  SSC_assertMsg(
+   ctx->keyfile_filename != SSC_NULL,
+   "Error: The input file %s was encrypted with a keyfile; specify it with -K.\n%s",
+   ctx->input_filename, Help_Suggestion);
+  Keyfile_t* kf_p;
+  SSC_assertMsg(
+   (kf_p = (Keyfile_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Keyfile_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  keyfile_load(ctx->keyfile_filename, kf_p->key);
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  keyfile_v1_decrypt(kf_p, &ctx->input_map, &ctx->output_map, ctx->output_filename);
+  SSC_secureZero(kf_p, sizeof(*kf_p));
+  DEALLOC_M_(kf_p);
+}
+#endif /* ! THREECRYPT_METHOD_KEYFILE_V1_ISDEF */
+
+#if THREECRYPT_USE_JOURNAL
+void recover_(Threecrypt* ctx)
+{
+  const char* filename = SSC_NULL;
+  if ((ctx->mode == THREECRYPT_MODE_SYMMETRIC_DEC) || (ctx->mode == THREECRYPT_MODE_VIEW))
+    filename = ctx->input_filename;
+  else if ((ctx->mode == THREECRYPT_MODE_APPEND) || (ctx->mode == THREECRYPT_MODE_UPDATE))
+    filename = ctx->output_filename;
+  if (filename && !ctx->recursive)
+    threecrypt_journal_recover(filename);
+}
+
+void unveil_journal_(const char* filename)
+{
+  char* journal = threecrypt_journal_name(filename);
+  SSC_OPENBSD_UNVEIL(journal, "rwc");
+  free(journal);
+  /* The directory is opened to sync the journal's creation and removal. */
+  char* parent = durability_parent(filename);
+  SSC_OPENBSD_UNVEIL(parent, "r");
+  free(parent);
+}
+#endif /* ! THREECRYPT_USE_JOURNAL */
+
+#if THREECRYPT_USE_DURABILITY
+void unveil_durable_(const char* output_filename)
+{
+  char* temp = durability_temp_name(output_filename);
+  SSC_OPENBSD_UNVEIL(temp, "rwc");
+  free(temp);
+  /* The directory is opened to sync the rename. */
+  char* parent = durability_parent(output_filename);
+  SSC_OPENBSD_UNVEIL(parent, "r");
+  free(parent);
+}
+
+void durably_(Threecrypt* ctx, void (*operation)(Threecrypt*))
+{
+  char* const  output_filename = ctx->output_filename;
+  const size_t output_filename_size = ctx->output_filename_size;
+  char* temp = durability_temp_name(output_filename);
+  SSC_assertMsg(
+   !SSC_FilePath_exists(temp),
+   "Error: The temporary file %s already seems to exist; remove it if it was left by an interrupted run.\n", temp);
+  ctx->output_filename = temp;
+  ctx->output_filename_size = output_filename_size + sizeof(THREECRYPT_DURABILITY_TEMP_SUFFIX) - 1;
+  operation(ctx);
+  ctx->output_filename = output_filename;
+  ctx->output_filename_size = output_filename_size;
+  durability_commit(temp, output_filename);
+  durability_flush();
+  free(temp);
+}
+#endif /* ! THREECRYPT_USE_DURABILITY */
+
+#if THREECRYPT_USE_RECURSIVE
+#define BATCH_FILES_ 64 /* The number of files encrypted or decrypted together. */
+
+void threecrypt_recursive_(Threecrypt* ctx)
+{
+  const bool encrypting = (ctx->mode == THREECRYPT_MODE_SYMMETRIC_ENC);
+  SSC_assertMsg(
+   encrypting || (ctx->mode == THREECRYPT_MODE_SYMMETRIC_DEC),
+   "Error: --recursive can only be used to encrypt or decrypt.\n%s", Help_Suggestion);
+  SSC_assertMsg(
+   ctx->keyfile_filename != SSC_NULL,
+   "Error: --recursive requires a keyfile; specify it with -K.\n%s", Help_Suggestion);
+  SSC_assertMsg(
+   ctx->output_filename == SSC_NULL,
+   "Error: --recursive writes each output file beside its input; do not specify -o.\n%s", Help_Suggestion);
+  SSC_assertMsg(
+   !ctx->input.g_low && !ctx->input.g_high && !ctx->input.lambda && !ctx->input.use_phi && !ctx->input.padding_bytes,
+   "Error: Dragonfly_V1 options cannot be used when encrypting with a keyfile.\n%s", Help_Suggestion);
+  Keyfile_t* kf_p;
+  SSC_assertMsg(
+   (kf_p = (Keyfile_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Keyfile_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  if (encrypting) {
+    PPQ_CSPRNG_init(&kf_p->csprng);
+    if (ctx->input.supplement_entropy) {
+      uint8_t buffer [PPQ_COMMON_MAX_PASSWORD_BYTES + 1];
+      supplement_entropy_(&kf_p->csprng, &kf_p->ubi512, buffer, sizeof(buffer), kf_p->mac);
+    }
+  }
+  if (encrypting && !SSC_FilePath_exists(ctx->keyfile_filename))
+    keyfile_generate(ctx->keyfile_filename, &kf_p->csprng, kf_p->key);
+  else
+    keyfile_load(ctx->keyfile_filename, kf_p->key);
+  /* Encrypt every file not already encrypted; decrypt every file ending in ".3c". */
+  Threecrypt_FileList list = THREECRYPT_FILELIST_NULL_LITERAL;
+  if (encrypting)
+    file_list_collect(&list, ctx->input_filename, SSC_NULL, ".3c");
+  else
+    file_list_collect(&list, ctx->input_filename, ".3c", SSC_NULL);
+  SSC_MemMap in_maps   [BATCH_FILES_];
+  SSC_MemMap out_maps  [BATCH_FILES_];
+  char*      in_names  [BATCH_FILES_];
+  char*      out_names [BATCH_FILES_];
+#if THREECRYPT_USE_DURABILITY
+  char*      final_names [BATCH_FILES_]; /* Under a durability policy, outputs are written as temporary files. */
+#endif
+  size_t failures = 0;
+  size_t i = 0;
+  while (i < list.count) {
+    size_t n = 0;
+    for (; (i < list.count) && (n < BATCH_FILES_); ++i) {
+      char* const  path = list.paths[i];
+      const size_t path_size = strlen(path);
+#if THREECRYPT_USE_DURABILITY
+      /* Temporary files left by an interrupted run are not inputs. */
+      if (durability_is_configured() &&
+          (path_size >= sizeof(THREECRYPT_DURABILITY_TEMP_SUFFIX)) &&
+          !strcmp(path + path_size - (sizeof(THREECRYPT_DURABILITY_TEMP_SUFFIX) - 1), THREECRYPT_DURABILITY_TEMP_SUFFIX))
+        continue;
+#endif
+      const size_t out_size = encrypting ? (path_size + 3) : (path_size - 3);
+      char* out = (char*)SSC_mallocOrDie(out_size + 1);
+      memcpy(out, path, (encrypting ? path_size : out_size));
+      if (encrypting)
+        memcpy(out + path_size, ".3c", 3);
+      out[out_size] = '\0';
+      if (!out_size || SSC_FilePath_exists(out)) {
+        fprintf(stderr, "Error: The output file for %s already seems to exist; skipping it.\n", path);
+        ++failures;
+        free(out);
+        continue;
+      }
+      in_maps[n] = SSC_MEMMAP_NULL_LITERAL;
+      in_maps[n].size = SSC_FilePath_getSizeOrDie(path);
+      in_maps[n].file = SSC_FilePath_openOrDie(path, true);
+      if (in_maps[n].size)
+        SSC_MemMap_mapOrDie(&in_maps[n], true);
+      if (!encrypting && (determine_crypto_method_(&in_maps[n]) != THREECRYPT_METHOD_KEYFILE_V1)) {
+        fprintf(stderr, "Error: The file %s was not encrypted with a keyfile; skipping it.\n", path);
+        ++failures;
+        if (in_maps[n].size)
+          SSC_MemMap_unmapOrDie(&in_maps[n]);
+        SSC_File_closeOrDie(in_maps[n].file);
+        free(out);
+        continue;
+      }
+#if THREECRYPT_USE_DURABILITY
+      if (durability_is_configured()) {
+        char* temp = durability_temp_name(out);
+        if (SSC_FilePath_exists(temp)) {
+          fprintf(stderr, "Error: The temporary file %s already seems to exist; skipping %s.\n", temp, path);
+          ++failures;
+          if (in_maps[n].size)
+            SSC_MemMap_unmapOrDie(&in_maps[n]);
+          SSC_File_closeOrDie(in_maps[n].file);
+          free(temp);
+          free(out);
+          continue;
+        }
+        final_names[n] = out;
+        out = temp;
+      }
+#endif
+      out_maps[n] = SSC_MEMMAP_NULL_LITERAL;
+      out_maps[n].file = SSC_FilePath_createOrDie(out);
+      in_names[n] = path;
+      out_names[n] = out;
+      ++n;
+    }
+    if (encrypting)
+      keyfile_v1_encrypt_batch(kf_p, in_maps, out_maps, n);
+    else
+      failures += keyfile_v1_decrypt_batch(kf_p, in_maps, out_maps, in_names, out_names, n);
+    for (size_t j = 0; j < n; ++j) {
+#if THREECRYPT_USE_DURABILITY
+      /* A failed decryption has already removed its output. */
+      if (durability_is_configured()) {
+        if (SSC_FilePath_exists(out_names[j]))
+          durability_commit(out_names[j], final_names[j]);
+        free(final_names[j]);
+      }
+#endif
+      free(out_names[j]);
+    }
+  }
+#if THREECRYPT_USE_DURABILITY
+  durability_flush();
+#endif
+  SSC_secureZero(kf_p, sizeof(*kf_p));
+  DEALLOC_M_(kf_p);
+  file_list_free(&list);
+  SSC_assertMsg(!failures, "Error: %zu files could not be %s.\n", failures, encrypting ? "encrypted" : "decrypted");
+}
+#endif /* ! THREECRYPT_USE_RECURSIVE */
+
+#if THREECRYPT_USE_KEYING
+/* Load the keying parameters of the file @filename from its keying @block into @keying,
+ * and check that -K was given if and only if the file is keyfile-keyed. */
+static void
+load_keying_(Threecrypt* ctx, Threecrypt_Keying* keying, const uint8_t* block, const char* filename)
+{
+  SSC_assertMsg(keying_load(keying, block), "Error: The file %s has malformed keying parameters.\n", filename);
+  if (keying->kind == THREECRYPT_KEYING_KEYFILE)
+    SSC_assertMsg(
+     ctx->keyfile_filename != SSC_NULL,
+     "Error: The file %s was encrypted with a keyfile; specify it with -K.\n%s", filename, Help_Suggestion);
+  else
+    SSC_assertMsg(
+     ctx->keyfile_filename == SSC_NULL,
+     "Error: The file %s was encrypted with a password, not a keyfile.\n", filename);
+}
+
+/* Get the password or keyfile key that @keying describes into @keying->secret.
+ * New password-keyed files have their password entered twice, and new keyfiles are generated with @csprng. */
+static void
+get_keying_secret_(Threecrypt* ctx, Threecrypt_Keying* keying, PPQ_CSPRNG* csprng, bool new_file)
+{
+  if (keying->kind == THREECRYPT_KEYING_KEYFILE) {
+    if (new_file && !SSC_FilePath_exists(ctx->keyfile_filename))
+      keyfile_generate(ctx->keyfile_filename, csprng, keying->secret);
+    else
+      keyfile_load(ctx->keyfile_filename, keying->secret);
+    keying->secret_size = THREECRYPT_KEYFILE_KEY_BYTES;
+  } else {
+    uint8_t check_buffer [PPQ_COMMON_MAX_PASSWORD_BYTES + 1];
+    keying->secret_size = get_password_(ctx, keying->secret, new_file ? check_buffer : SSC_NULL);
+    SSC_secureZero(check_buffer, sizeof(check_buffer));
+  }
+}
+
+/* Choose the keying of a new file from the command-line: a keyfile if -K was given,
+ * otherwise a password with the requested (or default) Catena parameters. */
+static void
+choose_keying_(Threecrypt* ctx, Threecrypt_Keying* keying)
+{
+  if (ctx->keyfile_filename) {
+    SSC_assertMsg(
+     !ctx->input.g_low && !ctx->input.g_high && !ctx->input.lambda && !ctx->input.use_phi,
+     "Error: Memory-hardness options cannot be used with a keyfile.\n%s", Help_Suggestion);
+    keying->kind = THREECRYPT_KEYING_KEYFILE;
+  } else {
+    set_catena_defaults_(&ctx->input);
+    keying->kind    = THREECRYPT_KEYING_PASSWORD;
+    keying->g_low   = ctx->input.g_low;
+    keying->g_high  = ctx->input.g_high;
+    keying->lambda  = ctx->input.lambda;
+    keying->use_phi = ctx->input.use_phi;
+  }
+}
+
+/* Prepare the output of a mode that updates an encrypted file in place.
+ * If the output file does not exist, it is created empty, its keying is chosen from the command-line
+ * and @ctx->output_map.size is zero. Otherwise it must be a @method file of at least @min_size bytes,
+ * which is opened read-write and mapped, and its keying is read from @keying_offset.
+ * Either way @keying->secret is initialized. Returns whether the output file is new. */
+static bool
+prepare_output_in_place_(
+ Threecrypt*        ctx,
+ Threecrypt_Keying* keying,
+ PPQ_CSPRNG*        csprng,
+ int                method,
+ size_t             min_size,
+ size_t             keying_offset,
+ const char*        method_name)
+{
+  SSC_assertMsg(
+   !ctx->input.padding_bytes,
+   "Error: Padding options cannot be used with %s files.\n%s", method_name, Help_Suggestion);
+  const bool new_file = !SSC_FilePath_exists(ctx->output_filename);
+  if (new_file) {
+    /* The keying of a new file is chosen here, and fixed for every later change. */
+    choose_keying_(ctx, keying);
+    get_keying_secret_(ctx, keying, csprng, true);
+    ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+    ctx->output_map.size = 0;
+  } else {
+    /* The keying of an existing file is read from its header. */
+    SSC_assertMsg(
+     !ctx->input.g_low && !ctx->input.g_high && !ctx->input.lambda && !ctx->input.use_phi,
+     "Error: Memory-hardness options cannot be changed for an existing file.\n%s", Help_Suggestion);
+    ctx->output_map.file = SSC_FilePath_openOrDie(ctx->output_filename, false);
+    ctx->output_map.size = SSC_FilePath_getSizeOrDie(ctx->output_filename);
+    SSC_assertMsg(
+     ctx->output_map.size >= min_size,
+     "Error: The output file %s is not a %s encrypted file.\n", ctx->output_filename, method_name);
+    SSC_MemMap_mapOrDie(&ctx->output_map, false);
+    SSC_assertMsg(
+     determine_crypto_method_(&ctx->output_map) == method,
+     "Error: The output file %s is not a %s encrypted file.\n", ctx->output_filename, method_name);
+    load_keying_(ctx, keying, ctx->output_map.ptr + keying_offset, ctx->output_filename);
+    get_keying_secret_(ctx, keying, csprng, false);
+  }
+  ctx->input_map.file = SSC_FilePath_openOrDie(ctx->input_filename, true);
+  if (ctx->input_map.size)
+    SSC_MemMap_mapOrDie(&ctx->input_map, true);
+  return new_file;
+}
+#endif /* ! THREECRYPT_USE_KEYING */
+
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+void threecrypt_append_(Threecrypt* ctx)
+{
+  Segmented_t* seg_p;
+  SSC_assertMsg(
+   (seg_p = (Segmented_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Segmented_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(seg_p, 0, sizeof(*seg_p));
+  PPQ_CSPRNG_init(&seg_p->csprng);
+  if (ctx->input.supplement_entropy) {
+    uint8_t buffer [PPQ_COMMON_MAX_PASSWORD_BYTES + 1];
+    supplement_entropy_(&seg_p->csprng, &seg_p->keying.ubi512, buffer, sizeof(buffer), seg_p->mac);
+  }
+  prepare_output_in_place_(
+   ctx,
+   &seg_p->keying,
+   &seg_p->csprng,
+   THREECRYPT_METHOD_SEGMENTED_V1,
+   THREECRYPT_SEGMENTED_V1_HEADER_BYTES,
+   THREECRYPT_SEGMENTED_V1_KEYING_OFFSET,
+   "Segmented_V1");
+  segmented_v1_append(seg_p, &ctx->input_map, &ctx->output_map, ctx->output_filename);
+  SSC_secureZero(seg_p, sizeof(*seg_p));
+  DEALLOC_M_(seg_p);
+}
+
+void threecrypt_resume_(Threecrypt* ctx)
+{
+  Segmented_t* seg_p;
+  SSC_assertMsg(
+   (seg_p = (Segmented_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Segmented_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(seg_p, 0, sizeof(*seg_p));
+  PPQ_CSPRNG_init(&seg_p->csprng);
+  if (ctx->input.supplement_entropy) {
+    uint8_t buffer [PPQ_COMMON_MAX_PASSWORD_BYTES + 1];
+    supplement_entropy_(&seg_p->csprng, &seg_p->keying.ubi512, buffer, sizeof(buffer), seg_p->mac);
+  }
+  segmented_v1_discard_unstarted(ctx->output_filename);
+  prepare_output_in_place_(
+   ctx,
+   &seg_p->keying,
+   &seg_p->csprng,
+   THREECRYPT_METHOD_SEGMENTED_V1,
+   THREECRYPT_SEGMENTED_V1_HEADER_BYTES,
+   THREECRYPT_SEGMENTED_V1_KEYING_OFFSET,
+   "Segmented_V1");
+  segmented_v1_encrypt_resumable(seg_p, &ctx->input_map, &ctx->output_map, ctx->output_filename);
+  SSC_secureZero(seg_p, sizeof(*seg_p));
+  DEALLOC_M_(seg_p);
+}
+
+void segmented_v1_decrypt_(Threecrypt* ctx)
+{
+  Segmented_t* seg_p;
+  SSC_assertMsg(
+   (seg_p = (Segmented_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Segmented_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(seg_p, 0, sizeof(*seg_p));
+  SSC_assertMsg(
+   ctx->input_map.size >= THREECRYPT_SEGMENTED_V1_HEADER_BYTES,
+   "Error: The input file %s is too small to be a Segmented_V1 encrypted file.\n", ctx->input_filename);
+  load_keying_(ctx, &seg_p->keying, ctx->input_map.ptr + THREECRYPT_SEGMENTED_V1_KEYING_OFFSET, ctx->input_filename);
+  get_keying_secret_(ctx, &seg_p->keying, SSC_NULL, false);
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  segmented_v1_decrypt(seg_p, &ctx->input_map, &ctx->output_map, ctx->output_filename);
+  SSC_secureZero(seg_p, sizeof(*seg_p));
+  DEALLOC_M_(seg_p);
+}
+#endif /* ! THREECRYPT_METHOD_SEGMENTED_V1_ISDEF */
+
+#if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+void threecrypt_update_(Threecrypt* ctx)
+{
+  Chunked_t* chk_p;
+  SSC_assertMsg(
+   (chk_p = (Chunked_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Chunked_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(chk_p, 0, sizeof(*chk_p));
+  chk_p->chunk_shift = THREECRYPT_CHUNKED_V1_DEFAULT_CHUNK_SHIFT;
+  PPQ_CSPRNG_init(&chk_p->csprng);
+  if (ctx->input.supplement_entropy) {
+    uint8_t buffer [PPQ_COMMON_MAX_PASSWORD_BYTES + 1];
+    supplement_entropy_(&chk_p->csprng, &chk_p->keying.ubi512, buffer, sizeof(buffer), chk_p->mac);
+  }
+  prepare_output_in_place_(
+   ctx,
+   &chk_p->keying,
+   &chk_p->csprng,
+   THREECRYPT_METHOD_CHUNKED_V1,
+   THREECRYPT_CHUNKED_V1_HEADER_BYTES,
+   THREECRYPT_CHUNKED_V1_KEYING_OFFSET,
+   "Chunked_V1");
+  chunked_v1_update(chk_p, &ctx->input_map, &ctx->output_map, ctx->output_filename);
+  SSC_secureZero(chk_p, sizeof(*chk_p));
+  DEALLOC_M_(chk_p);
+}
+
+void chunked_v1_decrypt_(Threecrypt* ctx)
+{
+  Chunked_t* chk_p;
+  SSC_assertMsg(
+   (chk_p = (Chunked_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Chunked_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(chk_p, 0, sizeof(*chk_p));
+  SSC_assertMsg(
+   ctx->input_map.size >= THREECRYPT_CHUNKED_V1_HEADER_BYTES,
+   "Error: The input file %s is too small to be a Chunked_V1 encrypted file.\n", ctx->input_filename);
+  load_keying_(ctx, &chk_p->keying, ctx->input_map.ptr + THREECRYPT_CHUNKED_V1_KEYING_OFFSET, ctx->input_filename);
+  get_keying_secret_(ctx, &chk_p->keying, SSC_NULL, false);
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  chunked_v1_decrypt(chk_p, &ctx->input_map, &ctx->output_map, ctx->output_filename);
+  SSC_secureZero(chk_p, sizeof(*chk_p));
+  DEALLOC_M_(chk_p);
+}
+#endif /* ! THREECRYPT_METHOD_CHUNKED_V1_ISDEF */
+
+#if THREECRYPT_USE_LAZY_VIEW
+void threecrypt_view_(Threecrypt* ctx)
+{
+  Chunked_t* chk_p;
+  SSC_assertMsg(
+   (chk_p = (Chunked_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Chunked_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(chk_p, 0, sizeof(*chk_p));
+  ctx->input_map.file = SSC_FilePath_openOrDie(ctx->input_filename, true);
+  if (ctx->input_map.size)
+    SSC_MemMap_mapOrDie(&ctx->input_map, true);
+  SSC_assertMsg(
+   determine_crypto_method_(&ctx->input_map) == THREECRYPT_METHOD_CHUNKED_V1,
+   "Error: The input file %s is not a Chunked_V1 encrypted file.\n", ctx->input_filename);
+  SSC_assertMsg(
+   ctx->input_map.size >= THREECRYPT_CHUNKED_V1_HEADER_BYTES,
+   "Error: The input file %s is too small to be a Chunked_V1 encrypted file.\n", ctx->input_filename);
+  load_keying_(ctx, &chk_p->keying, ctx->input_map.ptr + THREECRYPT_CHUNKED_V1_KEYING_OFFSET, ctx->input_filename);
+  get_keying_secret_(ctx, &chk_p->keying, SSC_NULL, false);
+  Threecrypt_LazyView view;
+  const char* error = lazy_view_open(&view, chk_p, &ctx->input_map);
+  if (error) {
+    SSC_MemMap_unmapOrDie(&ctx->input_map);
+    SSC_File_closeOrDie(ctx->input_map.file);
+    SSC_errx("%s", error);
+  }
+  /* Only the chunks overlapping the requested range are touched, so only they are decrypted. */
+  const uint64_t begin = (ctx->view_offset < view.size) ? ctx->view_offset : view.size;
+  const uint64_t left  = view.size - begin;
+  const uint64_t size  = (ctx->view_length < left) ? ctx->view_length : left;
+  if (ctx->output_filename) {
+    ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+    ctx->output_map.size = (size_t)size;
+    SSC_File_setSizeOrDie(ctx->output_map.file, ctx->output_map.size);
+    if (ctx->output_map.size) {
+      SSC_MemMap_mapOrDie(&ctx->output_map, false);
+      memcpy(ctx->output_map.ptr, view.base + begin, ctx->output_map.size);
+      durability_sync_map(&ctx->output_map);
+      SSC_MemMap_unmapOrDie(&ctx->output_map);
+    }
+    SSC_File_closeOrDie(ctx->output_map.file);
+  } else {
+    /* The kernel may not fault on our behalf, so the view is only ever read from user space, through @buffer. */
+    uint8_t buffer [4096];
+    for (uint64_t done = 0; done < size; ) {
+      const size_t n = ((size - done) < sizeof(buffer)) ? (size_t)(size - done) : sizeof(buffer);
+      memcpy(buffer, view.base + begin + done, n);
+      SSC_assertMsg(fwrite(buffer, 1, n, stdout) == n, "Error: Failed to write the view to stdout.\n");
+      done += n;
+    }
+    SSC_secureZero(buffer, sizeof(buffer));
+    fflush(stdout);
+  }
+  lazy_view_close(&view);
+  SSC_MemMap_unmapOrDie(&ctx->input_map);
+  SSC_File_closeOrDie(ctx->input_map.file);
+  SSC_secureZero(chk_p, sizeof(*chk_p));
+  DEALLOC_M_(chk_p);
+}
+#endif /* ! THREECRYPT_USE_LAZY_VIEW */
+
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+void sparse_v1_encrypt_(Threecrypt* ctx)
+{
+  SSC_assertMsg(
+   !ctx->input.padding_bytes,
+   "Error: Padding options cannot be used with Sparse_V1 files.\n%s", Help_Suggestion);
+  Sparse_t* spr_p;
+  SSC_assertMsg(
+   (spr_p = (Sparse_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Sparse_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(spr_p, 0, sizeof(*spr_p));
+  PPQ_CSPRNG_init(&spr_p->csprng);
+  if (ctx->input.supplement_entropy) {
+    uint8_t buffer [PPQ_COMMON_MAX_PASSWORD_BYTES + 1];
+    supplement_entropy_(&spr_p->csprng, &spr_p->keying.ubi512, buffer, sizeof(buffer), spr_p->mac);
+  }
+  choose_keying_(ctx, &spr_p->keying);
+  get_keying_secret_(ctx, &spr_p->keying, &spr_p->csprng, true);
+  ctx->input_map.file = SSC_FilePath_openOrDie(ctx->input_filename, true);
+  if (ctx->input_map.size)
+    SSC_MemMap_mapOrDie(&ctx->input_map, true);
+  /* Create the output file only once we have the passphrase. */
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  sparse_v1_encrypt(spr_p, &ctx->input_map, &ctx->output_map);
+  SSC_secureZero(spr_p, sizeof(*spr_p));
+  DEALLOC_M_(spr_p);
+}
+
+void sparse_v1_decrypt_(Threecrypt* ctx)
+{
+  Sparse_t* spr_p;
+  SSC_assertMsg(
+   (spr_p = (Sparse_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Sparse_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(spr_p, 0, sizeof(*spr_p));
+  SSC_assertMsg(
+   ctx->input_map.size >= THREECRYPT_SPARSE_V1_METADATA_BYTES,
+   "Error: The input file %s is too small to be a Sparse_V1 encrypted file.\n", ctx->input_filename);
+  load_keying_(ctx, &spr_p->keying, ctx->input_map.ptr + THREECRYPT_SPARSE_V1_KEYING_OFFSET, ctx->input_filename);
+  get_keying_secret_(ctx, &spr_p->keying, SSC_NULL, false);
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  sparse_v1_decrypt(spr_p, &ctx->input_map, &ctx->output_map, ctx->output_filename);
+  SSC_secureZero(spr_p, sizeof(*spr_p));
+  DEALLOC_M_(spr_p);
+}
+#endif /* ! THREECRYPT_METHOD_SPARSE_V1_ISDEF */
+
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+void xchacha_v1_encrypt_(Threecrypt* ctx)
+{
+  SSC_assertMsg(
+   !ctx->input.padding_bytes,
+   "Error: Padding options cannot be used with XChaCha_V1 files.\n%s", Help_Suggestion);
+  XChaCha_t* xch_p;
+  SSC_assertMsg(
+   (xch_p = (XChaCha_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(XChaCha_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(xch_p, 0, sizeof(*xch_p));
+  PPQ_CSPRNG_init(&xch_p->csprng);
+  if (ctx->input.supplement_entropy) {
+    uint8_t buffer [PPQ_COMMON_MAX_PASSWORD_BYTES + 1];
+    supplement_entropy_(&xch_p->csprng, &xch_p->keying.ubi512, buffer, sizeof(buffer), xch_p->mac);
+  }
+  choose_keying_(ctx, &xch_p->keying);
+  get_keying_secret_(ctx, &xch_p->keying, &xch_p->csprng, true);
+  ctx->input_map.file = SSC_FilePath_openOrDie(ctx->input_filename, true);
+  /* Create the output file only once we have the passphrase. */
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  xchacha_v1_encrypt(xch_p, &ctx->input_map, &ctx->output_map);
+  SSC_secureZero(xch_p, sizeof(*xch_p));
+  DEALLOC_M_(xch_p);
+}
+
+void xchacha_v1_decrypt_(Threecrypt* ctx, const uint8_t* header)
+{
+  XChaCha_t* xch_p;
+  SSC_assertMsg(
+   (xch_p = (XChaCha_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(XChaCha_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(xch_p, 0, sizeof(*xch_p));
+  SSC_assertMsg(
+   ctx->input_map.size >= THREECRYPT_XCHACHA_V1_METADATA_BYTES,
+   "Error: The input file %s is too small to be an XChaCha_V1 encrypted file.\n", ctx->input_filename);
+  load_keying_(ctx, &xch_p->keying, header + THREECRYPT_XCHACHA_V1_KEYING_OFFSET, ctx->input_filename);
+  get_keying_secret_(ctx, &xch_p->keying, SSC_NULL, false);
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  xchacha_v1_decrypt(xch_p, &ctx->input_map, &ctx->output_map, ctx->output_filename);
+  SSC_secureZero(xch_p, sizeof(*xch_p));
+  DEALLOC_M_(xch_p);
+}
+#endif /* ! THREECRYPT_METHOD_XCHACHA_V1_ISDEF */
+
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+void dragonfly_v2_encrypt_(Threecrypt* ctx)
+{
+  resolve_padding_(ctx, THREECRYPT_DRAGONFLY_V2_METADATA_BYTES);
+  DragonflyV2_t* dv2_p;
+  SSC_assertMsg(
+   (dv2_p = (DragonflyV2_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(DragonflyV2_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(dv2_p, 0, sizeof(*dv2_p));
+  dv2_p->padding = ctx->input.padding_bytes;
+  PPQ_CSPRNG_init(&dv2_p->csprng);
+  if (ctx->input.supplement_entropy) {
+    uint8_t buffer [PPQ_COMMON_MAX_PASSWORD_BYTES + 1];
+    supplement_entropy_(&dv2_p->csprng, &dv2_p->keying.ubi512, buffer, sizeof(buffer), dv2_p->mac);
+  }
+  choose_keying_(ctx, &dv2_p->keying);
+  get_keying_secret_(ctx, &dv2_p->keying, &dv2_p->csprng, true);
+  ctx->input_map.file = SSC_FilePath_openOrDie(ctx->input_filename, true);
+  /* Create the output file only once we have the passphrase. */
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  dragonfly_v2_encrypt(dv2_p, &ctx->input_map, &ctx->output_map);
+  SSC_secureZero(dv2_p, sizeof(*dv2_p));
+  DEALLOC_M_(dv2_p);
+}
+
+void dragonfly_v2_decrypt_(Threecrypt* ctx, const uint8_t* header)
+{
+  DragonflyV2_t* dv2_p;
+  SSC_assertMsg(
+   (dv2_p = (DragonflyV2_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(DragonflyV2_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(dv2_p, 0, sizeof(*dv2_p));
+  SSC_assertMsg(
+   ctx->input_map.size >= THREECRYPT_DRAGONFLY_V2_METADATA_BYTES,
+   "Error: The input file %s is too small to be a Dragonfly_V2 encrypted file.\n", ctx->input_filename);
+  load_keying_(ctx, &dv2_p->keying, header + THREECRYPT_DRAGONFLY_V2_KEYING_OFFSET, ctx->input_filename);
+  get_keying_secret_(ctx, &dv2_p->keying, SSC_NULL, false);
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  dragonfly_v2_decrypt(dv2_p, &ctx->input_map, &ctx->output_map, ctx->output_filename);
+  SSC_secureZero(dv2_p, sizeof(*dv2_p));
+  DEALLOC_M_(dv2_p);
+}
+#endif /* ! THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF */
+
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+static Archive_t*
+new_archive_(void)
+{
+  Archive_t* arc_p;
+  SSC_assertMsg(
+   (arc_p = (Archive_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Archive_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  memset(arc_p, 0, sizeof(*arc_p));
+  return arc_p;
+}
+
+static void
+delete_archive_(Archive_t* arc_p)
+{
+  SSC_secureZero(arc_p, sizeof(*arc_p));
+  DEALLOC_M_(arc_p);
+}
+
+void threecrypt_archive_(Threecrypt* ctx)
+{
+  SSC_assertMsg(
+   !ctx->input.padding_bytes,
+   "Error: Padding options cannot be used with Archive_V1 files.\n%s", Help_Suggestion);
+  Archive_t* arc_p = new_archive_();
+  PPQ_CSPRNG_init(&arc_p->csprng);
+  if (ctx->input.supplement_entropy) {
+    uint8_t buffer [PPQ_COMMON_MAX_PASSWORD_BYTES + 1];
+    supplement_entropy_(&arc_p->csprng, &arc_p->keying.ubi512, buffer, sizeof(buffer), arc_p->mac);
+  }
+  Threecrypt_FileList list = THREECRYPT_FILELIST_NULL_LITERAL;
+  file_list_collect(&list, ctx->input_filename, SSC_NULL, SSC_NULL);
+  choose_keying_(ctx, &arc_p->keying);
+  get_keying_secret_(ctx, &arc_p->keying, &arc_p->csprng, true);
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  /* The output may lie beneath the input directory; never archive it into itself. */
+  file_list_exclude(&list, ctx->output_filename);
+  archive_v1_pack(arc_p, &list, ctx->input_filename_size, &ctx->output_map);
+  file_list_free(&list);
+  delete_archive_(arc_p);
+}
+
+/* Map the input file, which must be an Archive_V1 file, and get the secret of its keying into @arc_p. */
+static void
+open_archive_(Threecrypt* ctx, Archive_t* arc_p)
+{
+  ctx->input_map.file = SSC_FilePath_openOrDie(ctx->input_filename, true);
+  if (ctx->input_map.size)
+    SSC_MemMap_mapOrDie(&ctx->input_map, true);
+  SSC_assertMsg(
+   determine_crypto_method_(&ctx->input_map) == THREECRYPT_METHOD_ARCHIVE_V1,
+   "Error: The input file %s is not an Archive_V1 encrypted file.\n", ctx->input_filename);
+  SSC_assertMsg(
+   ctx->input_map.size >= (THREECRYPT_ARCHIVE_V1_HEADER_BYTES + THREECRYPT_ARCHIVE_V1_TRAILER_BYTES),
+   "Error: The input file %s is too small to be an Archive_V1 encrypted file.\n", ctx->input_filename);
+  load_keying_(ctx, &arc_p->keying, ctx->input_map.ptr + THREECRYPT_ARCHIVE_V1_KEYING_OFFSET, ctx->input_filename);
+  get_keying_secret_(ctx, &arc_p->keying, SSC_NULL, false);
+}
+
+void threecrypt_list_(Threecrypt* ctx)
+{
+  Archive_t* arc_p = new_archive_();
+  open_archive_(ctx, arc_p);
+  archive_v1_list(arc_p, &ctx->input_map);
+  delete_archive_(arc_p);
+}
+
+void threecrypt_extract_(Threecrypt* ctx)
+{
+  Archive_t* arc_p = new_archive_();
+  open_archive_(ctx, arc_p);
+  archive_v1_extract(arc_p, &ctx->input_map, ctx->member_name, ctx->output_filename);
+  delete_archive_(arc_p);
+}
+
+void archive_v1_decrypt_(Threecrypt* ctx)
+{
+#if THREECRYPT_USE_DURABILITY
+  /* An archive decrypts into a directory of members, not one output file to rename into place. */
+  SSC_assertMsg(
+   !durability_is_configured(),
+   "Error: --durability cannot be used to decrypt Archive_V1 files.\n%s", Help_Suggestion);
+#endif
+  Archive_t* arc_p = new_archive_();
+  SSC_assertMsg(
+   ctx->input_map.size >= (THREECRYPT_ARCHIVE_V1_HEADER_BYTES + THREECRYPT_ARCHIVE_V1_TRAILER_BYTES),
+   "Error: The input file %s is too small to be an Archive_V1 encrypted file.\n", ctx->input_filename);
+  load_keying_(ctx, &arc_p->keying, ctx->input_map.ptr + THREECRYPT_ARCHIVE_V1_KEYING_OFFSET, ctx->input_filename);
+  get_keying_secret_(ctx, &arc_p->keying, SSC_NULL, false);
+  archive_v1_extract_all(arc_p, &ctx->input_map, ctx->output_filename);
+  delete_archive_(arc_p);
+}
+#endif /* ! THREECRYPT_METHOD_ARCHIVE_V1_ISDEF */
+
+void resolve_padding_(Threecrypt* ctx, uint64_t metadata_bytes)
+{
+  switch (ctx->input.padding_mode) {
+  case PPQ_COMMON_PAD_MODE_TARGET: {
+    uint64_t target = ctx->input.padding_bytes;
+    SSC_assertMsg(
+     target >= metadata_bytes,
+     "Error: The --pad-to target (%" PRIu64 ") is too small!\n", target);
+    SSC_assertMsg(
+     (target - metadata_bytes) >= ctx->input_map.size,
+     "Error: The input file size (%zu) is too large to --pad-to %" PRIu64 "\n",
+     ctx->input_map.size, target);
+    target -= ctx->input_map.size;
+    target -= metadata_bytes;
+    ctx->input.padding_bytes = target;
+    ctx->input.padding_mode = PPQ_COMMON_PAD_MODE_ADD;
+  } break;
+  case PPQ_COMMON_PAD_MODE_ASIF: {
+    uint64_t target = ctx->input.padding_bytes;
+    SSC_assertMsg(target >= 1, "Error: The --pad-as-if target (%" PRIu64 ") is too small!\n", target);
+    SSC_assertMsg(
+     target >= ctx->input_map.size,
+     "Error: The input file size (%zu) is too large to --pad-as-if %" PRIu64 "\n",
+     ctx->input_map.size, target);
+    target -= ctx->input_map.size;
+    ctx->input.padding_bytes = target;
+    ctx->input.padding_mode = PPQ_COMMON_PAD_MODE_ADD;
+  } break;
+  } /* ! switch(ctx->input.padding_mode) */
+}
+
+/* Only the formats 3crypt implements itself, and whose files are a single stream, can be windowed. */
+#define WINDOW_ERROR_ "Error: --window can only be used with Dragonfly_V2, Keyfile_V1 and XChaCha_V1 files.\n%s"
+
+/* Dragonfly_V1 is encrypted and decrypted whole, inside PPQ, so it cannot be throttled as it goes. */
+#define DFLY_V1_THROTTLE_ERROR_ "Error: --max-io-rate and --max-cpu cannot be used with Dragonfly_V1.\n%s"
+
+void threecrypt_encrypt_ (Threecrypt* ctx) {
+  SSC_assertMsg(
+   !threecrypt_window_bytes() ||
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+   (ctx->method == THREECRYPT_METHOD_DRAGONFLY_V2) ||
+#endif
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+   (ctx->method == THREECRYPT_METHOD_KEYFILE_V1) ||
+#endif
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+   (ctx->method == THREECRYPT_METHOD_XCHACHA_V1) ||
+#endif
+   false,
+   WINDOW_ERROR_, Help_Suggestion);
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+  if (ctx->method == THREECRYPT_METHOD_KEYFILE_V1) {
+    keyfile_v1_encrypt_(ctx);
+    return;
+  }
+#endif
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+  if (ctx->method == THREECRYPT_METHOD_SPARSE_V1) {
+    sparse_v1_encrypt_(ctx);
+    return;
+  }
+#endif
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+  if (ctx->method == THREECRYPT_METHOD_XCHACHA_V1) {
+    xchacha_v1_encrypt_(ctx);
+    return;
+  }
+#endif
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+  if (ctx->method == THREECRYPT_METHOD_DRAGONFLY_V2) {
+    dragonfly_v2_encrypt_(ctx);
+    return;
+  }
+#endif
+  SSC_assertMsg(!throttle_is_limited(), DFLY_V1_THROTTLE_ERROR_, Help_Suggestion);
+  resolve_padding_(ctx, PPQ_DRAGONFLY_V1_VISIBLE_METADATA_BYTES);
+  ctx->input_map.file = SSC_FilePath_openOrDie(ctx->input_filename, true);
+  SSC_MemMap_mapOrDie(&ctx->input_map, true);
+  set_catena_defaults_(&ctx->input);
+  Encrypt_t* enc_p;
+  SSC_assertMsg(
+   (enc_p = (Encrypt_t*)ALLOC_M_(SSC_MemLock_Global.page_size, sizeof(Encrypt_t))) != SSC_NULL,
+   "Error: Memory allocation failed!\n");
+  PPQ_DragonflyV1Encrypt_init(enc_p);
+  memcpy(&(enc_p->secret.input), &ctx->input, sizeof(ctx->input));
+  SSC_secureZero(&ctx->input, sizeof(ctx->input));
+  memset(enc_p->secret.input.check_buffer, 0, sizeof(enc_p->secret.input.check_buffer));
+  enc_p->secret.input.password_size = get_password_(
+   ctx,
+   enc_p->secret.input.password_buffer,
+   enc_p->secret.input.check_buffer);
+  {
+    PPQ_CSPRNG* const csprng_p = &enc_p->secret.input.csprng;
+    PPQ_CSPRNG_init(csprng_p);
+    if (enc_p->secret.input.supplement_entropy)
+      supplement_entropy_(
+       csprng_p,
+       &enc_p->secret.ubi512,
+       enc_p->secret.input.check_buffer,
+       sizeof(enc_p->secret.input.check_buffer),
+       enc_p->secret.hash_out);
+  }
+  /* Create the output file only once we have the passphrase, so a bad
+   * --passphrase-fd or --passphrase-file doesn't leave an empty file behind. */
+  ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+  /* PPQ derives the key and encrypts in one call, so the reservation covers the encryption too. */
+  kdf_budget_reserve(enc_p->secret.input.g_high);
+  PPQ_DragonflyV1_encrypt(enc_p, &ctx->input_map, &ctx->output_map, ctx->output_filename);
+  kdf_budget_release();
+  SSC_secureZero(enc_p, sizeof(*enc_p));
+  DEALLOC_M_(enc_p);
+}
+
+/* Dragonfly_V1 headers begin with the ID, the total size, g_low, then g_high. */
+#define DFLY_V1_G_HIGH_OFFSET_ (PPQ_DRAGONFLY_V1_ID_NBYTES + 8 + 1)
+
+/* The most of the input read to find its method and header when decrypting with --window. */
+#define WINDOWED_HEADER_BYTES_ 1024
+
+/* Decrypt a file of one of the methods that can be read a window at a time, without ever mapping it whole. */
+static void
+windowed_decrypt_(Threecrypt* ctx)
+{
+  uint8_t  header [WINDOWED_HEADER_BYTES_];
+  uint64_t size = (ctx->input_map.size < sizeof(header)) ? ctx->input_map.size : sizeof(header);
+  {
+    Threecrypt_Window window;
+    threecrypt_window_open(&window, &ctx->input_map, true);
+    if (size)
+      memcpy(header, threecrypt_window_get(&window, 0, &size), (size_t)size);
+    threecrypt_window_close(&window);
+  }
+  SSC_MemMap prefix = ctx->input_map;
+  prefix.ptr  = header;
+  prefix.size = (size_t)size;
+  switch (determine_crypto_method_(&prefix)) {
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+  case THREECRYPT_METHOD_KEYFILE_V1:
+    keyfile_v1_decrypt_(ctx);
+    break;
+#endif
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+  case THREECRYPT_METHOD_XCHACHA_V1:
+    SSC_STATIC_ASSERT(THREECRYPT_XCHACHA_V1_HEADER_BYTES <= WINDOWED_HEADER_BYTES_, "Header too large.");
+    xchacha_v1_decrypt_(ctx, header);
+    break;
+#endif
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+  case THREECRYPT_METHOD_DRAGONFLY_V2:
+    SSC_STATIC_ASSERT(THREECRYPT_DRAGONFLY_V2_HEADER_BYTES <= WINDOWED_HEADER_BYTES_, "Header too large.");
+    dragonfly_v2_decrypt_(ctx, header);
+    break;
+#endif
+  case THREECRYPT_METHOD_NONE:
+    SSC_errx("Error: The input file %s does not appear to be a valid 3crypt encrypted file.\n%s", ctx->input_filename, Help_Suggestion);
+    break;
+  default:
+    SSC_errx(WINDOW_ERROR_, Help_Suggestion);
+    break;
+  }
+  SSC_secureZero(header, sizeof(header));
+}
+
+void threecrypt_decrypt_ (Threecrypt * ctx) {
+  ctx->input_map.file = SSC_FilePath_openOrDie(ctx->input_filename, true);
+  if (threecrypt_window_bytes()) {
+    windowed_decrypt_(ctx);
+    return;
+  }
+  SSC_MemMap_mapOrDie(&ctx->input_map, true);
   int const method = determine_crypto_method_(&ctx->input_map);
   switch (method) {
 #if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
   case THREECRYPT_METHOD_DRAGONFLY_V1: {
-    ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+    SSC_assertMsg(
+     ctx->keyfile_filename == SSC_NULL,
+     "Error: The input file %s was encrypted with a password, not a keyfile.\n", ctx->input_filename);
+    SSC_assertMsg(!throttle_is_limited(), DFLY_V1_THROTTLE_ERROR_, Help_Suggestion);
     Decrypt_t dfly_dcrypt;
     PPQ_DragonflyV1Decrypt_init(&dfly_dcrypt);
-    memset(dfly_dcrypt.password, 0, sizeof(dfly_dcrypt.password));
-    {
-      SSC_Terminal_init();
-      dfly_dcrypt.password_size = SSC_Terminal_getPassword(
-       dfly_dcrypt.password,
-       PPQ_COMMON_PASSWORD_PROMPT,
-       1,
-       PPQ_COMMON_MAX_PASSWORD_BYTES,
-       (PPQ_COMMON_MAX_PASSWORD_BYTES + 1));
-      SSC_Terminal_end();
-    }
+    dfly_dcrypt.password_size = get_password_(ctx, dfly_dcrypt.password, SSC_NULL);
+    ctx->output_map.file = SSC_FilePath_createOrDie(ctx->output_filename);
+    /* As when encrypting, the reservation covers the decryption PPQ does in the same call. */
+    if (ctx->input_map.size > DFLY_V1_G_HIGH_OFFSET_)
+      kdf_budget_reserve(ctx->input_map.ptr[DFLY_V1_G_HIGH_OFFSET_]);
     PPQ_DragonflyV1_decrypt(
      &dfly_dcrypt,
      &ctx->input_map,
      &ctx->output_map,
      ctx->output_filename);
+    kdf_budget_release();
     SSC_secureZero(&dfly_dcrypt, sizeof(dfly_dcrypt));
   } break; /* THREECRYPT_METHOD_DRAGONFLY_V1 */
 #else
  #error "Only supported method!"
+#endif
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+  case THREECRYPT_METHOD_KEYFILE_V1:
+    keyfile_v1_decrypt_(ctx);
+    break;
+#endif
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+  case THREECRYPT_METHOD_SEGMENTED_V1:
+    segmented_v1_decrypt_(ctx);
+    break;
+#endif
+#if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+  case THREECRYPT_METHOD_CHUNKED_V1:
+    chunked_v1_decrypt_(ctx);
+    break;
+#endif
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+  case THREECRYPT_METHOD_SPARSE_V1:
+    sparse_v1_decrypt_(ctx);
+    break;
+#endif
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+  case THREECRYPT_METHOD_ARCHIVE_V1:
+    archive_v1_decrypt_(ctx);
+    break;
+#endif
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+  case THREECRYPT_METHOD_XCHACHA_V1:
+    xchacha_v1_decrypt_(ctx, ctx->input_map.ptr);
+    break;
+#endif
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+  case THREECRYPT_METHOD_DRAGONFLY_V2:
+    dragonfly_v2_decrypt_(ctx, ctx->input_map.ptr);
+    break;
 #endif
   case THREECRYPT_METHOD_NONE:
     SSC_errx("Error: The input file %s does not appear to be a valid 3crypt encrypted file.\n%s", ctx->input_filename, Help_Suggestion);
@@ -350,6 +1794,41 @@ void threecrypt_dump_ (Threecrypt * ctx) {
   case THREECRYPT_METHOD_DRAGONFLY_V1:
     PPQ_DragonflyV1_dumpHeader(&ctx->input_map, ctx->input_filename);
     break;
+#endif
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+  case THREECRYPT_METHOD_KEYFILE_V1:
+    keyfile_v1_dump_header(&ctx->input_map, ctx->input_filename);
+    break;
+#endif
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+  case THREECRYPT_METHOD_SEGMENTED_V1:
+    segmented_v1_dump_header(&ctx->input_map, ctx->input_filename);
+    break;
+#endif
+#if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+  case THREECRYPT_METHOD_CHUNKED_V1:
+    chunked_v1_dump_header(&ctx->input_map, ctx->input_filename);
+    break;
+#endif
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+  case THREECRYPT_METHOD_SPARSE_V1:
+    sparse_v1_dump_header(&ctx->input_map, ctx->input_filename);
+    break;
+#endif
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+  case THREECRYPT_METHOD_ARCHIVE_V1:
+    archive_v1_dump_header(&ctx->input_map, ctx->input_filename);
+    break;
+#endif
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+  case THREECRYPT_METHOD_XCHACHA_V1:
+    xchacha_v1_dump_header(&ctx->input_map, ctx->input_filename);
+    break;
+#endif
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+  case THREECRYPT_METHOD_DRAGONFLY_V2:
+    dragonfly_v2_dump_header(&ctx->input_map, ctx->input_filename);
+    break;
 #endif
   case THREECRYPT_METHOD_NONE:
     SSC_errx("Error: The input file %s does not appear to be a valid 3crypt encrypted file.\n%s", ctx->input_filename, Help_Suggestion);
@@ -365,6 +1844,18 @@ void threecrypt_dump_ (Threecrypt * ctx) {
 #else
  #define ENTROPY_HELP_LINE_ /* Nil. */
 #endif
+#define STRINGIFY_(X)        #X
+#define STRINGIFY_VALUE_(X)  STRINGIFY_(X)
+#ifdef THREECRYPT_EXTERN_CHECKPOINT_INTERVAL_MIB
+ #define CHECKPOINT_INTERVAL_HELP_ STRINGIFY_VALUE_(THREECRYPT_EXTERN_CHECKPOINT_INTERVAL_MIB) " MiB"
+#else
+ #define CHECKPOINT_INTERVAL_HELP_ "GiB"
+#endif
+#ifdef THREECRYPT_KDF_LEDGER_DEFAULT
+ #define KDF_LEDGER_HELP_ THREECRYPT_KDF_LEDGER_DEFAULT
+#else
+ #define KDF_LEDGER_HELP_ "your own, in $XDG_RUNTIME_DIR or ~/.cache"
+#endif
 
 void print_help(const char* topic) {
   if (topic == NULL) {
@@ -376,9 +1867,52 @@ void print_help(const char* topic) {
       "-e, --encrypt           Symmetrically encrypt a file.\n"
       "-d, --decrypt           Symmetrically decrypt a file.\n"
       "-D, --dump              Dump information on an encrypted file.\n"
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+      "--append                Append a file to a growing encrypted file.\n"
+#endif
+#if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+      "--update                Re-encrypt only the changed parts of an encrypted file.\n"
+#endif
+#if THREECRYPT_USE_LAZY_VIEW
+      "--view=<offset>[:<length>] Decrypt only part of a Chunked_V1 encrypted file.\n"
+#endif
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+      "--archive               Pack a directory into one encrypted archive.\n"
+      "--list                  List the members of an encrypted archive.\n"
+      "--extract=<member>      Extract one member of an encrypted archive.\n"
+#endif
       "-i, --input=<filepath>  Specifies an input filepath.\n"
       "-o, --output=<filepath> Specifies an output filepath.\n"
+      "--method=<method>       Encrypt with <method>. See --help=encrypt.\n"
       ENTROPY_HELP_LINE_
+      "--passphrase-fd=<fd>    Read the passphrase from file descriptor <fd>.\n"
+      "--passphrase-file=<filepath> Read the passphrase from <filepath>.\n"
+#if THREECRYPT_USE_KEYFILES
+      "-K, --keyfile=<filepath> Use a keyfile instead of a passphrase.\n"
+#endif
+#if THREECRYPT_USE_RECURSIVE
+      "-r, --recursive         Encrypt or decrypt every file in a directory with a keyfile.\n"
+#endif
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+      "--resume                Encrypt with checkpoints, resuming an interrupted encryption.\n"
+#endif
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+      "--sparse                Encrypt only the data of a sparse file, preserving its holes.\n"
+#endif
+#if THREECRYPT_USE_THROTTLE
+      "--max-io-rate, --max-cpu, --ionice Limit the impact on a busy host. See --help=throttle.\n"
+#endif
+#if THREECRYPT_USE_WINDOW
+      "--window=<num_bytes>[K|M|G] Map files this many bytes at a time instead of whole.\n"
+#endif
+#if THREECRYPT_USE_DURABILITY
+      "--durability=<policy>   Rename outputs into place, syncing them per file, in batches or not.\n"
+#endif
+#if THREECRYPT_USE_KDF_BUDGET
+      "--kdf-budget=<num_bytes>[K|M|G] Limit the key-derivation memory of all your 3crypt processes,\n"
+      "                        which wait in turn for memory through a shared ledger file.\n"
+      "--kdf-ledger=<filepath> Share that ledger instead of " KDF_LEDGER_HELP_ ".\n"
+#endif
     );
     return;
   }
@@ -386,6 +1920,21 @@ void print_help(const char* topic) {
   static const char* help_help = "Switch: -h, --help=<topic>\n"
                                  "Gives tips and usage details for different command-line switches.\n"
                                  "Topics: encrypt, decrypt, dump"
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+                                 ", append"
+#endif
+#if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+                                 ", update"
+#endif
+#if THREECRYPT_USE_LAZY_VIEW
+                                 ", view"
+#endif
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+                                 ", archive"
+#endif
+#if THREECRYPT_USE_THROTTLE
+                                 ", throttle"
+#endif
 #if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
                                  ", dfly_v1"
 #endif
@@ -394,32 +1943,209 @@ void print_help(const char* topic) {
                                     "Symmetrically encrypt a file.\n"
                                     "-i, --input=<filepath>   Specifies the file to be encrypted.\n"
                                     "-o, --output=<filepath>  Specifies where to output the encrypted file.\n"
+                                    "--passphrase-fd=<fd>     Read the passphrase from the first line of file descriptor <fd>,\n"
+                                    "                         without prompting on the terminal.\n"
+                                    "--passphrase-file=<filepath> Read the passphrase from the first line of <filepath>,\n"
+                                    "                         without prompting on the terminal.\n"
 #if THREECRYPT_USE_ENTROPY
                                     "-E, --entropy            Specifies to supplement RNG entropy from stdin.\n"
                                     "                         Only applicable if RNG is used.\n"
 #endif
 #if THREECRYPT_USE_KEYFILES
-                                    "-K, --keyfile=<filepath> Specifies where to place the generated keyfile.\n"
-                                    "                         Only applicable if using keyfiles and not passwords.\n"
+                                    "-K, --keyfile=<filepath> Encrypt with the keyfile at <filepath> instead of a password.\n"
+                                    "                         If it does not exist, a new random keyfile is generated there.\n"
+                                    "                         Keyfile encryption skips the memory-hard key-derivation.\n"
+#endif
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+                                    "--resume                 Encrypt into a Segmented_V1 file, recording a checkpoint\n"
+                                    "                         in <output>.ckpt before the first segment and after every\n"
+                                    "                         " CHECKPOINT_INTERVAL_HELP_ " of input. If the encryption is interrupted,\n"
+                                    "                         rerun the same command to continue from the last\n"
+                                    "                         checkpoint. Decrypt the file with -d as usual.\n"
+#endif
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+                                    "--sparse                 Encrypt into a Sparse_V1 file, reading and storing only\n"
+                                    "                         the data extents of the input and recording where its\n"
+                                    "                         holes are. Decrypting with -d recreates the holes, so\n"
+                                    "                         both take time and space in proportion to the data.\n"
+#endif
+#if THREECRYPT_USE_RECURSIVE
+                                    "-r, --recursive          Encrypt every file beneath the input directory with -K,\n"
+                                    "                         storing each beside its input with \".3c\" appended.\n"
+                                    "                         Small files are encrypted many at a time, keeping the\n"
+                                    "                         cipher's vector units busy.\n"
+#endif
+#if THREECRYPT_USE_WINDOW
+                                    "--window=<num_bytes>[K|M|G] Map the input and output <num_bytes>, at least 1M, at a\n"
+                                    "                         time instead of whole, bounding memory use whatever the\n"
+                                    "                         file size. Dragonfly_V2, Keyfile_V1 and XChaCha_V1 only.\n"
+#endif
+#if THREECRYPT_USE_DURABILITY
+                                    "--durability=<policy>    Write the output as \"<output>.3c-tmp\" and rename it into\n"
+                                    "                         place once complete. <policy> is none, to never sync it;\n"
+                                    "                         file, to sync it and its directory; or batch, to sync the\n"
+                                    "                         outputs of -r together, a group of files at a time.\n"
+#endif
+                                    "--method=<method>        Encrypt with <method>: one of"
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+                                    " dragonfly_v2"
 #endif
+#if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
+                                    " dragonfly_v1"
+#endif
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+                                    " keyfile_v1"
+#endif
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+                                    " sparse_v1"
+#endif
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+                                    " xchacha_v1"
+#endif
+                                    ".\n"
                                     "Method-Specific-Options:\n"
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+ #if (THREECRYPT_METHOD_DEFAULT == THREECRYPT_METHOD_DRAGONFLY_V2)
+                                    "Dragonfly_V2: Memory-Hard password-based symmetric encryption, the\n"
+                                    "default. A wrong password is rejected right after key-derivation.\n"
+ #else
+                                    "Dragonfly_V2: Memory-Hard password-based symmetric encryption. A\n"
+                                    "wrong password is rejected right after key-derivation.\n"
+ #endif
+                                    "Encrypted and authenticated on every processor at once.\n"
+                                    "Accepts the Dragonfly_V1 options; see --help=dfly_v1.\n"
+#endif
 #if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
                                     "Dragonfly_V1: Memory-Hard password-SSCd symmetric encryption.\n"
                                     "Use --help=dfly_v1 for more info.\n"
+#endif
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+                                    "Keyfile_V1: Keyfile-based symmetric encryption, used with -K.\n"
+#endif
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+                                    "Sparse_V1: Hole-preserving symmetric encryption, used with --sparse.\n"
+                                    "Accepts either a password or -K.\n"
+#endif
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+                                    "XChaCha_V1: XChaCha20 and Poly1305 symmetric encryption, used with\n"
+                                    "--method=xchacha_v1. Faster than Threefish-512 without AVX-512.\n"
+                                    "Accepts either a password or -K.\n"
 #endif
                                     ; /* ! encrypt_help */
   static const char* decrypt_help = "Switch: -d, --decrypt\n"
                                     "Symmetrically decrypt a file.\n"
                                     "-i, --input=<filepath>  Specifies the file to be decrypted.\n"
                                     "-o, --output=<filepath> Specifies where to output the decrypted file.\n"
+                                    "--passphrase-fd=<fd>    Read the passphrase from the first line of file descriptor <fd>,\n"
+                                    "                        without prompting on the terminal.\n"
+                                    "--passphrase-file=<filepath> Read the passphrase from the first line of <filepath>,\n"
+                                    "                        without prompting on the terminal.\n"
 #if THREECRYPT_USE_KEYFILES
                                     "-K, --keyfile=<filepath> Specifies the keyfile to decrypt with.\n"
                                     "                         Only applicable if using keyfiles and not passwords.\n"
+#endif
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+                                    "                         Archive_V1 archives are extracted beneath the new directory\n"
+                                    "                         <filepath>. See --help=archive.\n"
+#endif
+#if THREECRYPT_USE_RECURSIVE
+                                    "-r, --recursive          Decrypt every file ending in \".3c\" beneath the input directory\n"
+                                    "                         with -K, storing each beside its input without the \".3c\".\n"
+#endif
+#if THREECRYPT_USE_WINDOW
+                                    "--window=<num_bytes>[K|M|G] Map the input and output <num_bytes>, at least 1M, at a\n"
+                                    "                         time instead of whole. Dragonfly_V2, Keyfile_V1 and\n"
+                                    "                         XChaCha_V1 files only.\n"
+#endif
+#if THREECRYPT_USE_DURABILITY
+                                    "--durability=<policy>    Write the output as \"<output>.3c-tmp\" and rename it into\n"
+                                    "                         place once authenticated and complete. <policy> is none,\n"
+                                    "                         file or batch, as when encrypting.\n"
 #endif
                                     ; /* ! decrypt_help */
   static const char* dump_help = "Switch: -D, --dump\n"
                                  "Dump the header of an encrypted file.\n"
                                  "-i, --input=<filepath> Specifies the encrypted file to dump.\n";
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+  static const char* append_help = "Switch: --append\n"
+                                   "Encrypt a file and append it to a Segmented_V1 encrypted file,\n"
+                                   "creating it if it does not exist. Only the new data is encrypted,\n"
+                                   "and only the header and tail of the existing file are authenticated.\n"
+                                   "Decrypt the whole file with -d.\n"
+                                   "-i, --input=<filepath>   Specifies the new data to append.\n"
+                                   "-o, --output=<filepath>  Specifies the encrypted file to append to.\n"
+                                   "--passphrase-fd=<fd>     Read the passphrase from the first line of file descriptor <fd>.\n"
+                                   "--passphrase-file=<filepath> Read the passphrase from the first line of <filepath>.\n"
+                                   "-K, --keyfile=<filepath> Key a new file with the keyfile at <filepath>, generating it\n"
+                                   "                         if it does not exist. Required to append to keyfile-keyed files.\n"
+                                   "--min-memory, --max-memory, --use-memory, --iterations, --use-phi\n"
+                                   "                         Key-derivation options for a new password-keyed file.\n"
+                                   "                         See --help=dfly_v1.\n"; /* ! append_help */
+#endif
+#if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+  static const char* update_help = "Switch: --update\n"
+                                   "Make the Chunked_V1 encrypted file hold the contents of a file,\n"
+                                   "creating it if it does not exist. The file is encrypted in 1 MiB chunks,\n"
+                                   "and only chunks whose contents changed since the last update are\n"
+                                   "re-encrypted and rewritten. Decrypt the file with -d.\n"
+                                   "-i, --input=<filepath>   Specifies the current plaintext.\n"
+                                   "-o, --output=<filepath>  Specifies the encrypted file to update.\n"
+                                   "--passphrase-fd=<fd>     Read the passphrase from the first line of file descriptor <fd>.\n"
+                                   "--passphrase-file=<filepath> Read the passphrase from the first line of <filepath>.\n"
+                                   "-K, --keyfile=<filepath> Key a new file with the keyfile at <filepath>, generating it\n"
+                                   "                         if it does not exist. Required to update keyfile-keyed files.\n"
+                                   "--min-memory, --max-memory, --use-memory, --iterations, --use-phi\n"
+                                   "                         Key-derivation options for a new password-keyed file.\n"
+                                   "                         See --help=dfly_v1.\n"; /* ! update_help */
+#endif
+#if THREECRYPT_USE_LAZY_VIEW
+  static const char* view_help = "Switch: --view=<offset>[:<length>]\n"
+                                 "Decrypt <length> bytes of the plaintext of a Chunked_V1 encrypted file, starting\n"
+                                 "at byte <offset>, or everything from <offset> on if <length> is omitted.\n"
+                                 "Both accept K, M and G suffixes. Only the chunks holding the range are\n"
+                                 "authenticated and decrypted, as they are first read.\n"
+                                 "-i, --input=<filepath>   Specifies the encrypted file to view.\n"
+                                 "-o, --output=<filepath>  Specifies where to output the range; stdout by default.\n"
+                                 "--passphrase-fd=<fd>     Read the passphrase from the first line of file descriptor <fd>.\n"
+                                 "--passphrase-file=<filepath> Read the passphrase from the first line of <filepath>.\n"
+                                 "-K, --keyfile=<filepath> Specifies the keyfile of a keyfile-keyed file.\n"; /* ! view_help */
+#endif
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+  static const char* archive_help = "Switch: --archive\n"
+                                    "Pack every file beneath a directory into one Archive_V1 encrypted file,\n"
+                                    "under a single key-derivation, with an encrypted index of its members.\n"
+                                    "Members are encrypted in parallel.\n"
+                                    "-i, --input=<filepath>   Specifies the directory to archive.\n"
+                                    "-o, --output=<filepath>  Specifies where to output the archive; <input>.3c by default.\n"
+                                    "--passphrase-fd=<fd>     Read the passphrase from the first line of file descriptor <fd>.\n"
+                                    "--passphrase-file=<filepath> Read the passphrase from the first line of <filepath>.\n"
+                                    "-K, --keyfile=<filepath> Key the archive with the keyfile at <filepath>, generating it\n"
+                                    "                         if it does not exist.\n"
+                                    "--min-memory, --max-memory, --use-memory, --iterations, --use-phi\n"
+                                    "                         Key-derivation options for a password-keyed archive.\n"
+                                    "                         See --help=dfly_v1.\n"
+                                    "Switch: --list\n"
+                                    "List the size and name of each member of the archive -i <filepath>.\n"
+                                    "Switch: --extract=<member>\n"
+                                    "Extract the member named <member> of the archive -i <filepath>, authenticating\n"
+                                    "and decrypting only the index and that member.\n"
+                                    "-o, --output=<filepath>  Specifies where to output the member; by default, the last\n"
+                                    "                         component of <member> in the working directory.\n"
+                                    "Decrypting an archive with -d extracts every member beneath the new directory -o.\n"
+                                    ; /* ! archive_help */
+#endif
+#if THREECRYPT_USE_THROTTLE
+  static const char* throttle_help = "Switches: --max-io-rate, --max-cpu, --ionice\n"
+                                     "Limit the impact of encrypting or decrypting on a busy host. Applies to\n"
+                                     "every method but Dragonfly_V1, which is processed whole.\n"
+                                     "--max-io-rate=<num_bytes>[K|M|G] Process at most <num_bytes> of the file per second.\n"
+                                     "--max-cpu=<percent>      Use at most <percent> of one CPU, from 1 to 100.\n"
+                                     "  Key-derivation is not throttled. Once throttling, send 3crypt SIGUSR1 to\n"
+                                     "  halve both limits, or SIGUSR2 to double them.\n"
+                                     "--ionice=<class>[:<level>] Set the I/O scheduling class to idle, best-effort\n"
+                                     "                         or realtime, with a <level> from 0 (highest) to 7.\n"
+                                     "                         Linux only. Applies to every method.\n"; /* ! throttle_help */
+#endif
 #if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
  #if (THREECRYPT_METHOD_DEFAULT == THREECRYPT_METHOD_DRAGONFLY_V1)
   #define METHOD_ "Method: Dragonfly_V1, the default method.\n"
@@ -449,7 +2175,14 @@ void print_help(const char* topic) {
                                     "  WARNING: The phi function hardens the key-derivation function against\n"
                                     "  parallel adversaries, greatly increasing the work necessary to brute-force\n"
                                     "  your password, but introduces the potential for cache-timing attacks.\n"
-                                    "  Do NOT use this feature unless you understand the security implications!\n"; /* ! dfly_v1_help */
+                                    "  Do NOT use this feature unless you understand the security implications!\n"
+#if THREECRYPT_USE_KDF_BUDGET
+                                    "--kdf-budget=<num_bytes>[K|M|G] Limit the key-derivation memory of all your 3crypt\n"
+                                    "                                processes to <num_bytes>, waiting in turn for memory.\n"
+                                    "--kdf-ledger=<filepath> The ledger file shared by budgeted 3crypt processes.\n"
+                                    "                        Defaults to " KDF_LEDGER_HELP_ ".\n"
+#endif
+                                    ; /* ! dfly_v1_help */
 #endif
   /* End defining the help strings. */
 
@@ -462,9 +2195,42 @@ void print_help(const char* topic) {
         printf(help_help);
       else if (strcmp(topic, "dump") == 0)
         printf(dump_help);
+#if THREECRYPT_USE_LAZY_VIEW
+    /* Implicitly:
+    case (sizeof("view") - 1): */
+      else if (strcmp(topic, "view") == 0)
+        printf(view_help);
+#endif
       else
         fprintf(stderr, "Error: Invalid help topic '%s'.\n", topic);
       break;
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF || THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+    case (sizeof("append") - 1): {
+    /* Implicitly:
+    case (sizeof("update") - 1): */
+      const char* text = SSC_NULL;
+ #if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+      if (strcmp(topic, "append") == 0)
+        text = append_help;
+ #endif
+ #if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+      if (strcmp(topic, "update") == 0)
+        text = update_help;
+ #endif
+      if (text)
+        printf(text);
+      else
+        fprintf(stderr, "Error: Invalid help topic '%s'.\n", topic);
+    } break; /* ! case (sizeof("append") - 1): */
+#endif
+#if THREECRYPT_USE_THROTTLE
+    case (sizeof("throttle") - 1):
+      if (strcmp(topic, "throttle") == 0)
+        printf(throttle_help);
+      else
+        fprintf(stderr, "Error: Invalid help topic '%s'.\n", topic);
+      break;
+#endif
     case (sizeof("encrypt") - 1):
     /* Implicitly:
     case (sizeof("decrypt") - 1): */
@@ -472,6 +2238,12 @@ void print_help(const char* topic) {
         printf(encrypt_help);
       else if (strcmp(topic, "decrypt") == 0)
         printf(decrypt_help);
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+    /* Implicitly:
+    case (sizeof("archive") - 1): */
+      else if (strcmp(topic, "archive") == 0)
+        printf(archive_help);
+#endif
 #if THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
     /* Implicitly:
     case (sizeof("dfly_v1") - 1): */
@@ -8,6 +8,19 @@
 
 #include <PPQ/Common.h>
 #include "DragonflyV1.h" /* Enable Dragonfly V1. */
+#include "KeyfileV1.h"   /* Enable Keyfile V1. */
+#include "SegmentedV1.h" /* Enable Segmented V1. */
+#include "ChunkedV1.h"   /* Enable Chunked V1. */
+#include "SparseV1.h"    /* Enable Sparse V1. */
+#include "ArchiveV1.h"   /* Enable Archive V1. */
+#include "XChaChaV1.h"  /* Enable XChaCha V1. */
+#include "DragonflyV2.h" /* Enable Dragonfly V2. */
+#include "LazyView.h"
+#include "KdfBudget.h"
+#include "Throttle.h"
+#include "Window.h"
+#include "Durability.h"
+#include "Journal.h"
 
 #if !defined(SSC_OS_UNIXLIKE) && !defined(SSC_OS_WINDOWS)
  #error "Unsupported OS."
@@ -49,9 +62,15 @@ typedef enum {
   THREECRYPT_MODE_SYMMETRIC_ENC = 1,
   THREECRYPT_MODE_SYMMETRIC_DEC = 2,
   THREECRYPT_MODE_DUMP = 3,
-  THREECRYPT_MODE_MCOUNT = 4,
+  THREECRYPT_MODE_APPEND = 4,
+  THREECRYPT_MODE_UPDATE = 5,
+  THREECRYPT_MODE_ARCHIVE = 6,
+  THREECRYPT_MODE_LIST = 7,
+  THREECRYPT_MODE_EXTRACT = 8,
+  THREECRYPT_MODE_VIEW = 9,
+  THREECRYPT_MODE_MCOUNT = 10,
 } Threecrypt_Mode_t;
-#define THREECRYPT_NUM_MODES 3
+#define THREECRYPT_NUM_MODES 9
 
 #ifdef THREECRYPT_EXTERN_MODE_DEFAULT
  #define THREECRYPT_MODE_DEFAULT THREECRYPT_EXTERN_MODE_DEFAULT
@@ -71,7 +90,97 @@ typedef enum {
 #else
  #define THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF 0 
 #endif
-#define THREECRYPT_NUM_METHODS   THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
+/* Do we support Keyfile_V1? */
+#ifdef THREECRYPT_KEYFILE_V1_H
+ #define THREECRYPT_METHOD_KEYFILE_V1_ISDEF 1
+ #define THREECRYPT_METHOD_KEYFILE_V1 (THREECRYPT_METHOD_NONE + THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF + 1)
+#else
+ #define THREECRYPT_METHOD_KEYFILE_V1_ISDEF 0
+#endif
+/* Do we support Segmented_V1? */
+#ifdef THREECRYPT_SEGMENTED_V1_H
+ #define THREECRYPT_METHOD_SEGMENTED_V1_ISDEF 1
+ #define THREECRYPT_METHOD_SEGMENTED_V1 (\
+  THREECRYPT_METHOD_NONE +\
+  THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF +\
+  THREECRYPT_METHOD_KEYFILE_V1_ISDEF + 1)
+#else
+ #define THREECRYPT_METHOD_SEGMENTED_V1_ISDEF 0
+#endif
+/* Do we support Chunked_V1? */
+#ifdef THREECRYPT_CHUNKED_V1_H
+ #define THREECRYPT_METHOD_CHUNKED_V1_ISDEF 1
+ #define THREECRYPT_METHOD_CHUNKED_V1 (\
+  THREECRYPT_METHOD_NONE +\
+  THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF +\
+  THREECRYPT_METHOD_KEYFILE_V1_ISDEF +\
+  THREECRYPT_METHOD_SEGMENTED_V1_ISDEF + 1)
+#else
+ #define THREECRYPT_METHOD_CHUNKED_V1_ISDEF 0
+#endif
+/* Do we support Sparse_V1? */
+#ifdef THREECRYPT_SPARSE_V1_H
+ #define THREECRYPT_METHOD_SPARSE_V1_ISDEF 1
+ #define THREECRYPT_METHOD_SPARSE_V1 (\
+  THREECRYPT_METHOD_NONE +\
+  THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF +\
+  THREECRYPT_METHOD_KEYFILE_V1_ISDEF +\
+  THREECRYPT_METHOD_SEGMENTED_V1_ISDEF +\
+  THREECRYPT_METHOD_CHUNKED_V1_ISDEF + 1)
+#else
+ #define THREECRYPT_METHOD_SPARSE_V1_ISDEF 0
+#endif
+/* Do we support Archive_V1? */
+#ifdef THREECRYPT_ARCHIVE_V1_H
+ #define THREECRYPT_METHOD_ARCHIVE_V1_ISDEF 1
+ #define THREECRYPT_METHOD_ARCHIVE_V1 (\
+  THREECRYPT_METHOD_NONE +\
+  THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF +\
+  THREECRYPT_METHOD_KEYFILE_V1_ISDEF +\
+  THREECRYPT_METHOD_SEGMENTED_V1_ISDEF +\
+  THREECRYPT_METHOD_CHUNKED_V1_ISDEF +\
+  THREECRYPT_METHOD_SPARSE_V1_ISDEF + 1)
+#else
+ #define THREECRYPT_METHOD_ARCHIVE_V1_ISDEF 0
+#endif
+/* Do we support XChaCha_V1? */
+#ifdef THREECRYPT_XCHACHA_V1_H
+ #define THREECRYPT_METHOD_XCHACHA_V1_ISDEF 1
+ #define THREECRYPT_METHOD_XCHACHA_V1 (\
+  THREECRYPT_METHOD_NONE +\
+  THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF +\
+  THREECRYPT_METHOD_KEYFILE_V1_ISDEF +\
+  THREECRYPT_METHOD_SEGMENTED_V1_ISDEF +\
+  THREECRYPT_METHOD_CHUNKED_V1_ISDEF +\
+  THREECRYPT_METHOD_SPARSE_V1_ISDEF +\
+  THREECRYPT_METHOD_ARCHIVE_V1_ISDEF + 1)
+#else
+ #define THREECRYPT_METHOD_XCHACHA_V1_ISDEF 0
+#endif
+/* Do we support Dragonfly_V2? */
+#ifdef THREECRYPT_DRAGONFLY_V2_H
+ #define THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF 1
+ #define THREECRYPT_METHOD_DRAGONFLY_V2 (\
+  THREECRYPT_METHOD_NONE +\
+  THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF +\
+  THREECRYPT_METHOD_KEYFILE_V1_ISDEF +\
+  THREECRYPT_METHOD_SEGMENTED_V1_ISDEF +\
+  THREECRYPT_METHOD_CHUNKED_V1_ISDEF +\
+  THREECRYPT_METHOD_SPARSE_V1_ISDEF +\
+  THREECRYPT_METHOD_ARCHIVE_V1_ISDEF +\
+  THREECRYPT_METHOD_XCHACHA_V1_ISDEF + 1)
+#else
+ #define THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF 0
+#endif
+#define THREECRYPT_NUM_METHODS   (\
+ THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF +\
+ THREECRYPT_METHOD_KEYFILE_V1_ISDEF +\
+ THREECRYPT_METHOD_SEGMENTED_V1_ISDEF +\
+ THREECRYPT_METHOD_CHUNKED_V1_ISDEF +\
+ THREECRYPT_METHOD_SPARSE_V1_ISDEF +\
+ THREECRYPT_METHOD_ARCHIVE_V1_ISDEF +\
+ THREECRYPT_METHOD_XCHACHA_V1_ISDEF +\
+ THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF)
 #define THREECRYPT_METHOD_MCOUNT (THREECRYPT_NUM_METHODS + 1) /* Including NONE. */
 
 /* Is there at least 1 method? */
@@ -85,6 +194,8 @@ typedef enum {
   #define THREECRYPT_METHOD_DEFAULT THREECRYPT_EXTERN_METHOD_DEFAULT
  #elif THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
   #define THREECRYPT_METHOD_DEFAULT THREECRYPT_METHOD_DRAGONFLY_V1
+ #elif THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+  #define THREECRYPT_METHOD_DEFAULT THREECRYPT_METHOD_DRAGONFLY_V2
  #else
   #define THREECRYPT_METHOD_DEFAULT THREECRYPT_METHOD_NONE
  #endif
@@ -98,7 +209,51 @@ typedef int Threecrypt_Method_t;
   /* Dragonfly_V1 can use supplementary entropy from stdin. */
  #define THREECRYPT_USE_ENTROPY THREECRYPT_METHOD_DRAGONFLY_V1_ISDEF
 #endif
-#define THREECRYPT_USE_KEYFILES 0 /* Not implemented yet. */
+/* Segmented_V1, Chunked_V1, Sparse_V1, Archive_V1, XChaCha_V1 and Dragonfly_V2 may be keyed by either a password or a keyfile. */
+#define THREECRYPT_USE_KEYING (\
+ THREECRYPT_METHOD_SEGMENTED_V1_ISDEF ||\
+ THREECRYPT_METHOD_CHUNKED_V1_ISDEF ||\
+ THREECRYPT_METHOD_SPARSE_V1_ISDEF ||\
+ THREECRYPT_METHOD_ARCHIVE_V1_ISDEF ||\
+ THREECRYPT_METHOD_XCHACHA_V1_ISDEF ||\
+ THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF)
+/* Keyfiles are used by Keyfile_V1, and optionally by the above. */
+#define THREECRYPT_USE_KEYFILES (THREECRYPT_METHOD_KEYFILE_V1_ISDEF || THREECRYPT_USE_KEYING)
+/* Whole directories of files can be encrypted with Keyfile_V1 at once, in batches. */
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF && defined(SSC_OS_UNIXLIKE)
+ #define THREECRYPT_USE_RECURSIVE 1
+#else
+ #define THREECRYPT_USE_RECURSIVE 0
+#endif
+/* Key-derivation memory can be budgeted across processes, through a ledger file locked with flock(). */
+#if defined(SSC_OS_UNIXLIKE)
+ #define THREECRYPT_USE_KDF_BUDGET 1
+#else
+ #define THREECRYPT_USE_KDF_BUDGET 0
+#endif
+/* The data paths can be throttled, with POSIX clocks and signals. */
+#if defined(SSC_OS_UNIXLIKE)
+ #define THREECRYPT_USE_THROTTLE 1
+#else
+ #define THREECRYPT_USE_THROTTLE 0
+#endif
+
+/* Files can be mapped a window at a time, with mmap(2) at an offset. */
+#if defined(SSC_OS_UNIXLIKE)
+ #define THREECRYPT_USE_WINDOW 1
+#else
+ #define THREECRYPT_USE_WINDOW 0
+#endif
+/* Outputs can be renamed into place under a durability policy, with fsync(2) on directories. */
+#if defined(SSC_OS_UNIXLIKE)
+ #define THREECRYPT_USE_DURABILITY 1
+#else
+ #define THREECRYPT_USE_DURABILITY 0
+#endif
+/* Files rewritten in place are journaled, and rolled back if the rewrite was interrupted. */
+#define THREECRYPT_USE_JOURNAL (THREECRYPT_METHOD_SEGMENTED_V1_ISDEF || THREECRYPT_METHOD_CHUNKED_V1_ISDEF)
+/* Ranges of Chunked_V1 files can be viewed, decrypting only the chunks they touch. */
+#define THREECRYPT_USE_LAZY_VIEW THREECRYPT_METHOD_CHUNKED_V1_ISDEF
 
 #define THREECRYPT_ARGMAP_MAX_COUNT	100
 
@@ -116,6 +271,83 @@ typedef int Threecrypt_Method_t;
  #endif
 #endif
 
+#if THREECRYPT_METHOD_KEYFILE_V1_ISDEF
+ #if (THREECRYPT_KEYFILE_V1_ID_NBYTES < THREECRYPT_MIN_ID_STR_BYTES)
+  #undef  THREECRYPT_MIN_ID_STR_BYTES
+  #define THREECRYPT_MIN_ID_STR_BYTES THREECRYPT_KEYFILE_V1_ID_NBYTES
+ #endif
+ #if (THREECRYPT_KEYFILE_V1_ID_NBYTES > THREECRYPT_MAX_ID_STR_BYTES)
+  #undef  THREECRYPT_MAX_ID_STR_BYTES
+  #define THREECRYPT_MAX_ID_STR_BYTES THREECRYPT_KEYFILE_V1_ID_NBYTES
+ #endif
+#endif
+
+#if THREECRYPT_METHOD_SEGMENTED_V1_ISDEF
+ #if (THREECRYPT_SEGMENTED_V1_ID_NBYTES < THREECRYPT_MIN_ID_STR_BYTES)
+  #undef  THREECRYPT_MIN_ID_STR_BYTES
+  #define THREECRYPT_MIN_ID_STR_BYTES THREECRYPT_SEGMENTED_V1_ID_NBYTES
+ #endif
+ #if (THREECRYPT_SEGMENTED_V1_ID_NBYTES > THREECRYPT_MAX_ID_STR_BYTES)
+  #undef  THREECRYPT_MAX_ID_STR_BYTES
+  #define THREECRYPT_MAX_ID_STR_BYTES THREECRYPT_SEGMENTED_V1_ID_NBYTES
+ #endif
+#endif
+
+#if THREECRYPT_METHOD_CHUNKED_V1_ISDEF
+ #if (THREECRYPT_CHUNKED_V1_ID_NBYTES < THREECRYPT_MIN_ID_STR_BYTES)
+  #undef  THREECRYPT_MIN_ID_STR_BYTES
+  #define THREECRYPT_MIN_ID_STR_BYTES THREECRYPT_CHUNKED_V1_ID_NBYTES
+ #endif
+ #if (THREECRYPT_CHUNKED_V1_ID_NBYTES > THREECRYPT_MAX_ID_STR_BYTES)
+  #undef  THREECRYPT_MAX_ID_STR_BYTES
+  #define THREECRYPT_MAX_ID_STR_BYTES THREECRYPT_CHUNKED_V1_ID_NBYTES
+ #endif
+#endif
+
+#if THREECRYPT_METHOD_SPARSE_V1_ISDEF
+ #if (THREECRYPT_SPARSE_V1_ID_NBYTES < THREECRYPT_MIN_ID_STR_BYTES)
+  #undef  THREECRYPT_MIN_ID_STR_BYTES
+  #define THREECRYPT_MIN_ID_STR_BYTES THREECRYPT_SPARSE_V1_ID_NBYTES
+ #endif
+ #if (THREECRYPT_SPARSE_V1_ID_NBYTES > THREECRYPT_MAX_ID_STR_BYTES)
+  #undef  THREECRYPT_MAX_ID_STR_BYTES
+  #define THREECRYPT_MAX_ID_STR_BYTES THREECRYPT_SPARSE_V1_ID_NBYTES
+ #endif
+#endif
+
+#if THREECRYPT_METHOD_ARCHIVE_V1_ISDEF
+ #if (THREECRYPT_ARCHIVE_V1_ID_NBYTES < THREECRYPT_MIN_ID_STR_BYTES)
+  #undef  THREECRYPT_MIN_ID_STR_BYTES
+  #define THREECRYPT_MIN_ID_STR_BYTES THREECRYPT_ARCHIVE_V1_ID_NBYTES
+ #endif
+ #if (THREECRYPT_ARCHIVE_V1_ID_NBYTES > THREECRYPT_MAX_ID_STR_BYTES)
+  #undef  THREECRYPT_MAX_ID_STR_BYTES
+  #define THREECRYPT_MAX_ID_STR_BYTES THREECRYPT_ARCHIVE_V1_ID_NBYTES
+ #endif
+#endif
+
+#if THREECRYPT_METHOD_XCHACHA_V1_ISDEF
+ #if (THREECRYPT_XCHACHA_V1_ID_NBYTES < THREECRYPT_MIN_ID_STR_BYTES)
+  #undef  THREECRYPT_MIN_ID_STR_BYTES
+  #define THREECRYPT_MIN_ID_STR_BYTES THREECRYPT_XCHACHA_V1_ID_NBYTES
+ #endif
+ #if (THREECRYPT_XCHACHA_V1_ID_NBYTES > THREECRYPT_MAX_ID_STR_BYTES)
+  #undef  THREECRYPT_MAX_ID_STR_BYTES
+  #define THREECRYPT_MAX_ID_STR_BYTES THREECRYPT_XCHACHA_V1_ID_NBYTES
+ #endif
+#endif
+
+#if THREECRYPT_METHOD_DRAGONFLY_V2_ISDEF
+ #if (THREECRYPT_DRAGONFLY_V2_ID_NBYTES < THREECRYPT_MIN_ID_STR_BYTES)
+  #undef  THREECRYPT_MIN_ID_STR_BYTES
+  #define THREECRYPT_MIN_ID_STR_BYTES THREECRYPT_DRAGONFLY_V2_ID_NBYTES
+ #endif
+ #if (THREECRYPT_DRAGONFLY_V2_ID_NBYTES > THREECRYPT_MAX_ID_STR_BYTES)
+  #undef  THREECRYPT_MAX_ID_STR_BYTES
+  #define THREECRYPT_MAX_ID_STR_BYTES THREECRYPT_DRAGONFLY_V2_ID_NBYTES
+ #endif
+#endif
+
 #if   THREECRYPT_MIN_ID_STR_BYTES == INT_MAX
  #error "THREECRYPT_MIN_ID_STR_BYTES never got set!"
 #elif THREECRYPT_MAX_ID_STR_BYTES == INT_MIN
@@ -128,29 +360,73 @@ typedef struct {
   SSC_MemMap          output_map;
   char*               input_filename;
   char*               output_filename;
+  char*               passphrase_filename; /* Read the passphrase from this file instead of the terminal. */
+  char*               keyfile_filename;    /* Key with this keyfile instead of a passphrase. */
   size_t              input_filename_size;
   size_t              output_filename_size;
+  size_t              passphrase_filename_size;
+  size_t              keyfile_filename_size;
+  int                 passphrase_fd;       /* Read the passphrase from this file descriptor instead of the terminal. */
   Threecrypt_Mode_t   mode;
   Threecrypt_Method_t method;
+  bool                recursive;           /* Operate on every file beneath the input directory. */
+  char*               kdf_ledger_filename; /* Reserve key-derivation memory through this ledger. */
+  size_t              kdf_ledger_filename_size;
+  uint64_t            kdf_budget;          /* Shared key-derivation memory budget in bytes; zero for none. */
+  bool                resume;              /* Encrypt resumably, resuming from a checkpoint if there is one. */
+  char*               member_name;         /* The archive member to extract. */
+  size_t              member_name_size;
+  uint64_t            view_offset;         /* The first plaintext byte to view. */
+  uint64_t            view_length;         /* The number of plaintext bytes to view; UINT64_MAX for the rest. */
+  uint64_t            max_io_rate;         /* Throttle the data path to this many bytes per second; zero for none. */
+  unsigned            max_cpu;             /* Throttle the data path to this percentage of a CPU; zero for none. */
+  int                 ionice_class;        /* THREECRYPT_IONICE_*. */
+  int                 ionice_level;
+  uint64_t            window;              /* Map files this many bytes at a time; zero to map them whole. */
+  int                 durability;          /* THREECRYPT_DURABILITY_*. */
 } Threecrypt;
 
+#define THREECRYPT_PASSPHRASE_FD_NONE (-1)
+
 #define THREECRYPT_NULL_LITERAL SSC_COMPOUND_LITERAL(\
                                  Threecrypt,\
                                  SSC_COMPOUND_LITERAL(PPQ_Catena512Input, 0),\
 				 SSC_MEMMAP_NULL_LITERAL,\
 				 SSC_MEMMAP_NULL_LITERAL,\
-				 SSC_NULL, SSC_NULL, 0, 0,\
+				 SSC_NULL, SSC_NULL, SSC_NULL, SSC_NULL, 0, 0, 0, 0,\
+				 THREECRYPT_PASSPHRASE_FD_NONE,\
 				 THREECRYPT_MODE_NONE,\
-				 THREECRYPT_METHOD_NONE\
+				 THREECRYPT_METHOD_NONE,\
+				 false,\
+				 SSC_NULL, 0,\
+				 THREECRYPT_KDF_BUDGET_DEFAULT,\
+				 false,\
+				 SSC_NULL, 0,\
+				 0, UINT64_MAX,\
+				 0, 0,\
+				 THREECRYPT_IONICE_NONE, 4,\
+				 0,\
+				 THREECRYPT_DURABILITY_DEFAULT\
                                 )
 #define THREECRYPT_DEFAULT_LITERAL SSC_COMPOUND_LITERAL(\
                                     Threecrypt,\
 				    SSC_COMPOUND_LITERAL(PPQ_Catena512Input, 0),\
 				    SSC_MEMMAP_NULL_LITERAL,\
 				    SSC_MEMMAP_NULL_LITERAL,\
-				    SSC_NULL, SSC_NULL, 0, 0,\
+				    SSC_NULL, SSC_NULL, SSC_NULL, SSC_NULL, 0, 0, 0, 0,\
+				    THREECRYPT_PASSPHRASE_FD_NONE,\
 				    THREECRYPT_MODE_DEFAULT,\
-				    THREECRYPT_METHOD_DEFAULT\
+				    THREECRYPT_METHOD_DEFAULT,\
+				    false,\
+				    SSC_NULL, 0,\
+				    THREECRYPT_KDF_BUDGET_DEFAULT,\
+				    false,\
+				    SSC_NULL, 0,\
+				    0, UINT64_MAX,\
+				    0, 0,\
+				    THREECRYPT_IONICE_NONE, 4,\
+				    0,\
+				    THREECRYPT_DURABILITY_DEFAULT\
                                    )
 /* Default literal here passes uninitialized data like
  * THREECRYPT_NULL_LITERAL, except chooses the default method and mode. */
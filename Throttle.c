@@ -0,0 +1,182 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For syscall(). */
+#endif
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <SSC/Operation.h>
+#include "Throttle.h"
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <pthread.h>
+ #include <signal.h>
+ #include <stdatomic.h>
+ #include <time.h>
+ #include <unistd.h>
+ #if defined(__linux__)
+  #include <sys/syscall.h>
+ #endif
+#endif
+
+#define R_ SSC_RESTRICT
+
+#define NSEC_PER_SEC_       INT64_C(1000000000)
+#define IOPRIO_WHO_PROCESS_ 1
+#define IOPRIO_CLASS_SHIFT_ 13
+
+static bool Limited_ = false;
+
+#if defined(SSC_OS_UNIXLIKE)
+static pthread_mutex_t Lock_ = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t        Io_rate_ = 0;     /* Bytes per second, or zero. */
+static unsigned        Cpu_percent_ = 0; /* Percent of one core, or zero. */
+static int64_t         Io_debt_ = 0;     /* Nanoseconds we are ahead of the I/O limit. */
+static int64_t         Cpu_debt_ = 0;    /* Nanoseconds we are ahead of the CPU limit. */
+static int64_t         Last_wall_ = 0;
+static int64_t         Last_cpu_ = 0;
+/* Counted by the handler and taken whole by adjust_(), so no signal arriving in between is lost. */
+static atomic_int      Slower_ = 0;      /* SIGUSR1s not yet applied. */
+static atomic_int      Faster_ = 0;      /* SIGUSR2s not yet applied. */
+SSC_STATIC_ASSERT(ATOMIC_INT_LOCK_FREE == 2, "The signal handler needs lock-free atomics.");
+
+static int64_t
+now_(clockid_t clock)
+{
+  struct timespec ts;
+  SSC_assertMsg(!clock_gettime(clock, &ts), "Error: Failed to read the clock!\n");
+  return ((int64_t)ts.tv_sec * NSEC_PER_SEC_) + (int64_t)ts.tv_nsec;
+}
+
+static void
+on_signal_(int signum)
+{
+  if (signum == SIGUSR1)
+    atomic_fetch_add(&Slower_, 1);
+  else
+    atomic_fetch_add(&Faster_, 1);
+}
+
+/* Apply the SIGUSR1s and SIGUSR2s received since we last looked. */
+static void
+adjust_(void)
+{
+  int slower = atomic_exchange(&Slower_, 0);
+  int faster = atomic_exchange(&Faster_, 0);
+  const bool changed = slower || faster;
+  for (; slower; --slower) {
+    if (Io_rate_ > 1)
+      Io_rate_ /= 2;
+    if (Cpu_percent_ > 1)
+      Cpu_percent_ /= 2;
+  }
+  for (; faster; --faster) {
+    if (Io_rate_)
+      Io_rate_ = (Io_rate_ > (UINT64_MAX / 2)) ? UINT64_MAX : (Io_rate_ * 2);
+    if (Cpu_percent_)
+      Cpu_percent_ = (Cpu_percent_ > 50) ? 100 : (Cpu_percent_ * 2);
+  }
+  if (changed)
+    fprintf(stderr, "Throttling to %" PRIu64 " bytes per second and %u%% CPU (zero is unlimited).\n", Io_rate_, Cpu_percent_);
+}
+
+/* Charge the elapsed wall time against @debt, limiting the credit it may bank, and return it. */
+static int64_t
+settle_(int64_t debt, int64_t wall_elapsed)
+{
+  debt -= wall_elapsed;
+  return (debt < -THREECRYPT_THROTTLE_BURST_NSEC) ? -THREECRYPT_THROTTLE_BURST_NSEC : debt;
+}
+
+static void
+sleep_(int64_t nsec)
+{
+  struct timespec ts = {(time_t)(nsec / NSEC_PER_SEC_), (long)(nsec % NSEC_PER_SEC_)};
+  while (nanosleep(&ts, &ts) == -1)
+    SSC_assertMsg(errno == EINTR, "Error: Failed to sleep while throttling!\n");
+}
+#endif /* ! SSC_OS_UNIXLIKE */
+
+void throttle_configure(uint64_t io_rate, unsigned cpu_percent)
+{
+  SSC_assertMsg(cpu_percent <= 100, "Error: Cannot use more than 100%% of a CPU!\n");
+#if defined(SSC_OS_UNIXLIKE)
+  Io_rate_ = io_rate;
+  Cpu_percent_ = cpu_percent;
+  Limited_ = io_rate || cpu_percent;
+  throttle_restart();
+  if (Limited_) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal_;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    SSC_assertMsg(
+     !sigaction(SIGUSR1, &sa, SSC_NULL) && !sigaction(SIGUSR2, &sa, SSC_NULL),
+     "Error: Failed to install the throttling signal handlers!\n");
+  }
+#else
+  SSC_assertMsg(!io_rate && !cpu_percent, "Error: Throttling is not supported on this platform.\n");
+#endif
+}
+
+bool throttle_is_limited(void)
+{
+  return Limited_;
+}
+
+void throttle_ionice(int io_class, int level)
+{
+  SSC_assertMsg(level >= 0 && level <= 7, "Error: I/O priority levels range from 0 to 7!\n");
+#if defined(__linux__)
+  const int prio = (io_class << IOPRIO_CLASS_SHIFT_) | ((io_class == THREECRYPT_IONICE_IDLE) ? 0 : level);
+  SSC_assertMsg(
+   syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS_, 0, prio) == 0,
+   "Error: Failed to set the I/O priority (%s)!\n", strerror(errno));
+#else
+  (void)io_class;
+  SSC_errx("Error: --ionice is only supported on Linux.\n");
+#endif
+}
+
+void throttle_account(uint64_t bytes)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  if (!Limited_)
+    return;
+  pthread_mutex_lock(&Lock_);
+  adjust_();
+  const int64_t wall = now_(CLOCK_MONOTONIC);
+  const int64_t cpu  = now_(CLOCK_PROCESS_CPUTIME_ID);
+  const int64_t wall_elapsed = wall - Last_wall_;
+  if (Io_rate_) {
+    const double cost = ((double)bytes * (double)NSEC_PER_SEC_) / (double)Io_rate_;
+    Io_debt_ = settle_(Io_debt_ + ((cost > (double)INT64_MAX / 2) ? (INT64_MAX / 2) : (int64_t)cost), wall_elapsed);
+  }
+  if (Cpu_percent_)
+    Cpu_debt_ = settle_(Cpu_debt_ + (((cpu - Last_cpu_) * 100) / (int64_t)Cpu_percent_), wall_elapsed);
+  Last_wall_ = wall;
+  Last_cpu_  = cpu;
+  /* The time we sleep is charged against the debts the next time we are called. Sleeping with
+   * the lock held pauses the data paths of the other threads as well, as it should. */
+  const int64_t debt = (Io_debt_ > Cpu_debt_) ? Io_debt_ : Cpu_debt_;
+  if (debt > 0)
+    sleep_(debt);
+  pthread_mutex_unlock(&Lock_);
+#else
+  (void)bytes;
+#endif
+}
+
+void throttle_restart(void)
+{
+#if defined(SSC_OS_UNIXLIKE)
+  if (!Limited_)
+    return;
+  pthread_mutex_lock(&Lock_);
+  Io_debt_ = 0;
+  Cpu_debt_ = 0;
+  Last_wall_ = now_(CLOCK_MONOTONIC);
+  Last_cpu_  = now_(CLOCK_PROCESS_CPUTIME_ID);
+  pthread_mutex_unlock(&Lock_);
+#endif
+}
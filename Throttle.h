@@ -0,0 +1,52 @@
+#ifndef THREECRYPT_THROTTLE_H
+#define THREECRYPT_THROTTLE_H
+
+#include <SSC/Macro.h>
+
+/* Throttling of the data paths, so large files can be encrypted on busy hosts with predictable impact.
+ *
+ * The CTR passes of the formats 3crypt implements itself report the bytes they process every
+ * THREECRYPT_THROTTLE_QUANTUM bytes. Two token buckets, kept as nanoseconds of debt, decide
+ * whether to sleep before continuing: one charges each byte 1/rate seconds against the wall clock,
+ * the other charges each nanosecond of process CPU time 100/percent nanoseconds against it.
+ * Neither bucket banks more than THREECRYPT_THROTTLE_BURST_NSEC of credit while idle.
+ *
+ * Once throttling is configured, SIGUSR1 halves and SIGUSR2 doubles both limits at runtime. */
+#define THREECRYPT_THROTTLE_QUANTUM    (UINT64_C(1) << 18)
+#define THREECRYPT_THROTTLE_BURST_NSEC INT64_C(100000000)
+
+/* I/O scheduling classes for throttle_ionice(), as in ionice(1). */
+#define THREECRYPT_IONICE_NONE        0
+#define THREECRYPT_IONICE_REALTIME    1
+#define THREECRYPT_IONICE_BEST_EFFORT 2
+#define THREECRYPT_IONICE_IDLE        3
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+/* Limit the data paths to @io_rate bytes per second and @cpu_percent percent of one core.
+ * A zero for either disables that limit. */
+void
+throttle_configure(uint64_t io_rate, unsigned cpu_percent);
+
+/* Returns true if a limit was configured. */
+bool
+throttle_is_limited(void);
+
+/* Set the I/O scheduling @io_class and @level, 0 to 7, of this process, or die. */
+void
+throttle_ionice(int io_class, int level);
+
+/* Charge @bytes processed, sleeping if either limit has been exceeded.
+ * Returns immediately if throttling is not configured. Safe to call from several threads. */
+void
+throttle_account(uint64_t bytes);
+
+/* Forgive whatever has been consumed so far, i.e. key-derivation, which is not a data path. */
+void
+throttle_restart(void);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
@@ -0,0 +1,147 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* For madvise(). */
+#endif
+#include <errno.h>
+#include <inttypes.h>
+#include <SSC/Operation.h>
+#include "Window.h"
+#include "Durability.h"
+
+#if defined(SSC_OS_UNIXLIKE)
+ #include <sys/mman.h>
+ #include <unistd.h>
+#endif
+
+#define R_ SSC_RESTRICT
+
+static uint64_t Window_bytes_ = 0; /* Zero maps files whole. */
+
+void threecrypt_window_configure(uint64_t window_bytes)
+{
+  if (!window_bytes) {
+    Window_bytes_ = 0;
+    return;
+  }
+#if defined(SSC_OS_UNIXLIKE)
+  SSC_assertMsg(
+   window_bytes >= THREECRYPT_WINDOW_MIN_BYTES,
+   "Error: The window size must be at least %" PRIu64 " bytes.\n", THREECRYPT_WINDOW_MIN_BYTES);
+  const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+  SSC_assertMsg(window_bytes == (size_t)window_bytes, "Error: The window size is too large for this platform.\n");
+  Window_bytes_ = window_bytes - (window_bytes % page);
+#else
+  SSC_errx("Error: Windowed mapping is not supported on this platform.\n");
+#endif
+}
+
+uint64_t threecrypt_window_bytes(void)
+{
+  return Window_bytes_;
+}
+
+void threecrypt_window_open(Threecrypt_Window* R_ window, SSC_MemMap* R_ map, bool readonly)
+{
+  window->map      = map;
+  window->base     = SSC_NULL;
+  window->offset   = 0;
+  window->mapped   = 0;
+  window->readonly = readonly;
+  /* A file that is already mapped is used as it is. */
+  window->whole = !Window_bytes_ || map->ptr;
+  if (window->whole && map->size && !map->ptr)
+    SSC_MemMap_mapOrDie(map, readonly);
+}
+
+#if defined(SSC_OS_UNIXLIKE)
+/* Unmap the current window, if any, scheduling its writeback if it was written. */
+static void
+unmap_(Threecrypt_Window* R_ window)
+{
+  if (!window->base)
+    return;
+  if (!window->readonly)
+    SSC_assertMsg(!msync(window->base, window->mapped, MS_ASYNC), "Error: Failed to write back a window of the file!\n");
+  SSC_assertMsg(!munmap(window->base, window->mapped), "Error: Failed to unmap a window of the file!\n");
+  window->base   = SSC_NULL;
+  window->mapped = 0;
+}
+
+/* Map the window beginning at the page holding @offset. mmap() cannot map zero bytes, so for
+ * @offset at the end of the file, the window begins at the page holding the last byte instead. */
+static void
+remap_(Threecrypt_Window* R_ window, uint64_t offset)
+{
+  unmap_(window);
+  const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+  if (offset == (uint64_t)window->map->size)
+    --offset;
+  window->offset = offset - (offset % page);
+  uint64_t size = (uint64_t)window->map->size - window->offset;
+  if (size > Window_bytes_)
+    size = Window_bytes_;
+  void* base = mmap(
+   SSC_NULL,
+   (size_t)size,
+   window->readonly ? PROT_READ : (PROT_READ | PROT_WRITE),
+   MAP_SHARED,
+   window->map->file,
+   (off_t)window->offset);
+  SSC_assertMsg(base != MAP_FAILED, "Error: Failed to map a window of the file (%s)!\n", strerror(errno));
+#ifdef MADV_SEQUENTIAL
+  madvise(base, (size_t)size, MADV_SEQUENTIAL); /* Only advice; failure is harmless. */
+#endif
+  window->base   = (uint8_t*)base;
+  window->mapped = (size_t)size;
+}
+#endif /* ! SSC_OS_UNIXLIKE */
+
+uint8_t* threecrypt_window_get(Threecrypt_Window* R_ window, uint64_t offset, uint64_t* R_ size)
+{
+  SSC_assert((offset + *size) <= (uint64_t)window->map->size);
+  if (window->whole)
+    return window->map->ptr + offset;
+#if defined(SSC_OS_UNIXLIKE)
+  /* An empty file has nothing to map. */
+  if (!window->map->size)
+    return SSC_NULL;
+  const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+  const uint64_t end  = window->offset + window->mapped;
+  /* Stay in the current window while it holds @offset, unless a small request would straddle its end. */
+  if (!window->base || (offset < window->offset) || (offset >= end) ||
+      (((end - offset) < *size) && ((end - offset) < page)))
+    remap_(window, offset);
+  const uint64_t available = (window->offset + window->mapped) - offset;
+  if (*size > available)
+    *size = available;
+  return window->base + (offset - window->offset);
+#else
+  return SSC_NULL;
+#endif
+}
+
+void threecrypt_window_close(Threecrypt_Window* R_ window)
+{
+  if (window->whole) {
+    if (window->map->size && window->map->ptr) {
+      if (!window->readonly && durability_sync_on_close())
+        SSC_MemMap_syncOrDie(window->map);
+      SSC_MemMap_unmapOrDie(window->map);
+      window->map->ptr = SSC_NULL;
+    }
+    return;
+  }
+#if defined(SSC_OS_UNIXLIKE)
+  unmap_(window);
+  if (!window->readonly && durability_sync_on_close())
+    SSC_assertMsg(!fsync(window->map->file), "Error: Failed to sync the file (%s)!\n", strerror(errno));
+#endif
+}
+
+void threecrypt_window_release(Threecrypt_Window* R_ window)
+{
+  if (window->whole)
+    return;
+#if defined(SSC_OS_UNIXLIKE)
+  unmap_(window);
+#endif
+}
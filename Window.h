@@ -0,0 +1,63 @@
+#ifndef THREECRYPT_WINDOW_H
+#define THREECRYPT_WINDOW_H
+
+#include <SSC/Macro.h>
+#include <SSC/MemMap.h>
+
+/* Sliding-window mapping of the files the formats 3crypt implements itself read and write.
+ *
+ * Normally a file is mapped whole, so a 10 TB file takes 10 TB of address space and the page
+ * tables to match. Once threecrypt_window_configure() is given a window size, a file is instead
+ * mapped a window at a time: each threecrypt_window_get() that falls outside the current window
+ * unmaps it and maps the window beginning at the page holding the requested offset. The mappings,
+ * and the resident set they account for, stay bounded by the window size whatever the file size.
+ * Written windows are scheduled for writeback as they are unmapped, and the file is synced when
+ * it is closed, as a whole mapping would be. The files themselves are unchanged. */
+#define THREECRYPT_WINDOW_MIN_BYTES (UINT64_C(1) << 20)
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  SSC_MemMap* map;      /* The file; map->size is its size. Mapped whole at map->ptr unless windowed. */
+  uint8_t*    base;     /* The current window, or SSC_NULL. */
+  uint64_t    offset;   /* The offset of the current window in the file. */
+  size_t      mapped;   /* The size of the current window. */
+  bool        readonly;
+  bool        whole;    /* The file is mapped whole, at map->ptr. */
+} Threecrypt_Window;
+
+/* Map files @window_bytes at a time, rounded down to a whole number of pages, or whole if zero. */
+void
+threecrypt_window_configure(uint64_t window_bytes);
+
+/* Returns the window size, or zero if files are mapped whole. */
+uint64_t
+threecrypt_window_bytes(void);
+
+/* Begin accessing the open file of @map, whose size must already be set, through @window.
+ * If files are mapped whole, @map is mapped now unless it already is. */
+void
+threecrypt_window_open(Threecrypt_Window* R_ window, SSC_MemMap* R_ map, bool readonly);
+
+/* Returns a pointer to byte @offset of the file, shrinking @size to the number of bytes from there
+ * that may be accessed before the next call. A request for a page or less is never shrunk, so
+ * headers and tags may be read whole. An @offset at the end of the file is allowed, and yields a
+ * @size of zero. The pointer is only valid until the next call. */
+uint8_t*
+threecrypt_window_get(Threecrypt_Window* R_ window, uint64_t offset, uint64_t* R_ size);
+
+/* Unmap the file, syncing it first unless it was opened @readonly or the durability policy
+ * syncs outputs later, if at all. The file is left open. */
+void
+threecrypt_window_close(Threecrypt_Window* R_ window);
+
+/* Unmap @window, opened by a worker thread on a file another window already has open. That
+ * window keeps any whole mapping of the file, and syncs the file when it is closed. */
+void
+threecrypt_window_release(Threecrypt_Window* R_ window);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif /* ! */
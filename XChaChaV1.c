@@ -0,0 +1,205 @@
+#include <SSC/Operation.h>
+#include "XChaChaV1.h"
+#include "Prefetch.h"
+
+#ifdef THREECRYPT_XCHACHA_V1_H
+
+#define R_ SSC_RESTRICT
+
+#define MAC_BYTES_         THREECRYPT_XCHACHA_V1_MAC_BYTES
+#define TAG_BYTES_         THREECRYPT_POLY1305_TAG_BYTES
+#define HEADER_BYTES_      THREECRYPT_XCHACHA_V1_HEADER_BYTES
+#define KEYING_OFFSET_     THREECRYPT_XCHACHA_V1_KEYING_OFFSET
+#define NONCE_OFFSET_      (KEYING_OFFSET_ + THREECRYPT_KEYING_BYTES)
+#define HEADER_MAC_OFFSET_ (NONCE_OFFSET_ + THREECRYPT_XCHACHA20_NONCE_BYTES)
+/* The ciphertext is encrypted and authenticated a slice at a time, so each slice is MACed while still in cache. */
+#define SLICE_BYTES_       (UINT64_C(1) << 16)
+
+#define AUTH_FAILED_       "Error: Authentication failed. The file has been corrupted or truncated.\n"
+
+/* Derive the keys from @ctx->keying and the @header of an XChaCha_V1 file, and key the cipher. */
+static void
+derive_keys_(Threecrypt_XChaChaV1* R_ ctx, const uint8_t* R_ header)
+{
+  keying_derive(
+   &ctx->keying,
+   header + KEYING_OFFSET_,
+   THREECRYPT_XCHACHA_V1_ID,
+   THREECRYPT_XCHACHA_V1_ID_NBYTES,
+   ctx->derived,
+   sizeof(ctx->derived));
+  memcpy(ctx->enc_key,  ctx->derived,                                 THREECRYPT_CHACHA20_KEY_BYTES);
+  memcpy(ctx->auth_key, ctx->derived + THREECRYPT_CHACHA20_KEY_BYTES, PPQ_THREEFISH512_BLOCK_BYTES);
+  SSC_secureZero(ctx->derived, sizeof(ctx->derived));
+  threecrypt_xchacha20_init(&ctx->xchacha20, ctx->enc_key, header + NONCE_OFFSET_);
+}
+
+/* MAC the header at @header under the authentication key, storing the result in @out. */
+static void
+header_mac_(Threecrypt_XChaChaV1* R_ ctx, uint8_t* R_ out, const uint8_t* R_ header)
+{
+  PPQ_Skein512_mac(&ctx->keying.ubi512, out, header, ctx->auth_key, MAC_BYTES_, HEADER_MAC_OFFSET_);
+}
+
+/* Key Poly1305 with keystream block 0 and absorb the padded @header. */
+static void
+begin_tag_(Threecrypt_XChaChaV1* R_ ctx, const uint8_t* R_ header)
+{
+  static const uint8_t zeroes [16] = {0};
+  memset(ctx->one_time, 0, sizeof(ctx->one_time));
+  threecrypt_xchacha20_xor(&ctx->xchacha20, ctx->one_time, ctx->one_time, sizeof(ctx->one_time), 0);
+  threecrypt_poly1305_init(&ctx->poly1305, ctx->one_time);
+  SSC_secureZero(ctx->one_time, sizeof(ctx->one_time));
+  threecrypt_poly1305_update(&ctx->poly1305, header, HEADER_BYTES_);
+  threecrypt_poly1305_update(&ctx->poly1305, zeroes, (16 - (HEADER_BYTES_ % 16)) % 16);
+}
+
+/* Absorb the padding and lengths following @size bytes of ciphertext, and store the tag in @tag. */
+static void
+end_tag_(Threecrypt_XChaChaV1* R_ ctx, uint64_t size, uint8_t* R_ tag)
+{
+  static const uint8_t zeroes [16] = {0};
+  uint8_t lengths [16];
+  threecrypt_poly1305_update(&ctx->poly1305, zeroes, (16 - (size % 16)) % 16);
+  threecrypt_store64(lengths, HEADER_BYTES_);
+  threecrypt_store64(lengths + 8, size);
+  threecrypt_poly1305_update(&ctx->poly1305, lengths, sizeof(lengths));
+  threecrypt_poly1305_final(&ctx->poly1305, tag);
+}
+
+void
+xchacha_v1_encrypt(
+ Threecrypt_XChaChaV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map)
+{
+  const uint64_t size = (uint64_t)input_map->size;
+  Threecrypt_Window in, out;
+  threecrypt_window_open(&in, input_map, true);
+  output_map->size = (size_t)(size + THREECRYPT_XCHACHA_V1_METADATA_BYTES);
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  threecrypt_window_open(&out, output_map, false);
+  {
+    uint64_t n = HEADER_BYTES_;
+    uint8_t* const header = threecrypt_window_get(&out, 0, &n);
+    memcpy(header, THREECRYPT_XCHACHA_V1_ID, THREECRYPT_XCHACHA_V1_ID_NBYTES);
+    keying_store(&ctx->keying, header + KEYING_OFFSET_, &ctx->csprng);
+    PPQ_CSPRNG_get(&ctx->csprng, header + NONCE_OFFSET_, THREECRYPT_XCHACHA20_NONCE_BYTES);
+    Threecrypt_Prefetch prefetch = {0};
+    if (ctx->keying.kind == THREECRYPT_KEYING_PASSWORD)
+      threecrypt_prefetch_begin(&prefetch, input_map, 0, output_map);
+    derive_keys_(ctx, header);
+    threecrypt_prefetch_end(&prefetch);
+    header_mac_(ctx, header + HEADER_MAC_OFFSET_, header);
+    begin_tag_(ctx, header);
+  }
+  for (uint64_t done = 0; done < size; ) {
+    uint64_t n = ((size - done) < SLICE_BYTES_) ? (size - done) : SLICE_BYTES_;
+    const uint8_t* const plaintext = threecrypt_window_get(&in, done, &n);
+    uint8_t* const ciphertext = threecrypt_window_get(&out, HEADER_BYTES_ + done, &n);
+    threecrypt_xchacha20_xor(&ctx->xchacha20, ciphertext, plaintext, n, THREECRYPT_CHACHA20_BLOCK_BYTES + done);
+    threecrypt_poly1305_update(&ctx->poly1305, ciphertext, n);
+    done += n;
+  }
+  {
+    uint64_t n = TAG_BYTES_;
+    end_tag_(ctx, size, threecrypt_window_get(&out, HEADER_BYTES_ + size, &n));
+  }
+  threecrypt_window_close(&out);
+  threecrypt_window_close(&in);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+/* Authenticate the XChaCha_V1 file of @in. Returns an error message, or SSC_NULL. */
+static const char*
+authenticate_(Threecrypt_XChaChaV1* R_ ctx, Threecrypt_Window* R_ in)
+{
+  const uint64_t size = (uint64_t)in->map->size;
+  if (size < THREECRYPT_XCHACHA_V1_METADATA_BYTES)
+    return "Error: The file is too small to be an XChaCha_V1 encrypted file.\n";
+  {
+    uint64_t n = HEADER_BYTES_;
+    const uint8_t* const header = threecrypt_window_get(in, 0, &n);
+    Threecrypt_Prefetch prefetch = {0};
+    if (ctx->keying.kind == THREECRYPT_KEYING_PASSWORD)
+      threecrypt_prefetch_begin(&prefetch, in->map, HEADER_BYTES_, SSC_NULL);
+    derive_keys_(ctx, header);
+    threecrypt_prefetch_end(&prefetch);
+    /* A wrong password or keyfile is caught here, without reading the ciphertext. */
+    header_mac_(ctx, ctx->mac, header);
+    if (!threecrypt_ct_equal(ctx->mac, header + HEADER_MAC_OFFSET_, MAC_BYTES_))
+      return "Error: Authentication failed. Wrong password or keyfile, or the header has been corrupted.\n";
+    begin_tag_(ctx, header);
+  }
+  const uint64_t ciphertext_size = size - THREECRYPT_XCHACHA_V1_METADATA_BYTES;
+  for (uint64_t done = 0; done < ciphertext_size; ) {
+    uint64_t n = ciphertext_size - done;
+    const uint8_t* const ciphertext = threecrypt_window_get(in, HEADER_BYTES_ + done, &n);
+    threecrypt_poly1305_update(&ctx->poly1305, ciphertext, n);
+    done += n;
+  }
+  end_tag_(ctx, ciphertext_size, ctx->mac);
+  uint64_t n = TAG_BYTES_;
+  if (!threecrypt_ct_equal(ctx->mac, threecrypt_window_get(in, size - TAG_BYTES_, &n), TAG_BYTES_))
+    return AUTH_FAILED_;
+  return SSC_NULL;
+}
+
+void
+xchacha_v1_decrypt(
+ Threecrypt_XChaChaV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map,
+ const char* R_           output_filename)
+{
+  Threecrypt_Window in;
+  threecrypt_window_open(&in, input_map, true);
+  const char* error = authenticate_(ctx, &in);
+  if (error) {
+    threecrypt_window_close(&in);
+    SSC_File_closeOrDie(input_map->file);
+    SSC_File_closeOrDie(output_map->file);
+    remove(output_filename);
+    SSC_errx("%s", error);
+  }
+  output_map->size = input_map->size - THREECRYPT_XCHACHA_V1_METADATA_BYTES;
+  SSC_File_setSizeOrDie(output_map->file, output_map->size);
+  Threecrypt_Window out;
+  threecrypt_window_open(&out, output_map, false);
+  for (uint64_t done = 0; done < (uint64_t)output_map->size; ) {
+    uint64_t n = (uint64_t)output_map->size - done;
+    const uint8_t* const ciphertext = threecrypt_window_get(&in, HEADER_BYTES_ + done, &n);
+    uint8_t* const plaintext = threecrypt_window_get(&out, done, &n);
+    threecrypt_xchacha20_xor(
+     &ctx->xchacha20,
+     plaintext,
+     ciphertext,
+     n,
+     THREECRYPT_CHACHA20_BLOCK_BYTES + done);
+    done += n;
+  }
+  threecrypt_window_close(&out);
+  threecrypt_window_close(&in);
+  SSC_File_closeOrDie(output_map->file);
+  SSC_File_closeOrDie(input_map->file);
+}
+
+void
+xchacha_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename)
+{
+  SSC_assertMsg(
+   input_map->size >= THREECRYPT_XCHACHA_V1_METADATA_BYTES,
+   "Error: The input file %s is too small to be an XChaCha_V1 encrypted file.\n", filename);
+  const uint8_t* const in = input_map->ptr;
+  const uint8_t* const keying = in + KEYING_OFFSET_;
+  printf("File Header for %s\n", filename);
+  printf("Method             : XChaCha_V1\n");
+  keying_dump(keying);
+  threecrypt_print_hex("Nonce              : ", in + NONCE_OFFSET_, THREECRYPT_XCHACHA20_NONCE_BYTES);
+  printf(
+   "Ciphertext Size    : %" PRIu64 " bytes\n",
+   (uint64_t)(input_map->size - THREECRYPT_XCHACHA_V1_METADATA_BYTES));
+}
+
+#endif /* ! THREECRYPT_XCHACHA_V1_H */
@@ -0,0 +1,83 @@
+#if !defined(THREECRYPT_XCHACHA_V1_H) && defined(THREECRYPT_EXTERN_ENABLE_XCHACHA_V1)
+#define THREECRYPT_XCHACHA_V1_H
+
+#include <SSC/Macro.h>
+#include <SSC/MemMap.h>
+#include <PPQ/CSPRNG.h>
+#include "ChaCha20.h"
+#include "Keying.h"
+#include "Poly1305.h"
+#include "Primitive.h"
+#include "Window.h"
+
+/* XChaCha_V1 encrypted files are keyed like the other formats, through Catena or a keyfile, but
+ * encrypt and authenticate their contents with XChaCha20 and Poly1305, whose kernels vectorize far
+ * better than Threefish-512 and Skein-512, for when throughput matters more than an all-Threefish design.
+ *
+ * Layout:
+ *   Header:
+ *     ID          (THREECRYPT_XCHACHA_V1_ID_NBYTES)
+ *     Keying      (THREECRYPT_KEYING_BYTES)
+ *     Nonce       (THREECRYPT_XCHACHA20_NONCE_BYTES)
+ *     Header MAC  (64), Skein-512 MAC of the above.
+ *   Ciphertext, the plaintext XORed with XChaCha20 keystream beginning at block 1.
+ *   Tag         (THREECRYPT_POLY1305_TAG_BYTES), Poly1305 tag of:
+ *     Header, zero padded to a multiple of 16 bytes
+ *     Ciphertext, zero padded to a multiple of 16 bytes
+ *     LE64(header bytes) || LE64(ciphertext bytes)
+ *
+ * The Poly1305 key is the first 32 bytes of keystream block 0, as in RFC 8439's AEAD construction.
+ * The Header MAC catches a wrong password or keyfile without reading the ciphertext. */
+#define THREECRYPT_XCHACHA_V1_ID              "3CRYPT_XCHACHA_V1"
+#define THREECRYPT_XCHACHA_V1_ID_NBYTES       18
+#define THREECRYPT_XCHACHA_V1_MAC_BYTES       64
+#define THREECRYPT_XCHACHA_V1_HEADER_BYTES    (\
+ THREECRYPT_XCHACHA_V1_ID_NBYTES +\
+ THREECRYPT_KEYING_BYTES +\
+ THREECRYPT_XCHACHA20_NONCE_BYTES +\
+ THREECRYPT_XCHACHA_V1_MAC_BYTES)
+#define THREECRYPT_XCHACHA_V1_METADATA_BYTES  (THREECRYPT_XCHACHA_V1_HEADER_BYTES + THREECRYPT_POLY1305_TAG_BYTES)
+#define THREECRYPT_XCHACHA_V1_KEYING_OFFSET   THREECRYPT_XCHACHA_V1_ID_NBYTES
+
+#define R_ SSC_RESTRICT
+SSC_BEGIN_C_DECLS
+
+typedef struct {
+  Threecrypt_Keying    keying;
+  Threecrypt_XChaCha20 xchacha20;
+  Threecrypt_Poly1305  poly1305;
+  PPQ_CSPRNG           csprng; /* Only used when encrypting. */
+  uint8_t              enc_key  [THREECRYPT_CHACHA20_KEY_BYTES];
+  uint8_t              auth_key [PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t              derived  [THREECRYPT_CHACHA20_KEY_BYTES + PPQ_THREEFISH512_BLOCK_BYTES];
+  uint8_t              mac      [THREECRYPT_XCHACHA_V1_MAC_BYTES];
+  uint8_t              one_time [THREECRYPT_CHACHA20_BLOCK_BYTES];
+} Threecrypt_XChaChaV1;
+
+/* Encrypt @input_map into @output_map, whose files must already be open, with the keying parameters
+ * in @ctx->keying. The files are mapped whole or a window at a time, as threecrypt_window_bytes()
+ * directs. @ctx->keying.secret and @ctx->csprng must be initialized. Unmaps and closes both files. */
+void
+xchacha_v1_encrypt(
+ Threecrypt_XChaChaV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map);
+
+/* Authenticate @input_map, then decrypt it into @output_map, whose files must already be open, mapping
+ * them as xchacha_v1_encrypt() does. @ctx->keying must be loaded and its secret initialized. On failure @output_filename is removed
+ * and we die. Unmaps and closes both files. */
+void
+xchacha_v1_decrypt(
+ Threecrypt_XChaChaV1* R_ ctx,
+ SSC_MemMap* R_           input_map,
+ SSC_MemMap* R_           output_map,
+ const char* R_           output_filename);
+
+/* Print the header of the XChaCha_V1 file mapped by @input_map. */
+void
+xchacha_v1_dump_header(SSC_MemMap* R_ input_map, const char* R_ filename);
+
+SSC_END_C_DECLS
+#undef R_
+
+#endif
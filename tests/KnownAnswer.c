@@ -0,0 +1,73 @@
+#include <SSC/Operation.h>
+#include "ChaCha20.h"
+#include "Multibuffer.h"
+#include "Poly1305.h"
+
+/* Runs the known-answer tests of ChaCha20, Poly1305 and the multi-buffer Threefish-512 engine, each of
+ * which dies on the first use of its primitive if it disagrees with the published answers, then checks
+ * that feeding the primitives in uneven pieces, as the file formats do, gives the same answers as one call. */
+
+static const uint8_t Rfc8439_Key_ [THREECRYPT_POLY1305_KEY_BYTES] = {
+  0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+  0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b
+};
+static const char    Rfc8439_Message_ [] = "Cryptographic Forum Research Group";
+static const uint8_t Rfc8439_Tag_ [THREECRYPT_POLY1305_TAG_BYTES] = {
+  0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6, 0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9
+};
+
+/* Long enough to reach the lanes of both ciphers several times over, and a multiple of neither block. */
+enum { DATA_BYTES_ = 5003 };
+static const size_t Pieces_ [] = {1, 15, 17, 64, 511, 513, 1000, 2882};
+
+static void
+poly1305_pieces_(const uint8_t* key, const uint8_t* data)
+{
+  Threecrypt_Poly1305 ctx;
+  uint8_t tag [2][THREECRYPT_POLY1305_TAG_BYTES];
+  threecrypt_poly1305_init(&ctx, Rfc8439_Key_);
+  for (size_t i = 0; i < sizeof(Rfc8439_Message_) - 1; ++i)
+    threecrypt_poly1305_update(&ctx, (const uint8_t*)Rfc8439_Message_ + i, 1);
+  threecrypt_poly1305_final(&ctx, tag[0]);
+  SSC_assertMsg(!memcmp(tag[0], Rfc8439_Tag_, sizeof(Rfc8439_Tag_)), "Poly1305 disagrees with RFC 8439 a byte at a time.\n");
+  threecrypt_poly1305_init(&ctx, key);
+  threecrypt_poly1305_update(&ctx, data, DATA_BYTES_);
+  threecrypt_poly1305_final(&ctx, tag[0]);
+  threecrypt_poly1305_init(&ctx, key);
+  for (size_t i = 0, p = 0; i < DATA_BYTES_; i += Pieces_[p++])
+    threecrypt_poly1305_update(&ctx, data + i, Pieces_[p]);
+  threecrypt_poly1305_final(&ctx, tag[1]);
+  SSC_assertMsg(!memcmp(tag[0], tag[1], sizeof(tag[0])), "Poly1305 disagrees with itself in pieces.\n");
+}
+
+static void
+xchacha20_pieces_(const uint8_t* key, const uint8_t* data)
+{
+  Threecrypt_XChaCha20 ctx;
+  uint8_t nonce [THREECRYPT_XCHACHA20_NONCE_BYTES];
+  uint8_t output [2][DATA_BYTES_];
+  memcpy(nonce, data, sizeof(nonce));
+  threecrypt_xchacha20_init(&ctx, key, nonce);
+  threecrypt_xchacha20_xor(&ctx, output[0], data, DATA_BYTES_, 0);
+  for (size_t i = 0, p = 0; i < DATA_BYTES_; i += Pieces_[p++])
+    threecrypt_xchacha20_xor(&ctx, output[1] + i, data + i, Pieces_[p], i);
+  SSC_assertMsg(!memcmp(output[0], output[1], DATA_BYTES_), "XChaCha20 disagrees with itself in pieces.\n");
+  threecrypt_xchacha20_xor(&ctx, output[1], output[1], DATA_BYTES_, 0);
+  SSC_assertMsg(!memcmp(output[1], data, DATA_BYTES_), "XChaCha20 does not invert itself.\n");
+}
+
+int
+main(void)
+{
+  uint8_t key [THREECRYPT_CHACHA20_KEY_BYTES];
+  uint8_t data [DATA_BYTES_];
+  uint64_t x = UINT64_C(0x9E3779B97F4A7C15);
+  for (size_t i = 0; i < sizeof(key); ++i)
+    key[i] = (uint8_t)((x = (x * UINT64_C(6364136223846793005)) + 1) >> 56);
+  for (size_t i = 0; i < sizeof(data); ++i)
+    data[i] = (uint8_t)((x = (x * UINT64_C(6364136223846793005)) + 1) >> 56);
+  poly1305_pieces_(key, data);
+  xchacha20_pieces_(key, data);
+  threecrypt_mb_skein512_mac(SSC_NULL, 0);
+  return 0;
+}
@@ -0,0 +1,134 @@
+#!/bin/sh
+# Round-trip and tamper tests for every 3crypt format.
+# Usage: RoundTrip.sh <3crypt> <format>...
+# Each format is encrypted and decrypted back, then decrypted again with one ciphertext byte flipped, which must fail.
+set -u
+THREECRYPT=$1
+shift
+case $THREECRYPT in
+  /*) ;;
+  *) THREECRYPT=$(pwd)/$THREECRYPT ;;
+esac
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+cd "$DIR" || exit 1
+
+FAILED=0
+fail_ () {
+  echo "FAIL: $*" >&2
+  FAILED=1
+}
+run_ () {
+  "$THREECRYPT" "$@" > /dev/null 2>&1
+}
+# Flip the lowest bit of the byte at offset $2 of the file $1.
+flip_ () {
+  b=$(od -An -tu1 -j "$2" -N1 "$1" | tr -d ' ')
+  printf "\\$(printf '%03o' $((b ^ 1)))" | dd of="$1" bs=1 seek="$2" conv=notrunc 2> /dev/null
+}
+size_ () {
+  wc -c < "$1" | tr -d ' '
+}
+# Decrypt the copy of $1 with the byte at offset $2 flipped; anything but a failure is an error.
+tamper_ () {
+  name=$1; offset=$2; shift 2
+  cp "$name" tampered
+  flip_ tampered "$offset"
+  rm -rf tampered.out
+  if run_ -d -i tampered -o tampered.out "$@"; then
+    fail_ "$name decrypted with byte $offset flipped"
+  fi
+  rm -rf tampered tampered.out
+}
+# Tamper with the byte at offset $2, near the start of the ciphertext, the middle and the last byte of $1.
+tamper_all_ () {
+  name=$1; start=$2; shift 2
+  end=$(($(size_ "$name") - 1))
+  for offset in $start $((end / 2)) $end; do
+    tamper_ "$name" "$offset" "$@"
+  done
+}
+
+printf 'correct horse battery staple' > passphrase
+printf 'wrong horse battery staple' > wrong
+PASSPHRASE="--passphrase-file passphrase"
+# The smallest key-derivation keeps the tests fast; its strength is not under test.
+MEMORY="--use-memory=1M"
+: > empty
+head -c 1000 /dev/urandom > small
+# Large enough to span several 1 MiB chunks and leaves, and not a multiple of any block size.
+head -c 3500001 /dev/urandom > large
+
+# Dragonfly_V1, Dragonfly_V2, XChaCha_V1, Sparse_V1 and Keyfile_V1 files of several sizes.
+single_ () {
+  method=$1
+  if [ $method = keyfile_v1 ]; then
+    KEY="-K keyfile"
+    KDF=
+  else
+    KEY=$PASSPHRASE
+    KDF=$MEMORY
+  fi
+  for input in empty small large; do
+    out=$method.$input.3c
+    run_ -e -i $input -o $out --method=$method $KEY $KDF || { fail_ "$method failed to encrypt $input"; continue; }
+    run_ -d -i $out -o $out.out $KEY || { fail_ "$method failed to decrypt $input"; continue; }
+    cmp -s $input $out.out || fail_ "$method changed $input"
+    tamper_all_ $out $(($(size_ $out) - $(size_ $input) - 1)) $KEY
+  done
+  if [ $method != keyfile_v1 ]; then
+    run_ -d -i $method.small.3c -o wrong.out --passphrase-file wrong && fail_ "$method decrypted with the wrong passphrase"
+  fi
+}
+
+# Segmented_V1: two appends decrypt to their concatenation.
+segmented_ () {
+  head -c 70000 /dev/urandom > more
+  cat small more > appended
+  run_ --append -i small -o segmented.3c $PASSPHRASE $MEMORY || fail_ "segmented_v1 failed to create"
+  run_ --append -i more -o segmented.3c $PASSPHRASE || fail_ "segmented_v1 failed to append"
+  run_ -d -i segmented.3c -o segmented.out $PASSPHRASE || fail_ "segmented_v1 failed to decrypt"
+  cmp -s appended segmented.out || fail_ "segmented_v1 changed its segments"
+  tamper_all_ segmented.3c $(($(size_ segmented.3c) - $(size_ appended) - 1)) $PASSPHRASE
+}
+
+# Chunked_V1: an update that changes one chunk decrypts, and views, to the new contents.
+chunked_ () {
+  cp large updated
+  head -c 5000 /dev/urandom | dd of=updated bs=1 seek=1500000 conv=notrunc 2> /dev/null
+  run_ --update -i large -o chunked.3c -K keyfile || fail_ "chunked_v1 failed to create"
+  run_ --update -i updated -o chunked.3c -K keyfile || fail_ "chunked_v1 failed to update"
+  run_ -d -i chunked.3c -o chunked.out -K keyfile || fail_ "chunked_v1 failed to decrypt"
+  cmp -s updated chunked.out || fail_ "chunked_v1 changed its contents"
+  run_ --view 1499000:8000 -i chunked.3c -o view.out -K keyfile || fail_ "chunked_v1 failed to view"
+  dd if=updated of=view.expected bs=1000 skip=1499 count=8 2> /dev/null
+  cmp -s view.expected view.out || fail_ "chunked_v1 view changed its contents"
+  tamper_all_ chunked.3c $(($(size_ chunked.3c) - $(size_ updated) - 1)) -K keyfile
+}
+
+# Archive_V1: every member is extracted intact, together or on its own.
+archive_ () {
+  mkdir -p tree/sub
+  cp small tree/small
+  cp large tree/sub/large
+  cp empty tree/empty
+  run_ --archive -i tree -o archive.3c $PASSPHRASE $MEMORY || fail_ "archive_v1 failed to pack"
+  run_ -d -i archive.3c -o unpacked $PASSPHRASE || fail_ "archive_v1 failed to unpack"
+  for member in small sub/large empty; do
+    cmp -s tree/$member unpacked/$member || fail_ "archive_v1 changed $member"
+  done
+  run_ --extract sub/large -i archive.3c -o extracted $PASSPHRASE || fail_ "archive_v1 failed to extract"
+  cmp -s large extracted || fail_ "archive_v1 extract changed sub/large"
+  tamper_all_ archive.3c $(($(size_ archive.3c) - $(size_ small) - $(size_ large) - 1)) $PASSPHRASE
+}
+
+for format in "$@"; do
+  case $format in
+    segmented_v1) segmented_ ;;
+    chunked_v1)   chunked_ ;;
+    archive_v1)   archive_ ;;
+    *)            single_ $format ;;
+  esac
+done
+
+exit $FAILED